@@ -76,6 +76,8 @@ typedef struct {
     char *extra_response_data;   /**< SRW extra XML response (output) */
     Z_OtherInformation *search_input; /**< extra search info request (input) */
     Odr_int present_number;    /**<  piggyback present number (>0) (input) */
+    int pending;               /**< 1=response deferred; backend calls
+                                  bend_complete_search later (output) */
 } bend_search_rr;
 
 /** \brief Information for present handler. Does not replace bend_fetch. */
@@ -113,6 +115,9 @@ typedef struct bend_fetch_rr {
     char *errstring;           /**< Additional info (output) */
     int surrogate_flag;        /**< 1=surrogate diagnostic(SD); 0=NSD (output)*/
     char *schema;              /**< string record schema (input/output) */
+    bend_association association; /**< GFS association / session (input) */
+    int pending;               /**< 1=response deferred; backend calls
+                                  bend_complete_fetch later (output) */
 } bend_fetch_rr;
 
 /** \brief Information for scan entry */
@@ -312,6 +317,13 @@ typedef struct bend_initrequest
 
     /** \brief whether named result sets are supported (0=disable, 1=enable) */
     int named_result_sets;
+
+    /** \brief maximum number of operations run at a time per association.
+        0 or 1 runs requests one after another. A higher value makes the
+        GFS run search, present and scan of a client that negotiated
+        concurrentOperations on worker threads, so the handlers must then
+        be thread safe for the same handle. */
+    int concurrent_operations;
 } bend_initrequest;
 
 /** \brief result for init handler (must be filled by handler) */
@@ -373,6 +385,24 @@ YAZ_EXPORT int check_ip_tcpd(void *cd, const char *addr, int len, int type);
 
 YAZ_EXPORT int bend_assoc_is_alive(bend_association assoc);
 
+/** \brief completes a search that the backend deferred
+    \param rr search request as passed to bend_search
+
+    A bend_search handler may set rr->pending to 1 and return before
+    the search is done. It keeps rr (and the association) and calls
+    this function, possibly from another thread, when the output members
+    of rr are set. The GFS then resumes processing of the request.
+*/
+YAZ_EXPORT void bend_complete_search(bend_search_rr *rr);
+
+/** \brief completes a record fetch that the backend deferred
+    \param rr fetch request as passed to bend_fetch
+
+    Like bend_complete_search, but for a bend_fetch handler that has
+    set rr->pending to 1.
+*/
+YAZ_EXPORT void bend_complete_fetch(bend_fetch_rr *rr);
+
 YAZ_END_CDECL
 
 #endif
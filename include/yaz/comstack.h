@@ -45,6 +45,12 @@ struct comstack;
 typedef struct comstack *COMSTACK;
 typedef COMSTACK (*CS_TYPE)(int s, int flags, int protocol, void *vp);
 
+/** \brief buffer element for cs_putv */
+typedef struct cs_iovec {
+    char *buf;
+    int len;
+} cs_iovec;
+
 struct comstack
 {
     CS_TYPE type;
@@ -88,9 +94,11 @@ struct comstack
     void *(*f_straddr)(COMSTACK handle, const char *str);
     int (*f_set_blocking)(COMSTACK handle, int blocking);
     void *user;       /* user defined data associated with COMSTACK */
+    int (*f_putv)(COMSTACK handle, const cs_iovec *iov, int iovcnt);
 };
 
 #define cs_put(handle, buf, size) ((*(handle)->f_put)(handle, buf, size))
+#define cs_putv(handle, iov, cnt) ((*(handle)->f_putv)(handle, iov, cnt))
 #define cs_get(handle, buf, size) ((*(handle)->f_get)(handle, buf, size))
 #define cs_more(handle) ((*(handle)->f_more)(handle))
 #define cs_connect(handle, address) ((*(handle)->f_connect)(handle, address))
@@ -134,6 +142,29 @@ YAZ_EXPORT int cs_set_ssl_ctx(COMSTACK cs, void *ctx);
 YAZ_EXPORT int cs_set_ssl_certificate_file(COMSTACK cs, const char *fname);
 YAZ_EXPORT int cs_get_peer_certificate_x509(COMSTACK cs, char **buf, int *len);
 YAZ_EXPORT void cs_set_max_recv_bytes(COMSTACK cs, int max_recv_bytes);
+
+/** \brief returns TLS session cache statistics for ssl client COMSTACKs
+    \param hits number of handshakes that resumed a cached session
+    \param misses number of full handshakes
+*/
+YAZ_EXPORT void cs_get_ssl_session_stats(int *hits, int *misses);
+
+/** \brief empties the TLS session cache and resets its statistics */
+YAZ_EXPORT void cs_clear_ssl_session_cache(void);
+
+/** \brief writes buffers one by one with cs_put
+    \param cs COMSTACK
+    \param iov buffers
+    \param iovcnt number of buffers
+    \param no index of current buffer; must be 0 initially
+    \retval 0 all written
+    \retval 1 incomplete; call again with same buffers (non-blocking mode)
+    \retval -1 error
+
+    This is a helper for COMSTACK types without vectored output.
+*/
+YAZ_EXPORT int cs_putv_loop(COMSTACK cs, const cs_iovec *iov, int iovcnt,
+                            int *no);
 YAZ_EXPORT int completeWAIS(const char *buf, int len);
 
 YAZ_EXPORT void cs_print_session_info(COMSTACK cs);
@@ -44,17 +44,18 @@ YAZ_EXPORT
 Z_Query *yaz_copy_Z_Query(Z_Query *q, ODR out);
 
 YAZ_EXPORT
-Z_RPNQuery *yaz_clone_z_RPNQuery(Z_RPNQuery *q, NMEM out);
+Z_RPNQuery *yaz_clone_z_RPNQuery(const Z_RPNQuery *p, NMEM nmem);
 
 YAZ_EXPORT
-Z_Query *yaz_clone_z_Query(Z_Query *q, NMEM out);
+Z_Query *yaz_clone_z_Query(const Z_Query *p, NMEM nmem);
 
 YAZ_EXPORT
-Z_NamePlusRecord *yaz_clone_z_NamePlusRecord(Z_NamePlusRecord *s, NMEM out);
+Z_NamePlusRecord *yaz_clone_z_NamePlusRecord(const Z_NamePlusRecord *p,
+                                             NMEM nmem);
 
 YAZ_EXPORT
-Z_RecordComposition *yaz_clone_z_RecordComposition(Z_RecordComposition *s,
-                                                   NMEM out);
+Z_RecordComposition *yaz_clone_z_RecordComposition(
+    const Z_RecordComposition *p, NMEM nmem);
 
 YAZ_END_CDECL
 
@@ -159,6 +159,29 @@ int atoi_n_check(const char *buf, int size, int *val);
 YAZ_EXPORT int yaz_marc_read_iso2709(yaz_marc_t mt,
                                      const char *buf, int bsize);
 
+/** \brief controls whether ISO2709 input is copied
+    \param mt handle
+    \param enable 1=refer to input buffer; 0=copy data (default)
+
+    When enabled, yaz_marc_read_iso2709 does not copy field data but
+    refers to the buffer given to it. The buffer must be kept unchanged
+    until the record has been written.
+*/
+YAZ_EXPORT void yaz_marc_reference_input(yaz_marc_t mt, int enable);
+
+/** \brief finds the end of first ISO2709 record in a buffer
+    \param buf buffer with one or more concatenated records
+    \param size number of bytes in buffer
+
+    The record length of the leader is used. If the byte before does
+    not hold a record separator, the record is assumed to continue
+    to the next record separator.
+    \retval -1 buffer does not start with a record length
+    \retval 0 record is incomplete: more bytes needed
+    \retval >0 length of record
+*/
+YAZ_EXPORT int yaz_marc_iso2709_split(const char *buf, size_t size);
+
 /** \brief read MARC lineformat from stream
     \param mt handle
     \param getbyte get one byte handler
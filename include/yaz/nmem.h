@@ -201,6 +201,64 @@ YAZ_EXPORT void nmem_destroy(NMEM n);
  */
 YAZ_EXPORT void *nmem_malloc(NMEM n, size_t size);
 
+/** \brief NMEM account handle (opaque)
+
+    An account sums the block memory of the NMEM handles that are
+    charged to it. It may be shared by handles used in different threads.
+ */
+typedef struct nmem_account *nmem_account_t;
+
+/** \brief creates memory account
+    \returns account handle with zero usage
+ */
+YAZ_EXPORT nmem_account_t nmem_account_create(void);
+
+/** \brief releases memory account
+    \param a account handle
+
+    The account lives on until NMEM handles charged to it are destroyed.
+ */
+YAZ_EXPORT void nmem_account_destroy(nmem_account_t a);
+
+/** \brief charges memory not allocated by NMEM to account
+    \param a account handle (NULL for no operation)
+    \param size number of bytes
+ */
+YAZ_EXPORT void nmem_account_add(nmem_account_t a, size_t size);
+
+/** \brief credits memory to account
+    \param a account handle (NULL for no operation)
+    \param size number of bytes; must not exceed what is charged
+ */
+YAZ_EXPORT void nmem_account_sub(nmem_account_t a, size_t size);
+
+/** \brief returns bytes currently charged to account
+    \param a account handle
+    \returns number of bytes
+ */
+YAZ_EXPORT size_t nmem_account_current(nmem_account_t a);
+
+/** \brief returns highest number of bytes charged to account
+    \param a account handle
+    \returns number of bytes
+ */
+YAZ_EXPORT size_t nmem_account_peak(nmem_account_t a);
+
+/** \brief charges NMEM handle to account
+    \param n NMEM handle
+    \param a account handle; NULL for no accounting
+
+    Blocks already in n are moved to the new account. Memory moved
+    with nmem_transfer is moved between accounts as well.
+ */
+YAZ_EXPORT void nmem_set_account(NMEM n, nmem_account_t a);
+
+/** \brief returns account of NMEM handle
+    \param n NMEM handle
+    \returns account handle or NULL if none
+ */
+YAZ_EXPORT nmem_account_t nmem_get_account(NMEM n);
+
 YAZ_END_CDECL
 
 #endif
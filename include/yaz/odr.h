@@ -344,6 +344,36 @@ YAZ_EXPORT Odr_int odr_atoi(const char *s);
 
 YAZ_EXPORT Odr_int odr_strtol(const char *nptr, char **endptr, int base);
 
+/** \brief deep copy function for an ASN.1 type */
+typedef void *(*Odr_clone_fun)(const void *p, NMEM nmem);
+
+/* deep copy of basic types into NMEM; used by yaz_clone_ functions
+   generated by yaz-asncomp. All return NULL for NULL input */
+YAZ_EXPORT Odr_int *odr_clone_integer(const Odr_int *p, NMEM nmem);
+YAZ_EXPORT Odr_int *odr_clone_enum(const Odr_int *p, NMEM nmem);
+YAZ_EXPORT Odr_bool *odr_clone_bool(const Odr_bool *p, NMEM nmem);
+YAZ_EXPORT Odr_null *odr_clone_null(const Odr_null *p, NMEM nmem);
+YAZ_EXPORT Odr_oct *odr_clone_octetstring(const Odr_oct *p, NMEM nmem);
+YAZ_EXPORT Odr_any *odr_clone_any(const Odr_any *p, NMEM nmem);
+YAZ_EXPORT Odr_bitmask *odr_clone_bitstring(const Odr_bitmask *p, NMEM nmem);
+YAZ_EXPORT Odr_oid *odr_clone_oid(const Odr_oid *p, NMEM nmem);
+YAZ_EXPORT char *odr_clone_generalstring(const char *p, NMEM nmem);
+YAZ_EXPORT char *odr_clone_visiblestring(const char *p, NMEM nmem);
+YAZ_EXPORT char *odr_clone_graphicstring(const char *p, NMEM nmem);
+YAZ_EXPORT char *odr_clone_generalizedtime(const char *p, NMEM nmem);
+YAZ_EXPORT Odr_external *odr_clone_external(const Odr_external *p,
+                                            NMEM nmem);
+
+/** \brief copies array of pointers with element copy function f */
+YAZ_EXPORT void **odr_clone_array(void * const *a, int num, Odr_clone_fun f,
+                                  NMEM nmem);
+
+/** \brief copies value by encoding and decoding it with codec fun
+
+    For types without structural copy function only.
+*/
+YAZ_EXPORT void *odr_clone_codec(Odr_fun fun, const void *p, NMEM nmem);
+
 YAZ_END_CDECL
 
 #include <yaz/xmalloc.h>
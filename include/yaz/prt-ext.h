@@ -150,6 +150,8 @@ struct Z_External
 
 /** \brief codec for BER EXTERNAL */
 YAZ_EXPORT int z_External(ODR o, Z_External **p, int opt, const char *name);
+/** \brief deep copy of EXTERNAL into NMEM */
+YAZ_EXPORT Z_External *yaz_clone_z_External(const Z_External *p, NMEM nmem);
 /** \brief returns type information for OID (NULL if not known) */
 YAZ_EXPORT Z_ext_typeent *z_ext_getentbyref(const Odr_oid *oid);
 /** \brief encodes EXTERNAL record based on OID (NULL if not known) */
@@ -37,6 +37,7 @@
 #include <yaz/yconfig.h>
 #include <yaz/z-core.h>
 #include <yaz/wrbuf.h>
+#include <yaz/marcdisp.h>
 
 YAZ_BEGIN_CDECL
 
@@ -58,6 +59,27 @@ const char *yaz_record_render(Z_NamePlusRecord *npr, const char *schema,
                               WRBUF wrbuf,
                               const char *type_spec, int *len);
 
+/** \brief render records and keep parsed MARC record
+    \param npr record structure to be rendered (Z39.50)
+    \param schema for record (if known)
+    \param wrbuf Working WRBUF
+    \param type_spec format spec
+    \param len length of returned buffer
+    \param mt_p parsed ISO2709 record of npr (in/out); NULL for none
+    \retval !=0 buffer
+    \retval =0 record could not be rendered
+
+    Like yaz_record_render, but an ISO2709 record is parsed only once
+    for all types and charsets: *mt_p must be NULL initially and is set
+    to the parsed record, which refers to the buffer in npr. The caller
+    destroys *mt_p with yaz_marc_destroy and must do so if npr changes.
+*/
+YAZ_EXPORT
+const char *yaz_record_render2(Z_NamePlusRecord *npr, const char *schema,
+                               WRBUF wrbuf,
+                               const char *type_spec, int *len,
+                               yaz_marc_t *mt_p);
+
 YAZ_END_CDECL
 
 #endif
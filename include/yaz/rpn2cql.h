@@ -75,6 +75,21 @@ const char *cql_lookup_reverse(cql_transform_t ct,
                                const char *category,
                                Z_AttributeList *attributes);
 
+/** \brief transforms CQL tree to RPN query
+    \param ct CQL transform handle
+    \param cn CQL tree
+    \param o ODR for the result
+    \param rpn RPN query (result); NULL on failure
+    \retval 0 success
+    \retval !=0 failure (error code)
+
+    Builds the same query as parsing the PQF produced by cql_transform,
+    but without formatting and parsing PQF.
+ */
+YAZ_EXPORT
+int cql_transform_rpn(cql_transform_t ct, struct cql_node *cn, ODR o,
+                      Z_RPNQuery **rpn);
+
 YAZ_END_CDECL
 
 #endif
@@ -38,6 +38,19 @@
 
 YAZ_BEGIN_CDECL
 
+/* YAZ_SHPTR_ATOMIC: reference count maintained with atomic builtins
+   (GCC 4.7 or later, clang). Otherwise a mutex per shared pointer. */
+#ifndef YAZ_SHPTR_ATOMIC
+#if defined(__ATOMIC_ACQ_REL)
+#define YAZ_SHPTR_ATOMIC 1
+#else
+#define YAZ_SHPTR_ATOMIC 0
+#endif
+#endif
+
+/* the layout is the same in both modes, so that code built with and
+   without YAZ_SHPTR_ATOMIC may share pointers. mutex is unused (0) when
+   the count is atomic */
 #define YAZ_SHPTR_TYPE(type) \
     struct type##_shptr \
     {                          \
@@ -47,6 +60,26 @@ YAZ_BEGIN_CDECL
     };  \
     typedef struct type##_shptr *type##_shptr_t;
 
+#if YAZ_SHPTR_ATOMIC
+#define YAZ_SHPTR_INIT(p,n) {                   \
+        p = xmalloc(sizeof(*p));                \
+        p->ptr = n;                             \
+        p->ref = 1;                             \
+        p->mutex = 0;                           \
+    }
+
+#define YAZ_SHPTR_INC(p) {                      \
+        __atomic_add_fetch(&p->ref, 1, __ATOMIC_RELAXED); \
+    }
+
+#define YAZ_SHPTR_DEC(p, destroy)  {             \
+    if (__atomic_sub_fetch(&p->ref, 1, __ATOMIC_ACQ_REL) == 0) { \
+        destroy(p->ptr);                         \
+        xfree(p);                                \
+        p = 0;                                   \
+    } \
+    }
+#else
 #define YAZ_SHPTR_INIT(p,n) {                   \
         p = xmalloc(sizeof(*p));                \
         p->ptr = n;                             \
@@ -73,6 +106,7 @@ YAZ_BEGIN_CDECL
     yaz_mutex_leave(p->mutex); \
     } \
     }
+#endif
 
 YAZ_END_CDECL
 
@@ -42,6 +42,16 @@ YAZ_EXPORT COMSTACK ssl_type(int s, int flags, int protocol, void *vp);
 YAZ_EXPORT COMSTACK yaz_tcpip_create(int s, int flags, int protocol,
                                      const char *connect_host);
 
+/** \brief sets host that TLS sessions are cached for
+    \param h COMSTACK (no effect unless SSL)
+    \param host target host[:port]
+
+    By default sessions are cached for the address given to cs_straddr.
+    When connecting through a proxy that is the proxy, so the target
+    must be given to keep sessions of different targets apart.
+*/
+YAZ_EXPORT void yaz_tcpip_set_session_host(COMSTACK h, const char *host);
+
 YAZ_END_CDECL
 
 #endif
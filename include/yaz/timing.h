@@ -35,6 +35,7 @@
 #define YAZ_TIMING_H
 
 #include <yaz/yconfig.h>
+#include <yaz/wrbuf.h>
 
 YAZ_BEGIN_CDECL
 
@@ -104,6 +105,88 @@ double yaz_timing_get_sys(yaz_timing_t t);
 YAZ_EXPORT
 void yaz_timing_destroy(yaz_timing_t *tp);
 
+/** \brief YAZ spans handle (opaque type)
+
+    Sums the real time spent in phases of operations, such as the
+    decoding, backend and encoding phases of a search. Time is kept
+    for each distinct operation and phase. A handle may be used by
+    several threads.
+
+   \verbatim
+    yaz_spans_t s = yaz_spans_create("server");
+    double t = yaz_spans_start(s);
+    do_fetch();
+    yaz_spans_stop(s, "present", "fetch", t);
+    yaz_spans_log(s, YLOG_LOG);
+    yaz_spans_destroy(&s);
+   \endverbatim
+ */
+typedef struct yaz_spans *yaz_spans_t;
+
+/** \brief create spans handle
+    \param name name of the handle (first component of stack)
+    \returns spans handle
+ */
+YAZ_EXPORT
+yaz_spans_t yaz_spans_create(const char *name);
+
+/** \brief destroys spans handle
+    \param sp pointer to spans handle (set to NULL)
+ */
+YAZ_EXPORT
+void yaz_spans_destroy(yaz_spans_t *sp);
+
+/** \brief returns start time of a span
+    \param s spans handle
+    \returns start time; 0.0 if s is NULL (clock is not read)
+ */
+YAZ_EXPORT
+double yaz_spans_start(yaz_spans_t s);
+
+/** \brief ends span started with yaz_spans_start and adds its time
+    \param s spans handle (NULL for no operation)
+    \param op operation
+    \param phase phase of operation
+    \param start time returned by yaz_spans_start
+
+    The op and phase strings are not copied. They must exist as long
+    as the handle.
+ */
+YAZ_EXPORT
+void yaz_spans_stop(yaz_spans_t s, const char *op, const char *phase,
+                    double start);
+
+/** \brief adds time to phase of operation
+    \param s spans handle (NULL for no operation)
+    \param op operation (not copied)
+    \param phase phase of operation (not copied)
+    \param real_sec time in seconds
+ */
+YAZ_EXPORT
+void yaz_spans_add(yaz_spans_t s, const char *op, const char *phase,
+                   double real_sec);
+
+/** \brief writes time of all phases in folded stack format
+    \param s spans handle
+    \param w result buffer
+
+    Each phase is written as a line "name;op;phase usec" where usec
+    is the total time in microseconds. Flame graph tools read this
+    format.
+ */
+YAZ_EXPORT
+void yaz_spans_write(yaz_spans_t s, WRBUF w);
+
+/** \brief logs time of all phases in folded stack format
+    \param s spans handle
+    \param level log level
+
+    Like yaz_spans_write, but one log line per phase with the number
+    of spans added as "count=n".
+ */
+YAZ_EXPORT
+void yaz_spans_log(yaz_spans_t s, int level);
+
 YAZ_END_CDECL
 
 #endif
@@ -65,6 +65,29 @@ YAZ_EXPORT int yaz_iconv_close (yaz_iconv_t cd);
 /** \brief tests whether conversion is handled by YAZ' iconv or system iconv */
 YAZ_EXPORT int yaz_iconv_isbuiltin(yaz_iconv_t cd);
 
+/** \brief gets converter from process-wide pool
+    \param tocode destination encoding
+    \param fromcode source encoding
+    \returns converter; NULL if conversion is unsupported
+
+    Like yaz_iconv_open, but returns an idle converter for the same
+    encodings if one was given back with yaz_iconv_pool_put.
+    Thread safe.
+*/
+YAZ_EXPORT yaz_iconv_t yaz_iconv_pool_get(const char *tocode,
+                                          const char *fromcode);
+
+/** \brief gives converter back to pool
+    \param cd converter from yaz_iconv_pool_get (NULL ignored)
+
+    The conversion state is reset. A converter from yaz_iconv_open
+    is closed.
+*/
+YAZ_EXPORT void yaz_iconv_pool_put(yaz_iconv_t cd);
+
+/** \brief closes idle converters in pool */
+YAZ_EXPORT void yaz_iconv_pool_cleanup(void);
+
 YAZ_EXPORT unsigned long yaz_read_UTF8_char(unsigned char *inp,
                                             size_t inbytesleft,
                                             size_t *no_read,
@@ -82,7 +82,48 @@ YAZ_EXPORT void z_HTTP_header_add_content_type(ODR o, Z_HTTP_Header **hp,
 YAZ_EXPORT void z_HTTP_header_add_basic_auth(ODR o, Z_HTTP_Header **hp,
                                              const char *username,
                                              const char *password);
+/** \brief adds Accept-Encoding for the codings the HTTP decoder handles
+    \param o ODR for memory
+    \param hp header list
 
+    Nothing is added if YAZ is built without zlib.
+*/
+YAZ_EXPORT void z_HTTP_header_add_accept_encoding(ODR o, Z_HTTP_Header **hp);
+
+/** \brief sets maximum size of gzip or deflate coded HTTP body
+    \param o decoding stream
+    \param max maximum size in bytes once inflated; 0 for default (128 MB)
+
+    Decoding of a message fails (OHTTP) if its body inflates to more
+    than max bytes.
+*/
+YAZ_EXPORT void z_HTTP_set_max_content(ODR o, int max);
+
+/** \brief compresses HTTP response body with gzip or deflate
+    \param o ODR for memory
+    \param hr HTTP response
+    \param accept_encoding Accept-Encoding value of request (may be NULL)
+    \param level zlib compression level (-1 for default, 1-9)
+    \retval 1 body compressed and Content-Encoding added
+    \retval 0 body unmodified
+
+    The body is left unmodified if the client accepts neither coding,
+    if compression does not make it smaller or if YAZ is built without
+    zlib. yaz_decode_http_response and yaz_decode_http_request undo
+    gzip and deflate codings transparently.
+*/
+YAZ_EXPORT int yaz_http_response_compress(ODR o, Z_HTTP_Response *hr,
+                                          const char *accept_encoding,
+                                          int level);
+
+/** \brief returns value of HTTP header (case insensitive name)
+    \param hp headers
+    \param n header name
+    \returns value or NULL if not found
+
+    Well-known names (such as Content-Type) are found only in headers
+    decoded by YAZ or added with z_HTTP_header_add and friends.
+*/
 YAZ_EXPORT const char *z_HTTP_header_lookup(const Z_HTTP_Header *hp, const char *n);
 
 YAZ_EXPORT const char *z_HTTP_errmsg(int code);
@@ -207,6 +207,8 @@ COMSTACK cs_create_host_proxy(const char *vhost, int blocking, void **vp,
     }
     if (cs)
     {
+        const char *target = host;
+
         if (proxy_host)
             host = proxy_host;
         if (!(*vp = cs_straddr(cs, connect_host ? connect_host : host)))
@@ -214,6 +216,8 @@ COMSTACK cs_create_host_proxy(const char *vhost, int blocking, void **vp,
             cs_close (cs);
             cs = 0;
         }
+        else if (t == ssl_type && (proxy_host || connect_host))
+            yaz_tcpip_set_session_host(cs, target);
     }
     xfree(connect_host);
     return cs;
@@ -421,6 +425,25 @@ void cs_set_max_recv_bytes(COMSTACK cs, int max_recv_bytes)
     cs->max_recv_bytes = max_recv_bytes;
 }
 
+int cs_putv_loop(COMSTACK cs, const cs_iovec *iov, int iovcnt, int *no)
+{
+    for (; *no < iovcnt; (*no)++)
+    {
+        int r;
+        if (iov[*no].len == 0)
+            continue;
+        r = cs_put(cs, iov[*no].buf, iov[*no].len);
+        if (r)
+        {
+            if (r == -1)
+                *no = 0;
+            return r;
+        }
+    }
+    *no = 0;
+    return 0;
+}
+
 /*
  * Local variables:
  * c-basic-offset: 4
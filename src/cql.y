@@ -40,6 +40,8 @@
         int (*getbyte)(void *client_data);
         void (*ungetbyte)(int b, void *client_data);
         void *client_data;
+        /** position in query when parsing a string; 0 for stream */
+        const char *str;
         int last_error;
         int last_pos;
         struct cql_node *top;
@@ -254,6 +256,116 @@ static void putb(YYSTYPE *lval, CQL_parser cp, int c)
 }
 
 
+/**
+ * keyword returns the terminal for a word token: boolean and sortby
+ * keywords, PREFIX_NAME for relation like words or SIMPLE_STRING.
+ */
+static int keyword(YYSTYPE *lval, int relation_like)
+{
+    if (!cql_strcmp(lval->buf, "and"))
+    {
+        lval->buf = "and";
+        return AND;
+    }
+    if (!cql_strcmp(lval->buf, "or"))
+    {
+        lval->buf = "or";
+        return OR;
+    }
+    if (!cql_strcmp(lval->buf, "not"))
+    {
+        lval->buf = "not";
+        return NOT;
+    }
+    if (!cql_strcmp(lval->buf, "prox"))
+    {
+        lval->buf = "prox";
+        return PROX;
+    }
+    if (!cql_strcmp(lval->buf, "sortby"))
+    {
+        lval->buf = "sortby";
+        return SORTBY;
+    }
+    if (!cql_strcmp(lval->buf, "all"))
+        relation_like = 1;
+    if (!cql_strcmp(lval->buf, "any"))
+        relation_like = 1;
+    if (!cql_strcmp(lval->buf, "adj"))
+        relation_like = 1;
+    if (relation_like)
+        return PREFIX_NAME;
+    return SIMPLE_STRING;
+}
+
+/**
+ * lex_str is yylex for a query held in memory. A token is scanned
+ * in place and copied to NMEM once when its end is known.
+ */
+static int lex_str(YYSTYPE *lval, CQL_parser cp)
+{
+    const char *s = cp->str;
+    const char *start, *end;
+    int tok = SIMPLE_STRING;
+    int word = 0, relation_like = 0;
+
+    while (*s && *s != '\n' && yaz_isspace(*s))
+        s++;
+    if (*s == '\0' || *s == '\n')
+    {
+        lval->buf = "";
+        cp->str = s;
+        return 0;
+    }
+    start = s;
+    if (strchr("()=></", *s))
+    {
+        tok = *s++;
+        if (*s == '=' && tok == '=')
+            tok = EXACT;
+        else if (*s == '=' && tok == '>')
+            tok = GE;
+        else if (*s == '=' && tok == '<')
+            tok = LE;
+        else if (*s == '>' && tok == '<')
+            tok = NE;
+        if (tok == EXACT || tok == GE || tok == LE || tok == NE)
+            s++;
+        end = s;
+    }
+    else if (*s == '"')
+    {
+        start = ++s;
+        while (*s && *s != '"')
+            if (*s++ == '\\' && *s)
+                s++;
+        end = s;
+        if (*s)
+            s++; /* end quote */
+    }
+    else
+    {
+        word = 1;
+        while (*s && !strchr(" \n()=<>/", *s))
+        {
+            if (*s == '.')
+                relation_like = 1;
+            if (*s++ == '\\' && *s)
+                s++;
+        }
+        end = s;
+    }
+    lval->len = end - start;
+    lval->size = lval->len + 1;
+    lval->buf = (char *) nmem_malloc(cp->nmem, lval->size);
+    memcpy(lval->buf, start, lval->len);
+    lval->buf[lval->len] = '\0';
+    cp->str = s;
+    if (word)
+        return keyword(lval, relation_like);
+    return tok;
+}
+
 /**
  * yylex returns next token for Bison to be read. In this
  * case one of the CQL terminals are returned.
@@ -264,6 +376,8 @@ int yylex(YYSTYPE *lval, void *vp)
     int c;
     lval->cql = 0;
     lval->rel = 0;
+    if (cp->str)
+        return lex_str(lval, cp);
     lval->len = 0;
     lval->size = 10;
     lval->buf = (char *) nmem_malloc(cp->nmem, lval->size);
@@ -359,58 +473,38 @@ int yylex(YYSTYPE *lval, void *vp)
 #endif
 	if (c != 0)
 	    cp->ungetbyte(c, cp->client_data);
-	if (!cql_strcmp(lval->buf, "and"))
-	{
-	    lval->buf = "and";
-	    return AND;
-	}
-	if (!cql_strcmp(lval->buf, "or"))
-	{
-	    lval->buf = "or";
-	    return OR;
-	}
-	if (!cql_strcmp(lval->buf, "not"))
-	{
-	    lval->buf = "not";
-	    return NOT;
-	}
-	if (!cql_strcmp(lval->buf, "prox"))
-	{
-	    lval->buf = "prox";
-	    return PROX;
-	}
-	if (!cql_strcmp(lval->buf, "sortby"))
-	{
-	    lval->buf = "sortby";
-	    return SORTBY;
-	}
-	if (!cql_strcmp(lval->buf, "all"))
-	    relation_like = 1;
-	if (!cql_strcmp(lval->buf, "any"))
-	    relation_like = 1;
-	if (!cql_strcmp(lval->buf, "adj"))
-	    relation_like = 1;
-	if (relation_like)
-	    return PREFIX_NAME;
+	return keyword(lval, relation_like);
     }
     return SIMPLE_STRING;
 }
 
+static int parse(CQL_parser cp)
+{
+    nmem_reset(cp->nmem);
+    cql_node_destroy(cp->top);
+    cql_parse(cp);
+    cp->str = 0;
+    if (cp->top)
+        return 0;
+    return -1;
+}
 
 int cql_parser_stream(CQL_parser cp,
                       int (*getbyte)(void *client_data),
                       void (*ungetbyte)(int b, void *client_data),
                       void *client_data)
 {
-    nmem_reset(cp->nmem);
     cp->getbyte = getbyte;
     cp->ungetbyte = ungetbyte;
     cp->client_data = client_data;
-    cql_node_destroy(cp->top);
-    cql_parse(cp);
-    if (cp->top)
-        return 0;
-    return -1;
+    cp->str = 0;
+    return parse(cp);
+}
+
+int cql_parser_string(CQL_parser cp, const char *str)
+{
+    cp->str = str;
+    return parse(cp);
 }
 
 CQL_parser cql_parser_create(void)
@@ -421,6 +515,7 @@ CQL_parser cql_parser_create(void)
     cp->getbyte = 0;
     cp->ungetbyte = 0;
     cp->client_data = 0;
+    cp->str = 0;
     cp->last_error = 0;
     cp->last_pos = 0;
     cp->nmem = nmem_create();
@@ -31,6 +31,7 @@
 #include <yaz/z-core.h>
 #include <yaz/matchstr.h>
 #include <yaz/oid_db.h>
+#include <yaz/pquery.h>
 #include <yaz/log.h>
 
 struct cql_prop_entry {
@@ -206,6 +207,7 @@ int cql_transform_define_pattern(cql_transform_t ct, const char *pattern,
     int r;
     yaz_tok_parse_t tp = yaz_tok_parse_buf(ct->tok_cfg, value);
     yaz_tok_cfg_single_tokens(ct->tok_cfg, "=");
+    wrbuf_rewind(ct->w);
     r = cql_transform_parse_tok_line(ct, pattern, tp);
     yaz_tok_parse_destroy(tp);
     return r;
@@ -383,11 +385,261 @@ static const char *cql_lookup_property(cql_transform_t ct,
     return 0;
 }
 
-int cql_pr_attr_uri(cql_transform_t ct, const char *category,
-                   const char *uri, const char *val, const char *default_val,
-                   void (*pr)(const char *buf, void *client_data),
-                   void *client_data,
-                   int errcode)
+/** \brief attribute pushed while building RPN: same as one PQF @attr */
+struct cql_rpn_attr {
+    Odr_oid *set;
+    Odr_int type;
+    Odr_int numeric;
+    char *value;       /* string value; 0 for numeric value */
+};
+
+/* as many attributes as the PQF parser accepts */
+#define CQL_RPN_MAX_ATTR 512
+
+/** \brief transform output: PQF through pr or RPN structure when o != 0
+
+    Attributes pushed in RPN mode apply to all operands below the point
+    where they are pushed. This is the scoping that the PQF parser gives
+    to the PQF produced in text mode, so both modes yield the same query.
+*/
+struct cql_emit {
+    void (*pr)(const char *buf, void *client_data);
+    void *client_data;
+    ODR o;
+    int num_attr;
+    struct cql_rpn_attr *attr;
+    WRBUF term;
+};
+
+static void emit_pqf(struct cql_emit *e, const char *buf)
+{
+    if (!e->o)
+        (*e->pr)(buf, e->client_data);
+}
+
+static void emit_term_char(struct cql_emit *e, char ch)
+{
+    if (e->o)
+        wrbuf_putc(e->term, ch);
+    else
+    {
+        char x[2]; /* temp buffer */
+        x[0] = ch;
+        x[1] = '\0';
+        (*e->pr)(x, e->client_data);
+    }
+}
+
+/* backslash that is part of the term (Z39.58 escaped masking char) */
+static void emit_term_escape(struct cql_emit *e)
+{
+    if (e->o)
+        wrbuf_putc(e->term, '\\');
+    else
+        (*e->pr)("\\\\", e->client_data); /* double \\ to survive PQF parse */
+}
+
+static void cql_set_error(cql_transform_t ct, int errcode, const char *addinfo)
+{
+    if (!ct->error)
+    {
+        ct->error = errcode;
+        ct->addinfo = addinfo ? xstrdup(addinfo) : 0;
+    }
+}
+
+/* parses "[attset] type=value" the way the PQF parser reads @attr */
+static int rpn_push_attr(cql_transform_t ct, struct cql_emit *e,
+                         const char *spec, size_t len, const char *eval)
+{
+    struct cql_rpn_attr *a = e->attr + e->num_attr;
+    size_t i, no_star = 0, eval_len = eval ? strlen(eval) : 0;
+    char *buf, *cp, *eq;
+
+    for (i = 0; i < len; i++)
+        if (spec[i] == '*')
+            no_star++;
+    buf = (char *) odr_malloc(e->o, len + no_star * eval_len + 1);
+    for (cp = buf, i = 0; i < len; i++)
+        if (spec[i] == '*')
+        {
+            memcpy(cp, eval, eval_len);
+            cp += eval_len;
+        }
+        else
+            *cp++ = spec[i];
+    *cp = '\0';
+
+    if (e->num_attr >= CQL_RPN_MAX_ATTR)
+    {
+        cql_set_error(ct, YAZ_SRW_QUERY_SYNTAX_ERROR, buf);
+        return 0;
+    }
+    eq = strchr(buf, '=');
+    cp = strchr(buf, ' ');
+    if (!eq || (cp && cp < eq))
+    {
+        if (!cp)
+        {
+            cql_set_error(ct, YAZ_SRW_QUERY_SYNTAX_ERROR, buf);
+            return 0;
+        }
+        *cp = '\0';
+        a->set = yaz_string_to_oid_odr(yaz_oid_std(), CLASS_ATTSET, buf,
+                                       e->o);
+        if (!a->set)
+        {
+            cql_set_error(ct, YAZ_SRW_QUERY_SYNTAX_ERROR, buf);
+            return 0;
+        }
+        for (buf = cp + 1; *buf == ' '; buf++)
+            ;
+        eq = strchr(buf, '=');
+        if (!eq)
+        {
+            cql_set_error(ct, YAZ_SRW_QUERY_SYNTAX_ERROR, buf);
+            return 0;
+        }
+    }
+    else
+        a->set = e->num_attr > 0 ? a[-1].set : 0;
+    if (!yaz_isdigit(*buf))
+    {
+        cql_set_error(ct, YAZ_SRW_QUERY_SYNTAX_ERROR, buf);
+        return 0;
+    }
+    a->type = odr_atoi(buf);
+    for (cp = eq + 1; yaz_isdigit(*cp); cp++)
+        ;
+    if (*cp)
+        a->value = eq + 1;
+    else
+    {
+        a->value = 0;
+        a->numeric = odr_atoi(eq + 1);
+    }
+    e->num_attr++;
+    return 1;
+}
+
+/* attribute list for an operand; the last attribute of a type wins */
+static Z_AttributeList *rpn_attributes(struct cql_emit *e)
+{
+    Z_AttributeList *attributes = (Z_AttributeList *)
+        odr_malloc(e->o, sizeof(*attributes));
+    int i, j, k = 0;
+
+    if (!e->num_attr)
+    {
+        attributes->num_attributes = 0;
+        attributes->attributes = (Z_AttributeElement **) odr_nullval();
+        return attributes;
+    }
+    attributes->attributes = (Z_AttributeElement **)
+        odr_malloc(e->o, e->num_attr * sizeof(*attributes->attributes));
+    /* same order as produced by the PQF parser */
+    for (i = e->num_attr; --i >= 0; )
+    {
+        struct cql_rpn_attr *a = e->attr + i;
+        Z_AttributeElement *elem;
+
+        for (j = i + 1; j < e->num_attr; j++)
+            if (e->attr[j].type == a->type)
+                break;
+        if (j < e->num_attr)
+            continue;
+        elem = (Z_AttributeElement *) odr_malloc(e->o, sizeof(*elem));
+        elem->attributeSet = a->set;
+        elem->attributeType = odr_intdup(e->o, a->type);
+        if (a->value)
+        {
+            Z_ComplexAttribute *ca = (Z_ComplexAttribute *)
+                odr_malloc(e->o, sizeof(*ca));
+            elem->which = Z_AttributeValue_complex;
+            elem->value.complex = ca;
+            ca->num_list = 1;
+            ca->list = (Z_StringOrNumeric **)
+                odr_malloc(e->o, sizeof(Z_StringOrNumeric *));
+            ca->list[0] = (Z_StringOrNumeric *)
+                odr_malloc(e->o, sizeof(Z_StringOrNumeric));
+            ca->list[0]->which = Z_StringOrNumeric_string;
+            ca->list[0]->u.string = a->value;
+            ca->num_semanticAction = 0;
+            ca->semanticAction = 0;
+        }
+        else
+        {
+            elem->which = Z_AttributeValue_numeric;
+            elem->value.numeric = odr_intdup(e->o, a->numeric);
+        }
+        attributes->attributes[k++] = elem;
+    }
+    attributes->num_attributes = k;
+    return attributes;
+}
+
+static Z_RPNStructure *rpn_operand(struct cql_emit *e, Z_Operand *zo)
+{
+    Z_RPNStructure *s = (Z_RPNStructure *) odr_malloc(e->o, sizeof(*s));
+
+    s->which = Z_RPNStructure_simple;
+    s->u.simple = zo;
+    return s;
+}
+
+/** \brief emits boolean operator
+    \param e output
+    \param op CQL boolean (and, or, not, prox)
+    \param s RPN structure for operator (result); 0 in PQF mode
+    \returns complex of s (operands to be filled in); 0 in PQF mode
+*/
+static Z_Complex *emit_complex(struct cql_emit *e, const char *op,
+                               Z_RPNStructure **s)
+{
+    Z_Complex *zc;
+    Z_Operator *zo;
+
+    *s = 0;
+    if (!e->o)
+    {
+        (*e->pr)("@", e->client_data);
+        (*e->pr)(op, e->client_data);
+        (*e->pr)(" ", e->client_data);
+        return 0;
+    }
+    zc = (Z_Complex *) odr_malloc(e->o, sizeof(*zc));
+    zo = (Z_Operator *) odr_malloc(e->o, sizeof(*zo));
+    zc->roperator = zo;
+    zc->s1 = zc->s2 = 0;
+    if (!strcmp(op, "or"))
+    {
+        zo->which = Z_Operator_or;
+        zo->u.op_or = odr_nullval();
+    }
+    else if (!strcmp(op, "not"))
+    {
+        zo->which = Z_Operator_and_not;
+        zo->u.and_not = odr_nullval();
+    }
+    else if (!strcmp(op, "prox"))
+    {
+        zo->which = Z_Operator_prox;
+        zo->u.prox = 0;
+    }
+    else
+    {
+        zo->which = Z_Operator_and;
+        zo->u.op_and = odr_nullval();
+    }
+    *s = (Z_RPNStructure *) odr_malloc(e->o, sizeof(**s));
+    (*s)->which = Z_RPNStructure_complex;
+    (*s)->u.complex = zc;
+    return zc;
+}
+
+static const char *cql_lookup_attr(cql_transform_t ct, const char *category,
+                                   const char *uri, const char *val,
+                                   const char *default_val, int errcode)
 {
     const char *res = 0;
     const char *eval = val ? val : default_val;
@@ -426,6 +678,19 @@ int cql_pr_attr_uri(cql_transform_t ct, const char *category,
         if (!res)
             res = cql_lookup_property(ct, category, prefix, "*");
     }
+    if (!res && errcode)
+        cql_set_error(ct, errcode, val);
+    return res;
+}
+
+static int cql_pr_attr_uri(cql_transform_t ct, struct cql_emit *e,
+                           const char *category,
+                           const char *uri, const char *val,
+                           const char *default_val, int errcode)
+{
+    const char *eval = val ? val : default_val;
+    const char *res = cql_lookup_attr(ct, category, uri, val, default_val,
+                                      errcode);
     if (res)
     {
         char buf[64];
@@ -436,51 +701,49 @@ int cql_pr_attr_uri(cql_transform_t ct, const char *category,
             int i;
             while (*cp1 && *cp1 != ' ')
                 cp1++;
-            if (cp1 - cp0 >= (ptrdiff_t) sizeof(buf))
-                break;
-            memcpy(buf, cp0, cp1 - cp0);
-            buf[cp1-cp0] = 0;
-            (*pr)("@attr ", client_data);
-
-            for (i = 0; buf[i]; i++)
+            if (e->o)
             {
-                if (buf[i] == '*')
-                    (*pr)(eval, client_data);
-                else
+                if (!rpn_push_attr(ct, e, cp0, cp1 - cp0, eval))
+                    break;
+            }
+            else
+            {
+                if (cp1 - cp0 >= (ptrdiff_t) sizeof(buf))
+                    break;
+                memcpy(buf, cp0, cp1 - cp0);
+                buf[cp1-cp0] = 0;
+                (*e->pr)("@attr ", e->client_data);
+
+                for (i = 0; buf[i]; i++)
                 {
-                    char tmp[2];
-                    tmp[0] = buf[i];
-                    tmp[1] = '\0';
-                    (*pr)(tmp, client_data);
+                    if (buf[i] == '*')
+                        (*e->pr)(eval, e->client_data);
+                    else
+                    {
+                        char tmp[2];
+                        tmp[0] = buf[i];
+                        tmp[1] = '\0';
+                        (*e->pr)(tmp, e->client_data);
+                    }
                 }
+                (*e->pr)(" ", e->client_data);
             }
-            (*pr)(" ", client_data);
             cp0 = cp1;
             while (*cp0 == ' ')
                 cp0++;
         }
         return 1;
     }
-    /* error ... */
-    if (errcode && !ct->error)
-    {
-        ct->error = errcode;
-        if (val)
-            ct->addinfo = xstrdup(val);
-        else
-            ct->addinfo = 0;
-    }
     return 0;
 }
 
-int cql_pr_attr(cql_transform_t ct, const char *category,
-                const char *val, const char *default_val,
-                void (*pr)(const char *buf, void *client_data),
-                void *client_data,
-                int errcode)
+static int cql_pr_attr(cql_transform_t ct, struct cql_emit *e,
+                       const char *category,
+                       const char *val, const char *default_val,
+                       int errcode)
 {
-    return cql_pr_attr_uri(ct, category, 0 /* uri */,
-                           val, default_val, pr, client_data, errcode);
+    return cql_pr_attr_uri(ct, e, category, 0 /* uri */,
+                           val, default_val, errcode);
 }
 
 
@@ -496,8 +759,7 @@ static void cql_pr_int(int val,
 
 
 static int cql_pr_prox(cql_transform_t ct, struct cql_node *mods,
-                       void (*pr)(const char *buf, void *client_data),
-                       void *client_data)
+                       struct cql_emit *e, Z_Operator *zo)
 {
     int exclusion = 0;
     int distance = -1;
@@ -565,13 +827,27 @@ static int cql_pr_prox(cql_transform_t ct, struct cql_node *mods,
     if (distance == -1)
         distance = (unit == 2) ? 1 : 0;
 
-    cql_pr_int(exclusion, pr, client_data);
-    cql_pr_int(distance, pr, client_data);
-    cql_pr_int(ordered, pr, client_data);
-    cql_pr_int(proxrel, pr, client_data);
-    (*pr)("k ", client_data);
-    cql_pr_int(unit, pr, client_data);
-
+    if (e->o)
+    {
+        Z_ProximityOperator *p = (Z_ProximityOperator *)
+            odr_malloc(e->o, sizeof(*p));
+        p->exclusion = odr_booldup(e->o, exclusion);
+        p->distance = odr_intdup(e->o, distance);
+        p->ordered = odr_booldup(e->o, ordered);
+        p->relationType = odr_intdup(e->o, proxrel);
+        p->which = Z_ProximityOperator_known;
+        p->u.known = odr_intdup(e->o, unit);
+        zo->u.prox = p;
+    }
+    else
+    {
+        cql_pr_int(exclusion, e->pr, e->client_data);
+        cql_pr_int(distance, e->pr, e->client_data);
+        cql_pr_int(ordered, e->pr, e->client_data);
+        cql_pr_int(proxrel, e->pr, e->client_data);
+        (*e->pr)("k ", e->client_data);
+        cql_pr_int(unit, e->pr, e->client_data);
+    }
     return 1;
 }
 
@@ -587,11 +863,10 @@ static int has_modifier(struct cql_node *cn, const char *name) {
 }
 
 
-static void emit_term(cql_transform_t ct,
-                      struct cql_node *cn,
-                      const char *term, int length,
-                      void (*pr)(const char *buf, void *client_data),
-                      void *client_data)
+static Z_RPNStructure *emit_term(cql_transform_t ct,
+                                 struct cql_node *cn,
+                                 const char *term, int length,
+                                 struct cql_emit *e)
 {
     int i;
     const char *ns = cn->u.st.index_uri;
@@ -603,8 +878,8 @@ static void emit_term(cql_transform_t ct,
     else if (cql_lookup_property(ct, "truncation", 0, "cql"))
     {
         process_term = 0;
-        cql_pr_attr(ct, "truncation", "cql", 0,
-                    pr, client_data, YAZ_SRW_MASKING_CHAR_UNSUPP);
+        cql_pr_attr(ct, e, "truncation", "cql", 0,
+                    YAZ_SRW_MASKING_CHAR_UNSUPP);
     }
     assert(cn->which == CQL_NODE_ST);
 
@@ -642,160 +917,172 @@ static void emit_term(cql_transform_t ct,
         }
         if (anchor == 3)
         {
-            cql_pr_attr(ct, "position", "firstAndLast", 0,
-                        pr, client_data, YAZ_SRW_ANCHORING_CHAR_IN_UNSUPP_POSITION);
+            cql_pr_attr(ct, e, "position", "firstAndLast", 0,
+                        YAZ_SRW_ANCHORING_CHAR_IN_UNSUPP_POSITION);
             term++;
             length -= 2;
         }
         else if (anchor == 1)
         {
-            cql_pr_attr(ct, "position", "first", 0,
-                        pr, client_data, YAZ_SRW_ANCHORING_CHAR_IN_UNSUPP_POSITION);
+            cql_pr_attr(ct, e, "position", "first", 0,
+                        YAZ_SRW_ANCHORING_CHAR_IN_UNSUPP_POSITION);
             term++;
             length--;
         }
         else if (anchor == 2)
         {
-            cql_pr_attr(ct, "position", "last", 0,
-                        pr, client_data, YAZ_SRW_ANCHORING_CHAR_IN_UNSUPP_POSITION);
+            cql_pr_attr(ct, e, "position", "last", 0,
+                        YAZ_SRW_ANCHORING_CHAR_IN_UNSUPP_POSITION);
             length--;
         }
         else
         {
-            cql_pr_attr(ct, "position", "any", 0,
-                        pr, client_data, YAZ_SRW_ANCHORING_CHAR_IN_UNSUPP_POSITION);
+            cql_pr_attr(ct, e, "position", "any", 0,
+                        YAZ_SRW_ANCHORING_CHAR_IN_UNSUPP_POSITION);
         }
         if (z3958_mode == 0)
         {
-            if (trunc == 3 && cql_pr_attr(ct, "truncation",
-                                          "both", 0, pr, client_data, 0))
+            if (trunc == 3 && cql_pr_attr(ct, e, "truncation",
+                                          "both", 0, 0))
             {
                 term++;
                 length -= 2;
             }
-            else if (trunc == 1 && cql_pr_attr(ct, "truncation",
-                                               "left", 0, pr, client_data, 0))
+            else if (trunc == 1 && cql_pr_attr(ct, e, "truncation",
+                                               "left", 0, 0))
             {
                 term++;
                 length--;
             }
-            else if (trunc == 2 && cql_pr_attr(ct, "truncation", "right", 0,
-                                               pr, client_data, 0))
+            else if (trunc == 2 && cql_pr_attr(ct, e, "truncation", "right",
+                                               0, 0))
             {
                 length--;
             }
             else if (trunc)
                 z3958_mode = 1;
             else
-                cql_pr_attr(ct, "truncation", "none", 0,
-                            pr, client_data, 0);
+                cql_pr_attr(ct, e, "truncation", "none", 0, 0);
         }
         if (z3958_mode)
-            cql_pr_attr(ct, "truncation", "z3958", 0,
-                        pr, client_data, YAZ_SRW_MASKING_CHAR_UNSUPP);
+            cql_pr_attr(ct, e, "truncation", "z3958", 0,
+                        YAZ_SRW_MASKING_CHAR_UNSUPP);
     }
     if (ns) {
-        cql_pr_attr_uri(ct, "index", ns,
+        cql_pr_attr_uri(ct, e, "index", ns,
                         cn->u.st.index, "serverChoice",
-                        pr, client_data, YAZ_SRW_UNSUPP_INDEX);
+                        YAZ_SRW_UNSUPP_INDEX);
     }
     if (cn->u.st.modifiers)
     {
         struct cql_node *mod = cn->u.st.modifiers;
         for (; mod; mod = mod->u.st.modifiers)
         {
-            cql_pr_attr(ct, "relationModifier", mod->u.st.index, 0,
-                        pr, client_data, YAZ_SRW_UNSUPP_RELATION_MODIFIER);
+            cql_pr_attr(ct, e, "relationModifier", mod->u.st.index, 0,
+                        YAZ_SRW_UNSUPP_RELATION_MODIFIER);
         }
     }
-    (*pr)("\"", client_data);
+    emit_pqf(e, "\"");
+    if (e->o)
+        wrbuf_rewind(e->term);
     if (process_term)
         for (i = 0; i < length; i++)
         {
-            char x[2]; /* temp buffer */
             if (term[i] == '\\' && i < length - 1)
             {
                 i++;
                 if (strchr("\"\\", term[i]))
-                    pr("\\", client_data);
+                    emit_pqf(e, "\\");
                 if (z3958_mode && strchr("#?", term[i]))
-                    pr("\\\\", client_data); /* double \\ to survive PQF parse */
-                x[0] = term[i];
-                x[1] = '\0';
-                pr(x, client_data);
+                    emit_term_escape(e);
+                emit_term_char(e, term[i]);
             }
             else if (z3958_mode && term[i] == '*')
             {
-                pr("?", client_data);
+                emit_term_char(e, '?');
                 if (i < length - 1 && yaz_isdigit(term[i+1]))
-                    pr("\\\\", client_data); /* dbl \\ to survive PQF parse */
+                    emit_term_escape(e);
             }
             else if (z3958_mode && term[i] == '?')
             {
-                pr("#", client_data);
+                emit_term_char(e, '#');
             }
             else
             {
                 if (term[i] == '\"')
-                    pr("\\", client_data);
+                    emit_pqf(e, "\\");
                 if (z3958_mode && strchr("#?", term[i]))
-                    pr("\\\\", client_data); /* dbl \\ to survive PQF parse */
-                x[0] = term[i];
-                x[1] = '\0';
-                pr(x, client_data);
+                    emit_term_escape(e);
+                emit_term_char(e, term[i]);
             }
         }
     else
     {
         for (i = 0; i < length; i++)
-        {
-            char x[2];
-            x[0] = term[i];
-            x[1] = '\0';
-            pr(x, client_data);
-        }
+            emit_term_char(e, term[i]);
+    }
+    emit_pqf(e, "\" ");
+    if (e->o)
+    {
+        Z_Operand *zo = (Z_Operand *) odr_malloc(e->o, sizeof(*zo));
+        Z_AttributesPlusTerm *zapt = (Z_AttributesPlusTerm *)
+            odr_malloc(e->o, sizeof(*zapt));
+
+        zapt->attributes = rpn_attributes(e);
+        zapt->term = z_Term_create(e->o, Z_Term_general,
+                                   wrbuf_buf(e->term), wrbuf_len(e->term));
+        zo->which = Z_Operand_APT;
+        zo->u.attributesPlusTerm = zapt;
+        return rpn_operand(e, zo);
     }
-    (*pr)("\" ", client_data);
+    return 0;
 }
 
-static void emit_terms(cql_transform_t ct,
-                       struct cql_node *cn,
-                       void (*pr)(const char *buf, void *client_data),
-                       void *client_data,
-                       const char *op)
+static Z_RPNStructure *emit_terms(cql_transform_t ct,
+                                  struct cql_node *cn,
+                                  struct cql_emit *e,
+                                  const char *op)
 {
     struct cql_node *ne = cn->u.st.extra_terms;
+    int num_attr = e->num_attr;
+    Z_RPNStructure *top, **sp = &top;
+    Z_Complex *zc = 0;
+
     if (ne)
-    {
-        (*pr)("@", client_data);
-        (*pr)(op, client_data);
-        (*pr)(" ", client_data);
-    }
-    emit_term(ct, cn, cn->u.st.term, strlen(cn->u.st.term),
-              pr, client_data);
+        zc = emit_complex(e, op, sp);
+    if (zc)
+        sp = &zc->s1;
+    *sp = emit_term(ct, cn, cn->u.st.term, strlen(cn->u.st.term), e);
+    if (zc)
+        sp = &zc->s2;
     for (; ne; ne = ne->u.st.extra_terms)
     {
+        e->num_attr = num_attr;
+        zc = 0;
         if (ne->u.st.extra_terms)
-        {
-            (*pr)("@", client_data);
-            (*pr)(op, client_data);
-            (*pr)(" ", client_data);
-        }
-        emit_term(ct, cn, ne->u.st.term, strlen(ne->u.st.term),
-                  pr, client_data);
+            zc = emit_complex(e, op, sp);
+        if (zc)
+            sp = &zc->s1;
+        *sp = emit_term(ct, cn, ne->u.st.term, strlen(ne->u.st.term), e);
+        if (zc)
+            sp = &zc->s2;
     }
+    e->num_attr = num_attr;
+    return top;
 }
 
-static void emit_wordlist(cql_transform_t ct,
-                          struct cql_node *cn,
-                          void (*pr)(const char *buf, void *client_data),
-                          void *client_data,
-                          const char *op)
+static Z_RPNStructure *emit_wordlist(cql_transform_t ct,
+                                     struct cql_node *cn,
+                                     struct cql_emit *e,
+                                     const char *op)
 {
     const char *cp0 = cn->u.st.term;
     const char *cp1;
     const char *last_term = 0;
     int last_length = 0;
+    int num_attr = e->num_attr;
+    Z_RPNStructure *top = 0, **sp = &top;
+
     while(cp0)
     {
         while (*cp0 == ' ')
@@ -803,10 +1090,13 @@ static void emit_wordlist(cql_transform_t ct,
         cp1 = strchr(cp0, ' ');
         if (last_term)
         {
-            (*pr)("@", client_data);
-            (*pr)(op, client_data);
-            (*pr)(" ", client_data);
-            emit_term(ct, cn, last_term, last_length, pr, client_data);
+            Z_Complex *zc = emit_complex(e, op, sp);
+            if (zc)
+                sp = &zc->s1;
+            *sp = emit_term(ct, cn, last_term, last_length, e);
+            if (zc)
+                sp = &zc->s2;
+            e->num_attr = num_attr;
         }
         last_term = cp0;
         if (cp1)
@@ -816,19 +1106,23 @@ static void emit_wordlist(cql_transform_t ct,
         cp0 = cp1;
     }
     if (last_term)
-        emit_term(ct, cn, last_term, last_length, pr, client_data);
+        *sp = emit_term(ct, cn, last_term, last_length, e);
+    e->num_attr = num_attr;
+    return top;
 }
 
-void cql_transform_r(cql_transform_t ct,
-                     struct cql_node *cn,
-                     void (*pr)(const char *buf, void *client_data),
-                     void *client_data)
+static Z_RPNStructure *cql_transform_r(cql_transform_t ct,
+                                       struct cql_node *cn,
+                                       struct cql_emit *e)
 {
     const char *ns;
     struct cql_node *mods;
+    Z_RPNStructure *s = 0;
+    Z_Complex *zc;
+    int num_attr = e->num_attr;
 
     if (!cn)
-        return;
+        return 0;
     switch (cn->which)
     {
     case CQL_NODE_ST:
@@ -838,10 +1132,18 @@ void cql_transform_r(cql_transform_t ct,
             if (!strcmp(ns, cql_uri())
                 && cn->u.st.index && !cql_strcmp(cn->u.st.index, "resultSet"))
             {
-                (*pr)("@set \"", client_data);
-                (*pr)(cn->u.st.term, client_data);
-                (*pr)("\" ", client_data);
-                return ;
+                if (e->o)
+                {
+                    Z_Operand *zo = (Z_Operand *)
+                        odr_malloc(e->o, sizeof(*zo));
+                    zo->which = Z_Operand_resultSetId;
+                    zo->u.resultSetId = odr_strdup(e->o, cn->u.st.term);
+                    return rpn_operand(e, zo);
+                }
+                (*e->pr)("@set \"", e->client_data);
+                (*e->pr)(cn->u.st.term, e->client_data);
+                (*e->pr)("\" ", e->client_data);
+                return 0;
             }
         }
         else
@@ -852,68 +1154,118 @@ void cql_transform_r(cql_transform_t ct,
                 ct->addinfo = 0;
             }
         }
-        cql_pr_attr(ct, "always", 0, 0, pr, client_data, 0);
-        cql_pr_attr(ct, "relation", cn->u.st.relation, 0, pr, client_data,
+        cql_pr_attr(ct, e, "always", 0, 0, 0);
+        cql_pr_attr(ct, e, "relation", cn->u.st.relation, 0,
                     YAZ_SRW_UNSUPP_RELATION);
-        cql_pr_attr(ct, "structure", cn->u.st.relation, 0,
-                    pr, client_data, YAZ_SRW_UNSUPP_COMBI_OF_RELATION_AND_TERM);
+        cql_pr_attr(ct, e, "structure", cn->u.st.relation, 0,
+                    YAZ_SRW_UNSUPP_COMBI_OF_RELATION_AND_TERM);
         if (cn->u.st.relation && !cql_strcmp(cn->u.st.relation, "all"))
-            emit_wordlist(ct, cn, pr, client_data, "and");
+            s = emit_wordlist(ct, cn, e, "and");
         else if (cn->u.st.relation && !cql_strcmp(cn->u.st.relation, "any"))
-            emit_wordlist(ct, cn, pr, client_data, "or");
+            s = emit_wordlist(ct, cn, e, "or");
         else
-            emit_terms(ct, cn, pr, client_data, "and");
+            s = emit_terms(ct, cn, e, "and");
         break;
     case CQL_NODE_BOOL:
-        (*pr)("@", client_data);
-        (*pr)(cn->u.boolean.value, client_data);
-        (*pr)(" ", client_data);
+        zc = emit_complex(e, cn->u.boolean.value, &s);
         mods = cn->u.boolean.modifiers;
         if (!strcmp(cn->u.boolean.value, "prox"))
         {
-            if (!cql_pr_prox(ct, mods, pr, client_data))
-                return;
+            if (!cql_pr_prox(ct, mods, e, zc ? zc->roperator : 0))
+                return 0;
         }
         else if (mods)
         {
             /* Boolean modifiers other than on proximity not supported */
             ct->error = YAZ_SRW_UNSUPP_BOOLEAN_MODIFIER;
             ct->addinfo = xstrdup(mods->u.st.index);
-            return;
+            return 0;
         }
 
-        cql_transform_r(ct, cn->u.boolean.left, pr, client_data);
-        cql_transform_r(ct, cn->u.boolean.right, pr, client_data);
+        if (zc)
+        {
+            zc->s1 = cql_transform_r(ct, cn->u.boolean.left, e);
+            zc->s2 = cql_transform_r(ct, cn->u.boolean.right, e);
+        }
+        else
+        {
+            cql_transform_r(ct, cn->u.boolean.left, e);
+            cql_transform_r(ct, cn->u.boolean.right, e);
+        }
         break;
     case CQL_NODE_SORT:
-        cql_transform_r(ct, cn->u.sort.search, pr, client_data);
+        s = cql_transform_r(ct, cn->u.sort.search, e);
         break;
     default:
         fprintf(stderr, "Fatal: impossible CQL node-type %d\n", cn->which);
         abort();
     }
+    e->num_attr = num_attr;
+    return s;
 }
 
-int cql_transform(cql_transform_t ct, struct cql_node *cn,
-                  void (*pr)(const char *buf, void *client_data),
-                  void *client_data)
+static Z_RPNStructure *cql_transform_emit(cql_transform_t ct,
+                                          struct cql_node *cn,
+                                          struct cql_emit *e)
 {
-    struct cql_prop_entry *e;
+    struct cql_prop_entry *pe;
     NMEM nmem = nmem_create();
+    Z_RPNStructure *s;
 
     ct->error = 0;
     xfree(ct->addinfo);
     ct->addinfo = 0;
 
-    for (e = ct->entry; e ; e = e->next)
+    for (pe = ct->entry; pe ; pe = pe->next)
     {
-        if (!cql_strncmp(e->pattern, "set.", 4))
-            cql_apply_prefix(nmem, cn, e->pattern+4, e->value);
-        else if (!cql_strcmp(e->pattern, "set"))
-            cql_apply_prefix(nmem, cn, 0, e->value);
+        if (!cql_strncmp(pe->pattern, "set.", 4))
+            cql_apply_prefix(nmem, cn, pe->pattern+4, pe->value);
+        else if (!cql_strcmp(pe->pattern, "set"))
+            cql_apply_prefix(nmem, cn, 0, pe->value);
     }
-    cql_transform_r(ct, cn, pr, client_data);
+    s = cql_transform_r(ct, cn, e);
     nmem_destroy(nmem);
+    return s;
+}
+
+int cql_transform(cql_transform_t ct, struct cql_node *cn,
+                  void (*pr)(const char *buf, void *client_data),
+                  void *client_data)
+{
+    struct cql_emit e;
+
+    e.pr = pr;
+    e.client_data = client_data;
+    e.o = 0;
+    e.num_attr = 0;
+    e.attr = 0;
+    e.term = 0;
+    cql_transform_emit(ct, cn, &e);
+    return ct->error;
+}
+
+int cql_transform_rpn(cql_transform_t ct, struct cql_node *cn, ODR o,
+                      Z_RPNQuery **rpn)
+{
+    struct cql_emit e;
+    struct cql_rpn_attr attr[CQL_RPN_MAX_ATTR];
+    Z_RPNStructure *s;
+
+    *rpn = 0;
+    e.pr = 0;
+    e.client_data = 0;
+    e.o = o;
+    e.num_attr = 0;
+    e.attr = attr;
+    e.term = wrbuf_alloc();
+    s = cql_transform_emit(ct, cn, &e);
+    wrbuf_destroy(e.term);
+    if (!ct->error)
+    {
+        *rpn = (Z_RPNQuery *) odr_malloc(o, sizeof(**rpn));
+        (*rpn)->attributeSetId = odr_oiddup(o, yaz_oid_attset_bib_1);
+        (*rpn)->RPNStructure = s;
+    }
     return ct->error;
 }
 
@@ -62,6 +62,12 @@ IOCHAN iochan_create(int fd, IOC_CALLBACK cb, int flags, int chan_id)
     return new_iochan;
 }
 
+void iochan_append(IOCHAN list, IOCHAN chan)
+{
+    while (list->next)
+        list = list->next;
+    list->next = chan;
+}
 
 int iochan_is_alive(IOCHAN chan)
 {
@@ -137,7 +143,8 @@ int iochan_event_loop(IOCHAN *iochans)
             }
         }
         now = time(0);
-        for (i = 0, p = *iochans; p; p = p->next, i++)
+        /* channels added by the callbacks below are not polled yet */
+        for (i = 0, p = *iochans; p && i < no_fds; p = p->next, i++)
         {
             int force_event = p->force_event;
             enum yaz_poll_mask output_mask = fds[i].output_mask;
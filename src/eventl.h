@@ -78,6 +78,9 @@ int force_event;
 #define iochan_settimeout(i, t) ((i)->max_idle = (t), (i)->last_event = time(0))
 
 IOCHAN iochan_create(int fd, IOC_CALLBACK cb, int flags, int port);
+/* adds chan to the end of the list that list is a member of, so that
+   the event loop serving that list serves chan as well */
+void iochan_append(IOCHAN list, IOCHAN chan);
 int iochan_is_alive(IOCHAN chan);
 int iochan_event_loop(IOCHAN *iochans);
 void statserv_remove (IOCHAN pIOChannel);
@@ -0,0 +1,380 @@
+/* This file is part of the YAZ toolkit.
+ * Copyright (C) 1995-2013 Index Data
+ * See the file LICENSE for details.
+ */
+/**
+ * \file filecache.c
+ * \brief Cache of static documents served by GFS (docpath)
+ *
+ * Documents are cached with ETag, Last-Modified and MIME type. Entries
+ * are validated against stat(2) (or fstat(2) of the file about to be
+ * sent) on each lookup: inode, size, ctime and mtime, with nanoseconds
+ * where struct stat has them. So a changed or replaced file is
+ * reloaded. The content of small files is kept in memory as well.
+ */
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#if HAVE_SYS_TYPES_H
+#include <sys/types.h>
+#endif
+#if HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+
+#ifdef WIN32
+#define S_ISREG(x) (x & _S_IFREG)
+#endif
+
+#if HAVE_STRUCT_STAT_ST_MTIM_TV_NSEC
+#define STAT_MTIME_NSEC(st) ((long) (st)->st_mtim.tv_nsec)
+#else
+#define STAT_MTIME_NSEC(st) 0L
+#endif
+
+#include <yaz/xmalloc.h>
+#include <yaz/mutex.h>
+#include "mime.h"
+#include "filecache.h"
+
+/* max number of documents in cache */
+#define FILE_CACHE_MAX_ENTRIES 256
+/* max size of document whose content is cached */
+#define FILE_CACHE_MAX_FILE (256*1024)
+/* max size of all cached content */
+#define FILE_CACHE_MAX_TOTAL (16*1024*1024)
+
+struct file_cache_entry {
+    char *fname;
+    time_t mtime;
+    long mtime_nsec;
+    time_t ctime;
+    ino_t ino;
+    size_t size;
+    const char *content_type;
+    char etag[80];
+    char last_modified[40];
+    char *buf;
+    struct file_cache_entry *next;
+};
+
+struct file_cache {
+    YAZ_MUTEX mutex;
+    yaz_mime_types types;
+    struct file_cache_entry *entries;
+    int num_entries;
+    size_t total;
+};
+
+file_cache_t file_cache_create(void)
+{
+    file_cache_t fc = (file_cache_t) xmalloc(sizeof(*fc));
+    yaz_mime_types types = yaz_mime_types_create();
+
+    yaz_mime_types_add(types, "xsl", "application/xml");
+    yaz_mime_types_add(types, "xml", "application/xml");
+    yaz_mime_types_add(types, "css", "text/css");
+    yaz_mime_types_add(types, "html", "text/html");
+    yaz_mime_types_add(types, "htm", "text/html");
+    yaz_mime_types_add(types, "txt", "text/plain");
+    yaz_mime_types_add(types, "js", "application/x-javascript");
+
+    yaz_mime_types_add(types, "gif", "image/gif");
+    yaz_mime_types_add(types, "png", "image/png");
+    yaz_mime_types_add(types, "jpg", "image/jpeg");
+    yaz_mime_types_add(types, "jpeg", "image/jpeg");
+
+    fc->types = types;
+    fc->mutex = 0;
+    yaz_mutex_create(&fc->mutex);
+    fc->entries = 0;
+    fc->num_entries = 0;
+    fc->total = 0;
+    return fc;
+}
+
+static void entry_destroy(struct file_cache_entry *e)
+{
+    xfree(e->buf);
+    xfree(e->fname);
+    xfree(e);
+}
+
+void file_cache_destroy(file_cache_t fc)
+{
+    if (fc)
+    {
+        struct file_cache_entry *e = fc->entries;
+        while (e)
+        {
+            struct file_cache_entry *e_next = e->next;
+            entry_destroy(e);
+            e = e_next;
+        }
+        yaz_mime_types_destroy(fc->types);
+        yaz_mutex_destroy(&fc->mutex);
+        xfree(fc);
+    }
+}
+
+static int read_file(const char *fname, char *buf, size_t sz)
+{
+    int ret = 0;
+    FILE *inf = fopen(fname, "rb");
+    if (!inf)
+        return -1;
+    if (sz && fread(buf, 1, sz, inf) != sz)
+        ret = -1;
+    fclose(inf);
+    return ret;
+}
+
+static void entry_set_stat(file_cache_t fc, struct file_cache_entry *e,
+                           struct stat *st)
+{
+    struct tm tm_buf, *tm;
+
+    if (e->buf)
+    {
+        fc->total -= e->size;
+        xfree(e->buf);
+        e->buf = 0;
+    }
+    e->mtime = st->st_mtime;
+    e->mtime_nsec = STAT_MTIME_NSEC(st);
+    e->ctime = st->st_ctime;
+    e->ino = st->st_ino;
+    e->size = (size_t) st->st_size;
+    sprintf(e->etag, "\"%lx-%lx-%lx.%lx\"", (unsigned long) e->ino,
+            (unsigned long) e->size, (unsigned long) e->mtime,
+            (unsigned long) e->mtime_nsec);
+#if HAVE_GMTIME_R
+    tm = gmtime_r(&e->mtime, &tm_buf);
+#else
+    tm = gmtime(&e->mtime);
+    if (tm)
+    {
+        tm_buf = *tm;
+        tm = &tm_buf;
+    }
+#endif
+    *e->last_modified = '\0';
+    if (tm)
+        strftime(e->last_modified, sizeof(e->last_modified),
+                 "%a, %d %b %Y %H:%M:%S GMT", tm);
+}
+
+/* whether file of e has changed or been replaced since it was cached */
+static int entry_changed(struct file_cache_entry *e, struct stat *st)
+{
+    return e->mtime != st->st_mtime || e->mtime_nsec != STAT_MTIME_NSEC(st)
+        || e->ctime != st->st_ctime || e->ino != st->st_ino
+        || e->size != (size_t) st->st_size;
+}
+
+/* drop least recently used entries and content beyond the limits */
+static void file_cache_trim(file_cache_t fc)
+{
+    struct file_cache_entry **ep = &fc->entries;
+    int no = 0;
+    size_t total = 0;
+
+    while (*ep)
+    {
+        struct file_cache_entry *e = *ep;
+        if (no >= FILE_CACHE_MAX_ENTRIES)
+        {
+            *ep = e->next;
+            entry_destroy(e);
+            continue;
+        }
+        if (e->buf)
+        {
+            if (total + e->size > FILE_CACHE_MAX_TOTAL)
+            {
+                xfree(e->buf);
+                e->buf = 0;
+            }
+            else
+                total += e->size;
+        }
+        no++;
+        ep = &e->next;
+    }
+    fc->num_entries = no;
+    fc->total = total;
+}
+
+int file_cache_lookup(file_cache_t fc, const char *fname, int fd, NMEM nmem,
+                      int want_content, struct file_cache_info *info)
+{
+    struct stat st;
+    struct file_cache_entry **ep, *e;
+    int ret = 0;
+
+    if ((fd == -1 ? stat(fname, &st) : fstat(fd, &st))
+        || !S_ISREG(st.st_mode))
+        return -1;
+    yaz_mutex_enter(fc->mutex);
+    for (ep = &fc->entries; *ep; ep = &(*ep)->next)
+        if (!strcmp((*ep)->fname, fname))
+            break;
+    e = *ep;
+    if (e)
+    {
+        *ep = e->next;
+        if (entry_changed(e, &st))
+            entry_set_stat(fc, e, &st);
+    }
+    else
+    {
+        e = (struct file_cache_entry *) xmalloc(sizeof(*e));
+        e->fname = xstrdup(fname);
+        e->content_type = yaz_mime_lookup_fname(fc->types, fname);
+        e->buf = 0;
+        entry_set_stat(fc, e, &st);
+        fc->num_entries++;
+    }
+    /* move to front */
+    e->next = fc->entries;
+    fc->entries = e;
+
+    if (!e->content_type)
+        ret = -2;
+    else
+    {
+        info->size = e->size;
+        info->content_type = e->content_type;
+        info->etag = nmem_strdup(nmem, e->etag);
+        info->last_modified = nmem_strdup(nmem, e->last_modified);
+        info->mtime = e->mtime;
+        info->buf = 0;
+        if (want_content)
+        {
+            if (!e->buf && e->size <= FILE_CACHE_MAX_FILE)
+            {
+                e->buf = (char *) xmalloc(e->size + 1);
+                if (read_file(fname, e->buf, e->size))
+                {
+                    xfree(e->buf);
+                    e->buf = 0;
+                }
+                else
+                    fc->total += e->size;
+            }
+            info->buf = (char *) nmem_malloc(nmem, e->size + 1);
+            if (e->buf)
+                memcpy(info->buf, e->buf, e->size);
+            else if (read_file(fname, info->buf, e->size))
+                ret = -1;
+        }
+    }
+    if (fc->num_entries > FILE_CACHE_MAX_ENTRIES ||
+        fc->total > FILE_CACHE_MAX_TOTAL)
+        file_cache_trim(fc);
+    yaz_mutex_leave(fc->mutex);
+    return ret;
+}
+
+int file_cache_parse_date(const char *s, time_t *t)
+{
+    static const char *months[] = {
+        "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+        "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
+    };
+    char mon[4], tz[4];
+    int day, m, year, hh, mm, ss, y, yoe, doy;
+    long days;
+
+    if (strchr(s, ','))
+    {
+        s = strchr(s, ',') + 1;
+        /* IMF-fixdate: Sun, 06 Nov 1994 08:49:37 GMT */
+        if (sscanf(s, " %2d %3[A-Za-z] %4d %2d:%2d:%2d %3s",
+                   &day, mon, &year, &hh, &mm, &ss, tz) != 7)
+        {
+            /* obsolete RFC 850: Sunday, 06-Nov-94 08:49:37 GMT */
+            if (sscanf(s, " %2d-%3[A-Za-z]-%2d %2d:%2d:%2d %3s",
+                       &day, mon, &year, &hh, &mm, &ss, tz) != 7)
+                return -1;
+            year += year < 70 ? 2000 : 1900;
+        }
+        if (strcmp(tz, "GMT"))
+            return -1;
+    }
+    /* asctime: Sun Nov  6 08:49:37 1994 */
+    else if (sscanf(s, "%*3s %3[A-Za-z] %2d %2d:%2d:%2d %4d",
+                    mon, &day, &hh, &mm, &ss, &year) != 6)
+        return -1;
+    for (m = 0; m < 12; m++)
+        if (!strcmp(mon, months[m]))
+            break;
+    if (m == 12 || day < 1 || day > 31 || hh > 23 || mm > 59 || ss > 60
+        || year < 1970 || (sizeof(time_t) < 8 && year > 2037))
+        return -1;
+    /* days since 1970-01-01 of the proleptic Gregorian date, with years
+       starting in March so that the leap day is the last one */
+    y = m < 2 ? year - 1 : year;
+    yoe = y % 400;
+    doy = (153 * (m < 2 ? m + 10 : m - 2) + 2) / 5 + day - 1;
+    days = (y / 400) * 146097L + yoe * 365L + yoe / 4 - yoe / 100 + doy
+        - 719468L;
+    *t = (time_t) days * 86400 + hh * 3600 + mm * 60 + ss;
+    return 0;
+}
+
+/* whether weak comparison (RFC 9110 8.8.3.2) of etag with any of the
+   entity-tags in list (If-None-Match) succeeds */
+static int etag_list_match(const char *list, const char *etag)
+{
+    size_t len;
+
+    if (etag[0] == 'W' && etag[1] == '/')
+        etag += 2;
+    len = strlen(etag);
+    while (1)
+    {
+        const char *end;
+
+        while (*list == ' ' || *list == '\t' || *list == ',')
+            list++;
+        if (*list == '*')
+            return 1;
+        if (list[0] == 'W' && list[1] == '/')
+            list += 2;
+        if (*list != '"' || !(end = strchr(list + 1, '"')))
+            return 0;
+        end++;
+        if ((size_t) (end - list) == len && !memcmp(list, etag, len))
+            return 1;
+        list = end;
+    }
+}
+
+int file_cache_not_modified(const struct file_cache_info *info,
+                            const char *if_none_match,
+                            const char *if_modified_since)
+{
+    time_t since;
+
+    /* If-Modified-Since is ignored when If-None-Match is given */
+    if (if_none_match)
+        return etag_list_match(if_none_match, info->etag);
+    if (if_modified_since
+        && file_cache_parse_date(if_modified_since, &since) == 0)
+        return info->mtime <= since;
+    return 0;
+}
+/*
+ * Local variables:
+ * c-basic-offset: 4
+ * c-file-style: "Stroustrup"
+ * indent-tabs-mode: nil
+ * End:
+ * vim: shiftwidth=4 tabstop=8 expandtab
+ */
@@ -0,0 +1,98 @@
+/* This file is part of the YAZ toolkit.
+ * Copyright (C) 1995-2013 Index Data.
+ * All rights reserved.
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Index Data nor the names of its contributors
+ *       may be used to endorse or promote products derived from this
+ *       software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS AND CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file filecache.h
+ * \brief Cache of static documents served by GFS (docpath)
+ */
+
+#ifndef FILECACHE_H
+#define FILECACHE_H
+
+#include <time.h>
+#include <yaz/nmem.h>
+
+typedef struct file_cache *file_cache_t;
+
+/** \brief information about a cached document */
+struct file_cache_info {
+    size_t size;               /* size of document in bytes */
+    const char *content_type;  /* MIME type */
+    const char *etag;          /* value of ETag header */
+    const char *last_modified; /* value of Last-Modified header */
+    time_t mtime;              /* modification time */
+    char *buf;                 /* content (only if requested) */
+};
+
+/** \brief creates file cache */
+file_cache_t file_cache_create(void);
+
+/** \brief destroys file cache */
+void file_cache_destroy(file_cache_t fc);
+
+/** \brief looks up document, loading it if not cached or changed on disk
+    \param fc file cache
+    \param fname file name
+    \param fd file descriptor of fname to check against; -1 for none
+    \param nmem memory for result strings and content
+    \param want_content whether info->buf should be filled with content
+    \param info result
+    \retval 0 OK
+    \retval -1 file not found (or not a regular file)
+    \retval -2 no MIME type for file
+*/
+int file_cache_lookup(file_cache_t fc, const char *fname, int fd, NMEM nmem,
+                      int want_content, struct file_cache_info *info);
+
+/** \brief evaluates HTTP conditional GET for document (RFC 9110 13.1)
+    \param info document as returned by file_cache_lookup
+    \param if_none_match value of If-None-Match header; NULL for none
+    \param if_modified_since value of If-Modified-Since; NULL for none
+    \retval 1 not modified (respond with 304)
+    \retval 0 send the document
+*/
+int file_cache_not_modified(const struct file_cache_info *info,
+                            const char *if_none_match,
+                            const char *if_modified_since);
+
+/** \brief parses HTTP-date (RFC 9110 5.6.7), all three formats
+    \param s date string
+    \param t result
+    \retval 0 OK
+    \retval -1 invalid date
+*/
+int file_cache_parse_date(const char *s, time_t *t);
+
+#endif
+/*
+ * Local variables:
+ * c-basic-offset: 4
+ * c-file-style: "Stroustrup"
+ * indent-tabs-mode: nil
+ * End:
+ * vim: shiftwidth=4 tabstop=8 expandtab
+ */
@@ -10,70 +10,243 @@
 #include <config.h>
 #endif
 
+#include <stdlib.h>
 #include <yaz/odr.h>
 #include <yaz/yaz-version.h>
 #include <yaz/yaz-iconv.h>
 #include <yaz/matchstr.h>
 #include <yaz/zgdu.h>
 #include <yaz/base64.h>
+#include <yaz/wrbuf.h>
+#include <yaz/log.h>
+#include "odr-priv.h"
+
+#if HAVE_ZLIB
+#include <zlib.h>
+#endif
 
 #ifdef WIN32
 #define strncasecmp _strnicmp
 #define strcasecmp _stricmp
 #endif
 
+/* inflated HTTP body limit unless set by z_HTTP_set_max_content */
+#define HTTP_MAX_CONTENT (128 * 1024 * 1024)
+
+void z_HTTP_set_max_content(ODR o, int max)
+{
+    o->op->max_content = max;
+}
+
+#if HAVE_ZLIB
+/* inflate gzip/deflate coded body into ODR memory. Returns 0 on error,
+   including a body larger than the maximum once inflated */
+static int inflate_content(ODR o, const char *coding,
+                           char **content_buf, int *content_len)
+{
+    WRBUF w = wrbuf_alloc();
+    int raw, ret = Z_DATA_ERROR;
+    size_t max = o->op->max_content > 0 ?
+        o->op->max_content : HTTP_MAX_CONTENT;
+
+    /* "deflate" is meant to be zlib wrapped, but some servers send raw */
+    for (raw = 0; raw < 2 && ret == Z_DATA_ERROR; raw++)
+    {
+        z_stream zs;
+        unsigned char out[8192];
+
+        memset(&zs, 0, sizeof(zs));
+        /* +32: auto detect gzip or zlib header */
+        if (inflateInit2(&zs, raw ? -MAX_WBITS : MAX_WBITS + 32) != Z_OK)
+            break;
+        zs.next_in = (Bytef *) *content_buf;
+        zs.avail_in = *content_len;
+        wrbuf_rewind(w);
+        do
+        {
+            zs.next_out = out;
+            zs.avail_out = sizeof(out);
+            ret = inflate(&zs, Z_NO_FLUSH);
+            if (ret != Z_OK && ret != Z_STREAM_END)
+                break;
+            if (wrbuf_len(w) + sizeof(out) - zs.avail_out > max)
+            {
+                yaz_log(YLOG_WARN, "HTTP %s content exceeds %ld bytes",
+                        coding, (long) max);
+                ret = Z_BUF_ERROR;
+                break;
+            }
+            wrbuf_write(w, (const char *) out, sizeof(out) - zs.avail_out);
+        } while (ret != Z_STREAM_END);
+        inflateEnd(&zs);
+        if (strcasecmp(coding, "deflate"))
+            break;
+    }
+    if (ret == Z_STREAM_END)
+    {
+        *content_len = wrbuf_len(w);
+        *content_buf = (char *) odr_malloc(o, *content_len + 1);
+        memcpy(*content_buf, wrbuf_buf(w), *content_len);
+        (*content_buf)[*content_len] = '\0';
+    }
+    wrbuf_destroy(w);
+    return ret == Z_STREAM_END;
+}
+
+/* whether coding is acceptable according to Accept-Encoding value v */
+static int coding_accepted(const char *v, const char *coding)
+{
+    int star = 0;
+    while (*v)
+    {
+        const char *name;
+        size_t len;
+        int accept = 1;
+
+        while (*v == ' ' || *v == ',')
+            v++;
+        name = v;
+        while (*v && !strchr(" ,;", *v))
+            v++;
+        len = v - name;
+        while (*v && *v != ',')
+            if (*v++ == ';')
+            {
+                while (*v == ' ')
+                    v++;
+                if ((*v == 'q' || *v == 'Q') && v[1] == '=')
+                    accept = atof(v + 2) > 0.0;
+            }
+        if (len == strlen(coding) && !strncasecmp(name, coding, len))
+            return accept;
+        if (len == 1 && *name == '*')
+            star = accept;
+    }
+    return star;
+}
+#endif
+
+/* well-known header names, placed by http_header_hash */
+#define HTTP_HEADER_HASH 38
+static const char *http_header_names[HTTP_HEADER_HASH] = {
+    "Expect", "Date", "Cache-Control", "Accept-Encoding", 0,
+    "If-Modified-Since", 0, "Cookie", "SOAPAction", 0, 0, "Set-Cookie", 0,
+    0, "Content-Length", 0, 0, "Server", "Content-Type", "Content-Encoding",
+    0, "Host", "Connection", "Keep-Alive", 0, 0, "Authorization", 0,
+    "If-None-Match", "Last-Modified", "Transfer-Encoding", 0, "Accept",
+    "ETag", "User-Agent", 0, "Location", 0
+};
+#define HTTP_HEADER_CONTENT_LENGTH 14
+#define HTTP_HEADER_CONTENT_ENCODING 19
+#define HTTP_HEADER_TRANSFER_ENCODING 30
+
+static int http_lower(int c)
+{
+    return yaz_isupper(c) ? yaz_tolower(c) : c;
+}
+
+/* perfect hash of the names above; collisions for other names are
+   resolved by http_header_index */
+static int http_header_hash(const char *name, size_t len)
+{
+    return (int) ((len * 32 + http_lower((unsigned char) name[0]) * 11
+                   + http_lower((unsigned char) name[len - 1])
+                   + http_lower((unsigned char) name[len / 2]))
+                  % HTTP_HEADER_HASH);
+}
+
+/* index of well-known header name (case insensitive); -1 if unknown */
+static int http_header_index(const char *name, size_t len)
+{
+    if (len > 0)
+    {
+        int h = http_header_hash(name, len);
+        const char *known = http_header_names[h];
+        if (known && strlen(known) == len && !strncasecmp(known, name, len))
+            return h;
+    }
+    return -1;
+}
+
+/* name to store in a header: the table string for a well-known name,
+   whatever its case, so that lookups of those compare pointers only */
+static const char *http_header_canonical(int idx)
+{
+    return idx >= 0 ? http_header_names[idx] : 0;
+}
+
 static int decode_headers_content(ODR o, int off, Z_HTTP_Header **headers,
                                   char **content_buf, int *content_len)
 {
-    int i = off;
+    /* the rest of the message is copied once; names, values and the
+       de-chunked body are all terminated in place within that copy */
+    int n = o->size - off;
+    int i = 0;
     int chunked = 0;
+    Z_HTTP_Header **coding_hp = 0;
+    Z_HTTP_Header *length_h = 0;
+    char *b;
+    char c;
 
     *headers = 0;
-    while (i < o->size-1 && o->buf[i] == '\n')
+    if (n <= 0)
     {
-        int po;
+        o->error = OHTTP;
+        return 0;
+    }
+    b = (char *) odr_malloc(o, n + 1);
+    memcpy(b, o->buf + off, n);
+    b[n] = '\0';
+    c = b[0];
+    while (i < n - 1 && c == '\n')
+    {
+        const char *known;
+        char *name;
+        int po, idx;
+
         i++;
-        if (o->buf[i] == '\r' && i < o->size-1 && o->buf[i+1] == '\n')
+        if (b[i] == '\r' && i < n - 1 && b[i+1] == '\n')
         {
             i++;
             break;
         }
-        if (o->buf[i] == '\n')
+        if (b[i] == '\n')
             break;
-        for (po = i; ; i++)
+        for (po = i; i < n && b[i] != ':'; i++)
+            ;
+        if (i == n)
         {
-            if (i == o->size)
-            {
-                o->error = OHTTP;
-                return 0;
-            }
-            else if (o->buf[i] == ':')
-                break;
+            o->error = OHTTP;
+            return 0;
         }
+        name = b + po;
+        b[i] = '\0';
+        idx = http_header_index(name, i - po);
+        known = http_header_canonical(idx);
         *headers = (Z_HTTP_Header *) odr_malloc(o, sizeof(**headers));
-        (*headers)->name = (char*) odr_malloc(o, i - po + 1);
-        memcpy ((*headers)->name, o->buf + po, i - po);
-        (*headers)->name[i - po] = '\0';
+        (*headers)->name = known ? (char *) known : name;
         i++;
-        while (i < o->size-1 && o->buf[i] == ' ')
+        while (i < n - 1 && b[i] == ' ')
             i++;
-        for (po = i; i < o->size-1 && !strchr("\r\n", o->buf[i]); i++)
+        for (po = i; i < n - 1 && !strchr("\r\n", b[i]); i++)
             ;
+        c = b[i];
+        b[i] = '\0';
+        (*headers)->value = b + po;
 
-        (*headers)->value = (char*) odr_malloc(o, i - po + 1);
-        memcpy ((*headers)->value, o->buf + po, i - po);
-        (*headers)->value[i - po] = '\0';
-
-        if (!strcasecmp((*headers)->name, "Transfer-Encoding")
-            &&
-            !strcasecmp((*headers)->value, "chunked"))
+        if (idx == HTTP_HEADER_TRANSFER_ENCODING
+            && !strcasecmp((*headers)->value, "chunked"))
             chunked = 1;
+        else if (idx == HTTP_HEADER_CONTENT_ENCODING)
+            coding_hp = headers;
+        else if (idx == HTTP_HEADER_CONTENT_LENGTH)
+            length_h = *headers;
         headers = &(*headers)->next;
-        if (i < o->size-1 && o->buf[i] == '\r')
-            i++;
+        if (i < n - 1 && c == '\r')
+            c = b[++i];
     }
     *headers = 0;
-    if (o->buf[i] != '\n')
+    if (c != '\n')
     {
         o->error = OHTTP;
         return 0;
@@ -82,31 +255,33 @@ static int decode_headers_content(ODR o, int off, Z_HTTP_Header **headers,
 
     if (chunked)
     {
-        int off = 0;
-
-        /* we know buffer will be smaller than o->size - i*/
-        *content_buf = (char*) odr_malloc(o, o->size - i);
+        /* chunks are moved down to form the body; the write position
+           never passes the read position */
+        int start = i;
+        int w = i;
 
         while (1)
         {
             /* chunk length .. */
             int chunk_len = 0;
-            for (; i  < o->size-2; i++)
-                if (yaz_isdigit(o->buf[i]))
-                    chunk_len = chunk_len * 16 +
-                        (o->buf[i] - '0');
-                else if (yaz_isupper(o->buf[i]))
-                    chunk_len = chunk_len * 16 +
-                        (o->buf[i] - ('A'-10));
-                else if (yaz_islower(o->buf[i]))
-                    chunk_len = chunk_len * 16 +
-                        (o->buf[i] - ('a'-10));
+            if (i > n - 3)
+            {   /* no room for even the last chunk */
+                o->error = OHTTP;
+                return 0;
+            }
+            for (; i < n - 2; i++)
+                if (yaz_isdigit(b[i]))
+                    chunk_len = chunk_len * 16 + (b[i] - '0');
+                else if (yaz_isupper(b[i]))
+                    chunk_len = chunk_len * 16 + (b[i] - ('A'-10));
+                else if (yaz_islower(b[i]))
+                    chunk_len = chunk_len * 16 + (b[i] - ('a'-10));
                 else
                     break;
             /* chunk extension ... */
-            while (o->buf[i] != '\r' && o->buf[i+1] != '\n')
+            while (b[i] != '\r' || b[i+1] != '\n')
             {
-                if (i >= o->size-2)
+                if (i >= n - 2)
                 {
                     o->error = OHTTP;
                     return 0;
@@ -116,40 +291,62 @@ static int decode_headers_content(ODR o, int off, Z_HTTP_Header **headers,
             i += 2;  /* skip CRLF */
             if (chunk_len == 0)
                 break;
-            if (chunk_len < 0 || off + chunk_len > o->size)
+            if (chunk_len < 0 || chunk_len > n - i - 2)
             {
                 o->error = OHTTP;
                 return 0;
             }
-            /* copy chunk .. */
-            memcpy (*content_buf + off, o->buf + i, chunk_len);
+            memmove(b + w, b + i, chunk_len);
             i += chunk_len + 2; /* skip chunk+CRLF */
-            off += chunk_len;
+            w += chunk_len;
+        }
+        *content_len = w - start;
+        if (*content_len)
+        {
+            *content_buf = b + start;
+            b[w] = '\0';
         }
-        if (!off)
+        else
             *content_buf = 0;
-        *content_len = off;
     }
     else
     {
-        if (i > o->size)
+        if (i > n)
         {
             o->error = OHTTP;
             return 0;
         }
-        else if (i == o->size)
+        else if (i == n)
         {
             *content_buf = 0;
             *content_len = 0;
         }
         else
         {
-            *content_len = o->size - i;
-            *content_buf = (char*) odr_malloc(o, *content_len + 1);
-            memcpy(*content_buf, o->buf + i, *content_len);
-            (*content_buf)[*content_len] = '\0';
+            *content_len = n - i;
+            *content_buf = b + i;
+        }
+    }
+#if HAVE_ZLIB
+    if (coding_hp && *content_buf
+        && (!strcasecmp((*coding_hp)->value, "gzip")
+            || !strcasecmp((*coding_hp)->value, "x-gzip")
+            || !strcasecmp((*coding_hp)->value, "deflate")))
+    {   /* decode transparently: caller sees the identity body */
+        if (!inflate_content(o, (*coding_hp)->value,
+                             content_buf, content_len))
+        {
+            o->error = OHTTP;
+            return 0;
+        }
+        *coding_hp = (*coding_hp)->next;
+        if (length_h)
+        {
+            length_h->value = (char *) odr_malloc(o, 20);
+            sprintf(length_h->value, "%d", *content_len);
         }
     }
+#endif
     return 1;
 }
 
@@ -198,16 +395,88 @@ void z_HTTP_header_add_basic_auth(ODR o, Z_HTTP_Header **hp,
 void z_HTTP_header_add(ODR o, Z_HTTP_Header **hp, const char *n,
                        const char *v)
 {
+    const char *known;
+
     while (*hp)
         hp = &(*hp)->next;
     *hp = (Z_HTTP_Header *) odr_malloc(o, sizeof(**hp));
-    (*hp)->name = odr_strdup(o, n);
+    known = http_header_canonical(http_header_index(n, strlen(n)));
+    (*hp)->name = known ? (char *) known : odr_strdup(o, n);
     (*hp)->value = odr_strdup(o, v);
     (*hp)->next = 0;
 }
 
+void z_HTTP_header_add_accept_encoding(ODR o, Z_HTTP_Header **hp)
+{
+#if HAVE_ZLIB
+    z_HTTP_header_add(o, hp, "Accept-Encoding", "gzip, deflate");
+#endif
+}
+
+int yaz_http_response_compress(ODR o, Z_HTTP_Response *hr,
+                               const char *accept_encoding, int level)
+{
+#if HAVE_ZLIB
+    const char *coding;
+    int window_bits;
+    z_stream zs;
+    uLong bound;
+    char *buf;
+    int ret;
+
+    if (!hr->content_buf || hr->content_len <= 0 || !accept_encoding
+        || z_HTTP_header_lookup(hr->headers, "Content-Encoding"))
+        return 0;
+    if (coding_accepted(accept_encoding, "gzip"))
+    {
+        coding = "gzip";
+        window_bits = MAX_WBITS + 16;
+    }
+    else if (coding_accepted(accept_encoding, "deflate"))
+    {
+        coding = "deflate";
+        window_bits = MAX_WBITS;
+    }
+    else
+        return 0;
+    memset(&zs, 0, sizeof(zs));
+    if (deflateInit2(&zs, level, Z_DEFLATED, window_bits, 8,
+                     Z_DEFAULT_STRATEGY) != Z_OK)
+        return 0;
+    bound = deflateBound(&zs, hr->content_len);
+    buf = (char *) odr_malloc(o, bound);
+    zs.next_in = (Bytef *) hr->content_buf;
+    zs.avail_in = hr->content_len;
+    zs.next_out = (Bytef *) buf;
+    zs.avail_out = bound;
+    ret = deflate(&zs, Z_FINISH);
+    deflateEnd(&zs);
+    /* keep the original if it did not shrink */
+    if (ret != Z_STREAM_END || zs.total_out >= (uLong) hr->content_len)
+        return 0;
+    hr->content_buf = buf;
+    hr->content_len = (int) zs.total_out;
+    z_HTTP_header_add(o, &hr->headers, "Content-Encoding", coding);
+    return 1;
+#else
+    return 0;
+#endif
+}
+
 const char *z_HTTP_header_lookup(const Z_HTTP_Header *hp, const char *n)
 {
+    /* headers with a well-known name share the table string, so for
+       those a miss needs no string compare */
+    const char *known =
+        http_header_canonical(http_header_index(n, strlen(n)));
+
+    if (known)
+    {
+        for (; hp; hp = hp->next)
+            if (hp->name == known)
+                return hp->value;
+        return 0;
+    }
     for (; hp; hp = hp->next)
         if (!yaz_matchstr(hp->name, n))
             return hp->value;
@@ -325,7 +594,7 @@ Z_GDU *z_get_HTTP_Response(ODR o, int code)
     hres->version = "1.1";
     z_HTTP_header_add(o, &hres->headers, "Server",
                       "YAZ/" YAZ_VERSION);
-    if (code != 200)
+    if (code != 200 && code != 304)
     {
         hres->content_buf = (char*) odr_malloc(o, 400);
         sprintf(hres->content_buf,
@@ -353,6 +622,8 @@ const char *z_HTTP_errmsg(int code)
 {
     if (code == 200)
         return "OK";
+    else if (code == 304)
+        return "Not Modified";
     else if (code == 400)
         return "Bad Request";
     else if (code == 404)
@@ -361,6 +632,8 @@ const char *z_HTTP_errmsg(int code)
         return "Method Not Allowed";
     else if (code == 500)
         return "Internal Error";
+    else if (code == 503)
+        return "Service Unavailable";
     else
         return "Unknown Error";
 }
@@ -463,9 +736,9 @@ int yaz_encode_http_response(ODR o, Z_HTTP_Response *hr)
             hr->code,
             z_HTTP_errmsg(hr->code));
     odr_write(o, (unsigned char *) sbuf, strlen(sbuf));
-    /* apply Content-Length if not already applied */
-    if (!z_HTTP_header_lookup(hr->headers,
-                              "Content-Length"))
+    /* apply Content-Length if not already applied (304 has no body) */
+    if (hr->code != 304 && !z_HTTP_header_lookup(hr->headers,
+                                                 "Content-Length"))
     {
         char lstr[60];
         sprintf(lstr, "Content-Length: %d\r\n",
@@ -21,22 +21,111 @@
 #include <yaz/marcdisp.h>
 #include <yaz/wrbuf.h>
 #include <yaz/yaz-util.h>
+#include "marcdisp-p.h"
 
-int yaz_marc_read_iso2709(yaz_marc_t mt, const char *buf, int bsize)
+/*
+ * Delimiters RS, FS and IDFS are the only control characters expected
+ * in MARC data. The scanners below test a machine word at a time for
+ * bytes below 0x20 and only look at single bytes of a word containing
+ * one. Unaligned loads go through memcpy, which compilers turn into a
+ * plain load.
+ */
+typedef unsigned long marc_word_t;
+
+#define WORD_ONES (~(marc_word_t) 0 / 255)
+#define WORD_HIGH (WORD_ONES * 0x80)
+#define WORD_HAS_CONTROL(x) (((x) - WORD_ONES * 0x20) & ~(x) & WORD_HIGH)
+
+/* returns offset of first RS or FS (and IDFS if idfs is set) in
+   buf[i..end), or end if there is none */
+static int scan_delimiter(const char *buf, int i, int end, int idfs)
+{
+    for (;;)
+    {
+        while (i + (int) sizeof(marc_word_t) <= end)
+        {
+            marc_word_t w;
+            memcpy(&w, buf + i, sizeof(w));
+            if (WORD_HAS_CONTROL(w))
+                break;
+            i += sizeof(w);
+        }
+        if (i >= end)
+            return end;
+        /* word with control character, or tail: byte by byte */
+        {
+            int stop = i + (int) sizeof(marc_word_t);
+            if (stop > end)
+                stop = end;
+            for (; i < stop; i++)
+                if (buf[i] == ISO2709_RS || buf[i] == ISO2709_FS
+                    || (idfs && buf[i] == ISO2709_IDFS))
+                    return i;
+        }
+    }
+}
+
+/* decodes n digits; returns 0 if one of them is not a digit */
+static int decode_digits(const char *buf, int n, int *val)
+{
+    int v = 0;
+
+    while (--n >= 0)
+    {
+        unsigned d = (unsigned char) *buf++ - '0';
+        if (d > 9)
+            return 0;
+        v = v * 10 + d;
+    }
+    *val = v;
+    return 1;
+}
+
+struct marc_dir_entry {
+    const char *tag;
+    int data_length;
+    int data_offset;
+    int entry_p;
+};
+
+int yaz_marc_iso2709_split(const char *buf, size_t size)
+{
+    int record_length;
+    const char *rs;
+
+    if (size < 5)
+        return 0;
+    if (!decode_digits(buf, 5, &record_length) || record_length < 25)
+        return -1;
+    if ((size_t) record_length > size)
+        return 0;
+    if (buf[record_length - 1] == ISO2709_RS)
+        return record_length;
+    /* length is off; record continues to next RS */
+    rs = (const char *) memchr(buf + record_length, ISO2709_RS,
+                               size - record_length);
+    if (!rs)
+        return 0;
+    return rs - buf + 1;
+}
+
+static int marc_read_iso2709(yaz_marc_t mt, const char *buf, int bsize)
 {
     int entry_p;
     int record_length;
     int indicator_length;
     int identifier_length;
-    int end_of_directory;
     int base_address;
     int length_data_entry;
     int length_starting;
     int length_implementation;
+    int entry_length;
+    int no_entries, max_entries, k;
+    struct marc_dir_entry *entries;
 
     yaz_marc_reset(mt);
 
-    if (!atoi_n_check(buf, 5, &record_length))
+    if (!decode_digits(buf, 5, &record_length))
     {
         yaz_marc_cprintf(mt, "Bad leader");
         return -1;
@@ -64,12 +153,17 @@ int yaz_marc_read_iso2709(yaz_marc_t mt, const char *buf, int bsize)
                         &length_starting,
                         &length_implementation);
 
-    /* First pass. determine length of directory & base of data */
+    /* Directory: validate and decode each entry once */
+    entry_length = 3 + length_data_entry + length_starting;
+    max_entries = (record_length - 24) / entry_length + 1;
+    entries = (struct marc_dir_entry *)
+        nmem_malloc(yaz_marc_get_nmem(mt), max_entries * sizeof(*entries));
+    no_entries = 0;
     for (entry_p = 24; buf[entry_p] != ISO2709_FS; )
     {
-        /* length of directory entry */
-        int l = 3 + length_data_entry + length_starting;
-        if (entry_p + l >= record_length)
+        struct marc_dir_entry *e = entries + no_entries;
+
+        if (entry_p + entry_length >= record_length)
         {
             yaz_marc_cprintf(mt, "Directory offset %d: end of record."
                              " Missing FS char", entry_p);
@@ -92,48 +186,43 @@ int yaz_marc_read_iso2709(yaz_marc_t mt, const char *buf, int bsize)
             wrbuf_destroy(hex);
         }
         /* Check for digits in length+starting info */
-        while (--l >= 3)
-            if (!yaz_isdigit(buf[entry_p + l]))
-                break;
-        if (l >= 3)
+        if (!decode_digits(buf + entry_p + 3, length_data_entry,
+                           &e->data_length)
+            || !decode_digits(buf + entry_p + 3 + length_data_entry,
+                              length_starting, &e->data_offset))
         {
             WRBUF hex = wrbuf_alloc();
             /* Not all digits, so stop directory scan */
-            wrbuf_write_escaped(hex, buf + entry_p,
-                                length_data_entry + length_starting + 3);
+            wrbuf_write_escaped(hex, buf + entry_p, entry_length);
             yaz_marc_cprintf(mt, "Directory offset %d: Bad value for data"
                              " length and/or length starting (%s)", entry_p,
                              wrbuf_cstr(hex));
             wrbuf_destroy(hex);
             break;
         }
-        entry_p += 3 + length_data_entry + length_starting;
+        e->tag = buf + entry_p;
+        e->entry_p = entry_p;
+        no_entries++;
+        entry_p += entry_length;
     }
-    end_of_directory = entry_p;
     if (base_address != entry_p+1)
     {
         yaz_marc_cprintf(mt, "Base address not at end of directory,"
                          " base %d, end %d", base_address, entry_p+1);
     }
 
-    /* Second pass. parse control - and datafields */
-    for (entry_p = 24; entry_p != end_of_directory; )
+    /* Parse control - and datafields */
+    for (k = 0; k < no_entries; k++)
     {
-        int data_length;
-        int data_offset;
+        int data_length = entries[k].data_length;
+        int data_offset = entries[k].data_offset;
         int end_offset;
         int i;
         char tag[4];
         int identifier_flag = 0;
-        int entry_p0 = entry_p;
 
-        memcpy (tag, buf+entry_p, 3);
-        entry_p += 3;
+        memcpy(tag, entries[k].tag, 3);
         tag[3] = '\0';
-        data_length = atoi_n(buf+entry_p, length_data_entry);
-        entry_p += length_data_entry;
-        data_offset = atoi_n(buf+entry_p, length_starting);
-        entry_p += length_starting;
         i = data_offset + base_address;
         end_offset = i+data_length-1;
 
@@ -144,12 +233,12 @@ int yaz_marc_read_iso2709(yaz_marc_t mt, const char *buf, int bsize)
         {
             yaz_marc_cprintf(mt, "Tag: %s. Directory offset %d: data-length %d,"
                              " data-offset %d",
-                             tag, entry_p0, data_length, data_offset);
+                             tag, entries[k].entry_p, data_length, data_offset);
         }
         if (end_offset >= record_length)
         {
             yaz_marc_cprintf(mt, "Directory offset %d: Data out of bounds %d >= %d",
-                             entry_p0, end_offset, record_length);
+                             entries[k].entry_p, end_offset, record_length);
             break;
         }
 
@@ -191,11 +280,7 @@ int yaz_marc_read_iso2709(yaz_marc_t mt, const char *buf, int bsize)
             {
                 int code_offset = i+1;
 
-                i ++;
-                while (i < end_offset &&
-                        buf[i] != ISO2709_RS && buf[i] != ISO2709_IDFS &&
-                       buf[i] != ISO2709_FS)
-                    i++;
+                i = scan_delimiter(buf, i + 1, end_offset, 1);
                 if (i > code_offset)
                     yaz_marc_add_subfield(mt, buf+code_offset, i - code_offset);
             }
@@ -204,9 +289,7 @@ int yaz_marc_read_iso2709(yaz_marc_t mt, const char *buf, int bsize)
         {
             /* controlfield */
             int i0 = i;
-            while (i < end_offset &&
-                buf[i] != ISO2709_RS && buf[i] != ISO2709_FS)
-                i++;
+            i = scan_delimiter(buf, i, end_offset, 0);
             yaz_marc_add_controlfield(mt, tag, buf+i0, i-i0);
         }
         if (i < end_offset)
@@ -223,6 +306,16 @@ int yaz_marc_read_iso2709(yaz_marc_t mt, const char *buf, int bsize)
     return record_length;
 }
 
+int yaz_marc_read_iso2709(yaz_marc_t mt, const char *buf, int bsize)
+{
+    int r;
+
+    yaz_marc_borrow_input(mt, 1);
+    r = marc_read_iso2709(mt, buf, bsize);
+    yaz_marc_borrow_input(mt, 0);
+    return r;
+}
+
 /*
  * Local variables:
  * c-basic-offset: 4
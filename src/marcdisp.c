@@ -46,40 +46,27 @@ enum YAZ_MARC_NODE_TYPE
     YAZ_MARC_LEADER
 };
 
-/** \brief represets a data field */
-struct yaz_marc_datafield {
-    char *tag;
-    char *indicator;
-    struct yaz_marc_subfield *subfields;
-};
+/** \brief MARC node: one entry of the field table
 
-/** \brief represents a control field */
-struct yaz_marc_controlfield {
-    char *tag;
-    char *data;
-};
-
-/** \brief a comment node */
-struct yaz_marc_comment {
-    char *comment;
-};
-
-/** \brief MARC node */
+    Data is given by pointer and length; it lives in the NMEM of the
+    handle or, when input is borrowed, in the buffer given to
+    yaz_marc_read_iso2709. Tags of up to 3 characters are kept in the
+    node itself.
+*/
 struct yaz_marc_node {
     enum YAZ_MARC_NODE_TYPE which;
-    union {
-        struct yaz_marc_datafield datafield;
-        struct yaz_marc_controlfield controlfield;
-        char *comment;
-        char *leader;
-    } u;
-    struct yaz_marc_node *next;
+    char tag_buf[4];
+    const char *tag;      /* longer tag or 0 for tag_buf */
+    const char *data;     /* controlfield data, indicator, comment, leader */
+    size_t data_len;
+    int subfields;        /* datafield: first entry in subfield table */
+    int no_subfields;
 };
 
-/** \brief represents a subfield */
+/** \brief represents a subfield: code followed by data */
 struct yaz_marc_subfield {
-    char *code_data;
-    struct yaz_marc_subfield *next;
+    const char *code_data;
+    size_t len;
 };
 
 /** \brief the internals of a yaz_marc_t handle */
@@ -89,14 +76,20 @@ struct yaz_marc_t_ {
     int output_format;
     int debug;
     int write_using_libxml2;
+    int reference_input;
+    int borrow_input;
     enum yaz_collection_state enable_collection;
     yaz_iconv_t iconv_cd;
     char subfield_str[8];
     char endline_str[8];
     char *leader_spec;
     struct yaz_marc_node *nodes;
-    struct yaz_marc_node **nodes_pp;
-    struct yaz_marc_subfield **subfield_pp;
+    int no_nodes;
+    int max_nodes;
+    struct yaz_marc_subfield *subfields;
+    int no_subfields;
+    int max_subfields;
+    int datafield;        /* node that subfields are added to; -1 for none */
 };
 
 yaz_marc_t yaz_marc_create(void)
@@ -105,6 +98,8 @@ yaz_marc_t yaz_marc_create(void)
     mt->output_format = YAZ_MARC_LINE;
     mt->debug = 0;
     mt->write_using_libxml2 = 0;
+    mt->reference_input = 0;
+    mt->borrow_input = 0;
     mt->enable_collection = no_collection;
     mt->m_wr = wrbuf_alloc();
     mt->iconv_cd = 0;
@@ -113,6 +108,10 @@ yaz_marc_t yaz_marc_create(void)
     strcpy(mt->endline_str, "\n");
 
     mt->nmem = nmem_create();
+    mt->nodes = 0;
+    mt->max_nodes = 0;
+    mt->subfields = 0;
+    mt->max_subfields = 0;
     yaz_marc_reset(mt);
     return mt;
 }
@@ -124,6 +123,8 @@ void yaz_marc_destroy(yaz_marc_t mt)
     nmem_destroy(mt->nmem);
     wrbuf_destroy(mt->m_wr);
     xfree(mt->leader_spec);
+    xfree(mt->nodes);
+    xfree(mt->subfields);
     xfree(mt);
 }
 
@@ -146,33 +147,74 @@ static int yaz_marc_write_xml_turbo_xml(yaz_marc_t mt, xmlNode **root_ptr,
                                         const char *type);
 #endif
 
-static struct yaz_marc_node *yaz_marc_add_node(yaz_marc_t mt)
+static struct yaz_marc_node *yaz_marc_add_node(yaz_marc_t mt,
+                                               enum YAZ_MARC_NODE_TYPE which)
 {
-    struct yaz_marc_node *n = (struct yaz_marc_node *)
-        nmem_malloc(mt->nmem, sizeof(*n));
-    n->next = 0;
-    *mt->nodes_pp = n;
-    mt->nodes_pp = &n->next;
+    struct yaz_marc_node *n;
+
+    if (mt->no_nodes == mt->max_nodes)
+    {
+        mt->max_nodes = mt->max_nodes ? 2 * mt->max_nodes : 64;
+        mt->nodes = (struct yaz_marc_node *)
+            xrealloc(mt->nodes, mt->max_nodes * sizeof(*mt->nodes));
+    }
+    n = mt->nodes + mt->no_nodes++;
+    n->which = which;
+    n->tag = 0;
+    n->data = 0;
+    n->data_len = 0;
     return n;
 }
 
+static void node_set_tag(yaz_marc_t mt, struct yaz_marc_node *n,
+                         const char *tag)
+{
+    size_t len = strlen(tag);
+
+    if (len < sizeof(n->tag_buf))
+        memcpy(n->tag_buf, tag, len + 1);
+    else
+        n->tag = nmem_strdup(mt->nmem, tag);
+}
+
+static const char *node_tag(const struct yaz_marc_node *n)
+{
+    return n->tag ? n->tag : n->tag_buf;
+}
+
+/* data as given when borrowing input; a NMEM copy otherwise */
+static const char *marc_data(yaz_marc_t mt, const char *data, size_t len)
+{
+    if (mt->borrow_input)
+        return data;
+    return nmem_strdupn(mt->nmem, data, len);
+}
+
+static void marc_start_datafield(yaz_marc_t mt, struct yaz_marc_node *n)
+{
+    n->subfields = mt->no_subfields;
+    n->no_subfields = 0;
+    /* make this the current (last one) */
+    mt->datafield = n - mt->nodes;
+}
+
 #if YAZ_HAVE_XML2
 void yaz_marc_add_controlfield_xml(yaz_marc_t mt, const xmlNode *ptr_tag,
                                    const xmlNode *ptr_data)
 {
-    struct yaz_marc_node *n = yaz_marc_add_node(mt);
-    n->which = YAZ_MARC_CONTROLFIELD;
-    n->u.controlfield.tag = nmem_text_node_cdata(ptr_tag, mt->nmem);
-    n->u.controlfield.data = nmem_text_node_cdata(ptr_data, mt->nmem);
+    struct yaz_marc_node *n = yaz_marc_add_node(mt, YAZ_MARC_CONTROLFIELD);
+    n->tag = nmem_text_node_cdata(ptr_tag, mt->nmem);
+    n->data = nmem_text_node_cdata(ptr_data, mt->nmem);
+    n->data_len = strlen(n->data);
 }
 
 void yaz_marc_add_controlfield_xml2(yaz_marc_t mt, char *tag,
                                     const xmlNode *ptr_data)
 {
-    struct yaz_marc_node *n = yaz_marc_add_node(mt);
-    n->which = YAZ_MARC_CONTROLFIELD;
-    n->u.controlfield.tag = tag;
-    n->u.controlfield.data = nmem_text_node_cdata(ptr_data, mt->nmem);
+    struct yaz_marc_node *n = yaz_marc_add_node(mt, YAZ_MARC_CONTROLFIELD);
+    n->tag = tag;
+    n->data = nmem_text_node_cdata(ptr_data, mt->nmem);
+    n->data_len = strlen(n->data);
 }
 
 #endif
@@ -180,9 +222,9 @@ void yaz_marc_add_controlfield_xml2(yaz_marc_t mt, char *tag,
 
 void yaz_marc_add_comment(yaz_marc_t mt, char *comment)
 {
-    struct yaz_marc_node *n = yaz_marc_add_node(mt);
-    n->which = YAZ_MARC_COMMENT;
-    n->u.comment = nmem_strdup(mt->nmem, comment);
+    struct yaz_marc_node *n = yaz_marc_add_node(mt, YAZ_MARC_COMMENT);
+    n->data = nmem_strdup(mt->nmem, comment);
+    n->data_len = strlen(comment);
 }
 
 void yaz_marc_cprintf(yaz_marc_t mt, const char *fmt, ...)
@@ -203,19 +245,21 @@ int yaz_marc_get_debug(yaz_marc_t mt)
 
 void yaz_marc_add_leader(yaz_marc_t mt, const char *leader, size_t leader_len)
 {
-    struct yaz_marc_node *n = yaz_marc_add_node(mt);
-    n->which = YAZ_MARC_LEADER;
-    n->u.leader = nmem_strdupn(mt->nmem, leader, leader_len);
-    marc_exec_leader(mt->leader_spec, n->u.leader, leader_len);
+    struct yaz_marc_node *n = yaz_marc_add_node(mt, YAZ_MARC_LEADER);
+    /* always a copy: leader may be modified */
+    char *copy = nmem_strdupn(mt->nmem, leader, leader_len);
+    n->data = copy;
+    n->data_len = leader_len;
+    marc_exec_leader(mt->leader_spec, copy, leader_len);
 }
 
 void yaz_marc_add_controlfield(yaz_marc_t mt, const char *tag,
                                const char *data, size_t data_len)
 {
-    struct yaz_marc_node *n = yaz_marc_add_node(mt);
-    n->which = YAZ_MARC_CONTROLFIELD;
-    n->u.controlfield.tag = nmem_strdup(mt->nmem, tag);
-    n->u.controlfield.data = nmem_strdupn(mt->nmem, data, data_len);
+    struct yaz_marc_node *n = yaz_marc_add_node(mt, YAZ_MARC_CONTROLFIELD);
+    node_set_tag(mt, n, tag);
+    n->data = marc_data(mt, data, data_len);
+    n->data_len = data_len;
     if (mt->debug)
     {
         size_t i;
@@ -233,15 +277,11 @@ void yaz_marc_add_controlfield(yaz_marc_t mt, const char *tag,
 void yaz_marc_add_datafield(yaz_marc_t mt, const char *tag,
                             const char *indicator, size_t indicator_len)
 {
-    struct yaz_marc_node *n = yaz_marc_add_node(mt);
-    n->which = YAZ_MARC_DATAFIELD;
-    n->u.datafield.tag = nmem_strdup(mt->nmem, tag);
-    n->u.datafield.indicator =
-        nmem_strdupn(mt->nmem, indicator, indicator_len);
-    n->u.datafield.subfields = 0;
-
-    /* make subfield_pp the current (last one) */
-    mt->subfield_pp = &n->u.datafield.subfields;
+    struct yaz_marc_node *n = yaz_marc_add_node(mt, YAZ_MARC_DATAFIELD);
+    node_set_tag(mt, n, tag);
+    n->data = marc_data(mt, indicator, indicator_len);
+    n->data_len = indicator_len;
+    marc_start_datafield(mt, n);
 }
 
 /** \brief adds a attribute value to the element name if it is plain chars
@@ -252,7 +292,7 @@ void yaz_marc_add_datafield(yaz_marc_t mt, const char *tag,
 */
 static int element_name_append_attribute_value(
     yaz_marc_t mt, WRBUF buffer,
-    const char *attribute_name, char *code_data, size_t code_len)
+    const char *attribute_name, const char *code_data, size_t code_len)
 {
     /* TODO Map special codes to something possible for XML ELEMENT names */
 
@@ -268,7 +308,11 @@ static int element_name_append_attribute_value(
     }
     /* Add as attribute */
     if (encode && attribute_name)
-        wrbuf_printf(buffer, " %s=\"", attribute_name);
+    {
+        wrbuf_putc(buffer, ' ');
+        wrbuf_puts(buffer, attribute_name);
+        wrbuf_write(buffer, "=\"", 2);
+    }
 
     if (!encode || attribute_name)
         wrbuf_iconv_write_cdata(buffer, mt->iconv_cd, code_data, code_len);
@@ -276,7 +320,7 @@ static int element_name_append_attribute_value(
         success = -1;
 
     if (encode && attribute_name)
-        wrbuf_printf(buffer, "\""); /* return error if we couldn't handle it.*/
+        wrbuf_putc(buffer, '"'); /* return error if we couldn't handle it.*/
     return success;
 }
 
@@ -284,32 +328,26 @@ static int element_name_append_attribute_value(
 void yaz_marc_add_datafield_xml(yaz_marc_t mt, const xmlNode *ptr_tag,
                                 const char *indicator, size_t indicator_len)
 {
-    struct yaz_marc_node *n = yaz_marc_add_node(mt);
-    n->which = YAZ_MARC_DATAFIELD;
-    n->u.datafield.tag = nmem_text_node_cdata(ptr_tag, mt->nmem);
-    n->u.datafield.indicator =
-        nmem_strdupn(mt->nmem, indicator, indicator_len);
-    n->u.datafield.subfields = 0;
-
-    /* make subfield_pp the current (last one) */
-    mt->subfield_pp = &n->u.datafield.subfields;
+    struct yaz_marc_node *n = yaz_marc_add_node(mt, YAZ_MARC_DATAFIELD);
+    n->tag = nmem_text_node_cdata(ptr_tag, mt->nmem);
+    n->data = nmem_strdupn(mt->nmem, indicator, indicator_len);
+    n->data_len = indicator_len;
+    marc_start_datafield(mt, n);
 }
 
 void yaz_marc_add_datafield_xml2(yaz_marc_t mt, char *tag_value, char *indicators)
 {
-    struct yaz_marc_node *n = yaz_marc_add_node(mt);
-    n->which = YAZ_MARC_DATAFIELD;
-    n->u.datafield.tag = tag_value;
-    n->u.datafield.indicator = indicators;
-    n->u.datafield.subfields = 0;
-
-    /* make subfield_pp the current (last one) */
-    mt->subfield_pp = &n->u.datafield.subfields;
+    struct yaz_marc_node *n = yaz_marc_add_node(mt, YAZ_MARC_DATAFIELD);
+    n->tag = tag_value;
+    n->data = indicators;
+    n->data_len = indicators ? strlen(indicators) : 0;
+    marc_start_datafield(mt, n);
 }
 
 void yaz_marc_datafield_set_indicators(struct yaz_marc_node *n, char *indicator)
 {
-    n->u.datafield.indicator = indicator;
+    n->data = indicator;
+    n->data_len = indicator ? strlen(indicator) : 0;
 }
 
 #endif
@@ -330,15 +368,22 @@ void yaz_marc_add_subfield(yaz_marc_t mt,
         yaz_marc_add_comment(mt, msg);
     }
 
-    if (mt->subfield_pp)
+    if (mt->datafield >= 0)
     {
-        struct yaz_marc_subfield *n = (struct yaz_marc_subfield *)
-            nmem_malloc(mt->nmem, sizeof(*n));
-        n->code_data = nmem_strdupn(mt->nmem, code_data, code_data_len);
-        n->next = 0;
-        /* mark subfield_pp to point to this one, so we append here next */
-        *mt->subfield_pp = n;
-        mt->subfield_pp = &n->next;
+        struct yaz_marc_subfield *s;
+
+        if (mt->no_subfields == mt->max_subfields)
+        {
+            mt->max_subfields = mt->max_subfields ?
+                2 * mt->max_subfields : 128;
+            mt->subfields = (struct yaz_marc_subfield *)
+                xrealloc(mt->subfields,
+                         mt->max_subfields * sizeof(*mt->subfields));
+        }
+        s = mt->subfields + mt->no_subfields++;
+        s->code_data = marc_data(mt, code_data, code_data_len);
+        s->len = code_data_len;
+        mt->nodes[mt->datafield].no_subfields++;
     }
 }
 
@@ -448,12 +493,12 @@ void yaz_marc_endline_str(yaz_marc_t mt, const char *s)
 }
 
 /* try to guess how many bytes the identifier really is! */
-static size_t cdata_one_character(yaz_marc_t mt, const char *buf)
+static size_t cdata_one_character(yaz_marc_t mt, const char *buf, size_t len)
 {
     if (mt->iconv_cd)
     {
         size_t i;
-        for (i = 1; i<5; i++)
+        for (i = 1; i<5 && i <= len; i++)
         {
             char outbuf[12];
             size_t outbytesleft = sizeof(outbuf);
@@ -474,36 +519,50 @@ static size_t cdata_one_character(yaz_marc_t mt, const char *buf)
 void yaz_marc_reset(yaz_marc_t mt)
 {
     nmem_reset(mt->nmem);
-    mt->nodes = 0;
-    mt->nodes_pp = &mt->nodes;
-    mt->subfield_pp = 0;
+    mt->no_nodes = 0;
+    mt->no_subfields = 0;
+    mt->datafield = -1;
+}
+
+void yaz_marc_reference_input(yaz_marc_t mt, int enable)
+{
+    mt->reference_input = enable;
+}
+
+void yaz_marc_borrow_input(yaz_marc_t mt, int enable)
+{
+    mt->borrow_input = enable && mt->reference_input;
+}
+
+/* returns first leader or 0 if there is none */
+static const char *marc_leader(yaz_marc_t mt)
+{
+    int i;
+
+    for (i = 0; i < mt->no_nodes; i++)
+        if (mt->nodes[i].which == YAZ_MARC_LEADER)
+            return mt->nodes[i].data;
+    return 0;
 }
 
 int yaz_marc_write_check(yaz_marc_t mt, WRBUF wr)
 {
-    struct yaz_marc_node *n;
+    int i;
     int identifier_length;
-    const char *leader = 0;
-
-    for (n = mt->nodes; n; n = n->next)
-        if (n->which == YAZ_MARC_LEADER)
-        {
-            leader = n->u.leader;
-            break;
-        }
+    const char *leader = marc_leader(mt);
 
     if (!leader)
         return -1;
     if (!atoi_n_check(leader+11, 1, &identifier_length))
         return -1;
 
-    for (n = mt->nodes; n; n = n->next)
+    for (i = 0; i < mt->no_nodes; i++)
     {
+        struct yaz_marc_node *n = mt->nodes + i;
         switch(n->which)
         {
         case YAZ_MARC_COMMENT:
-            wrbuf_iconv_write(wr, mt->iconv_cd,
-                              n->u.comment, strlen(n->u.comment));
+            wrbuf_iconv_write(wr, mt->iconv_cd, n->data, n->data_len);
             wrbuf_puts(wr, "\n");
             break;
         default:
@@ -513,75 +572,76 @@ int yaz_marc_write_check(yaz_marc_t mt, WRBUF wr)
     return 0;
 }
 
-static size_t get_subfield_len(yaz_marc_t mt, const char *data,
+static size_t get_subfield_len(yaz_marc_t mt,
+                               const struct yaz_marc_subfield *s,
                                int identifier_length)
 {
+    size_t len;
     /* if identifier length is 2 (most MARCs) or less (probably an error),
        the code is a single character .. However we've
        seen multibyte codes, so see how big it really is */
     if (identifier_length > 2)
-        return identifier_length - 1;
+        len = identifier_length - 1;
     else
-        return cdata_one_character(mt, data);
+        len = cdata_one_character(mt, s->code_data, s->len);
+    return len < s->len ? len : s->len;
 }
 
 int yaz_marc_write_line(yaz_marc_t mt, WRBUF wr)
 {
-    struct yaz_marc_node *n;
+    int i;
     int identifier_length;
-    const char *leader = 0;
-
-    for (n = mt->nodes; n; n = n->next)
-        if (n->which == YAZ_MARC_LEADER)
-        {
-            leader = n->u.leader;
-            break;
-        }
+    const char *leader = marc_leader(mt);
 
     if (!leader)
         return -1;
     if (!atoi_n_check(leader+11, 1, &identifier_length))
         return -1;
 
-    for (n = mt->nodes; n; n = n->next)
+    for (i = 0; i < mt->no_nodes; i++)
     {
-        struct yaz_marc_subfield *s;
+        struct yaz_marc_node *n = mt->nodes + i;
+        struct yaz_marc_subfield *s = mt->subfields + n->subfields;
+        int j;
+
         switch(n->which)
         {
         case YAZ_MARC_DATAFIELD:
-            wrbuf_printf(wr, "%s %s", n->u.datafield.tag,
-                         n->u.datafield.indicator);
-            for (s = n->u.datafield.subfields; s; s = s->next)
+            wrbuf_puts(wr, node_tag(n));
+            wrbuf_putc(wr, ' ');
+            wrbuf_write(wr, n->data, n->data_len);
+            for (j = 0; j < n->no_subfields; j++, s++)
             {
-                size_t using_code_len = get_subfield_len(mt, s->code_data,
+                size_t using_code_len = get_subfield_len(mt, s,
                                                          identifier_length);
 
                 wrbuf_puts (wr, mt->subfield_str);
                 wrbuf_iconv_write(wr, mt->iconv_cd, s->code_data,
                                   using_code_len);
                 wrbuf_iconv_puts(wr, mt->iconv_cd, " ");
-                wrbuf_iconv_puts(wr, mt->iconv_cd,
-                                 s->code_data + using_code_len);
+                wrbuf_iconv_write(wr, mt->iconv_cd,
+                                  s->code_data + using_code_len,
+                                  s->len - using_code_len);
                 marc_iconv_reset(mt, wr);
             }
             wrbuf_puts (wr, mt->endline_str);
             break;
         case YAZ_MARC_CONTROLFIELD:
-            wrbuf_printf(wr, "%s", n->u.controlfield.tag);
+            wrbuf_puts(wr, node_tag(n));
             wrbuf_iconv_puts(wr, mt->iconv_cd, " ");
-            wrbuf_iconv_puts(wr, mt->iconv_cd, n->u.controlfield.data);
+            wrbuf_iconv_write(wr, mt->iconv_cd, n->data, n->data_len);
             marc_iconv_reset(mt, wr);
             wrbuf_puts (wr, mt->endline_str);
             break;
         case YAZ_MARC_COMMENT:
             wrbuf_puts(wr, "(");
-            wrbuf_iconv_write(wr, mt->iconv_cd,
-                              n->u.comment, strlen(n->u.comment));
+            wrbuf_iconv_write(wr, mt->iconv_cd, n->data, n->data_len);
             marc_iconv_reset(mt, wr);
             wrbuf_puts(wr, ")\n");
             break;
         case YAZ_MARC_LEADER:
-            wrbuf_printf(wr, "%s\n", n->u.leader);
+            wrbuf_write(wr, n->data, n->data_len);
+            wrbuf_putc(wr, '\n');
         }
     }
     wrbuf_puts(wr, "\n");
@@ -648,22 +708,39 @@ static const char *subfield_name[2]  	= { "subfield", "s"};
     \retval 0 OK
     \retval -1 failure
 */
+/* writes "<name" or "</name" */
+static void marcxml_start_tag(WRBUF wr, const char *indent, int end,
+                              const char *name)
+{
+    wrbuf_puts(wr, indent);
+    if (end)
+        wrbuf_write(wr, "</", 2);
+    else
+        wrbuf_putc(wr, '<');
+    wrbuf_puts(wr, name);
+}
+
+/* writes ' name="value"' where value is at most 80 characters */
+static void marcxml_attr80(WRBUF wr, const char *name, const char *value)
+{
+    size_t len = strlen(value);
+
+    wrbuf_putc(wr, ' ');
+    wrbuf_puts(wr, name);
+    wrbuf_write(wr, "=\"", 2);
+    wrbuf_write(wr, value, len > 80 ? 80 : len);
+    wrbuf_putc(wr, '"');
+}
+
 static int yaz_marc_write_marcxml_wrbuf(yaz_marc_t mt, WRBUF wr,
                                         const char *ns,
                                         const char *format,
                                         const char *type,
                                         int turbo)
 {
-    struct yaz_marc_node *n;
+    int i;
     int identifier_length;
-    const char *leader = 0;
-
-    for (n = mt->nodes; n; n = n->next)
-        if (n->which == YAZ_MARC_LEADER)
-        {
-            leader = n->u.leader;
-            break;
-        }
+    const char *leader = marc_leader(mt);
 
     if (!leader)
         return -1;
@@ -674,55 +751,63 @@ static int yaz_marc_write_marcxml_wrbuf(yaz_marc_t mt, WRBUF wr,
     {
         if (mt->enable_collection == collection_first)
         {
-            wrbuf_printf(wr, "<collection xmlns=\"%s\">\n", ns);
+            wrbuf_puts(wr, "<collection xmlns=\"");
+            wrbuf_puts(wr, ns);
+            wrbuf_write(wr, "\">\n", 3);
             mt->enable_collection = collection_second;
         }
-        wrbuf_printf(wr, "<%s", record_name[turbo]);
+        marcxml_start_tag(wr, "", 0, record_name[turbo]);
     }
     else
     {
-        wrbuf_printf(wr, "<%s xmlns=\"%s\"", record_name[turbo], ns);
+        marcxml_start_tag(wr, "", 0, record_name[turbo]);
+        wrbuf_puts(wr, " xmlns=\"");
+        wrbuf_puts(wr, ns);
+        wrbuf_putc(wr, '"');
     }
     if (format)
-        wrbuf_printf(wr, " format=\"%.80s\"", format);
+        marcxml_attr80(wr, "format", format);
     if (type)
-        wrbuf_printf(wr, " type=\"%.80s\"", type);
-    wrbuf_printf(wr, ">\n");
-    for (n = mt->nodes; n; n = n->next)
+        marcxml_attr80(wr, "type", type);
+    wrbuf_write(wr, ">\n", 2);
+    for (i = 0; i < mt->no_nodes; i++)
     {
-        struct yaz_marc_subfield *s;
+        struct yaz_marc_node *n = mt->nodes + i;
+        struct yaz_marc_subfield *s = mt->subfields + n->subfields;
+        const char *tag = node_tag(n);
+        int j;
 
         switch(n->which)
         {
         case YAZ_MARC_DATAFIELD:
 
-            wrbuf_printf(wr, "  <%s", datafield_name[turbo]);
+            marcxml_start_tag(wr, "  ", 0, datafield_name[turbo]);
             if (!turbo)
-            	wrbuf_printf(wr, " tag=\"");
-            wrbuf_iconv_write_cdata(wr, mt->iconv_cd, n->u.datafield.tag,
-                                    strlen(n->u.datafield.tag));
+            	wrbuf_write(wr, " tag=\"", 6);
+            wrbuf_iconv_write_cdata(wr, mt->iconv_cd, tag, strlen(tag));
             if (!turbo)
-                wrbuf_printf(wr, "\"");
-    	    if (n->u.datafield.indicator)
-    	    {
-    	    	int i;
-    	    	for (i = 0; n->u.datafield.indicator[i]; i++)
-    	    	{
-                    wrbuf_printf(wr, " %s%d=\"", indicator_name[turbo], i+1);
-                    wrbuf_iconv_write_cdata(wr, mt->iconv_cd,
-                                            n->u.datafield.indicator+i, 1);
-                    wrbuf_iconv_puts(wr, mt->iconv_cd, "\"");
-                }
+                wrbuf_putc(wr, '"');
+            for (j = 0; j < (int) n->data_len; j++)
+            {
+                wrbuf_putc(wr, ' ');
+                wrbuf_puts(wr, indicator_name[turbo]);
+                if (j < 9)
+                    wrbuf_putc(wr, '1' + j);
+                else
+                    wrbuf_printf(wr, "%d", j+1);
+                wrbuf_write(wr, "=\"", 2);
+                wrbuf_iconv_write_cdata(wr, mt->iconv_cd, n->data+j, 1);
+                wrbuf_iconv_puts(wr, mt->iconv_cd, "\"");
             }
-            wrbuf_printf(wr, ">\n");
-            for (s = n->u.datafield.subfields; s; s = s->next)
+            wrbuf_write(wr, ">\n", 2);
+            for (j = 0; j < n->no_subfields; j++, s++)
             {
-                size_t using_code_len = get_subfield_len(mt, s->code_data,
+                size_t using_code_len = get_subfield_len(mt, s,
                                                          identifier_length);
-                wrbuf_printf(wr, "    <%s", subfield_name[turbo]);
+                marcxml_start_tag(wr, "    ", 0, subfield_name[turbo]);
                 if (!turbo)
                 {
-                    wrbuf_printf(wr, " code=\"");
+                    wrbuf_write(wr, " code=\"", 7);
                     wrbuf_iconv_write_cdata(wr, mt->iconv_cd,
                                             s->code_data, using_code_len);
                     wrbuf_iconv_puts(wr, mt->iconv_cd, "\">");
@@ -730,65 +815,62 @@ static int yaz_marc_write_marcxml_wrbuf(yaz_marc_t mt, WRBUF wr,
                 else
                 {
                     element_name_append_attribute_value(mt, wr, "code", s->code_data, using_code_len);
-                    wrbuf_puts(wr, ">");
+                    wrbuf_putc(wr, '>');
                 }
                 wrbuf_iconv_write_cdata(wr, mt->iconv_cd,
                                         s->code_data + using_code_len,
-                                        strlen(s->code_data + using_code_len));
+                                        s->len - using_code_len);
                 marc_iconv_reset(mt, wr);
-                wrbuf_printf(wr, "</%s", subfield_name[turbo]);
+                marcxml_start_tag(wr, "", 1, subfield_name[turbo]);
                 if (turbo)
                     element_name_append_attribute_value(mt, wr, 0, s->code_data, using_code_len);
-                wrbuf_puts(wr, ">\n");
+                wrbuf_write(wr, ">\n", 2);
             }
-            wrbuf_printf(wr, "  </%s", datafield_name[turbo]);
+            marcxml_start_tag(wr, "  ", 1, datafield_name[turbo]);
             /* TODO Not CDATA */
             if (turbo)
-            	wrbuf_iconv_write_cdata(wr, mt->iconv_cd, n->u.datafield.tag,
-                                        strlen(n->u.datafield.tag));
-            wrbuf_printf(wr, ">\n");
+            	wrbuf_iconv_write_cdata(wr, mt->iconv_cd, tag, strlen(tag));
+            wrbuf_write(wr, ">\n", 2);
             break;
         case YAZ_MARC_CONTROLFIELD:
-            wrbuf_printf(wr, "  <%s", controlfield_name[turbo]);
+            marcxml_start_tag(wr, "  ", 0, controlfield_name[turbo]);
             if (!turbo)
             {
-            	wrbuf_printf(wr, " tag=\"");
-                wrbuf_iconv_write_cdata(wr, mt->iconv_cd, n->u.controlfield.tag,
-        				strlen(n->u.controlfield.tag));
+            	wrbuf_write(wr, " tag=\"", 6);
+                wrbuf_iconv_write_cdata(wr, mt->iconv_cd, tag, strlen(tag));
                 wrbuf_iconv_puts(wr, mt->iconv_cd, "\">");
             }
             else
             {
                 /* TODO convert special */
-                wrbuf_iconv_write_cdata(wr, mt->iconv_cd, n->u.controlfield.tag,
-        				strlen(n->u.controlfield.tag));
+                wrbuf_iconv_write_cdata(wr, mt->iconv_cd, tag, strlen(tag));
                 wrbuf_iconv_puts(wr, mt->iconv_cd, ">");
             }
-            wrbuf_iconv_write_cdata(wr, mt->iconv_cd,
-                                    n->u.controlfield.data,
-                                    strlen(n->u.controlfield.data));
+            wrbuf_iconv_write_cdata(wr, mt->iconv_cd, n->data, n->data_len);
             marc_iconv_reset(mt, wr);
-            wrbuf_printf(wr, "</%s", controlfield_name[turbo]);
+            marcxml_start_tag(wr, "", 1, controlfield_name[turbo]);
             /* TODO convert special */
             if (turbo)
-                wrbuf_iconv_write_cdata(wr, mt->iconv_cd, n->u.controlfield.tag,
-    					strlen(n->u.controlfield.tag));
-            wrbuf_puts(wr, ">\n");
+                wrbuf_iconv_write_cdata(wr, mt->iconv_cd, tag, strlen(tag));
+            wrbuf_write(wr, ">\n", 2);
             break;
         case YAZ_MARC_COMMENT:
-            wrbuf_printf(wr, "<!-- ");
-            wrbuf_puts(wr, n->u.comment);
-            wrbuf_printf(wr, " -->\n");
+            wrbuf_write(wr, "<!-- ", 5);
+            wrbuf_write(wr, n->data, n->data_len);
+            wrbuf_write(wr, " -->\n", 5);
             break;
         case YAZ_MARC_LEADER:
-            wrbuf_printf(wr, "  <%s>", leader_name[turbo]);
+            marcxml_start_tag(wr, "  ", 0, leader_name[turbo]);
+            wrbuf_putc(wr, '>');
             wrbuf_iconv_write_cdata(wr,
                                     0 , /* no charset conversion for leader */
-                                    n->u.leader, strlen(n->u.leader));
-            wrbuf_printf(wr, "</%s>\n", leader_name[turbo]);
+                                    n->data, n->data_len);
+            marcxml_start_tag(wr, "", 1, leader_name[turbo]);
+            wrbuf_write(wr, ">\n", 2);
         }
     }
-    wrbuf_printf(wr, "</%s>\n", record_name[turbo]);
+    marcxml_start_tag(wr, "", 1, record_name[turbo]);
+    wrbuf_write(wr, ">\n", 2);
     return 0;
 }
 
@@ -869,38 +951,35 @@ void add_marc_datafield_turbo_xml(yaz_marc_t mt, struct yaz_marc_node *n,
                                   int identifier_length)
 {
     xmlNode *ptr;
-    struct yaz_marc_subfield *s;
+    struct yaz_marc_subfield *s = mt->subfields + n->subfields;
     WRBUF subfield_name = wrbuf_alloc();
+    int i;
 
     /* TODO consider if safe */
     char field[10];
     field[0] = 'd';
-    strncpy(field + 1, n->u.datafield.tag, 3);
+    memcpy(field + 1, node_tag(n), 3);
     field[4] = '\0';
     ptr = xmlNewChild(record_ptr, ns_record, BAD_CAST field, 0);
 
-    if (n->u.datafield.indicator)
+    for (i = 0; i < (int) n->data_len; i++)
     {
-        int i;
-        for (i = 0; n->u.datafield.indicator[i]; i++)
-        {
-            char ind_str[6];
-            char ind_val[2];
+        char ind_str[6];
+        char ind_val[2];
 
-            ind_val[0] = n->u.datafield.indicator[i];
-            ind_val[1] = '\0';
-            sprintf(ind_str, "%s%d", indicator_name[1], i+1);
-            xmlNewProp(ptr, BAD_CAST ind_str, BAD_CAST ind_val);
-        }
+        ind_val[0] = n->data[i];
+        ind_val[1] = '\0';
+        sprintf(ind_str, "%s%d", indicator_name[1], i+1);
+        xmlNewProp(ptr, BAD_CAST ind_str, BAD_CAST ind_val);
     }
-    for (s = n->u.datafield.subfields; s; s = s->next)
+    for (i = 0; i < n->no_subfields; i++, s++)
     {
         int not_written;
         xmlNode *ptr_subfield;
-        size_t using_code_len = get_subfield_len(mt, s->code_data,
-                                                 identifier_length);
+        size_t using_code_len = get_subfield_len(mt, s, identifier_length);
         wrbuf_rewind(wr_cdata);
-        wrbuf_iconv_puts(wr_cdata, mt->iconv_cd, s->code_data + using_code_len);
+        wrbuf_iconv_write(wr_cdata, mt->iconv_cd, s->code_data + using_code_len,
+                          s->len - using_code_len);
         marc_iconv_reset(mt, wr_cdata);
 
         wrbuf_rewind(subfield_name);
@@ -925,20 +1004,13 @@ static int yaz_marc_write_xml_turbo_xml(yaz_marc_t mt, xmlNode **root_ptr,
                                         const char *format,
                                         const char *type)
 {
-    struct yaz_marc_node *n;
+    int i;
     int identifier_length;
-    const char *leader = 0;
+    const char *leader = marc_leader(mt);
     xmlNode *record_ptr;
     xmlNsPtr ns_record;
     WRBUF wr_cdata = 0;
 
-    for (n = mt->nodes; n; n = n->next)
-        if (n->which == YAZ_MARC_LEADER)
-        {
-            leader = n->u.leader;
-            break;
-        }
-
     if (!leader)
         return -1;
     if (!atoi_n_check(leader+11, 1, &identifier_length))
@@ -956,8 +1028,9 @@ static int yaz_marc_write_xml_turbo_xml(yaz_marc_t mt, xmlNode **root_ptr,
         xmlNewProp(record_ptr, BAD_CAST "format", BAD_CAST format);
     if (type)
         xmlNewProp(record_ptr, BAD_CAST "type", BAD_CAST type);
-    for (n = mt->nodes; n; n = n->next)
+    for (i = 0; i < mt->no_nodes; i++)
     {
+        struct yaz_marc_node *n = mt->nodes + i;
         xmlNode *ptr;
 
         char field[10];
@@ -971,21 +1044,21 @@ static int yaz_marc_write_xml_turbo_xml(yaz_marc_t mt, xmlNode **root_ptr,
             break;
         case YAZ_MARC_CONTROLFIELD:
             wrbuf_rewind(wr_cdata);
-            wrbuf_iconv_puts(wr_cdata, mt->iconv_cd, n->u.controlfield.data);
+            wrbuf_iconv_write(wr_cdata, mt->iconv_cd, n->data, n->data_len);
             marc_iconv_reset(mt, wr_cdata);
 
-            strncpy(field + 1, n->u.controlfield.tag, 3);
+            memcpy(field + 1, node_tag(n), 3);
             ptr = xmlNewTextChild(record_ptr, ns_record,
                                   BAD_CAST field,
                                   BAD_CAST wrbuf_cstr(wr_cdata));
             break;
         case YAZ_MARC_COMMENT:
-            ptr = xmlNewComment(BAD_CAST n->u.comment);
+            ptr = xmlNewComment(BAD_CAST n->data);
             xmlAddChild(record_ptr, ptr);
             break;
         case YAZ_MARC_LEADER:
             xmlNewTextChild(record_ptr, ns_record, BAD_CAST "l",
-                            BAD_CAST n->u.leader);
+                            BAD_CAST n->data);
             break;
         }
     }
@@ -999,20 +1072,13 @@ int yaz_marc_write_xml(yaz_marc_t mt, xmlNode **root_ptr,
                        const char *format,
                        const char *type)
 {
-    struct yaz_marc_node *n;
+    int i;
     int identifier_length;
-    const char *leader = 0;
+    const char *leader = marc_leader(mt);
     xmlNode *record_ptr;
     xmlNsPtr ns_record;
     WRBUF wr_cdata = 0;
 
-    for (n = mt->nodes; n; n = n->next)
-        if (n->which == YAZ_MARC_LEADER)
-        {
-            leader = n->u.leader;
-            break;
-        }
-
     if (!leader)
         return -1;
     if (!atoi_n_check(leader+11, 1, &identifier_length))
@@ -1030,38 +1096,37 @@ int yaz_marc_write_xml(yaz_marc_t mt, xmlNode **root_ptr,
         xmlNewProp(record_ptr, BAD_CAST "format", BAD_CAST format);
     if (type)
         xmlNewProp(record_ptr, BAD_CAST "type", BAD_CAST type);
-    for (n = mt->nodes; n; n = n->next)
+    for (i = 0; i < mt->no_nodes; i++)
     {
-        struct yaz_marc_subfield *s;
+        struct yaz_marc_node *n = mt->nodes + i;
+        struct yaz_marc_subfield *s = mt->subfields + n->subfields;
         xmlNode *ptr;
+        int j;
 
         switch(n->which)
         {
         case YAZ_MARC_DATAFIELD:
             ptr = xmlNewChild(record_ptr, ns_record, BAD_CAST "datafield", 0);
-            xmlNewProp(ptr, BAD_CAST "tag", BAD_CAST n->u.datafield.tag);
-            if (n->u.datafield.indicator)
+            xmlNewProp(ptr, BAD_CAST "tag", BAD_CAST node_tag(n));
+            for (j = 0; j < (int) n->data_len; j++)
             {
-                int i;
-                for (i = 0; n->u.datafield.indicator[i]; i++)
-                {
-                    char ind_str[6];
-                    char ind_val[2];
+                char ind_str[6];
+                char ind_val[2];
 
-                    sprintf(ind_str, "ind%d", i+1);
-                    ind_val[0] = n->u.datafield.indicator[i];
-                    ind_val[1] = '\0';
-                    xmlNewProp(ptr, BAD_CAST ind_str, BAD_CAST ind_val);
-                }
+                sprintf(ind_str, "ind%d", j+1);
+                ind_val[0] = n->data[j];
+                ind_val[1] = '\0';
+                xmlNewProp(ptr, BAD_CAST ind_str, BAD_CAST ind_val);
             }
-            for (s = n->u.datafield.subfields; s; s = s->next)
+            for (j = 0; j < n->no_subfields; j++, s++)
             {
                 xmlNode *ptr_subfield;
-                size_t using_code_len = get_subfield_len(mt, s->code_data,
+                size_t using_code_len = get_subfield_len(mt, s,
                                                          identifier_length);
                 wrbuf_rewind(wr_cdata);
-                wrbuf_iconv_puts(wr_cdata, mt->iconv_cd,
-                                 s->code_data + using_code_len);
+                wrbuf_iconv_write(wr_cdata, mt->iconv_cd,
+                                  s->code_data + using_code_len,
+                                  s->len - using_code_len);
                 marc_iconv_reset(mt, wr_cdata);
                 ptr_subfield = xmlNewTextChild(
                     ptr, ns_record,
@@ -1076,22 +1141,22 @@ int yaz_marc_write_xml(yaz_marc_t mt, xmlNode **root_ptr,
             break;
         case YAZ_MARC_CONTROLFIELD:
             wrbuf_rewind(wr_cdata);
-            wrbuf_iconv_puts(wr_cdata, mt->iconv_cd, n->u.controlfield.data);
+            wrbuf_iconv_write(wr_cdata, mt->iconv_cd, n->data, n->data_len);
             marc_iconv_reset(mt, wr_cdata);
 
             ptr = xmlNewTextChild(record_ptr, ns_record,
                                   BAD_CAST "controlfield",
                                   BAD_CAST wrbuf_cstr(wr_cdata));
 
-            xmlNewProp(ptr, BAD_CAST "tag", BAD_CAST n->u.controlfield.tag);
+            xmlNewProp(ptr, BAD_CAST "tag", BAD_CAST node_tag(n));
             break;
         case YAZ_MARC_COMMENT:
-            ptr = xmlNewComment(BAD_CAST n->u.comment);
+            ptr = xmlNewComment(BAD_CAST n->data);
             xmlAddChild(record_ptr, ptr);
             break;
         case YAZ_MARC_LEADER:
             xmlNewTextChild(record_ptr, ns_record, BAD_CAST "leader",
-                            BAD_CAST n->u.leader);
+                            BAD_CAST n->data);
             break;
         }
     }
@@ -1103,7 +1168,7 @@ int yaz_marc_write_xml(yaz_marc_t mt, xmlNode **root_ptr,
 
 int yaz_marc_write_iso2709(yaz_marc_t mt, WRBUF wr)
 {
-    struct yaz_marc_node *n;
+    int i;
     int indicator_length;
     int identifier_length;
     int length_data_entry;
@@ -1111,12 +1176,13 @@ int yaz_marc_write_iso2709(yaz_marc_t mt, WRBUF wr)
     int length_implementation;
     int data_offset = 0;
     const char *leader = 0;
-    WRBUF wr_dir, wr_head, wr_data_tmp;
+    char *dir, *dir_p;
+    size_t start = wrbuf_len(wr);
     int base_address;
 
-    for (n = mt->nodes; n; n = n->next)
-        if (n->which == YAZ_MARC_LEADER)
-            leader = n->u.leader;
+    for (i = 0; i < mt->no_nodes; i++)
+        if (mt->nodes[i].which == YAZ_MARC_LEADER)
+            leader = mt->nodes[i].data;
 
     if (!leader)
         return -1;
@@ -1131,105 +1197,68 @@ int yaz_marc_write_iso2709(yaz_marc_t mt, WRBUF wr)
     if (!atoi_n_check(leader+22, 1, &length_implementation))
         return -1;
 
-    wr_data_tmp = wrbuf_alloc();
-    wr_dir = wrbuf_alloc();
-    for (n = mt->nodes; n; n = n->next)
+    /* leader + directory; room for numbers that exceed their width */
+    dir = (char *) nmem_malloc(mt->nmem, 24 + mt->no_nodes * (3 + 2 * 12) + 1);
+    dir_p = dir + 24;
+
+    /* data is written first; leader and directory are inserted after */
+    for (i = 0; i < mt->no_nodes; i++)
     {
-        int data_length = 0;
-        struct yaz_marc_subfield *s;
+        struct yaz_marc_node *n = mt->nodes + i;
+        struct yaz_marc_subfield *s = mt->subfields + n->subfields;
+        size_t field_start = wrbuf_len(wr);
+        int data_length, j;
 
         switch(n->which)
         {
         case YAZ_MARC_DATAFIELD:
-            wrbuf_printf(wr_dir, "%.3s", n->u.datafield.tag);
-            data_length += indicator_length;
-            wrbuf_rewind(wr_data_tmp);
-            for (s = n->u.datafield.subfields; s; s = s->next)
+            if ((int) n->data_len >= indicator_length)
+                wrbuf_write(wr, n->data, indicator_length);
+            else
             {
-                /* write dummy IDFS + content */
-                wrbuf_iconv_putchar(wr_data_tmp, mt->iconv_cd, ' ');
-                wrbuf_iconv_puts(wr_data_tmp, mt->iconv_cd, s->code_data);
-                marc_iconv_reset(mt, wr_data_tmp);
+                wrbuf_write(wr, n->data, n->data_len);
+                for (j = n->data_len; j < indicator_length; j++)
+                    wrbuf_putc(wr, ' ');
             }
-            /* write dummy FS (makes MARC-8 to become ASCII) */
-            wrbuf_iconv_putchar(wr_data_tmp, mt->iconv_cd, ' ');
-            marc_iconv_reset(mt, wr_data_tmp);
-            data_length += wrbuf_len(wr_data_tmp);
+            for (j = 0; j < n->no_subfields; j++, s++)
+            {
+                wrbuf_putc(wr, ISO2709_IDFS);
+                wrbuf_iconv_write(wr, mt->iconv_cd, s->code_data, s->len);
+                marc_iconv_reset(mt, wr);
+            }
+            wrbuf_putc(wr, ISO2709_FS);
             break;
         case YAZ_MARC_CONTROLFIELD:
-            wrbuf_printf(wr_dir, "%.3s", n->u.controlfield.tag);
-
-            wrbuf_rewind(wr_data_tmp);
-            wrbuf_iconv_puts(wr_data_tmp, mt->iconv_cd,
-                             n->u.controlfield.data);
-            marc_iconv_reset(mt, wr_data_tmp);
-            wrbuf_iconv_putchar(wr_data_tmp, mt->iconv_cd, ' ');/* field sep */
-            marc_iconv_reset(mt, wr_data_tmp);
-            data_length += wrbuf_len(wr_data_tmp);
-            break;
-        case YAZ_MARC_COMMENT:
-            break;
-        case YAZ_MARC_LEADER:
+            wrbuf_iconv_write(wr, mt->iconv_cd, n->data, n->data_len);
+            marc_iconv_reset(mt, wr);
+            wrbuf_putc(wr, ISO2709_FS);
             break;
+        default:
+            continue;
         }
-        if (data_length)
-        {
-            wrbuf_printf(wr_dir, "%0*d", length_data_entry, data_length);
-            wrbuf_printf(wr_dir, "%0*d", length_starting, data_offset);
-            data_offset += data_length;
-        }
+        data_length = wrbuf_len(wr) - field_start;
+        sprintf(dir_p, "%.3s%0*d%0*d", node_tag(n),
+                length_data_entry, data_length, length_starting, data_offset);
+        dir_p += strlen(dir_p);
+        data_offset += data_length;
     }
     /* mark end of directory */
-    wrbuf_putc(wr_dir, ISO2709_FS);
+    *dir_p++ = ISO2709_FS;
 
     /* base address of data (comes after leader+directory) */
-    base_address = 24 + wrbuf_len(wr_dir);
-
-    wr_head = wrbuf_alloc();
+    base_address = dir_p - dir;
 
     /* write record length */
-    wrbuf_printf(wr_head, "%05d", base_address + data_offset + 1);
+    sprintf(dir, "%05d", base_address + data_offset + 1);
     /* from "original" leader */
-    wrbuf_write(wr_head, leader+5, 7);
+    memcpy(dir + 5, leader + 5, 7);
     /* base address of data */
-    wrbuf_printf(wr_head, "%05d", base_address);
+    sprintf(dir + 12, "%05d", base_address);
     /* from "original" leader */
-    wrbuf_write(wr_head, leader+17, 7);
-
-    wrbuf_write(wr, wrbuf_buf(wr_head), 24);
-    wrbuf_write(wr, wrbuf_buf(wr_dir), wrbuf_len(wr_dir));
-    wrbuf_destroy(wr_head);
-    wrbuf_destroy(wr_dir);
-    wrbuf_destroy(wr_data_tmp);
+    memcpy(dir + 17, leader + 17, 7);
 
-    for (n = mt->nodes; n; n = n->next)
-    {
-        struct yaz_marc_subfield *s;
-
-        switch(n->which)
-        {
-        case YAZ_MARC_DATAFIELD:
-            wrbuf_write(wr, n->u.datafield.indicator, indicator_length);
-            for (s = n->u.datafield.subfields; s; s = s->next)
-            {
-                wrbuf_putc(wr, ISO2709_IDFS);
-                wrbuf_iconv_puts(wr, mt->iconv_cd, s->code_data);
-                marc_iconv_reset(mt, wr);
-            }
-            wrbuf_putc(wr, ISO2709_FS);
-            break;
-        case YAZ_MARC_CONTROLFIELD:
-            wrbuf_iconv_puts(wr, mt->iconv_cd, n->u.controlfield.data);
-            marc_iconv_reset(mt, wr);
-            wrbuf_putc(wr, ISO2709_FS);
-            break;
-        case YAZ_MARC_COMMENT:
-            break;
-        case YAZ_MARC_LEADER:
-            break;
-        }
-    }
-    wrbuf_printf(wr, "%c", ISO2709_RS);
+    wrbuf_insert(wr, start, dir, base_address);
+    wrbuf_putc(wr, ISO2709_RS);
     return 0;
 }
 
@@ -1282,15 +1311,10 @@ yaz_iconv_t yaz_marc_get_iconv(yaz_marc_t mt)
 
 void yaz_marc_modify_leader(yaz_marc_t mt, size_t off, const char *str)
 {
-    struct yaz_marc_node *n;
-    char *leader = 0;
-    for (n = mt->nodes; n; n = n->next)
-        if (n->which == YAZ_MARC_LEADER)
-        {
-            leader = n->u.leader;
-            memcpy(leader+off, str, strlen(str));
-            break;
-        }
+    /* leader is always a copy, so it can be modified */
+    char *leader = (char *) marc_leader(mt);
+    if (leader)
+        memcpy(leader+off, str, strlen(str));
 }
 
 int yaz_marc_leader_spec(yaz_marc_t mt, const char *leader_spec)
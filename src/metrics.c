@@ -0,0 +1,318 @@
+/* This file is part of the YAZ toolkit.
+ * Copyright (C) 1995-2013 Index Data
+ * See the file LICENSE for details.
+ */
+/**
+ * \file metrics.c
+ * \brief Request and backend metrics of GFS
+ *
+ * Counters and latency histograms are process wide. They are updated
+ * with atomic operations where the compiler offers them; otherwise
+ * a mutex protects them. Readers take no lock, so a histogram written
+ * while requests complete may be off by a few requests.
+ */
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+#include <time.h>
+#if HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif
+
+#include <yaz/gettimeofday.h>
+#include <yaz/nmem.h>
+#include <yaz/mutex.h>
+#include <yaz/log.h>
+#if YAZ_POSIX_THREADS
+#include <pthread.h>
+#endif
+#include "metrics.h"
+
+#if defined(__ATOMIC_RELAXED)
+#define METRICS_ATOMIC 1
+#else
+#define METRICS_ATOMIC 0
+#endif
+
+/* upper bounds of histogram buckets in seconds; last bucket is +Inf */
+#define NUM_BOUNDS 13
+static const double bounds[NUM_BOUNDS] = {
+    0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1.0, 2.5,
+    5.0, 10.0
+};
+
+struct histogram {
+    nmem_int_t buckets[NUM_BOUNDS + 1];
+    nmem_int_t sum_usec;
+};
+
+static const char *op_names[GFS_METRICS_OP_MAX] = {
+    "init", "search", "present", "scan", "sort", "extendedservices",
+    "delete", "close", "z3950_other", "sru_searchretrieve", "sru_scan",
+    "sru_explain", "sru_update", "http_file", "http_other"
+};
+
+static const char *bend_names[GFS_METRICS_BEND_MAX] = {
+    "search", "fetch", "scan"
+};
+
+static struct histogram op_hist[GFS_METRICS_OP_MAX];
+static struct histogram bend_hist[GFS_METRICS_BEND_MAX];
+static nmem_int_t bytes_in = 0;
+static nmem_int_t bytes_out = 0;
+static nmem_int_t assoc_total = 0;
+static nmem_int_t assoc_active = 0;
+static nmem_int_t last_log = 0;
+
+#if !METRICS_ATOMIC
+static YAZ_MUTEX metrics_mutex = 0;
+
+static void metrics_init(void)
+{
+    yaz_mutex_create(&metrics_mutex);
+}
+
+static void metrics_lock(void)
+{
+#if YAZ_POSIX_THREADS
+    static pthread_once_t once_control = PTHREAD_ONCE_INIT;
+    pthread_once(&once_control, metrics_init);
+#else
+    if (!metrics_mutex)
+        metrics_init();
+#endif
+    yaz_mutex_enter(metrics_mutex);
+}
+#endif
+
+static void add(nmem_int_t *p, nmem_int_t v)
+{
+#if METRICS_ATOMIC
+    __atomic_fetch_add(p, v, __ATOMIC_RELAXED);
+#else
+    metrics_lock();
+    *p += v;
+    yaz_mutex_leave(metrics_mutex);
+#endif
+}
+
+static nmem_int_t get(nmem_int_t *p)
+{
+#if METRICS_ATOMIC
+    return __atomic_load_n(p, __ATOMIC_RELAXED);
+#else
+    nmem_int_t v;
+    metrics_lock();
+    v = *p;
+    yaz_mutex_leave(metrics_mutex);
+    return v;
+#endif
+}
+
+/* sets *p to v if it is still old; returns non-zero if so */
+static int swap(nmem_int_t *p, nmem_int_t old, nmem_int_t v)
+{
+#if METRICS_ATOMIC
+    return __atomic_compare_exchange_n(p, &old, v, 0, __ATOMIC_RELAXED,
+                                       __ATOMIC_RELAXED);
+#else
+    int ret = 0;
+    metrics_lock();
+    if (*p == old)
+    {
+        *p = v;
+        ret = 1;
+    }
+    yaz_mutex_leave(metrics_mutex);
+    return ret;
+#endif
+}
+
+const char *gfs_metrics_op_name(int op)
+{
+    if (op < 0 || op >= GFS_METRICS_OP_MAX)
+        return "other";
+    return op_names[op];
+}
+
+double gfs_metrics_now(void)
+{
+    struct timeval tv;
+
+    yaz_gettimeofday(&tv);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static void observe(struct histogram *h, double seconds)
+{
+    int i;
+
+    if (seconds < 0.0)
+        seconds = 0.0;
+    for (i = 0; i < NUM_BOUNDS; i++)
+        if (seconds <= bounds[i])
+            break;
+    add(&h->buckets[i], 1);
+    add(&h->sum_usec, (nmem_int_t) (seconds * 1000000.0));
+}
+
+void gfs_metrics_request(int op, double seconds, long in, long out)
+{
+    if (op < 0 || op >= GFS_METRICS_OP_MAX)
+        return;
+    observe(&op_hist[op], seconds);
+    if (in > 0)
+        add(&bytes_in, in);
+    if (out > 0)
+        add(&bytes_out, out);
+}
+
+void gfs_metrics_backend(int bend, double seconds)
+{
+    if (bend < 0 || bend >= GFS_METRICS_BEND_MAX)
+        return;
+    observe(&bend_hist[bend], seconds);
+}
+
+void gfs_metrics_association(int delta)
+{
+    add(&assoc_active, delta);
+    if (delta > 0)
+        add(&assoc_total, delta);
+}
+
+/* copies buckets of h (made cumulative); returns total count */
+static nmem_int_t snapshot(struct histogram *h,
+                           nmem_int_t *cum, nmem_int_t *sum_usec)
+{
+    nmem_int_t n = 0;
+    int i;
+
+    for (i = 0; i <= NUM_BOUNDS; i++)
+        cum[i] = (n += get(&h->buckets[i]));
+    *sum_usec = get(&h->sum_usec);
+    return n;
+}
+
+static void write_histograms(WRBUF w, const char *name, const char *help,
+                             const char *label, struct histogram *hist,
+                             const char **names, int num)
+{
+    int j;
+
+    wrbuf_printf(w, "# HELP %s %s\n", name, help);
+    wrbuf_printf(w, "# TYPE %s histogram\n", name);
+    for (j = 0; j < num; j++)
+    {
+        nmem_int_t cum[NUM_BOUNDS + 1], sum_usec;
+        nmem_int_t n = snapshot(hist + j, cum, &sum_usec);
+        int i;
+
+        if (n == 0)
+            continue;
+        for (i = 0; i < NUM_BOUNDS; i++)
+            wrbuf_printf(w, "%s_bucket{%s=\"%s\",le=\"%g\"} "
+                         NMEM_INT_PRINTF "\n",
+                         name, label, names[j], bounds[i], cum[i]);
+        wrbuf_printf(w, "%s_bucket{%s=\"%s\",le=\"+Inf\"} "
+                     NMEM_INT_PRINTF "\n", name, label, names[j], n);
+        wrbuf_printf(w, "%s_sum{%s=\"%s\"} %.6f\n", name, label, names[j],
+                     sum_usec / 1000000.0);
+        wrbuf_printf(w, "%s_count{%s=\"%s\"} " NMEM_INT_PRINTF "\n",
+                     name, label, names[j], n);
+    }
+}
+
+static void write_value(WRBUF w, const char *name, const char *type,
+                        const char *help, nmem_int_t v)
+{
+    wrbuf_printf(w, "# HELP %s %s\n", name, help);
+    wrbuf_printf(w, "# TYPE %s %s\n", name, type);
+    wrbuf_printf(w, "%s " NMEM_INT_PRINTF "\n", name, v);
+}
+
+void gfs_metrics_write(WRBUF w)
+{
+    write_histograms(w, "yaz_gfs_request_duration_seconds",
+                     "Time from arrival of request until response is "
+                     "encoded.", "type", op_hist, op_names,
+                     GFS_METRICS_OP_MAX);
+    write_histograms(w, "yaz_gfs_backend_duration_seconds",
+                     "Time from backend call until result is available.", "call",
+                     bend_hist, bend_names, GFS_METRICS_BEND_MAX);
+    write_value(w, "yaz_gfs_received_bytes_total", "counter",
+                "Size of requests received.", get(&bytes_in));
+    write_value(w, "yaz_gfs_sent_bytes_total", "counter",
+                "Size of responses sent.", get(&bytes_out));
+    write_value(w, "yaz_gfs_associations", "gauge",
+                "Associations (connections) open.", get(&assoc_active));
+    write_value(w, "yaz_gfs_associations_total", "counter",
+                "Associations (connections) accepted.", get(&assoc_total));
+}
+
+int gfs_metrics_is_path(const char *metrics_path, const char *path)
+{
+    size_t len = strlen(metrics_path);
+
+    return !strncmp(path, metrics_path, len)
+        && (path[len] == '\0' || path[len] == '?');
+}
+
+static void log_histogram(const char *what, const char *name,
+                          struct histogram *h)
+{
+    nmem_int_t cum[NUM_BOUNDS + 1], sum_usec;
+    nmem_int_t n = snapshot(h, cum, &sum_usec);
+    int i;
+
+    if (n == 0)
+        return;
+    /* bucket holding the 99th percentile */
+    for (i = 0; i < NUM_BOUNDS; i++)
+        if (cum[i] * 100 >= n * 99)
+            break;
+    if (i < NUM_BOUNDS)
+        yaz_log(YLOG_LOG, "metrics %s %s: " NMEM_INT_PRINTF " avg %.4fs "
+                "p99 <= %gs", what, name, n, sum_usec / 1000000.0 / n,
+                bounds[i]);
+    else
+        yaz_log(YLOG_LOG, "metrics %s %s: " NMEM_INT_PRINTF " avg %.4fs "
+                "p99 > %gs", what, name, n, sum_usec / 1000000.0 / n,
+                bounds[NUM_BOUNDS - 1]);
+}
+
+void gfs_metrics_log(int interval)
+{
+    nmem_int_t now, last;
+    int i;
+
+    if (interval <= 0)
+        return;
+    now = (nmem_int_t) time(0);
+    last = get(&last_log);
+    if (last == 0)
+    {   /* first call starts the interval */
+        swap(&last_log, 0, now);
+        return;
+    }
+    if (now - last < interval || !swap(&last_log, last, now))
+        return;
+    for (i = 0; i < GFS_METRICS_OP_MAX; i++)
+        log_histogram("request", op_names[i], op_hist + i);
+    for (i = 0; i < GFS_METRICS_BEND_MAX; i++)
+        log_histogram("backend", bend_names[i], bend_hist + i);
+    yaz_log(YLOG_LOG, "metrics associations " NMEM_INT_PRINTF " open "
+            NMEM_INT_PRINTF " total; bytes " NMEM_INT_PRINTF " in "
+            NMEM_INT_PRINTF " out", get(&assoc_active), get(&assoc_total),
+            get(&bytes_in), get(&bytes_out));
+}
+/*
+ * Local variables:
+ * c-basic-offset: 4
+ * c-file-style: "Stroustrup"
+ * indent-tabs-mode: nil
+ * End:
+ * vim: shiftwidth=4 tabstop=8 expandtab
+ */
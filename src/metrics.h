@@ -0,0 +1,120 @@
+/* This file is part of the YAZ toolkit.
+ * Copyright (C) 1995-2013 Index Data.
+ * All rights reserved.
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Index Data nor the names of its contributors
+ *       may be used to endorse or promote products derived from this
+ *       software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS AND CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file metrics.h
+ * \brief Request and backend metrics of GFS
+ */
+
+#ifndef GFS_METRICS_H
+#define GFS_METRICS_H
+
+#include <yaz/wrbuf.h>
+
+/** \brief request types counted */
+enum gfs_metrics_op {
+    GFS_METRICS_INIT,
+    GFS_METRICS_SEARCH,
+    GFS_METRICS_PRESENT,
+    GFS_METRICS_SCAN,
+    GFS_METRICS_SORT,
+    GFS_METRICS_ES,
+    GFS_METRICS_DELETE,
+    GFS_METRICS_CLOSE,
+    GFS_METRICS_Z3950_OTHER,
+    GFS_METRICS_SRU_SEARCH,
+    GFS_METRICS_SRU_SCAN,
+    GFS_METRICS_SRU_EXPLAIN,
+    GFS_METRICS_SRU_UPDATE,
+    GFS_METRICS_HTTP_FILE,
+    GFS_METRICS_HTTP_OTHER,
+    GFS_METRICS_OP_MAX
+};
+
+/** \brief backend calls timed */
+enum gfs_metrics_bend {
+    GFS_METRICS_BEND_SEARCH,
+    GFS_METRICS_BEND_FETCH,
+    GFS_METRICS_BEND_SCAN,
+    GFS_METRICS_BEND_MAX
+};
+
+/** \brief returns name of request type
+    \param op request type (enum gfs_metrics_op)
+    \returns name; "other" for unknown type
+*/
+const char *gfs_metrics_op_name(int op);
+
+/** \brief returns wall clock time in seconds (for durations) */
+double gfs_metrics_now(void);
+
+/** \brief counts a completed request
+    \param op request type (enum gfs_metrics_op)
+    \param seconds time from arrival until the response was encoded
+    \param bytes_in size of request
+    \param bytes_out size of response
+*/
+void gfs_metrics_request(int op, double seconds, long bytes_in,
+                         long bytes_out);
+
+/** \brief counts a backend call
+    \param bend backend handler (enum gfs_metrics_bend)
+    \param seconds time from call until result is available (also when
+    the backend completes the operation later)
+*/
+void gfs_metrics_backend(int bend, double seconds);
+
+/** \brief counts association created (delta=1) or destroyed (delta=-1) */
+void gfs_metrics_association(int delta);
+
+/** \brief writes all metrics in Prometheus text format */
+void gfs_metrics_write(WRBUF w);
+
+/** \brief checks whether HTTP path refers to metrics
+    \param metrics_path path metrics are served at, e.g. "/metrics"
+    \param path HTTP request path, possibly with query
+    \retval 1 path is metrics_path (optionally followed by ?query)
+    \retval 0 path is something else
+*/
+int gfs_metrics_is_path(const char *metrics_path, const char *path);
+
+/** \brief logs summary of metrics if interval has passed since last time
+    \param interval seconds between summaries; 0 for no logging
+
+    Only one caller logs when called from several threads at once.
+*/
+void gfs_metrics_log(int interval);
+
+#endif
+/*
+ * Local variables:
+ * c-basic-offset: 4
+ * c-file-style: "Stroustrup"
+ * indent-tabs-mode: nil
+ * End:
+ * vim: shiftwidth=4 tabstop=8 expandtab
+ */
@@ -22,6 +22,7 @@
 #include <stddef.h>
 #include <yaz/xmalloc.h>
 #include <yaz/nmem.h>
+#include <yaz/mutex.h>
 #include <yaz/log.h>
 
 #define NMEM_CHUNK (4*1024)
@@ -39,6 +40,17 @@ struct nmem_control
     size_t total;
     struct nmem_block *blocks;
     struct nmem_control *next;
+    nmem_account_t account;
+};
+
+/* shared by all NMEM handles charged to it; released when the last
+   handle and the creator have let go */
+struct nmem_account
+{
+    YAZ_MUTEX mutex;
+    int ref;
+    size_t current;
+    size_t peak;
 };
 
 struct align {
@@ -61,6 +73,96 @@ struct align {
 static int log_level = 0;
 static int log_level_initialized = 0;
 
+nmem_account_t nmem_account_create(void)
+{
+    nmem_account_t a = (nmem_account_t) xmalloc(sizeof(*a));
+    a->mutex = 0;
+    yaz_mutex_create(&a->mutex);
+    a->ref = 1;
+    a->current = a->peak = 0;
+    return a;
+}
+
+static void account_ref(nmem_account_t a)
+{
+    yaz_mutex_enter(a->mutex);
+    a->ref++;
+    yaz_mutex_leave(a->mutex);
+}
+
+static void account_unref(nmem_account_t a)
+{
+    int ref;
+
+    yaz_mutex_enter(a->mutex);
+    ref = --a->ref;
+    yaz_mutex_leave(a->mutex);
+    if (ref == 0)
+    {
+        yaz_mutex_destroy(&a->mutex);
+        xfree(a);
+    }
+}
+
+void nmem_account_destroy(nmem_account_t a)
+{
+    if (a)
+        account_unref(a);
+}
+
+void nmem_account_add(nmem_account_t a, size_t size)
+{
+    if (!a)
+        return;
+    yaz_mutex_enter(a->mutex);
+    a->current += size;
+    if (a->current > a->peak)
+        a->peak = a->current;
+    yaz_mutex_leave(a->mutex);
+}
+
+void nmem_account_sub(nmem_account_t a, size_t size)
+{
+    if (!a)
+        return;
+    yaz_mutex_enter(a->mutex);
+    assert(a->current >= size);
+    a->current -= size;
+    yaz_mutex_leave(a->mutex);
+}
+
+size_t nmem_account_current(nmem_account_t a)
+{
+    size_t v;
+
+    if (!a)
+        return 0;
+    yaz_mutex_enter(a->mutex);
+    v = a->current;
+    yaz_mutex_leave(a->mutex);
+    return v;
+}
+
+size_t nmem_account_peak(nmem_account_t a)
+{
+    size_t v;
+
+    if (!a)
+        return 0;
+    yaz_mutex_enter(a->mutex);
+    v = a->peak;
+    yaz_mutex_leave(a->mutex);
+    return v;
+}
+
+static size_t blocks_size(struct nmem_block *p)
+{
+    size_t sz = 0;
+    for (; p; p = p->next)
+        sz += p->size;
+    return sz;
+}
+
 static void free_block(struct nmem_block *p)
 {
     xfree(p->buf);
@@ -95,6 +197,7 @@ static struct nmem_block *get_block(size_t size)
 void nmem_reset(NMEM n)
 {
     struct nmem_block *t;
+    size_t freed = 0;
 
     yaz_log(log_level, "nmem_reset p=%p", n);
     if (!n)
@@ -103,9 +206,12 @@ void nmem_reset(NMEM n)
     {
         t = n->blocks;
         n->blocks = n->blocks->next;
+        freed += t->size;
         free_block(t);
     }
     n->total = 0;
+    if (n->account)
+        nmem_account_sub(n->account, freed);
 }
 
 void *nmem_malloc(NMEM n, size_t size)
@@ -124,6 +230,8 @@ void *nmem_malloc(NMEM n, size_t size)
         p = get_block(size);
         p->next = n->blocks;
         n->blocks = p;
+        if (n->account)
+            nmem_account_add(n->account, p->size);
     }
     r = p->buf + p->top;
     /* align size */
@@ -151,6 +259,7 @@ NMEM nmem_create(void)
     r->blocks = 0;
     r->total = 0;
     r->next = 0;
+    r->account = 0;
 
     return r;
 }
@@ -161,12 +270,46 @@ void nmem_destroy(NMEM n)
         return;
 
     nmem_reset(n);
+    if (n->account)
+        account_unref(n->account);
     xfree(n);
 }
 
+void nmem_set_account(NMEM n, nmem_account_t a)
+{
+    size_t sz;
+
+    if (n->account == a)
+        return;
+    sz = blocks_size(n->blocks);
+    if (a)
+    {
+        account_ref(a);
+        nmem_account_add(a, sz);
+    }
+    if (n->account)
+    {
+        nmem_account_sub(n->account, sz);
+        account_unref(n->account);
+    }
+    n->account = a;
+}
+
+nmem_account_t nmem_get_account(NMEM n)
+{
+    return n->account;
+}
+
 void nmem_transfer(NMEM dst, NMEM src)
 {
     struct nmem_block *t;
+
+    if (dst->account != src->account && src->blocks)
+    {
+        size_t sz = blocks_size(src->blocks);
+        nmem_account_sub(src->account, sz);
+        nmem_account_add(dst->account, sz);
+    }
     while ((t = src->blocks))
     {
         src->blocks = t->next;
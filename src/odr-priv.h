@@ -107,6 +107,7 @@ struct Odr_private {
     int lenlen;          /* force length-of-lenght (odr_setlen()) */
     FILE *print;         /* output file handler for direction print */
     int indent;          /* current indent level for printing */
+    int max_content;     /* max size of inflated HTTP body (0=default) */
 };
 
 #define ODR_STACK_POP(x) (x)->op->stack_top = (x)->op->stack_top->prev
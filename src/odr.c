@@ -190,11 +190,11 @@ void odr_set_stream(ODR o, void *handle,
 int odr_set_charset(ODR o, const char *to, const char *from)
 {
     if (o->op->iconv_handle)
-        yaz_iconv_close (o->op->iconv_handle);
+        yaz_iconv_pool_put(o->op->iconv_handle);
     o->op->iconv_handle = 0;
     if (to && from)
     {
-        o->op->iconv_handle = yaz_iconv_open(to, from);
+        o->op->iconv_handle = yaz_iconv_pool_get(to, from);
         if (o->op->iconv_handle == 0)
             return -1;
     }
@@ -222,6 +222,7 @@ ODR odr_createmem(int direction)
     o->op->enable_bias = 1;
     o->op->odr_ber_tag.lclass = -1;
     o->op->iconv_handle = 0;
+    o->op->max_content = 0;
     odr_setprint(o, stderr);
     odr_reset(o);
     yaz_log(log_level, "odr_createmem dir=%d o=%p", direction, o);
@@ -263,7 +264,7 @@ void odr_destroy(ODR o)
     if (o->op->stream_close)
         o->op->stream_close(o->op->print);
     if (o->op->iconv_handle != 0)
-        yaz_iconv_close(o->op->iconv_handle);
+        yaz_iconv_pool_put(o->op->iconv_handle);
     xfree(o->op);
     xfree(o);
     yaz_log(log_level, "odr_destroy o=%p", o);
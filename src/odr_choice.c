@@ -12,8 +12,249 @@
 #include <config.h>
 #endif
 
+#include <stdlib.h>
+#include <string.h>
+
+#if YAZ_POSIX_THREADS
+#include <pthread.h>
+#endif
+
+#include <yaz/xmalloc.h>
+#include <yaz/mutex.h>
+#include <yaz/log.h>
 #include "odr-priv.h"
 
+/* ODR_CHOICE_INDEX: arm tables get a tag and which index, published
+   with atomic builtins (GCC 4.7 or later, clang). Otherwise arms are
+   always searched linearly.
+
+   An index is keyed by table address. It is built, and the arms copied,
+   once: when the table is first seen. After that each call compares
+   only the arm it picks (or the first arm, if none) with the copy, so
+   that another table at the same address is searched linearly.
+
+   Indexes are never freed. There are at most CHOICE_INDEX_SLOTS of them
+   and a table that finds no free slot among CHOICE_INDEX_PROBES is
+   always searched linearly (logged once) */
+#ifndef ODR_CHOICE_INDEX
+#if defined(__ATOMIC_ACQUIRE)
+#define ODR_CHOICE_INDEX 1
+#else
+#define ODR_CHOICE_INDEX 0
+#endif
+#endif
+
+#if ODR_CHOICE_INDEX
+/* smallest number of arms for which an index is used */
+#define CHOICE_INDEX_MIN 6
+/* largest range of tags or which values in an index */
+#define CHOICE_INDEX_RANGE 256
+#define CHOICE_INDEX_SLOTS 1024
+#define CHOICE_INDEX_PROBES 8
+
+/* index for one arm table. Built on first use and never changed */
+struct choice_index {
+    const Odr_arm *arm;        /* the table; the key */
+    int linear;                /* small or irregular table: no index */
+    Odr_arm *copy;             /* the arms the index was built for */
+    int zclass;                /* class of all arms */
+    int tag_min;
+    int tag_max;
+    const Odr_arm **tag_arm;   /* into copy; indexed by tag - tag_min */
+    int which_min;
+    int which_max;
+    const Odr_arm **which_arm; /* into copy; by which - which_min */
+};
+
+static struct choice_index *choice_slots[CHOICE_INDEX_SLOTS];
+static YAZ_MUTEX choice_mutex = 0;
+static int choice_slots_full = 0;
+
+static void choice_index_init(void)
+{
+    yaz_mutex_create(&choice_mutex);
+}
+
+static unsigned choice_hash(const Odr_arm *arm)
+{
+    return (unsigned) (((size_t) arm >> 4) * 2654435761U)
+        % CHOICE_INDEX_SLOTS;
+}
+
+/* the index is used only when there are enough arms, all tagged in the
+   same class, and tags and which values are unique, so that order of
+   arms is of no consequence */
+static struct choice_index *choice_index_build(const Odr_arm *arm)
+{
+    struct choice_index *ci = (struct choice_index *) xmalloc(sizeof(*ci));
+    int i;
+
+    ci->arm = arm;
+    ci->linear = 1;
+    ci->zclass = arm[0].zclass;
+    ci->tag_min = ci->tag_max = arm[0].tag;
+    ci->which_min = ci->which_max = arm[0].which;
+    ci->tag_arm = ci->which_arm = 0;
+    ci->copy = 0;
+    for (i = 0; arm[i].fun; i++)
+    {
+        if (arm[i].tagmode == ODR_NONE || arm[i].zclass != ci->zclass)
+            return ci;
+        if (arm[i].tag < ci->tag_min)
+            ci->tag_min = arm[i].tag;
+        if (arm[i].tag > ci->tag_max)
+            ci->tag_max = arm[i].tag;
+        if (arm[i].which < ci->which_min)
+            ci->which_min = arm[i].which;
+        if (arm[i].which > ci->which_max)
+            ci->which_max = arm[i].which;
+    }
+    if (i < CHOICE_INDEX_MIN
+        || ci->tag_max - ci->tag_min >= CHOICE_INDEX_RANGE
+        || ci->which_max - ci->which_min >= CHOICE_INDEX_RANGE)
+        return ci;
+    ci->copy = (Odr_arm *) xmalloc(i * sizeof(*ci->copy));
+    memcpy(ci->copy, arm, i * sizeof(*ci->copy));
+    ci->tag_arm = (const Odr_arm **)
+        xcalloc(ci->tag_max - ci->tag_min + 1, sizeof(*ci->tag_arm));
+    ci->which_arm = (const Odr_arm **)
+        xcalloc(ci->which_max - ci->which_min + 1, sizeof(*ci->which_arm));
+    for (i = 0; arm[i].fun; i++)
+    {
+        const Odr_arm **tp = ci->tag_arm + (arm[i].tag - ci->tag_min);
+        const Odr_arm **wp = ci->which_arm + (arm[i].which - ci->which_min);
+        if (*tp || *wp)
+            return ci;
+        *tp = *wp = ci->copy + i;
+    }
+    ci->linear = 0;
+    return ci;
+}
+
+/* whether arm a is still c: the arm that the index holds at the same
+   position. Another table may take the address of the one the index
+   was built for (stack, heap or unloaded module) */
+static int choice_arm_same(const Odr_arm *a, const Odr_arm *c)
+{
+    return a->fun == c->fun && a->which == c->which && a->tag == c->tag
+        && a->zclass == c->zclass && a->tagmode == c->tagmode;
+}
+
+static const struct choice_index *choice_index_add(const Odr_arm *arm,
+                                                   unsigned h)
+{
+    struct choice_index *ci = 0;
+    int i;
+
+#if YAZ_POSIX_THREADS
+    static pthread_once_t once_control = PTHREAD_ONCE_INIT;
+    pthread_once(&once_control, choice_index_init);
+#else
+    if (!choice_mutex)
+        choice_index_init();
+#endif
+    yaz_mutex_enter(choice_mutex);
+    for (i = 0; i < CHOICE_INDEX_PROBES; i++)
+    {
+        struct choice_index **slot =
+            &choice_slots[(h + i) % CHOICE_INDEX_SLOTS];
+        if (!*slot)
+        {
+            ci = choice_index_build(arm);
+            __atomic_store_n(slot, ci, __ATOMIC_RELEASE);
+            break;
+        }
+        if ((*slot)->arm == arm)
+        {   /* added by another thread */
+            ci = *slot;
+            break;
+        }
+    }
+    if (!ci && !choice_slots_full)
+    {
+        choice_slots_full = 1;
+        yaz_log(YLOG_LOG, "odr_choice: no index slot for arm table %p; "
+                "searching it linearly", (void *) arm);
+    }
+    yaz_mutex_leave(choice_mutex);
+    return ci;
+}
+
+/* returns index for arm table; NULL if there is no room for it */
+static const struct choice_index *choice_index_get(const Odr_arm *arm)
+{
+    unsigned h = choice_hash(arm);
+    int i;
+
+    for (i = 0; i < CHOICE_INDEX_PROBES; i++)
+    {
+        const struct choice_index *ci =
+            __atomic_load_n(&choice_slots[(h + i) % CHOICE_INDEX_SLOTS],
+                            __ATOMIC_ACQUIRE);
+        if (!ci)
+            return choice_index_add(arm, h);
+        if (ci->arm == arm)
+            return ci;
+    }
+    return 0;
+}
+
+/* result when the index has no arm: 0 as for the linear search, or -1
+   if the table has changed and must be searched linearly */
+static int choice_miss(const struct choice_index *ci, const Odr_arm *table)
+{
+    return choice_arm_same(table, ci->copy) ? 0 : -1;
+}
+
+/* same result as the linear search in odr_choice for indexed tables;
+   -1 if the table has changed and must be searched linearly */
+static int choice_indexed(ODR o, const struct choice_index *ci,
+                          const Odr_arm *table, void *p, int *which, int bias)
+{
+    const Odr_arm *c = 0, *arm;
+    int w = o->direction == ODR_DECODE ? bias : *which;
+
+    if (w >= ci->which_min && w <= ci->which_max)
+        c = ci->which_arm[w - ci->which_min];
+    if (o->direction == ODR_DECODE)
+    {
+        int cl, tg, cn;
+
+        if (bias >= 0 && !c)
+            return choice_miss(ci, table);
+        if (o->op->stack_top && !odr_constructed_more(o))
+            return choice_miss(ci, table);
+        if (ber_dectag(o->bp, &cl, &tg, &cn, odr_max(o)) <= 0)
+            return choice_miss(ci, table);
+        if (bias < 0)
+        {
+            c = 0;
+            if (cl == ci->zclass && tg >= ci->tag_min && tg <= ci->tag_max)
+                c = ci->tag_arm[tg - ci->tag_min];
+        }
+        if (!c || tg != c->tag || cl != c->zclass)
+            return choice_miss(ci, table);
+    }
+    else if (!c)
+        return choice_miss(ci, table);
+    arm = table + (c - ci->copy);
+    if (!choice_arm_same(arm, c))
+        return -1;
+    if (o->direction == ODR_DECODE)
+        *which = arm->which;
+    if (arm->tagmode == ODR_IMPLICIT)
+    {
+        odr_implicit_settag(o, arm->zclass, arm->tag);
+        return (*arm->fun)(o, (char **)p, 0, arm->name);
+    }
+    /* explicit */
+    if (!odr_constructed_begin(o, p, arm->zclass, arm->tag, 0))
+        return 0;
+    return (*arm->fun)(o, (char **)p, 0, arm->name) &&
+        odr_constructed_end(o);
+}
+#endif
+
 int odr_choice(ODR o, Odr_arm arm[], void *p, void *whichp,
                const char *name)
 {
@@ -39,6 +280,22 @@ int odr_choice(ODR o, Odr_arm arm[], void *p, void *whichp,
             odr_printf(o, "choice\n");
         }
     }
+#if ODR_CHOICE_INDEX
+    {
+        /* first slot checked here; it is nearly always the one */
+        const struct choice_index *ci =
+            __atomic_load_n(&choice_slots[choice_hash(arm)],
+                            __ATOMIC_ACQUIRE);
+        if (!ci || ci->arm != arm)
+            ci = choice_index_get(arm);
+        if (ci && !ci->linear)
+        {
+            int r = choice_indexed(o, ci, arm, p, which, bias);
+            if (r >= 0)
+                return r;
+        }
+    }
+#endif
     for (i = 0; arm[i].fun; i++)
     {
         if (o->direction == ODR_DECODE)
@@ -0,0 +1,166 @@
+/* This file is part of the YAZ toolkit.
+ * Copyright (C) 1995-2013 Index Data
+ * See the file LICENSE for details.
+ */
+/**
+ * \file odr_clone.c
+ * \brief Implements deep copy of basic ODR types
+ *
+ * These are the building blocks of the yaz_clone_ functions generated
+ * by yaz-asncomp for each ASN.1 type.
+ */
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+#include "odr-priv.h"
+
+Odr_int *odr_clone_integer(const Odr_int *p, NMEM nmem)
+{
+    return p ? nmem_intdup(nmem, *p) : 0;
+}
+
+Odr_int *odr_clone_enum(const Odr_int *p, NMEM nmem)
+{
+    return p ? nmem_intdup(nmem, *p) : 0;
+}
+
+Odr_bool *odr_clone_bool(const Odr_bool *p, NMEM nmem)
+{
+    return p ? nmem_booldup(nmem, *p) : 0;
+}
+
+Odr_null *odr_clone_null(const Odr_null *p, NMEM nmem)
+{
+    return p ? odr_nullval() : 0;
+}
+
+Odr_oct *odr_clone_octetstring(const Odr_oct *p, NMEM nmem)
+{
+    Odr_oct *c;
+
+    if (!p)
+        return 0;
+    c = (Odr_oct *) nmem_malloc(nmem, sizeof(*c));
+    c->len = c->size = p->len;
+    c->buf = (unsigned char *) nmem_malloc(nmem, p->len + 1);
+    if (p->len > 0)
+        memcpy(c->buf, p->buf, p->len);
+    c->buf[p->len] = '\0'; /* decoder terminates too */
+    return c;
+}
+
+Odr_any *odr_clone_any(const Odr_any *p, NMEM nmem)
+{
+    return odr_clone_octetstring(p, nmem);
+}
+
+Odr_bitmask *odr_clone_bitstring(const Odr_bitmask *p, NMEM nmem)
+{
+    Odr_bitmask *c;
+
+    if (!p)
+        return 0;
+    c = (Odr_bitmask *) nmem_malloc(nmem, sizeof(*c));
+    memcpy(c, p, sizeof(*c));
+    return c;
+}
+
+Odr_oid *odr_clone_oid(const Odr_oid *p, NMEM nmem)
+{
+    return p ? odr_oiddup_nmem(nmem, p) : 0;
+}
+
+char *odr_clone_generalstring(const char *p, NMEM nmem)
+{
+    return nmem_strdup_null(nmem, p);
+}
+
+char *odr_clone_visiblestring(const char *p, NMEM nmem)
+{
+    return nmem_strdup_null(nmem, p);
+}
+
+char *odr_clone_graphicstring(const char *p, NMEM nmem)
+{
+    return nmem_strdup_null(nmem, p);
+}
+
+char *odr_clone_generalizedtime(const char *p, NMEM nmem)
+{
+    return nmem_strdup_null(nmem, p);
+}
+
+Odr_external *odr_clone_external(const Odr_external *p, NMEM nmem)
+{
+    Odr_external *c;
+
+    if (!p)
+        return 0;
+    c = (Odr_external *) nmem_malloc(nmem, sizeof(*c));
+    c->direct_reference = odr_clone_oid(p->direct_reference, nmem);
+    c->indirect_reference = odr_clone_integer(p->indirect_reference, nmem);
+    c->descriptor = nmem_strdup_null(nmem, p->descriptor);
+    c->which = p->which;
+    switch (p->which)
+    {
+    case ODR_EXTERNAL_single:
+        c->u.single_ASN1_type = odr_clone_any(p->u.single_ASN1_type, nmem);
+        break;
+    case ODR_EXTERNAL_octet:
+        c->u.octet_aligned = odr_clone_octetstring(p->u.octet_aligned, nmem);
+        break;
+    case ODR_EXTERNAL_arbitrary:
+        c->u.arbitrary = odr_clone_bitstring(p->u.arbitrary, nmem);
+        break;
+    }
+    return c;
+}
+
+void **odr_clone_array(void * const *a, int num, Odr_clone_fun f, NMEM nmem)
+{
+    void **c;
+    int i;
+
+    if (!a)
+        return 0;
+    c = (void **) nmem_malloc(nmem, (num > 0 ? num : 1) * sizeof(*c));
+    for (i = 0; i < num; i++)
+        c[i] = f(a[i], nmem);
+    return c;
+}
+
+void *odr_clone_codec(Odr_fun fun, const void *p, NMEM nmem)
+{
+    void *c = 0;
+    ODR enc, dec;
+
+    if (!p)
+        return 0;
+    enc = odr_createmem(ODR_ENCODE);
+    dec = odr_createmem(ODR_DECODE);
+    if (fun(enc, (char **) &p, 0, 0))
+    {
+        int len;
+        char *buf = odr_getbuf(enc, &len, 0);
+        if (buf)
+        {
+            odr_setbuf(dec, buf, len, 0);
+            fun(dec, (char **) &c, 0, 0);
+            nmem_transfer(nmem, dec->mem);
+        }
+    }
+    odr_destroy(enc);
+    odr_destroy(dec);
+    return c;
+}
+
+/*
+ * Local variables:
+ * c-basic-offset: 4
+ * c-file-style: "Stroustrup"
+ * indent-tabs-mode: nil
+ * End:
+ * vim: shiftwidth=4 tabstop=8 expandtab
+ */
@@ -24,6 +24,7 @@ NMEM odr_extract_mem(ODR o)
     NMEM r = o->mem;
 
     o->mem = nmem_create();
+    nmem_set_account(o->mem, nmem_get_account(r));
     return r;
 }
 
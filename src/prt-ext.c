@@ -258,6 +258,145 @@ int z_External(ODR o, Z_External **p, int opt, const char *name)
         odr_sequence_end(o);
 }
 
+/** \brief deep copy of EXTERNAL; known types are copied structurally */
+Z_External *yaz_clone_z_External(const Z_External *p, NMEM nmem)
+{
+    Z_External *c;
+
+    if (!p)
+        return 0;
+    c = (Z_External *) nmem_malloc(nmem, sizeof(*c));
+    c->direct_reference = odr_clone_oid(p->direct_reference, nmem);
+    c->indirect_reference = odr_clone_integer(p->indirect_reference, nmem);
+    c->descriptor = nmem_strdup_null(nmem, p->descriptor);
+    c->which = p->which;
+    switch (p->which)
+    {
+    case Z_External_single:
+        c->u.single_ASN1_type = odr_clone_any(p->u.single_ASN1_type, nmem);
+        break;
+    case Z_External_octet:
+        c->u.octet_aligned = odr_clone_octetstring(p->u.octet_aligned, nmem);
+        break;
+    case Z_External_arbitrary:
+        c->u.arbitrary = odr_clone_bitstring(p->u.arbitrary, nmem);
+        break;
+    case Z_External_sutrs:
+        c->u.sutrs = yaz_clone_z_SUTRS(p->u.sutrs, nmem);
+        break;
+    case Z_External_explainRecord:
+        c->u.explainRecord =
+            yaz_clone_z_ExplainRecord(p->u.explainRecord, nmem);
+        break;
+    case Z_External_resourceReport1:
+        c->u.resourceReport1 =
+            yaz_clone_z_ResourceReport1(p->u.resourceReport1, nmem);
+        break;
+    case Z_External_resourceReport2:
+        c->u.resourceReport2 =
+            yaz_clone_z_ResourceReport2(p->u.resourceReport2, nmem);
+        break;
+    case Z_External_promptObject1:
+        c->u.promptObject1 =
+            yaz_clone_z_PromptObject1(p->u.promptObject1, nmem);
+        break;
+    case Z_External_grs1:
+        c->u.grs1 = yaz_clone_z_GenericRecord(p->u.grs1, nmem);
+        break;
+    case Z_External_extendedService:
+        c->u.extendedService =
+            yaz_clone_z_TaskPackage(p->u.extendedService, nmem);
+        break;
+    case Z_External_itemOrder:
+        c->u.itemOrder = yaz_clone_z_IOItemOrder(p->u.itemOrder, nmem);
+        break;
+    case Z_External_diag1:
+        c->u.diag1 = yaz_clone_z_DiagnosticFormat(p->u.diag1, nmem);
+        break;
+    case Z_External_espec1:
+        c->u.espec1 = yaz_clone_z_Espec1(p->u.espec1, nmem);
+        break;
+    case Z_External_summary:
+        c->u.summary = yaz_clone_z_BriefBib(p->u.summary, nmem);
+        break;
+    case Z_External_OPAC:
+        c->u.opac = yaz_clone_z_OPACRecord(p->u.opac, nmem);
+        break;
+    case Z_External_searchResult1:
+        c->u.searchResult1 =
+            yaz_clone_z_SearchInfoReport(p->u.searchResult1, nmem);
+        break;
+    case Z_External_update:
+        c->u.update = yaz_clone_z_IUUpdate(p->u.update, nmem);
+        break;
+    case Z_External_dateTime:
+        c->u.dateTime = yaz_clone_z_DateTime(p->u.dateTime, nmem);
+        break;
+    case Z_External_universeReport:
+        c->u.universeReport =
+            yaz_clone_z_UniverseReport(p->u.universeReport, nmem);
+        break;
+    case Z_External_ESAdmin:
+        c->u.adminService = yaz_clone_z_Admin(p->u.adminService, nmem);
+        break;
+    case Z_External_update0:
+        c->u.update0 = yaz_clone_z_IU0Update(p->u.update0, nmem);
+        break;
+    case Z_External_userInfo1:
+        c->u.userInfo1 = yaz_clone_z_OtherInformation(p->u.userInfo1, nmem);
+        break;
+    case Z_External_charSetandLanguageNegotiation:
+        c->u.charNeg3 =
+            yaz_clone_z_CharSetandLanguageNegotiation(p->u.charNeg3, nmem);
+        break;
+    case Z_External_acfPrompt1:
+        c->u.acfPrompt1 = yaz_clone_z_PromptObject1(p->u.acfPrompt1, nmem);
+        break;
+    case Z_External_acfDes1:
+        c->u.acfDes1 = yaz_clone_z_DES_RN_Object(p->u.acfDes1, nmem);
+        break;
+    case Z_External_acfKrb1:
+        c->u.acfKrb1 = yaz_clone_z_KRBObject(p->u.acfKrb1, nmem);
+        break;
+    case Z_External_multisrch2:
+        c->u.multipleSearchTerms_2 =
+            yaz_clone_z_MultipleSearchTerms_2(p->u.multipleSearchTerms_2, nmem);
+        break;
+    case Z_External_CQL:
+        c->u.cql = yaz_clone_z_InternationalString(p->u.cql, nmem);
+        break;
+    case Z_External_OCLCUserInfo:
+        c->u.oclc = yaz_clone_z_OCLC_UserInformation(p->u.oclc, nmem);
+        break;
+    case Z_External_persistentResultSet:
+        c->u.persistentResultSet =
+            yaz_clone_z_PRPersistentResultSet(p->u.persistentResultSet, nmem);
+        break;
+    case Z_External_persistentQuery:
+        c->u.persistentQuery =
+            yaz_clone_z_PQueryPersistentQuery(p->u.persistentQuery, nmem);
+        break;
+    case Z_External_periodicQuerySchedule:
+        c->u.periodicQuerySchedule =
+            yaz_clone_z_PQSPeriodicQuerySchedule(p->u.periodicQuerySchedule, nmem);
+        break;
+    case Z_External_exportSpecification:
+        c->u.exportSpecification =
+            yaz_clone_z_ESExportSpecification(p->u.exportSpecification, nmem);
+        break;
+    case Z_External_exportInvocation:
+        c->u.exportInvocation =
+            yaz_clone_z_EIExportInvocation(p->u.exportInvocation, nmem);
+        break;
+    case Z_External_userFacets:
+        c->u.facetList = yaz_clone_z_FacetList(p->u.facetList, nmem);
+        break;
+    default:
+        return (Z_External *) odr_clone_codec((Odr_fun) z_External, p, nmem);
+    }
+    return c;
+}
+
 Z_External *z_ext_record_oid_nmem(NMEM nmem, const Odr_oid *oid,
                                   const char *buf, int len)
 {
@@ -0,0 +1,273 @@
+/* This file is part of the YAZ toolkit.
+ * Copyright (C) 1995-2013 Index Data
+ * See the file LICENSE for details.
+ */
+/**
+ * \file querycache.c
+ * \brief Cache of query translations done by GFS
+ *
+ * Translations of CQL, CCL and PQF to RPN are kept in a hash table
+ * with a least recently used list that bounds the number of entries.
+ * The RPN query is stored BER encoded and is decoded into the memory
+ * of the request on a hit, so a backend may modify the query it gets.
+ * Failed translations are cached as well.
+ */
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <yaz/xmalloc.h>
+#include <yaz/mutex.h>
+#include "querycache.h"
+
+struct query_cache_entry {
+    const void *transform;
+    char *query;
+    unsigned hash;
+    char *ber;          /* BER encoded RPN query; 0 if none */
+    int ber_len;
+    char *sortkeys;
+    int errcode;
+    char *errstring;
+    struct query_cache_entry *hash_next;
+    struct query_cache_entry *lru_prev;  /* more recently used */
+    struct query_cache_entry *lru_next;  /* less recently used */
+};
+
+struct query_cache {
+    YAZ_MUTEX mutex;
+    ODR encode;
+    ODR decode;
+    struct query_cache_entry **hash;
+    unsigned hash_mask;
+    struct query_cache_entry *lru_head;
+    struct query_cache_entry *lru_tail;
+    int num_entries;
+    int max_entries;
+    long hits;
+    long misses;
+};
+
+query_cache_t query_cache_create(int max_entries)
+{
+    query_cache_t qc;
+    unsigned hash_size = 16;
+
+    if (max_entries <= 0)
+        return 0;
+    while (hash_size < (unsigned) max_entries)
+        hash_size *= 2;
+    qc = (query_cache_t) xmalloc(sizeof(*qc));
+    qc->mutex = 0;
+    yaz_mutex_create(&qc->mutex);
+    qc->encode = odr_createmem(ODR_ENCODE);
+    qc->decode = odr_createmem(ODR_DECODE);
+    qc->hash = (struct query_cache_entry **)
+        xcalloc(hash_size, sizeof(*qc->hash));
+    qc->hash_mask = hash_size - 1;
+    qc->lru_head = qc->lru_tail = 0;
+    qc->num_entries = 0;
+    qc->max_entries = max_entries;
+    qc->hits = qc->misses = 0;
+    return qc;
+}
+
+static void entry_destroy(struct query_cache_entry *e)
+{
+    xfree(e->query);
+    xfree(e->ber);
+    xfree(e->sortkeys);
+    xfree(e->errstring);
+    xfree(e);
+}
+
+void query_cache_destroy(query_cache_t qc)
+{
+    if (qc)
+    {
+        struct query_cache_entry *e = qc->lru_head;
+        while (e)
+        {
+            struct query_cache_entry *e_next = e->lru_next;
+            entry_destroy(e);
+            e = e_next;
+        }
+        xfree(qc->hash);
+        odr_destroy(qc->encode);
+        odr_destroy(qc->decode);
+        yaz_mutex_destroy(&qc->mutex);
+        xfree(qc);
+    }
+}
+
+static unsigned query_hash(const void *transform, const char *query)
+{
+    /* FNV-1a */
+    unsigned h = 2166136261U ^ (unsigned) ((size_t) transform >> 4);
+    for (; *query; query++)
+    {
+        h ^= (unsigned char) *query;
+        h *= 16777619U;
+    }
+    return h;
+}
+
+static struct query_cache_entry *lookup(query_cache_t qc,
+                                        const void *transform,
+                                        const char *query, unsigned hash)
+{
+    struct query_cache_entry *e = qc->hash[hash & qc->hash_mask];
+    for (; e; e = e->hash_next)
+        if (e->hash == hash && e->transform == transform
+            && !strcmp(e->query, query))
+            break;
+    return e;
+}
+
+static void lru_unlink(query_cache_t qc, struct query_cache_entry *e)
+{
+    if (e->lru_prev)
+        e->lru_prev->lru_next = e->lru_next;
+    else
+        qc->lru_head = e->lru_next;
+    if (e->lru_next)
+        e->lru_next->lru_prev = e->lru_prev;
+    else
+        qc->lru_tail = e->lru_prev;
+}
+
+static void lru_push(query_cache_t qc, struct query_cache_entry *e)
+{
+    e->lru_prev = 0;
+    e->lru_next = qc->lru_head;
+    if (qc->lru_head)
+        qc->lru_head->lru_prev = e;
+    else
+        qc->lru_tail = e;
+    qc->lru_head = e;
+}
+
+static void evict(query_cache_t qc)
+{
+    struct query_cache_entry *e = qc->lru_tail;
+    struct query_cache_entry **ep = &qc->hash[e->hash & qc->hash_mask];
+
+    while (*ep != e)
+        ep = &(*ep)->hash_next;
+    *ep = e->hash_next;
+    lru_unlink(qc, e);
+    entry_destroy(e);
+    qc->num_entries--;
+}
+
+int query_cache_lookup(query_cache_t qc, const void *transform,
+                       const char *query, ODR odr,
+                       struct query_cache_result *res)
+{
+    struct query_cache_entry *e;
+    unsigned hash;
+    int ret = 0;
+
+    if (!qc)
+        return 0;
+    hash = query_hash(transform, query);
+    yaz_mutex_enter(qc->mutex);
+    e = lookup(qc, transform, query, hash);
+    if (e)
+    {
+        res->rpn = 0;
+        ret = 1;
+        if (e->ber)
+        {
+            odr_setbuf(qc->decode, e->ber, e->ber_len, 0);
+            if (z_RPNQuery(qc->decode, &res->rpn, 0, 0))
+                nmem_transfer(odr_getmem(odr), odr_getmem(qc->decode));
+            else
+                ret = 0;
+            odr_reset(qc->decode);
+        }
+    }
+    if (ret)
+    {
+        res->sortkeys = odr_strdup_null(odr, e->sortkeys);
+        res->errcode = e->errcode;
+        res->errstring = odr_strdup_null(odr, e->errstring);
+        lru_unlink(qc, e);
+        lru_push(qc, e);
+        qc->hits++;
+    }
+    else
+        qc->misses++;
+    yaz_mutex_leave(qc->mutex);
+    return ret;
+}
+
+void query_cache_add(query_cache_t qc, const void *transform,
+                     const char *query, const struct query_cache_result *res)
+{
+    struct query_cache_entry *e;
+    unsigned hash;
+
+    if (!qc)
+        return;
+    hash = query_hash(transform, query);
+    yaz_mutex_enter(qc->mutex);
+    if (!lookup(qc, transform, query, hash))
+    {
+        Z_RPNQuery *rpn = res->rpn;
+
+        e = (struct query_cache_entry *) xmalloc(sizeof(*e));
+        e->transform = transform;
+        e->query = xstrdup(query);
+        e->hash = hash;
+        e->ber = 0;
+        e->ber_len = 0;
+        e->sortkeys = 0;
+        e->errcode = res->errcode;
+        e->errstring = 0;
+        if (rpn && z_RPNQuery(qc->encode, &rpn, 0, 0))
+        {
+            char *buf = odr_getbuf(qc->encode, &e->ber_len, 0);
+            e->ber = (char *) xmalloc(e->ber_len);
+            memcpy(e->ber, buf, e->ber_len);
+        }
+        odr_reset(qc->encode);
+        if (rpn && !e->ber)
+            entry_destroy(e); /* could not encode: do not cache */
+        else
+        {
+            e->sortkeys = res->sortkeys ? xstrdup(res->sortkeys) : 0;
+            e->errstring = res->errstring ? xstrdup(res->errstring) : 0;
+            e->hash_next = qc->hash[hash & qc->hash_mask];
+            qc->hash[hash & qc->hash_mask] = e;
+            lru_push(qc, e);
+            if (++qc->num_entries > qc->max_entries)
+                evict(qc);
+        }
+    }
+    yaz_mutex_leave(qc->mutex);
+}
+
+void query_cache_stat(query_cache_t qc, long *hits, long *misses,
+                      int *entries)
+{
+    *hits = *misses = 0;
+    *entries = 0;
+    if (!qc)
+        return;
+    yaz_mutex_enter(qc->mutex);
+    *hits = qc->hits;
+    *misses = qc->misses;
+    *entries = qc->num_entries;
+    yaz_mutex_leave(qc->mutex);
+}
+/*
+ * Local variables:
+ * c-basic-offset: 4
+ * c-file-style: "Stroustrup"
+ * indent-tabs-mode: nil
+ * End:
+ * vim: shiftwidth=4 tabstop=8 expandtab
+ */
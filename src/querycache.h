@@ -0,0 +1,96 @@
+/* This file is part of the YAZ toolkit.
+ * Copyright (C) 1995-2013 Index Data.
+ * All rights reserved.
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Index Data nor the names of its contributors
+ *       may be used to endorse or promote products derived from this
+ *       software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS AND CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file querycache.h
+ * \brief Cache of query translations done by GFS
+ */
+
+#ifndef QUERYCACHE_H
+#define QUERYCACHE_H
+
+#include <yaz/z-core.h>
+
+typedef struct query_cache *query_cache_t;
+
+/** \brief result of a query translation */
+struct query_cache_result {
+    Z_RPNQuery *rpn;   /* translated query; 0 if translation failed */
+    char *sortkeys;    /* SRU sort keys from query (or 0) */
+    int errcode;       /* SRU diagnostic; 0 for success */
+    char *errstring;   /* additional information for errcode (or 0) */
+};
+
+/** \brief creates query cache
+    \param max_entries maximum number of translations kept
+    \returns cache handle; 0 if max_entries <= 0 (no caching)
+*/
+query_cache_t query_cache_create(int max_entries);
+
+/** \brief destroys query cache */
+void query_cache_destroy(query_cache_t qc);
+
+/** \brief looks up translation
+    \param qc query cache (0 for none)
+    \param transform identity of translation (CQL transform, bibset, ..)
+    \param query query string
+    \param odr memory for result
+    \param res result (when found)
+    \retval 1 found
+    \retval 0 not found
+*/
+int query_cache_lookup(query_cache_t qc, const void *transform,
+                       const char *query, ODR odr,
+                       struct query_cache_result *res);
+
+/** \brief stores translation
+    \param qc query cache (0 for none)
+    \param transform identity of translation
+    \param query query string
+    \param res result of translation
+*/
+void query_cache_add(query_cache_t qc, const void *transform,
+                     const char *query, const struct query_cache_result *res);
+
+/** \brief returns cache statistics
+    \param qc query cache
+    \param hits number of successful lookups (result)
+    \param misses number of failed lookups (result)
+    \param entries number of translations in cache (result)
+*/
+void query_cache_stat(query_cache_t qc, long *hits, long *misses,
+                      int *entries);
+
+#endif
+/*
+ * Local variables:
+ * c-basic-offset: 4
+ * c-file-style: "Stroustrup"
+ * indent-tabs-mode: nil
+ * End:
+ * vim: shiftwidth=4 tabstop=8 expandtab
+ */
@@ -444,8 +444,8 @@ static void *construct_marc(const xmlNode *ptr,
     }
     if (info->input_charset && info->output_charset)
     {
-        yaz_iconv_t cd = yaz_iconv_open(info->output_charset,
-                                        info->input_charset);
+        yaz_iconv_t cd = yaz_iconv_pool_get(info->output_charset,
+                                            info->input_charset);
         if (!cd)
         {
             wrbuf_printf(wr_error,
@@ -456,7 +456,7 @@ static void *construct_marc(const xmlNode *ptr,
             nmem_destroy(info->nmem);
             return 0;
         }
-        yaz_iconv_close(cd);
+        yaz_iconv_pool_put(cd);
     }
     else if (!info->output_charset)
     {
@@ -482,7 +482,8 @@ static int convert_marc(void *info, WRBUF record, WRBUF wr_error)
     struct marc_info *mi = info;
     int ret = 0;
 
-    yaz_iconv_t cd = yaz_iconv_open(mi->output_charset, mi->input_charset);
+    yaz_iconv_t cd = yaz_iconv_pool_get(mi->output_charset,
+                                        mi->input_charset);
     yaz_marc_t mt = yaz_marc_create();
 
     yaz_marc_xml(mt, mi->output_format_mode);
@@ -493,8 +494,11 @@ static int convert_marc(void *info, WRBUF record, WRBUF wr_error)
         yaz_marc_iconv(mt, cd);
     if (mi->input_format_mode == YAZ_MARC_ISO2709)
     {
-        int sz = yaz_marc_read_iso2709(mt, wrbuf_buf(record),
-                                       wrbuf_len(record));
+        int sz;
+
+        /* record is kept until written to out */
+        yaz_marc_reference_input(mt, 1);
+        sz = yaz_marc_read_iso2709(mt, wrbuf_buf(record), wrbuf_len(record));
         if (sz > 0)
             ret = 0;
         else
@@ -523,7 +527,22 @@ static int convert_marc(void *info, WRBUF record, WRBUF wr_error)
         wrbuf_printf(wr_error, "unsupported input format");
         ret = -1;
     }
-    if (ret == 0)
+    if (ret == 0 && mi->input_format_mode == YAZ_MARC_ISO2709)
+    {
+        /* fields still point into record, so it can't be written to */
+        WRBUF out = wrbuf_alloc();
+        ret = yaz_marc_write_mode(mt, out);
+        if (ret)
+            wrbuf_printf(wr_error, "yaz_marc_write_mode failed");
+        else
+        {   /* record takes over the buffer; out frees the input */
+            struct wrbuf tmp = *record;
+            *record = *out;
+            *out = tmp;
+        }
+        wrbuf_destroy(out);
+    }
+    else if (ret == 0)
     {
         wrbuf_rewind(record);
         ret = yaz_marc_write_mode(mt, record);
@@ -531,7 +550,7 @@ static int convert_marc(void *info, WRBUF record, WRBUF wr_error)
             wrbuf_printf(wr_error, "yaz_marc_write_mode failed");
     }
     if (cd)
-        yaz_iconv_close(cd);
+        yaz_iconv_pool_put(cd);
     yaz_marc_destroy(mt);
     return ret;
 }
@@ -640,8 +659,8 @@ int yaz_record_conv_opac_record(yaz_record_conv_t p,
 
         WRBUF res = wrbuf_alloc();
         yaz_marc_t mt = yaz_marc_create();
-        yaz_iconv_t cd = yaz_iconv_open(mi->output_charset,
-                                        mi->input_charset);
+        yaz_iconv_t cd = yaz_iconv_pool_get(mi->output_charset,
+                                            mi->input_charset);
 
         wrbuf_rewind(p->wr_error);
         yaz_marc_xml(mt, mi->output_format_mode);
@@ -658,7 +677,7 @@ int yaz_record_conv_opac_record(yaz_record_conv_t p,
         }
         yaz_marc_destroy(mt);
         if (cd)
-            yaz_iconv_close(cd);
+            yaz_iconv_pool_put(cd);
         wrbuf_destroy(res);
     }
     return ret;
@@ -62,11 +62,11 @@ static yaz_iconv_t iconv_create_charset(const char *record_charset,
     }
 
     if (from_set1)
-        cd = yaz_iconv_open(to_set, from_set1);
+        cd = yaz_iconv_pool_get(to_set, from_set1);
     if (cd2)
     {
         if (from_set2)
-            *cd2 = yaz_iconv_open(to_set, from_set2);
+            *cd2 = yaz_iconv_pool_get(to_set, from_set2);
         else
             *cd2 = 0;
     }
@@ -77,23 +77,46 @@ static const char *return_marc_record(WRBUF wrbuf,
                                       int marc_type,
                                       int *len,
                                       const char *buf, int sz,
-                                      const char *record_charset)
+                                      const char *record_charset,
+                                      yaz_marc_t *mt_p)
 {
     yaz_iconv_t cd = iconv_create_charset(record_charset, 0);
-    yaz_marc_t mt = yaz_marc_create();
+    yaz_marc_t mt = mt_p ? *mt_p : 0;
     const char *ret_string = 0;
+    int r = 1;
 
-    if (cd)
-        yaz_marc_iconv(mt, cd);
-    yaz_marc_xml(mt, marc_type);
-    if (yaz_marc_decode_wrbuf(mt, buf, sz, wrbuf) > 0)
+    if (!mt)
     {
-        *len = wrbuf_len(wrbuf);
-        ret_string = wrbuf_cstr(wrbuf);
+        mt = yaz_marc_create();
+        if (mt_p)
+            yaz_marc_reference_input(mt, 1); /* buf outlives mt */
+        r = yaz_marc_read_iso2709(mt, buf, sz);
+        if (r > 0 && mt_p)
+            *mt_p = mt;
     }
-    yaz_marc_destroy(mt);
+    if (r > 0)
+    {
+        yaz_marc_iconv(mt, cd);
+        yaz_marc_xml(mt, marc_type);
+        if (yaz_marc_write_mode(mt, wrbuf) == 0)
+        {
+            *len = wrbuf_len(wrbuf);
+            ret_string = wrbuf_cstr(wrbuf);
+        }
+        yaz_marc_iconv(mt, 0);
+        if (sz > 9)
+        {
+            /* MARCXML and turbomarc writers set leader 09 */
+            char leader09[2];
+            leader09[0] = buf[9];
+            leader09[1] = '\0';
+            yaz_marc_modify_leader(mt, 9, leader09);
+        }
+    }
+    if (!mt_p || *mt_p != mt)
+        yaz_marc_destroy(mt);
     if (cd)
-        yaz_iconv_close(cd);
+        yaz_iconv_pool_put(cd);
     return ret_string;
 }
 
@@ -119,9 +142,9 @@ static const char *return_opac_record(WRBUF wrbuf,
     yaz_marc_destroy(mt);
 
     if (cd)
-        yaz_iconv_close(cd);
+        yaz_iconv_pool_put(cd);
     if (cd2)
-        yaz_iconv_close(cd2);
+        yaz_iconv_pool_put(cd2);
     *len = wrbuf_len(wrbuf);
     return wrbuf_cstr(wrbuf);
 }
@@ -140,7 +163,7 @@ static const char *return_string_record(WRBUF wrbuf,
 
         buf = wrbuf_cstr(wrbuf);
         sz = wrbuf_len(wrbuf);
-        yaz_iconv_close(cd);
+        yaz_iconv_pool_put(cd);
     }
     *len = sz;
     return buf;
@@ -148,7 +171,8 @@ static const char *return_string_record(WRBUF wrbuf,
 
 static const char *return_record_wrbuf(WRBUF wrbuf, int *len,
                                        Z_NamePlusRecord *npr,
-                                       int marctype, const char *charset)
+                                       int marctype, const char *charset,
+                                       yaz_marc_t *mt_p)
 {
     Z_External *r = (Z_External *) npr->u.databaseRecord;
     const Odr_oid *oid = r->direct_reference;
@@ -173,7 +197,7 @@ static const char *return_record_wrbuf(WRBUF wrbuf, int *len,
                 wrbuf, marctype, len,
                 (const char *) r->u.octet_aligned->buf,
                 r->u.octet_aligned->len,
-                charset);
+                charset, mt_p);
             if (ret_buf)
                 return ret_buf;
             /* bad ISO2709. Return fail unless raw (ISO2709) is wanted */
@@ -199,9 +223,10 @@ static const char *return_record_wrbuf(WRBUF wrbuf, int *len,
 static const char *get_record_format(WRBUF wrbuf, int *len,
                                      Z_NamePlusRecord *npr,
                                      int marctype, const char *charset,
-                                     const char *format)
+                                     const char *format, yaz_marc_t *mt_p)
 {
-    const char *res = return_record_wrbuf(wrbuf, len, npr, marctype, charset);
+    const char *res = return_record_wrbuf(wrbuf, len, npr, marctype, charset,
+                                          mt_p);
 #if YAZ_HAVE_XML2
     if (*format == '1')
     {
@@ -334,6 +359,14 @@ static const char *base64_render(NMEM nmem, WRBUF wrbuf,
 const char *yaz_record_render(Z_NamePlusRecord *npr, const char *schema,
                               WRBUF wrbuf,
                               const char *type_spec, int *len)
+{
+    return yaz_record_render2(npr, schema, wrbuf, type_spec, len, 0);
+}
+
+const char *yaz_record_render2(Z_NamePlusRecord *npr, const char *schema,
+                               WRBUF wrbuf,
+                               const char *type_spec, int *len,
+                               yaz_marc_t *mt_p)
 {
     const char *ret = 0;
     NMEM nmem = 0;
@@ -430,22 +463,23 @@ const char *yaz_record_render(Z_NamePlusRecord *npr, const char *schema,
         ;
     else if (!strcmp(type, "render"))
     {
-        ret = get_record_format(wrbuf, len, npr, YAZ_MARC_LINE, charset, format);
+        ret = get_record_format(wrbuf, len, npr, YAZ_MARC_LINE, charset,
+                                format, mt_p);
     }
     else if (!strcmp(type, "xml"))
     {
         ret = get_record_format(wrbuf, len, npr, YAZ_MARC_MARCXML, charset,
-                                format);
+                                format, mt_p);
     }
     else if (!strcmp(type, "txml"))
     {
         ret = get_record_format(wrbuf, len, npr, YAZ_MARC_TURBOMARC, charset,
-                                format);
+                                format, mt_p);
     }
     else if (!strcmp(type, "raw"))
     {
         ret = get_record_format(wrbuf, len, npr, YAZ_MARC_ISO2709, charset,
-                                format);
+                                format, mt_p);
     }
     else if (!strcmp(type, "ext"))
     {
@@ -456,7 +490,7 @@ const char *yaz_record_render(Z_NamePlusRecord *npr, const char *schema,
     {
         if (npr->u.databaseRecord->which == Z_External_OPAC)
             ret = get_record_format(wrbuf, len, npr, YAZ_MARC_MARCXML, charset,
-                                    format);
+                                    format, mt_p);
     }
 
     if (base64_xpath && *len != -1)
@@ -14,12 +14,19 @@
 #endif
 
 #include <stdlib.h>
+#if HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef WIN32
+#include <io.h>
+#endif
 
 #include <yaz/xmalloc.h>
 #include "session.h"
 
 void request_enq(request_q *q, request *r)
 {
+    r->next = 0;
     if (q->tail)
         q->tail->next = r;
     else
@@ -46,6 +53,26 @@ request *request_deq(request_q *q)
     return r;
 }
 
+request *request_deq_x(request_q *q, request *r)
+{
+    request *prev = 0, *p;
+
+    for (p = q->head; p; prev = p, p = p->next)
+        if (p == r)
+        {
+            if (prev)
+                prev->next = p->next;
+            else
+                q->head = p->next;
+            if (q->tail == p)
+                q->tail = prev;
+            p->next = 0;
+            q->num--;
+            return p;
+        }
+    return 0;
+}
+
 void request_initq(request_q *q)
 {
     q->head = q->tail = q->list = 0;
@@ -76,13 +103,34 @@ request *request_get(request_q *q)
             abort();
         r->response = 0;
         r->size_response = 0;
+        r->encode = 0;
+        r->decode = 0;
     }
     r->q = q;
     r->gdu_request = 0;
     r->apdu_request = 0;
     r->request_mem = 0;
     r->len_response = 0;
+    r->response_ext = 0;
+    r->len_response_ext = 0;
+    r->response_mem = 0;
+    r->metrics_op = -1;
+    r->metrics_start = 0.0;
+    r->len_request = 0;
+    r->span_decode = 0.0;
+    r->span_backend = 0.0;
+    r->metrics_backend = 0.0;
+    r->metrics_bend = -1;
+    r->span_backend_phase = 0;
+    r->response_fd = -1;
+    r->response_fd_len = 0;
+    r->response_fd_sent = 0;
     r->clientData = 0;
+    r->deferred_rr = 0;
+    r->deferred_done = 0;
+    r->deferred_busy = 0;
+    r->deferred_cont = 0;
+    r->deferred_data = 0;
     r->state = REQUEST_IDLE;
     r->next = 0;
     return r;
@@ -93,6 +141,21 @@ void request_release(request *r)
     request_q *q = r->q;
     if (r->request_mem)
         nmem_destroy(r->request_mem);
+    if (r->response_mem)
+        nmem_destroy(r->response_mem);
+    r->response_mem = 0;
+    if (r->response_fd != -1)
+        close(r->response_fd);
+    r->response_fd = -1;
+    if (r->encode)
+    {
+        odr_setbuf(r->encode, 0, 0, 0); /* response buffer is ours */
+        odr_destroy(r->encode);
+    }
+    r->encode = 0;
+    if (r->decode)
+        odr_destroy(r->decode);
+    r->decode = 0;
     r->next = q->list;
     q->list = r;
 }
@@ -33,6 +33,8 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
 
 #if HAVE_SYS_TYPES_H
 #include <sys/types.h>
@@ -50,6 +52,13 @@
 #if HAVE_UNISTD_H
 #include <unistd.h>
 #endif
+#if HAVE_SYS_SENDFILE_H
+#include <sys/sendfile.h>
+#endif
+
+#if YAZ_POSIX_THREADS
+#include <pthread.h>
+#endif
 
 #if YAZ_HAVE_XML2
 #include <libxml/parser.h>
@@ -58,9 +67,11 @@
 
 #include <yaz/xmalloc.h>
 #include <yaz/comstack.h>
+#include <yaz/tcpip.h>
+#include <yaz/errno.h>
 #include "eventl.h"
 #include "session.h"
-#include "mime.h"
+#include "metrics.h"
 #include <yaz/proto.h>
 #include <yaz/oid_db.h>
 #include <yaz/log.h>
@@ -72,6 +83,8 @@
 #include <yaz/otherinfo.h>
 #include <yaz/yaz-util.h>
 #include <yaz/pquery.h>
+#include <yaz/rpn2cql.h>
+#include <yaz/thread_create.h>
 #include <yaz/oid_db.h>
 
 #include <yaz/srw.h>
@@ -81,6 +94,10 @@
 static void process_gdu_request(association *assoc, request *req);
 static int process_z_request(association *assoc, request *req, char **msg);
 static int process_gdu_response(association *assoc, request *req, Z_GDU *res);
+static int send_response_file(association *assoc, request *req);
+
+/* HTTP bodies at least this size are not copied to encoding buffer */
+#define HTTP_BODY_PUTV_MIN 4096
 static int process_z_response(association *assoc, request *req, Z_APDU *res);
 static Z_APDU *process_initRequest(association *assoc, request *reqb);
 static Z_External *init_diagnostics(ODR odr, int errcode,
@@ -88,6 +105,7 @@ static Z_External *init_diagnostics(ODR odr, int errcode,
 static Z_APDU *process_searchRequest(association *assoc, request *reqb);
 static Z_APDU *response_searchRequest(association *assoc, request *reqb,
                                       bend_search_rr *bsrr);
+static void search_resume(association *assoc, request *reqb);
 static Z_APDU *process_presentRequest(association *assoc, request *reqb);
 static Z_APDU *process_scanRequest(association *assoc, request *reqb);
 static Z_APDU *process_sortRequest(association *assoc, request *reqb);
@@ -95,6 +113,8 @@ static void process_close(association *assoc, request *reqb);
 static Z_APDU *process_deleteRequest(association *assoc, request *reqb);
 static Z_APDU *process_segmentRequest(association *assoc, request *reqb);
 static Z_APDU *process_ESRequest(association *assoc, request *reqb);
+static void do_close_req(association *a, int reason, char *message,
+                         request *req);
 
 /* dynamic logging levels */
 static int logbits_set = 0;
@@ -102,6 +122,7 @@ static int log_session = 0; /* one-line logs for session */
 static int log_sessiondetail = 0; /* more detailed stuff */
 static int log_request = 0; /* one-line logs for requests */
 static int log_requestdetail = 0;  /* more detailed stuff */
+static int log_spans = 0; /* time of request phases at session end */
 
 /** get_logbits sets global loglevel bits */
 static void get_logbits(void)
@@ -113,6 +134,7 @@ static void get_logbits(void)
         log_sessiondetail = yaz_log_module_level("sessiondetail");
         log_request = yaz_log_module_level("request");
         log_requestdetail = yaz_log_module_level("requestdetail");
+        log_spans = yaz_log_module_level("spans");
     }
 }
 
@@ -128,6 +150,12 @@ static void wr_diag(WRBUF w, int error, const char *addinfo)
     wrbuf_puts(w, " ");
 }
 
+/* non-zero if memory charged to session exceeds limit (0 = no limit) */
+static int mem_over_limit(association *assoc, size_t limit)
+{
+    return limit && nmem_account_current(assoc->mem_account) > limit;
+}
+
 static int odr_int_to_int(Odr_int v)
 {
     if (v >= INT_MAX)
@@ -164,6 +192,12 @@ association *create_association(IOCHAN channel, COMSTACK link,
     if (!(anew->decode = odr_createmem(ODR_DECODE)) ||
         !(anew->encode = odr_createmem(ODR_ENCODE)))
         return 0;
+    anew->mem_account = nmem_account_create();
+    nmem_set_account(odr_getmem(anew->decode), anew->mem_account);
+    nmem_set_account(odr_getmem(anew->encode), anew->mem_account);
+    anew->mem_soft = anew->mem_hard = 0;
+    anew->mem_limited = 0;
+    anew->spans = log_spans ? yaz_spans_create("gfs") : 0;
     if (apdufile && *apdufile)
     {
         FILE *f;
@@ -195,19 +229,66 @@ association *create_association(IOCHAN channel, COMSTACK link,
     anew->state = ASSOC_NEW;
     request_initq(&anew->incoming);
     request_initq(&anew->outgoing);
+    request_initq(&anew->deferred);
+    anew->deferred_mutex = 0;
+    anew->deferred_cond = 0;
+    anew->wake_chan = 0;
+    anew->wake_fd[0] = anew->wake_fd[1] = -1;
+    anew->destroy_deferred = 0;
+    anew->concurrent_max = 1;
     anew->proto = cs_getproto(link);
     anew->server = 0;
+    gfs_metrics_association(1);
     return anew;
 }
 
+static void association_free(association *h);
+
 /*
- * Free association and release resources.
+ * Free association and release resources. If the backend still owns
+ * deferred requests, the association is only marked dead; it is freed
+ * by deferred_io when the last of them completes.
  */
 void destroy_association(association *h)
+{
+    request *req = 0;
+
+    if (h->deferred_mutex)
+    {
+        yaz_mutex_enter(h->deferred_mutex);
+        for (req = request_head(&h->deferred); req; req = req->next)
+            if (!req->deferred_done || req->deferred_busy)
+                break;
+        yaz_mutex_leave(h->deferred_mutex);
+    }
+    if (req)
+    {
+        yaz_log(log_session, "Deferred backend response outstanding");
+        h->state = ASSOC_DEAD;
+        h->destroy_deferred = 1;
+    }
+    else
+        association_free(h);
+}
+
+static void association_free(association *h)
 {
     statserv_options_block *cb = statserv_getcontrol();
     request *req;
 
+    if (h->deferred_mutex)
+    {
+        while ((req = request_deq(&h->deferred)))
+            request_release(req);
+        yaz_mutex_destroy(&h->deferred_mutex);
+        yaz_cond_destroy(&h->deferred_cond);
+    }
+    if (h->wake_chan)
+    {
+        iochan_destroy(h->wake_chan);
+        close(h->wake_fd[0]);
+        close(h->wake_fd[1]);
+    }
     xfree(h->init);
     odr_destroy(h->decode);
     odr_destroy(h->encode);
@@ -223,7 +304,16 @@ void destroy_association(association *h)
         request_release(req);
     request_delq(&h->incoming);
     request_delq(&h->outgoing);
+    yaz_log(log_session, "Memory peak %ld bytes, %d requests limited",
+            (long) nmem_account_peak(h->mem_account), h->mem_limited);
+    nmem_account_destroy(h->mem_account);
+    if (h->spans)
+    {
+        yaz_spans_log(h->spans, log_spans);
+        yaz_spans_destroy(&h->spans);
+    }
     xfree(h);
+    gfs_metrics_association(-1);
     xmalloc_trav("session closed");
 }
 
@@ -261,12 +351,434 @@ static void do_close(association *a, int reason, char *message)
     do_close_req(a, reason, message, req);
 }
 
+/*
+ * Deferred backend responses. A request is put on assoc->deferred before
+ * bend_search/bend_fetch is called, so that bend_complete_search/fetch
+ * can find it, even if called before the handler returns. If the
+ * backend leaves the operation pending, the request stays there and
+ * input is suspended until the completion wakes the event loop through
+ * the association's pipe and deferred_cont resumes processing.
+ */
+static void deferred_begin(association *assoc, request *req, void *rr)
+{
+    if (!assoc->deferred_mutex)
+    {
+        yaz_mutex_create(&assoc->deferred_mutex);
+        yaz_cond_create(&assoc->deferred_cond);
+    }
+    yaz_mutex_enter(assoc->deferred_mutex);
+    req->deferred_rr = rr;
+    req->deferred_done = 0;
+    request_enq(&assoc->deferred, req);
+    yaz_mutex_leave(assoc->deferred_mutex);
+}
+
+static void deferred_io(IOCHAN h, int event);
+
+/* whether reading of further requests must wait for deferred ones */
+static int assoc_input_blocked(association *assoc)
+{
+    return assoc->deferred.num >= assoc->concurrent_max
+        || (assoc->deferred.num && request_head(&assoc->incoming));
+}
+
+/* whether req may run next to other operations on the association */
+static int request_concurrent(request *req)
+{
+    if (req->gdu_request->which != Z_GDU_Z3950)
+        return 0;
+    switch (req->gdu_request->u.z3950->which)
+    {
+    case Z_APDU_searchRequest:
+    case Z_APDU_presentRequest:
+    case Z_APDU_scanRequest:
+        return 1;
+    }
+    return 0;
+}
+
+/* whether req may be processed now */
+static int request_may_start(association *assoc, request *req)
+{
+    if (!assoc->deferred.num)
+        return 1;
+    if (assoc->deferred.num >= assoc->concurrent_max)
+        return 0;
+    return request_concurrent(req);
+}
+
+/* makes assoc->encode, assoc->decode refer to streams of req if it
+   has its own (concurrent operation). Previous ones saved in save */
+static void request_streams_enter(association *assoc, request *req,
+                                  ODR *save)
+{
+    save[0] = assoc->encode;
+    save[1] = assoc->decode;
+    if (req->encode)
+    {
+        assoc->encode = req->encode;
+        assoc->decode = req->decode;
+    }
+}
+
+static void request_streams_leave(association *assoc, ODR *save)
+{
+    assoc->encode = save[0];
+    assoc->decode = save[1];
+}
+
+/* creates wake pipe if not already there. Returns 0 if unsupported */
+static int deferred_wake_init(association *assoc)
+{
+#ifdef WIN32
+    return 0;
+#else
+    if (assoc->wake_chan)
+        return 1;
+    if (pipe(assoc->wake_fd))
+    {
+        yaz_log(YLOG_WARN|YLOG_ERRNO, "pipe");
+        assoc->wake_fd[0] = assoc->wake_fd[1] = -1;
+        return 0;
+    }
+    fcntl(assoc->wake_fd[0], F_SETFL, O_NONBLOCK);
+    fcntl(assoc->wake_fd[1], F_SETFL, O_NONBLOCK);
+    assoc->wake_chan = iochan_create(assoc->wake_fd[0], deferred_io,
+                                     EVENT_INPUT, 0);
+    iochan_setdata(assoc->wake_chan, assoc);
+    iochan_append(assoc->client_chan, assoc->wake_chan);
+    return 1;
+#endif
+}
+
+/*
+ * Called after bend_search/bend_fetch returned. If the operation is still
+ * pending, cont is called later from the event loop and 1 is returned.
+ * If cont is NULL (the caller can not be resumed) this waits for the
+ * completion. Returns 0 if the result is available now.
+ */
+static int deferred_end(association *assoc, request *req, int pending,
+                        void (*cont)(association *assoc, request *req))
+{
+    int deferred = 0;
+
+    yaz_mutex_enter(assoc->deferred_mutex);
+    if (pending && (!req->deferred_done || req->deferred_busy))
+    {
+        if (cont && deferred_wake_init(assoc))
+        {
+            req->state = REQUEST_DEFERRED;
+            req->deferred_cont = cont;
+            deferred = 1;
+        }
+        else
+        {
+            while (!req->deferred_done || req->deferred_busy)
+                yaz_cond_wait(assoc->deferred_cond, assoc->deferred_mutex, 0);
+        }
+    }
+    if (!deferred)
+        request_deq_x(&assoc->deferred, req);
+    yaz_mutex_leave(assoc->deferred_mutex);
+    if (deferred)
+    {
+        yaz_log(log_requestdetail, "Backend response deferred");
+        /* no more requests until this one is done */
+        if (!(assoc->cs_put_mask & EVENT_INPUT) && assoc_input_blocked(assoc))
+            iochan_clearflag(assoc->client_chan, EVENT_INPUT);
+    }
+    return deferred;
+}
+
+/* wakes the event loop if req can be resumed. deferred_mutex held */
+static void deferred_wake(association *assoc, request *req)
+{
+    if (req->deferred_done && !req->deferred_busy
+        && req->state == REQUEST_DEFERRED)
+    {
+        if (write(assoc->wake_fd[1], "", 1) < 0 && errno != EAGAIN)
+            yaz_log(YLOG_WARN|YLOG_ERRNO, "write wake pipe");
+    }
+}
+
+static void deferred_complete(association *assoc, void *rr)
+{
+    request *req;
+
+    yaz_mutex_enter(assoc->deferred_mutex);
+    for (req = request_head(&assoc->deferred); req; req = req->next)
+        if (req->deferred_rr == rr)
+            break;
+    if (!req)
+        yaz_log(YLOG_WARN, "bend_complete: no such request");
+    else
+    {
+        req->deferred_done = 1;
+        deferred_wake(assoc, req);
+    }
+    yaz_cond_broadcast(assoc->deferred_cond);
+    yaz_mutex_leave(assoc->deferred_mutex);
+}
+
+/*
+ * Called by a worker when the handler has returned. Until then the
+ * request is busy: it is neither resumed nor released, even if the
+ * backend completed it from another thread, so pending (a member of rr)
+ * is still valid here.
+ */
+static void deferred_worker_done(association *assoc, request *req,
+                                 int *pending)
+{
+    yaz_mutex_enter(assoc->deferred_mutex);
+    req->deferred_busy = 0;
+    if (!pending || !*pending)
+        req->deferred_done = 1;
+    deferred_wake(assoc, req);
+    yaz_cond_broadcast(assoc->deferred_cond);
+    yaz_mutex_leave(assoc->deferred_mutex);
+}
+
+void bend_complete_search(bend_search_rr *rr)
+{
+    deferred_complete(rr->association, rr);
+}
+
+void bend_complete_fetch(bend_fetch_rr *rr)
+{
+    deferred_complete(rr->association, rr);
+}
+
+static void deferred_io(IOCHAN h, int event)
+{
+    association *assoc = (association *) iochan_getdata(h);
+    char buf[64];
+
+    if (event != EVENT_INPUT)
+        return;
+    while (read(assoc->wake_fd[0], buf, sizeof(buf)) > 0)
+        ;
+    for (;;)
+    {
+        request *req;
+
+        yaz_mutex_enter(assoc->deferred_mutex);
+        for (req = request_head(&assoc->deferred); req; req = req->next)
+            if (req->deferred_done && !req->deferred_busy
+                && req->state == REQUEST_DEFERRED)
+                break;
+        if (req)
+            request_deq_x(&assoc->deferred, req);
+        yaz_mutex_leave(assoc->deferred_mutex);
+        if (!req)
+            break;
+        yaz_log(log_requestdetail, "Backend response completed");
+        if (assoc->state == ASSOC_DEAD)
+            request_release(req);
+        else
+        {
+            ODR save[2];
+
+            req->state = REQUEST_PENDING;
+            gfs_metrics_backend(req->metrics_bend,
+                                gfs_metrics_now() - req->metrics_backend);
+            if (req->span_backend_phase)
+            {
+                yaz_spans_stop(assoc->spans,
+                               gfs_metrics_op_name(req->metrics_op),
+                               req->span_backend_phase, req->span_backend);
+                req->span_backend_phase = 0;
+            }
+            request_streams_enter(assoc, req, save);
+            (*req->deferred_cont)(assoc, req);
+            request_streams_leave(assoc, save);
+        }
+    }
+    if (assoc->destroy_deferred && !assoc->deferred.num)
+        association_free(assoc);
+}
+
+/* encodes response of a resumed request */
+static void deferred_response(association *assoc, request *req, Z_APDU *res)
+{
+    if (req->state == REQUEST_DEFERRED)
+        return; /* deferred again */
+    if (!res || process_z_response(assoc, req, res) < 0)
+        do_close_req(assoc, Z_Close_systemProblem, "Unknown Error", req);
+}
+
+/*
+ * Worker threads that run backend handlers of concurrent operations.
+ * Shared by all associations of the process. Threads are started on
+ * demand, up to WORKERS_MAX.
+ */
+#define WORKERS_MAX 16
+
+struct worker_job {
+    association *assoc;
+    request *req;
+    void *rr;
+    int *pending;
+    void (*fun)(association *assoc, void *rr);
+    struct worker_job *next;
+};
+
+#if YAZ_POSIX_THREADS
+static YAZ_MUTEX workers_mutex = 0;
+static YAZ_COND workers_cond = 0;
+static struct worker_job *workers_jobs = 0;
+static int workers_num = 0;
+static int workers_idle = 0;
+
+static void workers_init(void)
+{
+    yaz_mutex_create(&workers_mutex);
+    yaz_cond_create(&workers_cond);
+}
+
+static void *worker_handler(void *p)
+{
+    yaz_mutex_enter(workers_mutex);
+    for (;;)
+    {
+        struct worker_job *job = workers_jobs;
+
+        if (!job)
+        {
+            workers_idle++;
+            yaz_cond_wait(workers_cond, workers_mutex, 0);
+            workers_idle--;
+            continue;
+        }
+        workers_jobs = job->next;
+        yaz_mutex_leave(workers_mutex);
+
+        if (job->pending)
+            *job->pending = 0;
+        (*job->fun)(job->assoc, job->rr);
+        deferred_worker_done(job->assoc, job->req, job->pending);
+        xfree(job);
+
+        yaz_mutex_enter(workers_mutex);
+    }
+    return 0;
+}
+#endif
+
+/* queues fun(assoc, rr) for a worker. Returns 0 if not possible */
+static int worker_submit(association *assoc, request *req,
+                         void *rr, int *pending,
+                         void (*fun)(association *assoc, void *rr))
+{
+#if YAZ_POSIX_THREADS
+    static pthread_once_t once_control = PTHREAD_ONCE_INIT;
+    struct worker_job *job, **jp;
+
+    pthread_once(&once_control, workers_init);
+    yaz_mutex_enter(workers_mutex);
+    if (workers_idle == 0 && workers_num < WORKERS_MAX)
+    {
+        yaz_thread_t t = yaz_thread_create(worker_handler, 0);
+        if (t)
+        {
+            yaz_thread_detach(&t);
+            workers_num++;
+        }
+    }
+    if (workers_num == 0)
+    {
+        yaz_mutex_leave(workers_mutex);
+        return 0;
+    }
+    job = (struct worker_job *) xmalloc(sizeof(*job));
+    job->assoc = assoc;
+    job->req = req;
+    job->rr = rr;
+    job->pending = pending;
+    job->fun = fun;
+    job->next = 0;
+    for (jp = &workers_jobs; *jp; jp = &(*jp)->next)
+        ;
+    *jp = job;
+    req->deferred_busy = 1; /* before the worker can see the job */
+    yaz_cond_signal(workers_cond);
+    yaz_mutex_leave(workers_mutex);
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+static void call_bend_search(association *assoc, void *rr)
+{
+    (*assoc->init->bend_search)(assoc->backend, (bend_search_rr *) rr);
+}
+
+static void call_bend_fetch(association *assoc, void *rr)
+{
+    (*assoc->init->bend_fetch)(assoc->backend, (bend_fetch_rr *) rr);
+}
+
+static void call_bend_scan(association *assoc, void *rr)
+{
+    ((int (*)(void *, bend_scan_rr *))
+     (*assoc->init->bend_scan))(assoc->backend, (bend_scan_rr *) rr);
+}
+
+/*
+ * Calls a backend handler through fun for request req. pending points to
+ * the handler's pending member (0 if it has none). Operations of an
+ * association that runs concurrently are given to a worker. Returns 1 if
+ * the result is not ready: cont is called later (see deferred_end).
+ */
+static int backend_call(association *assoc, request *req, void *rr,
+                        int *pending,
+                        void (*fun)(association *assoc, void *rr),
+                        void (*cont)(association *assoc, request *req))
+{
+    double start = yaz_spans_start(assoc->spans);
+    double metrics_start = gfs_metrics_now();
+    int bend = fun == call_bend_search ? GFS_METRICS_BEND_SEARCH :
+        fun == call_bend_fetch ? GFS_METRICS_BEND_FETCH :
+        GFS_METRICS_BEND_SCAN;
+    int deferred;
+
+    deferred_begin(assoc, req, rr);
+    if (req->encode && cont && worker_submit(assoc, req, rr, pending, fun))
+        deferred = deferred_end(assoc, req, 1, cont);
+    else
+    {
+        (*fun)(assoc, rr);
+        deferred = deferred_end(assoc, req, pending ? *pending : 0, cont);
+    }
+    if (deferred)
+    {   /* counted when resumed */
+        req->metrics_backend = metrics_start;
+        req->metrics_bend = bend;
+    }
+    else
+        gfs_metrics_backend(bend, gfs_metrics_now() - metrics_start);
+    if (assoc->spans)
+    {
+        const char *phase = fun == call_bend_search ? "bend_search" :
+            fun == call_bend_fetch ? "bend_fetch" : "bend_scan";
+        if (deferred)
+        {   /* added when resumed */
+            req->span_backend = start;
+            req->span_backend_phase = phase;
+        }
+        else
+            yaz_spans_stop(assoc->spans, gfs_metrics_op_name(req->metrics_op),
+                           phase, start);
+    }
+    return deferred;
+}
 
 int ir_read(IOCHAN h, int event)
 {
     association *assoc = (association *)iochan_getdata(h);
     COMSTACK conn = assoc->client_link;
     request *req;
+    double start;
 
     if ((assoc->cs_put_mask & EVENT_INPUT) == 0 && (event & assoc->cs_get_mask))
     {
@@ -283,8 +795,13 @@ int ir_read(IOCHAN h, int event)
 
         do
         {
+            int buffer_len = assoc->input_buffer_len;
             int res = cs_get(conn, &assoc->input_buffer,
                              &assoc->input_buffer_len);
+
+            if (assoc->input_buffer_len > buffer_len)
+                nmem_account_add(assoc->mem_account,
+                                 assoc->input_buffer_len - buffer_len);
             if (res < 0 && cs_errno(conn) == CSBUFSIZE)
             {
                 yaz_log(log_session, "Connection error: %s res=%d",
@@ -313,8 +830,11 @@ int ir_read(IOCHAN h, int event)
                     assoc->input_buffer[1] & 0xff,
                     assoc->input_buffer[2] & 0xff);
             req = request_get(&assoc->incoming); /* get a new request */
+            req->metrics_start = gfs_metrics_now();
+            req->len_request = res;
             odr_reset(assoc->decode);
             odr_setbuf(assoc->decode, assoc->input_buffer, res, 0);
+            start = yaz_spans_start(assoc->spans);
             if (!z_GDU(assoc->decode, &req->gdu_request, 0, 0))
             {
                 yaz_log(YLOG_WARN, "ODR error on incoming PDU: %s [element %s] "
@@ -337,6 +857,8 @@ int ir_read(IOCHAN h, int event)
                 }
                 return 0;
             }
+            if (assoc->spans)
+                req->span_decode = yaz_spans_start(assoc->spans) - start;
             req->request_mem = odr_extract_mem(assoc->decode);
             if (assoc->print)
             {
@@ -371,6 +893,8 @@ void ir_session(IOCHAN h, int event)
     assert(h && conn && assoc);
     if (event == EVENT_TIMEOUT)
     {
+        if (assoc->deferred.num && assoc->state == ASSOC_UP)
+            return; /* client is waiting for the backend, not idle */
         if (assoc->state != ASSOC_UP)
         {
             yaz_log(log_session, "Timeout. Closing connection");
@@ -416,8 +940,8 @@ void ir_session(IOCHAN h, int event)
     {
         if (!ir_read(h, event))
             return;
-        req = request_head(&assoc->incoming);
-        if (req->state == REQUEST_IDLE)
+        while ((req = request_head(&assoc->incoming)) &&
+               req->state == REQUEST_IDLE && request_may_start(assoc, req))
         {
             request_deq(&assoc->incoming);
             process_gdu_request(assoc, req);
@@ -426,11 +950,40 @@ void ir_session(IOCHAN h, int event)
     if (event & assoc->cs_put_mask)
     {
         request *req = request_head(&assoc->outgoing);
+        double start = yaz_spans_start(assoc->spans);
 
         assoc->cs_put_mask = 0;
         yaz_log(YLOG_DEBUG, "ir_session (output)");
         req->state = REQUEST_PENDING;
-        switch (res = cs_put(conn, req->response, req->len_response))
+        if (req->len_response_ext)
+        {
+            cs_iovec iov[2];
+
+            iov[0].buf = req->response;
+            iov[0].len = req->len_response;
+            iov[1].buf = req->response_ext;
+            iov[1].len = req->len_response_ext;
+            res = cs_putv(conn, iov, 2);
+        }
+        else if (req->len_response)
+            res = cs_put(conn, req->response, req->len_response);
+        else
+            res = 0; /* encoded part already sent */
+        if (res == 0 && req->response_fd != -1)
+        {
+            yaz_log(YLOG_DEBUG, "Wrote PDU, %d bytes", req->len_response);
+            req->len_response = 0;
+            req->len_response_ext = 0;
+            if ((res = send_response_file(assoc, req)) == 1)
+            {   /* socket full; wait until writable */
+                assoc->cs_put_mask = EVENT_OUTPUT;
+                iochan_setflag(h, assoc->cs_put_mask);
+                return;
+            }
+        }
+        yaz_spans_stop(assoc->spans, gfs_metrics_op_name(req->metrics_op),
+                       "write", start);
+        switch (res)
         {
         case -1:
             yaz_log(log_sessiondetail, "Connection closed by client");
@@ -449,7 +1002,8 @@ void ir_session(IOCHAN h, int event)
             if (!request_head(&assoc->outgoing))
             {   /* restore mask for cs_get operation ... */
                 iochan_clearflag(h, EVENT_OUTPUT|EVENT_INPUT);
-                iochan_setflag(h, assoc->cs_get_mask);
+                if (!assoc_input_blocked(assoc))
+                    iochan_setflag(h, assoc->cs_get_mask);
                 if (assoc->state == ASSOC_DEAD)
                     iochan_setevent(assoc->client_chan, EVENT_TIMEOUT);
             }
@@ -504,6 +1058,7 @@ static void assoc_init_reset(association *assoc)
     assoc->init->bend_srw_scan = NULL;
     assoc->init->bend_srw_update = NULL;
     assoc->init->named_result_sets = 0;
+    assoc->init->concurrent_operations = 0;
 
     assoc->init->charneg_request = NULL;
     assoc->init->charneg_response = NULL;
@@ -577,12 +1132,25 @@ static int srw_bend_init(association *assoc, Z_SRW_diagnostic **d, int *num, Z_S
     return 1;
 }
 
-static int retrieve_fetch(association *assoc, bend_fetch_rr *rr)
+/* record conversion for a bend_fetch; kept while the fetch is deferred */
+struct retrieve_conv {
+#if YAZ_HAVE_XML2
+    yaz_record_conv_t rc;
+    const char *match_schema;
+    Odr_oid *match_syntax;
+#else
+    int dummy;
+#endif
+};
+
+/* prepares rr for bend_fetch. Returns -1 (rr->errcode set) on error */
+static int retrieve_fetch_begin(association *assoc, bend_fetch_rr *rr,
+                                struct retrieve_conv *conv)
 {
 #if YAZ_HAVE_XML2
-    yaz_record_conv_t rc = 0;
-    const char *match_schema = 0;
-    Odr_oid *match_syntax = 0;
+    conv->rc = 0;
+    conv->match_schema = 0;
+    conv->match_syntax = 0;
 
     if (assoc->server)
     {
@@ -596,9 +1164,9 @@ static int retrieve_fetch(association *assoc, bend_fetch_rr *rr)
         r = yaz_retrieval_request(assoc->server->retrieval,
                                   input_schema,
                                   input_syntax_raw,
-                                  &match_schema,
-                                  &match_syntax,
-                                  &rc,
+                                  &conv->match_schema,
+                                  &conv->match_syntax,
+                                  &conv->rc,
                                   &backend_schema,
                                   &backend_syntax);
         if (r == -1) /* error ? */
@@ -638,12 +1206,25 @@ static int retrieve_fetch(association *assoc, bend_fetch_rr *rr)
         if (backend_syntax)
             rr->request_format = backend_syntax;
     }
-    (*assoc->init->bend_fetch)(assoc->backend, rr);
+#endif
+    return 0;
+}
+
+/* converts record returned by bend_fetch */
+static void retrieve_fetch_end(association *assoc, request *req,
+                               bend_fetch_rr *rr, struct retrieve_conv *conv)
+{
+#if YAZ_HAVE_XML2
+    yaz_record_conv_t rc = conv->rc;
+    const char *match_schema = conv->match_schema;
+    Odr_oid *match_syntax = conv->match_syntax;
+
     if (rc && rr->record && rr->errcode == 0)
     {   /* post conversion must take place .. */
         WRBUF output_record = wrbuf_alloc();
         int r = 1;
         const char *details = 0;
+        double start = yaz_spans_start(assoc->spans);
         if (rr->len > 0)
         {
             r = yaz_record_conv_record(rc, rr->record, rr->len, output_record);
@@ -691,18 +1272,32 @@ static int retrieve_fetch(association *assoc, bend_fetch_rr *rr)
                 rr->errstring = odr_strdup(rr->stream, details);
         }
         wrbuf_destroy(output_record);
+        yaz_spans_stop(assoc->spans, gfs_metrics_op_name(req->metrics_op),
+                       "convert", start);
     }
     if (match_syntax)
         rr->output_format = match_syntax;
     if (match_schema)
         rr->schema = odr_strdup(rr->stream, match_schema);
-#else
-    (*assoc->init->bend_fetch)(assoc->backend, rr);
 #endif
+}
+
+/* fetch for callers that can not be resumed; waits if deferred */
+static int retrieve_fetch(association *assoc, request *req,
+                          bend_fetch_rr *rr)
+{
+    struct retrieve_conv conv;
+
+    rr->association = assoc;
+    rr->pending = 0;
+    if (retrieve_fetch_begin(assoc, rr, &conv))
+        return -1;
+    backend_call(assoc, req, rr, &rr->pending, call_bend_fetch, 0);
+    retrieve_fetch_end(assoc, req, rr, &conv);
     return 0;
 }
 
-static int srw_bend_fetch(association *assoc, int pos,
+static int srw_bend_fetch(association *assoc, request *req, int pos,
                           Z_SRW_searchRetrieveRequest *srw_req,
                           Z_SRW_record *record,
                           const char **addinfo, int *last_in_set)
@@ -762,7 +1357,7 @@ static int srw_bend_fetch(association *assoc, int pos,
     if (!assoc->init->bend_fetch)
         return 1;
 
-    retrieve_fetch(assoc, &rr);
+    retrieve_fetch(assoc, req, &rr);
 
     *last_in_set = rr.last_in_set;
 
@@ -788,30 +1383,31 @@ static int srw_bend_fetch(association *assoc, int pos,
     return 0;
 }
 
-static int cql2pqf(ODR odr, const char *cql, cql_transform_t ct,
-                   Z_Query *query_result, char **sortkeys_p)
+static void cql2rpn(ODR odr, const char *cql, cql_transform_t ct,
+                    struct query_cache_result *res)
 {
     /* have a CQL query and  CQL to PQF transform .. */
     CQL_parser cp = cql_parser_create();
     int r;
-    int srw_errcode = 0;
     const char *add = 0;
-    WRBUF rpn_buf = wrbuf_alloc();
 
-    *sortkeys_p = 0;
+    res->rpn = 0;
+    res->sortkeys = 0;
+    res->errcode = 0;
+    res->errstring = 0;
     r = cql_parser_string(cp, cql);
     if (r)
     {
-        srw_errcode = YAZ_SRW_QUERY_SYNTAX_ERROR;
+        res->errcode = YAZ_SRW_QUERY_SYNTAX_ERROR;
     }
     if (!r)
     {
         struct cql_node *cn = cql_parser_result(cp);
 
         /* Syntax OK */
-        r = cql_transform(ct, cn, wrbuf_vp_puts, rpn_buf);
+        r = cql_transform_rpn(ct, cn, odr, &res->rpn);
         if (r)
-            srw_errcode = cql_transform_error(ct, &add);
+            res->errcode = cql_transform_error(ct, &add);
         else
         {
             char out[100];
@@ -821,49 +1417,45 @@ static int cql2pqf(ODR odr, const char *cql, cql_transform_t ct,
             {
                 if (*out)
                     yaz_log(log_requestdetail, "srw_sortKeys '%s'", out);
-                *sortkeys_p = odr_strdup(odr, out);
+                res->sortkeys = odr_strdup(odr, out);
             }
             else
             {
                 yaz_log(log_requestdetail, "failed to create srw_sortKeys");
-                srw_errcode = YAZ_SRW_UNSUPP_SORT_TYPE;
+                res->errcode = YAZ_SRW_UNSUPP_SORT_TYPE;
             }
         }
     }
-    if (!r)
+    cql_parser_destroy(cp);
+}
+
+static int cql2pqf(ODR odr, const char *cql, cql_transform_t ct,
+                   query_cache_t qc, Z_Query *query_result, char **sortkeys_p)
+{
+    struct query_cache_result res;
+
+    if (!query_cache_lookup(qc, ct, cql, odr, &res))
+    {
+        cql2rpn(odr, cql, ct, &res);
+        query_cache_add(qc, ct, cql, &res);
+    }
+    *sortkeys_p = res.sortkeys;
+    if (res.rpn)
     {
         /* Syntax & transform OK. */
-        /* Convert PQF string to Z39.50 to RPN query struct */
-        YAZ_PQF_Parser pp = yaz_pqf_create();
-        Z_RPNQuery *rpnquery = yaz_pqf_parse(pp, odr, wrbuf_cstr(rpn_buf));
-        if (!rpnquery)
-        {
-            size_t off;
-            const char *pqf_msg;
-            int code = yaz_pqf_error(pp, &pqf_msg, &off);
-            yaz_log(YLOG_WARN, "PQF Parser Error %s (code %d)",
-                    pqf_msg, code);
-            srw_errcode = YAZ_SRW_QUERY_SYNTAX_ERROR;
-        }
-        else
-        {
-            query_result->which = Z_Query_type_1;
-            query_result->u.type_1 = rpnquery;
-        }
-        yaz_pqf_destroy(pp);
+        query_result->which = Z_Query_type_1;
+        query_result->u.type_1 = res.rpn;
     }
-    cql_parser_destroy(cp);
-    wrbuf_destroy(rpn_buf);
-    return srw_errcode;
+    return res.errcode;
 }
 
 static int cql2pqf_scan(ODR odr, const char *cql, cql_transform_t ct,
-                        Z_AttributesPlusTerm *result)
+                        query_cache_t qc, Z_AttributesPlusTerm *result)
 {
     Z_Query query;
     Z_RPNQuery *rpn;
     char *sortkeys = 0;
-    int srw_error = cql2pqf(odr, cql, ct, &query, &sortkeys);
+    int srw_error = cql2pqf(odr, cql, ct, qc, &query, &sortkeys);
     if (srw_error)
         return srw_error;
     if (query.which != Z_Query_type_1 && query.which != Z_Query_type_101)
@@ -882,25 +1474,44 @@ static int cql2pqf_scan(ODR odr, const char *cql, cql_transform_t ct,
 
 
 static int ccl2pqf(ODR odr, const Odr_oct *ccl, CCL_bibset bibset,
-                   bend_search_rr *bsrr)
+                   query_cache_t qc, bend_search_rr *bsrr)
 {
     char *ccl0;
-    struct ccl_rpn_node *node;
-    int errcode, pos;
+    struct query_cache_result res;
 
     ccl0 = odr_strdupn(odr, (char*) ccl->buf, ccl->len);
-    if ((node = ccl_find_str(bibset, ccl0, &errcode, &pos)) == 0)
+    if (!query_cache_lookup(qc, bibset, ccl0, odr, &res))
     {
-        bsrr->errstring = (char*) ccl_err_msg(errcode);
-        return YAZ_SRW_QUERY_SYNTAX_ERROR;    /* Query syntax error */
+        struct ccl_rpn_node *node;
+        int errcode, pos;
+
+        res.rpn = 0;
+        res.sortkeys = 0;
+        res.errcode = 0;
+        res.errstring = 0;
+        if ((node = ccl_find_str(bibset, ccl0, &errcode, &pos)) == 0)
+        {
+            res.errstring = (char*) ccl_err_msg(errcode);
+            res.errcode = YAZ_SRW_QUERY_SYNTAX_ERROR; /* Query syntax error */
+        }
+        else
+        {
+            res.rpn = ccl_rpn_query(odr, node);
+            ccl_rpn_delete(node);
+        }
+        query_cache_add(qc, bibset, ccl0, &res);
+    }
+    if (res.errcode)
+    {
+        bsrr->errstring = res.errstring;
+        return res.errcode;
     }
-
     bsrr->query->which = Z_Query_type_1;
-    bsrr->query->u.type_1 = ccl_rpn_query(odr, node);
+    bsrr->query->u.type_1 = res.rpn;
     return 0;
 }
 
-static void srw_bend_search(association *assoc,
+static void srw_bend_search(association *assoc, request *req,
                             Z_SRW_PDU *sr,
                             Z_SRW_PDU *res,
                             int *http_code)
@@ -939,6 +1550,7 @@ static void srw_bend_search(association *assoc,
             {
                 int srw_errcode = cql2pqf(assoc->encode, srw_req->query.cql,
                                           assoc->server->cql_transform,
+                                          assoc->server->query_cache,
                                           rr.query,
                                           &rr.srw_sortKeys);
 
@@ -967,27 +1579,37 @@ static void srw_bend_search(association *assoc,
         }
         else if (srw_req->query_type == Z_SRW_query_type_pqf)
         {
-            Z_RPNQuery *RPNquery;
-            YAZ_PQF_Parser pqf_parser;
-
-            pqf_parser = yaz_pqf_create();
+            struct query_cache_result qres;
+            query_cache_t qc = assoc->server ? assoc->server->query_cache : 0;
 
-            RPNquery = yaz_pqf_parse(pqf_parser, assoc->decode,
-                                     srw_req->query.pqf);
-            if (!RPNquery)
+            /* PQF translations are cached with a null transform */
+            if (!query_cache_lookup(qc, 0, srw_req->query.pqf,
+                                    assoc->decode, &qres))
             {
-                const char *pqf_msg;
-                size_t off;
-                int code = yaz_pqf_error(pqf_parser, &pqf_msg, &off);
-                yaz_log(log_requestdetail, "Parse error %d %s near offset %ld",
-                        code, pqf_msg, (long) off);
-                srw_error = YAZ_SRW_QUERY_SYNTAX_ERROR;
+                YAZ_PQF_Parser pqf_parser = yaz_pqf_create();
+
+                qres.sortkeys = 0;
+                qres.errcode = 0;
+                qres.errstring = 0;
+                qres.rpn = yaz_pqf_parse(pqf_parser, assoc->decode,
+                                         srw_req->query.pqf);
+                if (!qres.rpn)
+                {
+                    const char *pqf_msg;
+                    size_t off;
+                    int code = yaz_pqf_error(pqf_parser, &pqf_msg, &off);
+                    yaz_log(log_requestdetail,
+                            "Parse error %d %s near offset %ld",
+                            code, pqf_msg, (long) off);
+                    qres.errcode = YAZ_SRW_QUERY_SYNTAX_ERROR;
+                }
+                yaz_pqf_destroy(pqf_parser);
+                query_cache_add(qc, 0, srw_req->query.pqf, &qres);
             }
+            srw_error = qres.errcode;
 
             rr.query->which = Z_Query_type_1;
-            rr.query->u.type_1 =  RPNquery;
-
-            yaz_pqf_destroy(pqf_parser);
+            rr.query->u.type_1 = qres.rpn;
         }
         else
         {
@@ -1009,9 +1631,10 @@ static void srw_bend_search(association *assoc,
             rr.errstring = 0;
             rr.search_info = 0;
             rr.search_input = 0;
+            rr.pending = 0;
             yaz_log_zquery_level(log_requestdetail,rr.query);
 
-            (assoc->init->bend_search)(assoc->backend, &rr);
+            backend_call(assoc, req, &rr, &rr.pending, call_bend_search, 0);
             if (rr.errcode)
             {
                 if (rr.errcode == YAZ_BIB1_DATABASE_UNAVAILABLE)
@@ -1129,11 +1752,25 @@ static void srw_bend_search(association *assoc,
                             int last_in_set = 0;
                             const char *addinfo = 0;
 
+                            if (mem_over_limit(assoc, assoc->mem_soft))
+                            {
+                                int bib1 = j ?
+                                    YAZ_BIB1_RESOURCES_EXHAUSTED_VALID_SUBSET_OF_RESULTS_AVAILABLE
+                                    : YAZ_BIB1_RESOURCES_EXHAUSTED_NO_RESULTS_AVAILABLE;
+                                assoc->mem_limited++;
+                                yaz_add_srw_diagnostic(
+                                    assoc->encode, &srw_res->diagnostics,
+                                    &srw_res->num_diagnostics,
+                                    yaz_diag_bib1_to_srw(bib1),
+                                    "memory limit");
+                                break;
+                            }
                             srw_res->records[j].recordPacking = packing;
                             srw_res->records[j].recordData_buf = 0;
                             srw_res->extra_records[j] = 0;
                             yaz_log(YLOG_DEBUG, "srw_bend_fetch %d", i+start);
-                            errcode = srw_bend_fetch(assoc, i+start, srw_req,
+                            errcode = srw_bend_fetch(assoc, req, i+start,
+                                                     srw_req,
                                                      srw_res->records + j,
                                                      &addinfo, &last_in_set);
                             if (errcode)
@@ -1371,6 +2008,7 @@ static void srw_bend_scan(association *assoc,
             srw_error = cql2pqf_scan(assoc->encode,
                                      srw_req->scanClause.cql,
                                      assoc->server->cql_transform,
+                                     assoc->server->query_cache,
                                      bsrr->term);
             if (srw_error)
                 yaz_add_srw_diagnostic(assoc->encode, &srw_res->diagnostics,
@@ -1726,21 +2364,72 @@ static int check_path(const char *path)
     return 1;
 }
 
-static char *read_file(const char *fname, ODR o, size_t *sz)
+/* whether file may be transmitted with sendfile rather than encoded */
+static int use_sendfile(association *assoc)
 {
-    char *buf;
-    FILE *inf = fopen(fname, "rb");
-    if (!inf)
-        return 0;
+#if HAVE_SENDFILE && HAVE_SYS_SENDFILE_H
+    return cs_type(assoc->client_link) == tcpip_type && !assoc->print;
+#else
+    return 0;
+#endif
+}
 
-    fseek(inf, 0L, SEEK_END);
-    *sz = ftell(inf);
-    rewind(inf);
-    buf = (char *) odr_malloc(o, *sz);
-    if (fread(buf, 1, *sz, inf) != *sz)
-        yaz_log(YLOG_WARN|YLOG_ERRNO, "short read %s", fname);
-    fclose(inf);
-    return buf;
+/*
+ * Sends remaining part of file for request.
+ * Returns -1 on error, 0 when all is sent, 1 if more is to be sent
+ */
+static int send_response_file(association *assoc, request *req)
+{
+#if HAVE_SENDFILE && HAVE_SYS_SENDFILE_H
+    while (req->response_fd_sent < req->response_fd_len)
+    {
+        off_t offset = (off_t) req->response_fd_sent;
+        ssize_t r = sendfile(cs_fileno(assoc->client_link), req->response_fd,
+                             &offset,
+                             req->response_fd_len - req->response_fd_sent);
+        if (r < 0)
+        {
+            if (yaz_errno() == EAGAIN || yaz_errno() == EINTR)
+                return 1;
+            yaz_log(YLOG_WARN|YLOG_ERRNO, "sendfile");
+            return -1;
+        }
+        if (r == 0)
+        {
+            yaz_log(YLOG_WARN, "sendfile: file truncated");
+            return -1;
+        }
+        req->response_fd_sent += r;
+    }
+#endif
+    return 0;
+}
+
+/* compress textual HTTP body if configured and accepted by client */
+static void http_response_compress(association *assoc, Z_HTTP_Request *hreq,
+                                   Z_HTTP_Response *hres)
+{
+    struct gfs_server *server = assoc->server;
+    const char *ctype;
+    int len = hres->content_len;
+
+    if (!server || !server->http_compress_level || !hres->content_buf
+        || len < server->http_compress_threshold)
+        return;
+    ctype = z_HTTP_header_lookup(hres->headers, "Content-Type");
+    /* images and the like are compressed already */
+    if (!ctype || (strncmp(ctype, "text/", 5) && !strstr(ctype, "xml")
+                   && !strstr(ctype, "json")
+                   && !strstr(ctype, "javascript")))
+        return;
+    z_HTTP_header_add(assoc->encode, &hres->headers, "Vary",
+                      "Accept-Encoding");
+    if (yaz_http_response_compress(
+            assoc->encode, hres,
+            z_HTTP_header_lookup(hreq->headers, "Accept-Encoding"),
+            server->http_compress_level))
+        yaz_log(YLOG_DEBUG, "HTTP body compressed %d -> %d", len,
+                hres->content_len);
 }
 
 static void process_http_request(association *assoc, request *req)
@@ -1765,6 +2454,21 @@ static void process_http_request(association *assoc, request *req)
         p = z_get_HTTP_Response(o, 404);
         r = 1;
     }
+    if (r == 2 && assoc->server && assoc->server->metrics_path
+        && gfs_metrics_is_path(assoc->server->metrics_path, hreq->path))
+    {
+        WRBUF w = wrbuf_alloc();
+
+        gfs_metrics_write(w);
+        p = z_get_HTTP_Response(o, 200);
+        hres = p->u.HTTP_Response;
+        hres->content_buf = odr_strdupn(o, wrbuf_buf(w), wrbuf_len(w));
+        hres->content_len = wrbuf_len(w);
+        z_HTTP_header_add(o, &hres->headers, "Content-Type",
+                          "text/plain; version=0.0.4");
+        wrbuf_destroy(w);
+        r = 1;
+    }
     if (r == 2 && assoc->server && assoc->server->docpath
         && hreq->path[0] == '/'
         &&
@@ -1780,46 +2484,61 @@ static void process_http_request(association *assoc, request *req)
         }
         else
         {
-            size_t content_size = 0;
-            char *content_buf = read_file(hreq->path+1, o, &content_size);
-            if (!content_buf)
+            struct file_cache_info info;
+            const char *fname = hreq->path+1;
+            int by_fd = use_sendfile(assoc);
+            int ret = -1;
+
+            req->metrics_op = GFS_METRICS_HTTP_FILE;
+            /* a file sent by descriptor is checked against the one opened
+               so that length and validators are of what is sent */
+            if (by_fd && (req->response_fd = open(fname, O_RDONLY)) == -1)
+                yaz_log(YLOG_LOG|YLOG_ERRNO, "open %s", fname);
+            else
+                ret = file_cache_lookup(assoc->server->file_cache, fname,
+                                        req->response_fd, odr_getmem(o),
+                                        !by_fd, &info);
+            if (ret == -1)
+            {
+                yaz_log(YLOG_LOG, "File %s not found", fname);
+                p = z_get_HTTP_Response(o, 404);
+            }
+            else if (ret == -2)
             {
-                yaz_log(YLOG_LOG, "File %s not found", hreq->path+1);
+                yaz_log(YLOG_LOG, "No mime type for %s", fname);
                 p = z_get_HTTP_Response(o, 404);
             }
             else
             {
-                const char *ctype = 0;
-                yaz_mime_types types = yaz_mime_types_create();
-
-                yaz_mime_types_add(types, "xsl", "application/xml");
-                yaz_mime_types_add(types, "xml", "application/xml");
-                yaz_mime_types_add(types, "css", "text/css");
-                yaz_mime_types_add(types, "html", "text/html");
-                yaz_mime_types_add(types, "htm", "text/html");
-                yaz_mime_types_add(types, "txt", "text/plain");
-                yaz_mime_types_add(types, "js", "application/x-javascript");
-
-                yaz_mime_types_add(types, "gif", "image/gif");
-                yaz_mime_types_add(types, "png", "image/png");
-                yaz_mime_types_add(types, "jpg", "image/jpeg");
-                yaz_mime_types_add(types, "jpeg", "image/jpeg");
-
-                ctype = yaz_mime_lookup_fname(types, hreq->path);
-                if (!ctype)
+                if (file_cache_not_modified(
+                        &info,
+                        z_HTTP_header_lookup(hreq->headers, "If-None-Match"),
+                        z_HTTP_header_lookup(hreq->headers,
+                                             "If-Modified-Since")))
                 {
-                    yaz_log(YLOG_LOG, "No mime type for %s", hreq->path+1);
-                    p = z_get_HTTP_Response(o, 404);
+                    p = z_get_HTTP_Response(o, 304);
+                    hres = p->u.HTTP_Response;
                 }
                 else
                 {
                     p = z_get_HTTP_Response(o, 200);
                     hres = p->u.HTTP_Response;
-                    hres->content_buf = content_buf;
-                    hres->content_len = content_size;
-                    z_HTTP_header_add(o, &hres->headers, "Content-Type", ctype);
+                    hres->content_buf = info.buf;
+                    hres->content_len = (int) info.size;
+                    req->response_fd_len = by_fd ? info.size : 0;
+                    req->response_fd_sent = 0;
+                    z_HTTP_header_add(o, &hres->headers, "Content-Type",
+                                      info.content_type);
                 }
-                yaz_mime_types_destroy(types);
+                z_HTTP_header_add(o, &hres->headers, "ETag", info.etag);
+                if (*info.last_modified)
+                    z_HTTP_header_add(o, &hres->headers, "Last-Modified",
+                                      info.last_modified);
+            }
+            if (req->response_fd != -1 && (!hres || hres->code != 200))
+            {
+                close(req->response_fd);
+                req->response_fd = -1;
             }
         }
         r = 1;
@@ -1844,6 +2563,8 @@ static void process_http_request(association *assoc, request *req)
             Z_SRW_PDU *res =
                 yaz_srw_get_pdu(assoc->encode, Z_SRW_searchRetrieve_response,
                                 sr->srw_version);
+
+            req->metrics_op = GFS_METRICS_SRU_SEARCH;
             stylesheet = sr->u.request->stylesheet;
             if (num_diagnostic)
             {
@@ -1852,7 +2573,7 @@ static void process_http_request(association *assoc, request *req)
             }
             else
             {
-                srw_bend_search(assoc, sr, res, &http_code);
+                srw_bend_search(assoc, req, sr, res, &http_code);
             }
             if (http_code == 200)
                 soap_package->u.generic->p = res;
@@ -1861,6 +2582,8 @@ static void process_http_request(association *assoc, request *req)
         {
             Z_SRW_PDU *res = yaz_srw_get_pdu(o, Z_SRW_explain_response,
                                              sr->srw_version);
+
+            req->metrics_op = GFS_METRICS_SRU_EXPLAIN;
             stylesheet = sr->u.explain_request->stylesheet;
             if (num_diagnostic)
             {
@@ -1875,6 +2598,8 @@ static void process_http_request(association *assoc, request *req)
         {
             Z_SRW_PDU *res = yaz_srw_get_pdu(o, Z_SRW_scan_response,
                                              sr->srw_version);
+
+            req->metrics_op = GFS_METRICS_SRU_SCAN;
             stylesheet = sr->u.scan_request->stylesheet;
             if (num_diagnostic)
             {
@@ -1889,6 +2614,8 @@ static void process_http_request(association *assoc, request *req)
         {
             Z_SRW_PDU *res = yaz_srw_get_pdu(o, Z_SRW_update_response,
                                              sr->srw_version);
+
+            req->metrics_op = GFS_METRICS_SRU_UPDATE;
             yaz_log(YLOG_DEBUG, "handling SRW UpdateRequest");
             if (num_diagnostic)
             {
@@ -1987,17 +2714,75 @@ static void process_http_request(association *assoc, request *req)
         iochan_settimeout(assoc->client_chan,t);
         z_HTTP_header_add(o, &hres->headers, "Connection", "Keep-Alive");
     }
+    http_response_compress(assoc, hreq, hres);
     process_gdu_response(assoc, req, p);
 }
 
+static int metrics_op(Z_APDU *apdu)
+{
+    switch (apdu->which)
+    {
+    case Z_APDU_initRequest:
+        return GFS_METRICS_INIT;
+    case Z_APDU_searchRequest:
+        return GFS_METRICS_SEARCH;
+    case Z_APDU_presentRequest:
+        return GFS_METRICS_PRESENT;
+    case Z_APDU_scanRequest:
+        return GFS_METRICS_SCAN;
+    case Z_APDU_sortRequest:
+        return GFS_METRICS_SORT;
+    case Z_APDU_extendedServicesRequest:
+        return GFS_METRICS_ES;
+    case Z_APDU_deleteResultSetRequest:
+        return GFS_METRICS_DELETE;
+    case Z_APDU_close:
+        return GFS_METRICS_CLOSE;
+    }
+    return GFS_METRICS_Z3950_OTHER;
+}
+
 static void process_gdu_request(association *assoc, request *req)
 {
+    if (req->gdu_request->which == Z_GDU_Z3950)
+        req->metrics_op = metrics_op(req->gdu_request->u.z3950);
+    else
+        req->metrics_op = GFS_METRICS_HTTP_OTHER;
+    if (mem_over_limit(assoc, assoc->mem_hard))
+    {
+        yaz_log(log_session, "Memory %ld bytes exceeds limit %ld",
+                (long) nmem_account_current(assoc->mem_account),
+                (long) assoc->mem_hard);
+        assoc->mem_limited++;
+        if (req->gdu_request->which == Z_GDU_HTTP_Request)
+        {
+            Z_GDU *p = z_get_HTTP_Response(assoc->encode, 503);
+            assoc->state = ASSOC_DEAD;
+            process_gdu_response(assoc, req, p);
+        }
+        else
+            do_close_req(assoc, Z_Close_resources, "Memory limit exceeded",
+                         req);
+        return;
+    }
     if (req->gdu_request->which == Z_GDU_Z3950)
     {
         char *msg = 0;
+        ODR save[2];
+
         req->apdu_request = req->gdu_request->u.z3950;
+        if (assoc->concurrent_max > 1 && !req->encode &&
+            request_concurrent(req))
+        {   /* may run next to others: needs streams of its own */
+            req->encode = odr_createmem(ODR_ENCODE);
+            req->decode = odr_createmem(ODR_DECODE);
+            nmem_set_account(odr_getmem(req->encode), assoc->mem_account);
+            nmem_set_account(odr_getmem(req->decode), assoc->mem_account);
+        }
+        request_streams_enter(assoc, req, save);
         if (process_z_request(assoc, req, &msg) < 0)
             do_close_req(assoc, Z_Close_systemProblem, msg, req);
+        request_streams_leave(assoc, save);
     }
     else if (req->gdu_request->which == Z_GDU_HTTP_Request)
         process_http_request(assoc, req);
@@ -2091,6 +2876,11 @@ static int process_z_request(association *assoc, request *req, char **msg)
         yaz_log(YLOG_DEBUG, "  result immediately available");
         retval = process_z_response(assoc, req, res);
     }
+    else if (req->state == REQUEST_DEFERRED)
+    {
+        yaz_log(YLOG_DEBUG, "  result deferred by backend");
+        retval = 0;
+    }
     else
     {
         yaz_log(YLOG_DEBUG, "  result unavailable");
@@ -2104,6 +2894,10 @@ static int process_z_request(association *assoc, request *req, char **msg)
  */
 static int process_gdu_response(association *assoc, request *req, Z_GDU *res)
 {
+    Z_HTTP_Response *hres = 0;
+    int size;
+    double start;
+
     odr_setbuf(assoc->encode, req->response, req->size_response, 1);
 
     if (assoc->print)
@@ -2113,15 +2907,54 @@ static int process_gdu_response(association *assoc, request *req, Z_GDU *res)
                 odr_errmsg(odr_geterror(assoc->print)));
         odr_reset(assoc->print);
     }
+    if (res->which == Z_GDU_HTTP_Response && res->u.HTTP_Response->content_buf
+        && res->u.HTTP_Response->content_len >= HTTP_BODY_PUTV_MIN)
+    {   /* encode header only; body is written from where it is */
+        hres = res->u.HTTP_Response;
+        req->response_ext = hres->content_buf;
+        req->len_response_ext = hres->content_len;
+        hres->content_buf = 0;
+    }
+    start = yaz_spans_start(assoc->spans);
     if (!z_GDU(assoc->encode, &res, 0, 0))
     {
         yaz_log(YLOG_WARN, "ODR error when encoding PDU: %s [element %s]",
                 odr_errmsg(odr_geterror(assoc->decode)),
                 odr_getelement(assoc->decode));
+        req->len_response_ext = 0;
         return -1;
     }
+    if (hres)
+    {
+        hres->content_buf = req->response_ext;
+        /* body lives in encode memory: keep it with the request */
+        if (req->response_mem)
+            nmem_destroy(req->response_mem);
+        req->response_mem = odr_extract_mem(assoc->encode);
+    }
+    size = req->size_response;
     req->response = odr_getbuf(assoc->encode, &req->len_response,
         &req->size_response);
+    if (req->size_response > size)
+        nmem_account_add(assoc->mem_account, req->size_response - size);
+    if (assoc->spans)
+    {
+        const char *op = gfs_metrics_op_name(req->metrics_op);
+
+        yaz_spans_stop(assoc->spans, op, "encode", start);
+        yaz_spans_add(assoc->spans, op, "decode", req->span_decode);
+    }
+    if (req->metrics_op >= 0 && req->metrics_start > 0.0)
+    {
+        gfs_metrics_request(req->metrics_op,
+                            gfs_metrics_now() - req->metrics_start,
+                            req->len_request,
+                            req->len_response + req->len_response_ext
+                            + (long) req->response_fd_len);
+        req->metrics_start = 0.0;
+        if (assoc->server)
+            gfs_metrics_log(assoc->server->metrics_log);
+    }
     odr_setbuf(assoc->encode, 0, 0, 0); /* don'txfree if we abort later */
     odr_reset(assoc->encode);
     req->state = REQUEST_IDLE;
@@ -2133,7 +2966,8 @@ static int process_gdu_response(association *assoc, request *req, Z_GDU *res)
     for (;;)
     {
         req = request_head(&assoc->incoming);
-        if (req && req->state == REQUEST_IDLE)
+        if (req && req->state == REQUEST_IDLE &&
+            request_may_start(assoc, req))
         {
             request_deq(&assoc->incoming);
             process_gdu_request(assoc, req);
@@ -2293,6 +3127,8 @@ static Z_APDU *process_initRequest(association *assoc, request *reqb)
     {
         ODR_MASK_SET(resp->options, Z_Options_concurrentOperations);
         strcat(options, " concurrop");
+        if (assoc->init->concurrent_operations > 1)
+            assoc->concurrent_max = assoc->init->concurrent_operations;
     }
     if (ODR_MASK_GET(req->options, Z_Options_sort) && assoc->init->bend_sort)
     {
@@ -2476,14 +3312,80 @@ static Z_NamePlusRecord *surrogatediagrec(association *assoc,
     return zget_surrogateDiagRec(assoc->encode, dbname, error, addinfo);
 }
 
-static Z_Records *pack_records(association *a, char *setname, Odr_int start,
-                               Odr_int *num, Z_RecordComposition *comp,
-                               Odr_int *next, Odr_int *pres,
-                               Z_ReferenceId *referenceId,
-                               Odr_oid *oid, int *errcode)
+/* state of pack_records; lives in encode memory while bend_fetch is
+   deferred. done is called when records are packed after deferral */
+struct pack_state {
+    char *setname;
+    Odr_int start;
+    Odr_int *num;
+    Z_RecordComposition *comp;
+    Odr_int *next;
+    Odr_int *pres;
+    Z_ReferenceId *referenceId;
+    Odr_oid *oid;
+    int errcode;
+    int recno;
+    int toget;
+    int total_length;
+    int dumped_records;
+    Z_Records *records;
+    bend_fetch_rr freq;
+    struct retrieve_conv conv;
+    int fetched;  /* freq holds result of deferred fetch for recno */
+    void (*done)(association *a, request *req, struct pack_state *ps,
+                 Z_Records *records);
+    Z_APDU *apdu; /* response being built (for done) */
+    bend_search_rr *bsrr; /* search, if piggyback (for done) */
+};
+
+static struct pack_state *pack_state_create(
+    association *a, char *setname, Odr_int start, Odr_int *num,
+    Z_RecordComposition *comp, Odr_int *next, Odr_int *pres,
+    Z_ReferenceId *referenceId, Odr_oid *oid)
 {
-    int recno, total_length = 0, dumped_records = 0;
-    int toget = odr_int_to_int(*num);
+    struct pack_state *ps = (struct pack_state *)
+        odr_malloc(a->encode, sizeof(*ps));
+
+    ps->setname = setname;
+    ps->start = start;
+    ps->num = num;
+    ps->comp = comp;
+    ps->next = next;
+    ps->pres = pres;
+    ps->referenceId = referenceId;
+    ps->oid = oid;
+    ps->errcode = 0;
+    ps->fetched = 0;
+    ps->done = 0;
+    ps->apdu = 0;
+    ps->bsrr = 0;
+    return ps;
+}
+
+static Z_Records *pack_records_run(association *a, request *req,
+                                   struct pack_state *ps);
+
+static void pack_records_resume(association *a, request *req)
+{
+    struct pack_state *ps = (struct pack_state *) req->deferred_data;
+    Z_Records *records;
+
+    retrieve_fetch_end(a, req, &ps->freq, &ps->conv);
+    ps->fetched = 1;
+    records = pack_records_run(a, req, ps);
+    if (req->state != REQUEST_DEFERRED)
+        (*ps->done)(a, req, ps, records);
+}
+
+/*
+ * Packs records from bend_fetch into a Z_Records. Returns NULL on error
+ * or if a fetch was deferred by the backend (req->state is then
+ * REQUEST_DEFERRED and ps->done is called later).
+ */
+static Z_Records *pack_records(association *a, request *req,
+                               struct pack_state *ps)
+{
+    int toget = odr_int_to_int(*ps->num);
     Z_Records *records =
         (Z_Records *) odr_malloc(a->encode, sizeof(*records));
     Z_NamePlusRecordList *reclist =
@@ -2501,86 +3403,137 @@ static Z_Records *pack_records(association *a, char *setname, Odr_int start,
         reclist->records = (Z_NamePlusRecord **)
             odr_malloc(a->encode, sizeof(*reclist->records) * toget);
 
-    *pres = Z_PresentStatus_success;
-    *num = 0;
-    *next = 0;
+    *ps->pres = Z_PresentStatus_success;
+    *ps->num = 0;
+    *ps->next = 0;
 
-    yaz_log(log_requestdetail, "Request to pack " ODR_INT_PRINTF "+%d %s", start, toget, setname);
+    yaz_log(log_requestdetail, "Request to pack " ODR_INT_PRINTF "+%d %s",
+            ps->start, toget, ps->setname);
     yaz_log(log_requestdetail, "pms=%d, mrs=%d", a->preferredMessageSize,
         a->maximumRecordSize);
-    for (recno = odr_int_to_int(start); reclist->num_records < toget; recno++)
+    ps->toget = toget;
+    ps->records = records;
+    ps->recno = odr_int_to_int(ps->start);
+    ps->total_length = 0;
+    ps->dumped_records = 0;
+    return pack_records_run(a, req, ps);
+}
+
+static Z_Records *pack_records_run(association *a, request *req,
+                                   struct pack_state *ps)
+{
+    int toget = ps->toget;
+    Z_NamePlusRecordList *reclist = ps->records->u.databaseOrSurDiagnostics;
+    Odr_int *pres = ps->pres;
+    Odr_int *next = ps->next;
+
+    for (; reclist->num_records < toget; ps->recno++)
     {
-        bend_fetch_rr freq;
+        bend_fetch_rr *freq = &ps->freq;
+        int recno = ps->recno;
         Z_NamePlusRecord *thisrec;
         int this_length = 0;
-        /*
-         * we get the number of bytes allocated on the stream before any
-         * allocation done by the backend - this should give us a reasonable
-         * idea of the total size of the data so far.
-         */
-        total_length = odr_total(a->encode) - dumped_records;
-        freq.errcode = 0;
-        freq.errstring = 0;
-        freq.basename = 0;
-        freq.len = 0;
-        freq.record = 0;
-        freq.last_in_set = 0;
-        freq.setname = setname;
-        freq.surrogate_flag = 0;
-        freq.number = recno;
-        freq.comp = comp;
-        freq.request_format = oid;
-        freq.output_format = 0;
-        freq.stream = a->encode;
-        freq.print = a->print;
-        freq.referenceId = referenceId;
-        freq.schema = 0;
-
-        retrieve_fetch(a, &freq);
-
-        *next = freq.last_in_set ? 0 : recno + 1;
-
-        if (freq.errcode)
-        {
-            if (!freq.surrogate_flag) /* non-surrogate diagnostic i.e. global */
+
+        if (!ps->fetched)
+        {
+            /* checked before the fetch (also after a deferred one was
+               resumed) so that no fetched record is thrown away */
+            if (mem_over_limit(a, a->mem_soft))
+            {
+                yaz_log(log_requestdetail, "  Memory limit after %d records",
+                        reclist->num_records);
+                a->mem_limited++;
+                if (reclist->num_records == 0)
+                {
+                    *pres = Z_PresentStatus_failure;
+                    ps->errcode =
+                        YAZ_BIB1_RESOURCES_EXHAUSTED_NO_RESULTS_AVAILABLE;
+                    return diagrec(a, ps->errcode, "memory limit");
+                }
+                *pres = Z_PresentStatus_partial_3;
+                *next = recno;
+                break;
+            }
+            /*
+             * we get the number of bytes allocated on the stream before any
+             * allocation done by the backend - this should give us a
+             * reasonable idea of the total size of the data so far.
+             */
+            ps->total_length = odr_total(a->encode) - ps->dumped_records;
+            freq->errcode = 0;
+            freq->errstring = 0;
+            freq->basename = 0;
+            freq->len = 0;
+            freq->record = 0;
+            freq->last_in_set = 0;
+            freq->setname = ps->setname;
+            freq->surrogate_flag = 0;
+            freq->number = recno;
+            freq->comp = ps->comp;
+            freq->request_format = ps->oid;
+            freq->output_format = 0;
+            freq->stream = a->encode;
+            freq->print = a->print;
+            freq->referenceId = ps->referenceId;
+            freq->schema = 0;
+            freq->association = a;
+            freq->pending = 0;
+
+            if (retrieve_fetch_begin(a, freq, &ps->conv) == 0)
+            {
+                req->deferred_data = ps;
+                if (backend_call(a, req, freq, &freq->pending,
+                                 call_bend_fetch,
+                                 ps->done ? pack_records_resume : 0))
+                    return 0;
+                retrieve_fetch_end(a, req, freq, &ps->conv);
+            }
+        }
+        ps->fetched = 0;
+
+        *next = freq->last_in_set ? 0 : recno + 1;
+
+        if (freq->errcode)
+        {
+            if (!freq->surrogate_flag) /* non-surrogate diagnostic i.e. global */
             {
                 char s[20];
                 *pres = Z_PresentStatus_failure;
                 /* for 'present request out of range',
                    set addinfo to record position if not set */
-                if (freq.errcode == YAZ_BIB1_PRESENT_REQUEST_OUT_OF_RANGE  &&
-                                freq.errstring == 0)
+                if (freq->errcode == YAZ_BIB1_PRESENT_REQUEST_OUT_OF_RANGE  &&
+                                freq->errstring == 0)
                 {
                     sprintf(s, "%d", recno);
-                    freq.errstring = s;
+                    freq->errstring = s;
                 }
-                if (errcode)
-                    *errcode = freq.errcode;
-                return diagrec(a, freq.errcode, freq.errstring);
+                ps->errcode = freq->errcode;
+                return diagrec(a, freq->errcode, freq->errstring);
             }
             reclist->records[reclist->num_records] =
-                surrogatediagrec(a, freq.basename, freq.errcode,
-                                 freq.errstring);
+                surrogatediagrec(a, freq->basename, freq->errcode,
+                                 freq->errstring);
             reclist->num_records++;
             continue;
         }
-        if (freq.record == 0)  /* no error and no record ? */
+        if (freq->record == 0)  /* no error and no record ? */
         {
             *pres = Z_PresentStatus_partial_4;
             *next = 0;   /* signal end-of-set and stop */
             break;
         }
-        if (freq.len >= 0)
-            this_length = freq.len;
+        if (freq->len >= 0)
+            this_length = freq->len;
         else
-            this_length = odr_total(a->encode) - total_length - dumped_records;
+            this_length = odr_total(a->encode) - ps->total_length
+                - ps->dumped_records;
         yaz_log(YLOG_DEBUG, "  fetched record, len=%d, total=%d dumped=%d",
-            this_length, total_length, dumped_records);
+            this_length, ps->total_length, ps->dumped_records);
         if (a->preferredMessageSize > 0 &&
-                this_length + total_length > a->preferredMessageSize)
+                this_length + ps->total_length > a->preferredMessageSize)
         {
             /* record is small enough, really */
-            if (this_length <= a->preferredMessageSize && recno > start)
+            if (this_length <= a->preferredMessageSize && recno > ps->start)
             {
                 yaz_log(log_requestdetail, "  Dropped last normal-sized record");
                 *pres = Z_PresentStatus_partial_2;
@@ -2597,10 +3550,10 @@ static Z_Records *pack_records(association *a, char *setname, Odr_int start,
                     yaz_log(YLOG_DEBUG, "  Dropped it");
                     reclist->records[reclist->num_records] =
                          surrogatediagrec(
-                             a, freq.basename,
+                             a, freq->basename,
                              YAZ_BIB1_RECORD_EXCEEDS_PREFERRED_MESSAGE_SIZE, 0);
                     reclist->num_records++;
-                    dumped_records += this_length;
+                    ps->dumped_records += this_length;
                     continue;
                 }
             }
@@ -2611,10 +3564,10 @@ static Z_Records *pack_records(association *a, char *setname, Odr_int start,
                         this_length, a->maximumRecordSize);
                 reclist->records[reclist->num_records] =
                     surrogatediagrec(
-                        a, freq.basename,
+                        a, freq->basename,
                         YAZ_BIB1_RECORD_EXCEEDS_MAXIMUM_RECORD_SIZE, 0);
                 reclist->num_records++;
-                dumped_records += this_length;
+                ps->dumped_records += this_length;
                 continue;
             }
         }
@@ -2622,25 +3575,25 @@ static Z_Records *pack_records(association *a, char *setname, Odr_int start,
         if (!(thisrec = (Z_NamePlusRecord *)
               odr_malloc(a->encode, sizeof(*thisrec))))
             return 0;
-        thisrec->databaseName = odr_strdup_null(a->encode, freq.basename);
+        thisrec->databaseName = odr_strdup_null(a->encode, freq->basename);
         thisrec->which = Z_NamePlusRecord_databaseRecord;
 
-        if (!freq.output_format)
+        if (!freq->output_format)
         {
             yaz_log(YLOG_WARN, "bend_fetch output_format not set");
             return 0;
         }
         thisrec->u.databaseRecord = z_ext_record_oid(
-            a->encode, freq.output_format, freq.record, freq.len);
+            a->encode, freq->output_format, freq->record, freq->len);
         if (!thisrec->u.databaseRecord)
             return 0;
         reclist->records[reclist->num_records] = thisrec;
         reclist->num_records++;
-        if (freq.last_in_set)
+        if (freq->last_in_set)
             break;
     }
-    *num = reclist->num_records;
-    return records;
+    *ps->num = reclist->num_records;
+    return ps->records;
 }
 
 static Z_APDU *process_searchRequest(association *assoc, request *reqb)
@@ -2659,6 +3612,7 @@ static Z_APDU *process_searchRequest(association *assoc, request *reqb)
     bsrr->partial_resultset = 0;
     bsrr->extra_args = 0;
     bsrr->extra_response_data = 0;
+    bsrr->pending = 0;
 
     yaz_log(log_requestdetail, "ResultSet '%s'", req->resultSetName);
     if (req->databaseNames)
@@ -2695,7 +3649,8 @@ static Z_APDU *process_searchRequest(association *assoc, request *reqb)
             /* have a CQL query and a CQL to PQF transform .. */
             int srw_errcode =
                 cql2pqf(bsrr->stream, req->query->u.type_104->u.cql,
-                        assoc->server->cql_transform, bsrr->query,
+                        assoc->server->cql_transform,
+                        assoc->server->query_cache, bsrr->query,
                         &bsrr->srw_sortKeys);
             if (srw_errcode)
                 bsrr->errcode = yaz_diag_srw_to_bib1(srw_errcode);
@@ -2707,13 +3662,19 @@ static Z_APDU *process_searchRequest(association *assoc, request *reqb)
             /* have a CCL query and a CCL to PQF transform .. */
             int srw_errcode =
                 ccl2pqf(bsrr->stream, req->query->u.type_2,
-                        assoc->server->ccl_transform, bsrr);
+                        assoc->server->ccl_transform,
+                        assoc->server->query_cache, bsrr);
             if (srw_errcode)
                 bsrr->errcode = yaz_diag_srw_to_bib1(srw_errcode);
         }
 
         if (!bsrr->errcode)
-            (assoc->init->bend_search)(assoc->backend, bsrr);
+        {
+            reqb->deferred_data = bsrr;
+            if (backend_call(assoc, reqb, bsrr, &bsrr->pending,
+                             call_bend_search, search_resume))
+                return 0;
+        }
     }
     else
     {
@@ -2723,6 +3684,36 @@ static Z_APDU *process_searchRequest(association *assoc, request *reqb)
     return response_searchRequest(assoc, reqb, bsrr);
 }
 
+static void search_resume(association *assoc, request *reqb)
+{
+    bend_search_rr *bsrr = (bend_search_rr *) reqb->deferred_data;
+
+    deferred_response(assoc, reqb,
+                      response_searchRequest(assoc, reqb, bsrr));
+}
+
+static Z_APDU *log_searchRequest(association *assoc, request *reqb,
+                                 bend_search_rr *bsrt, Z_APDU *apdu);
+
+/* search response piggyback records packed after deferred fetch */
+static void search_records_done(association *assoc, request *reqb,
+                                struct pack_state *ps, Z_Records *records)
+{
+    Z_APDU *apdu = ps->apdu;
+    Z_SearchResponse *resp = apdu->u.searchResponse;
+
+    if (records)
+    {
+        resp->records = records;
+        resp->numberOfRecordsReturned = ps->num;
+        resp->presentStatus = ps->pres;
+        apdu = log_searchRequest(assoc, reqb, ps->bsrr, apdu);
+    }
+    else
+        apdu = 0;
+    deferred_response(assoc, reqb, apdu);
+}
+
 /*
  * Prepare a searchresponse based on the backend results. We probably want
  * to look at making the fetching of records nonblocking as well, but
@@ -2730,6 +3721,22 @@ static Z_APDU *process_searchRequest(association *assoc, request *reqb)
  * If bsrt is null, that means we're called in response to a communications
  * event, and we'll have to get the response for ourselves.
  */
+static void set_resultSetStatus(association *assoc, Z_SearchResponse *resp,
+                                bend_search_rr *bsrt)
+{
+    resp->resultSetStatus = 0;
+    if (bsrt->estimated_hit_count)
+    {
+        resp->resultSetStatus = odr_intdup(assoc->encode,
+                                           Z_SearchResponse_estimate);
+    }
+    else if (bsrt->partial_resultset)
+    {
+        resp->resultSetStatus = odr_intdup(assoc->encode,
+                                           Z_SearchResponse_subset);
+    }
+}
+
 static Z_APDU *response_searchRequest(association *assoc, request *reqb,
                                       bend_search_rr *bsrt)
 {
@@ -2740,7 +3747,6 @@ static Z_APDU *response_searchRequest(association *assoc, request *reqb,
     Odr_int *nulint = odr_intdup(assoc->encode, 0);
     Odr_int *next = odr_intdup(assoc->encode, 0);
     Odr_int *none = odr_intdup(assoc->encode, Z_SearchResponse_none);
-    Odr_int returnedrecs = 0;
 
     apdu->which = Z_APDU_searchResponse;
     apdu->u.searchResponse = resp;
@@ -2764,32 +3770,37 @@ static Z_APDU *response_searchRequest(association *assoc, request *reqb,
     }
     else
     {
-        bool_t *sr = odr_booldup(assoc->encode, 1);
         Odr_int *toget = odr_intdup(assoc->encode, 0);
-        Z_RecordComposition comp, *compp = 0;
+        /* in encode memory: used by pack_records after deferral */
+        Z_RecordComposition *comp = (Z_RecordComposition *)
+            odr_malloc(assoc->encode, sizeof(*comp));
+        Z_RecordComposition *compp = 0;
 
         yaz_log(log_requestdetail, "resultCount: " ODR_INT_PRINTF, bsrt->hits);
 
         resp->records = 0;
         resp->resultCount = &bsrt->hits;
+        resp->nextResultSetPosition = next;
+        resp->searchStatus = odr_booldup(assoc->encode, 1);
+        set_resultSetStatus(assoc, resp, bsrt);
 
-        comp.which = Z_RecordComp_simple;
+        comp->which = Z_RecordComp_simple;
         /* how many records does the user agent want, then? */
         if (bsrt->hits < 0)
             *toget = 0;
         else if (bsrt->hits <= *req->smallSetUpperBound)
         {
             *toget = bsrt->hits;
-            if ((comp.u.simple = req->smallSetElementSetNames))
-                compp = &comp;
+            if ((comp->u.simple = req->smallSetElementSetNames))
+                compp = comp;
         }
         else if (bsrt->hits < *req->largeSetLowerBound)
         {
             *toget = *req->mediumSetPresentNumber;
             if (*toget > bsrt->hits)
                 *toget = bsrt->hits;
-            if ((comp.u.simple = req->mediumSetElementSetNames))
-                compp = &comp;
+            if ((comp->u.simple = req->mediumSetElementSetNames))
+                compp = comp;
         }
         else
             *toget = 0;
@@ -2797,6 +3808,8 @@ static Z_APDU *response_searchRequest(association *assoc, request *reqb,
         if (*toget && !resp->records)
         {
             Odr_int *presst = odr_intdup(assoc->encode, 0);
+
+            resp->presentStatus = presst;
             /* Call bend_present if defined */
             if (assoc->init->bend_present)
             {
@@ -2823,14 +3836,19 @@ static Z_APDU *response_searchRequest(association *assoc, request *reqb,
             }
 
             if (!resp->records)
-                resp->records = pack_records(
+            {
+                struct pack_state *ps = pack_state_create(
                     assoc, req->resultSetName, 1,
                     toget, compp, next, presst, req->referenceId,
-                    req->preferredRecordSyntax, NULL);
+                    req->preferredRecordSyntax);
+                ps->done = search_records_done;
+                ps->apdu = apdu;
+                ps->bsrr = bsrt;
+                resp->records = pack_records(assoc, reqb, ps);
+            }
             if (!resp->records)
                 return 0;
             resp->numberOfRecordsReturned = toget;
-            returnedrecs = *toget;
             resp->presentStatus = presst;
         }
         else
@@ -2840,24 +3858,23 @@ static Z_APDU *response_searchRequest(association *assoc, request *reqb,
             resp->numberOfRecordsReturned = nulint;
             resp->presentStatus = 0;
         }
-        resp->nextResultSetPosition = next;
-        resp->searchStatus = sr;
-        resp->resultSetStatus = 0;
-        if (bsrt->estimated_hit_count)
-        {
-            resp->resultSetStatus = odr_intdup(assoc->encode,
-                                               Z_SearchResponse_estimate);
-        }
-        else if (bsrt->partial_resultset)
-        {
-            resp->resultSetStatus = odr_intdup(assoc->encode,
-                                               Z_SearchResponse_subset);
-        }
     }
+    return log_searchRequest(assoc, reqb, bsrt, apdu);
+}
+
+/* sets additionalSearchInfo and logs search response */
+static Z_APDU *log_searchRequest(association *assoc, request *reqb,
+                                 bend_search_rr *bsrt, Z_APDU *apdu)
+{
+    Z_SearchRequest *req = reqb->apdu_request->u.searchRequest;
+    Z_SearchResponse *resp = apdu->u.searchResponse;
+
     resp->additionalSearchInfo = bsrt->search_info;
 
     if (log_request)
     {
+        Odr_int returnedrecs = resp->numberOfRecordsReturned ?
+            *resp->numberOfRecordsReturned : 0;
         int i;
         WRBUF wr = wrbuf_alloc();
 
@@ -2898,6 +3915,51 @@ static Z_APDU *response_searchRequest(association *assoc, request *reqb,
  * operation is more fun in operations that have an unpredictable execution
  * speed - which is normally more true for search than for present.
  */
+static Z_APDU *log_presentRequest(association *assoc, request *reqb,
+                                  Z_APDU *apdu, int errcode)
+{
+    Z_PresentRequest *req = reqb->apdu_request->u.presentRequest;
+    Z_PresentResponse *resp = apdu->u.presentResponse;
+
+    if (log_request)
+    {
+        WRBUF wr = wrbuf_alloc();
+        wrbuf_printf(wr, "Present ");
+
+        if (*resp->presentStatus == Z_PresentStatus_failure)
+            wrbuf_printf(wr, "ERROR %d ", errcode);
+        else if (*resp->presentStatus == Z_PresentStatus_success)
+            wrbuf_printf(wr, "OK -  ");
+        else
+            wrbuf_printf(wr, "Partial " ODR_INT_PRINTF " - ",
+                         *resp->presentStatus);
+
+        wrbuf_printf(wr, " %s " ODR_INT_PRINTF "+" ODR_INT_PRINTF " ",
+                req->resultSetId, *req->resultSetStartPoint,
+                *req->numberOfRecordsRequested);
+        yaz_log(log_request, "%s", wrbuf_cstr(wr) );
+        wrbuf_destroy(wr);
+    }
+    if (!resp->records)
+        return 0;
+    return apdu;
+}
+
+static void present_records_done(association *assoc, request *reqb,
+                                 struct pack_state *ps, Z_Records *records)
+{
+    Z_APDU *apdu = ps->apdu;
+
+    apdu->u.presentResponse->records = records;
+    deferred_response(assoc, reqb,
+                      log_presentRequest(assoc, reqb, apdu, ps->errcode));
+}
+
+/*
+ * Process a present request, fetching records through pack_records.
+ * If the backend defers a fetch the response is completed later by
+ * present_records_done and 0 is returned with the request deferred.
+ */
 static Z_APDU *process_presentRequest(association *assoc, request *reqb)
 {
     Z_PresentRequest *req = reqb->apdu_request->u.presentRequest;
@@ -2944,42 +4006,46 @@ static Z_APDU *process_presentRequest(association *assoc, request *reqb)
     apdu->u.presentResponse = resp;
     resp->referenceId = req->referenceId;
     resp->otherInfo = 0;
+    resp->numberOfRecordsReturned = num;
+    resp->nextResultSetPosition = next;
 
     if (!resp->records)
     {
+        struct pack_state *ps;
+
         *num = *req->numberOfRecordsRequested;
-        resp->records =
-            pack_records(assoc, req->resultSetId, *req->resultSetStartPoint,
-                         num, req->recordComposition, next,
-                         resp->presentStatus,
-                         req->referenceId, req->preferredRecordSyntax,
-                         &errcode);
+        ps = pack_state_create(assoc, req->resultSetId,
+                               *req->resultSetStartPoint, num,
+                               req->recordComposition, next,
+                               resp->presentStatus,
+                               req->referenceId, req->preferredRecordSyntax);
+        ps->done = present_records_done;
+        ps->apdu = apdu;
+        resp->records = pack_records(assoc, reqb, ps);
+        if (reqb->state == REQUEST_DEFERRED)
+            return 0;
+        errcode = ps->errcode;
     }
-    if (log_request)
-    {
-        WRBUF wr = wrbuf_alloc();
-        wrbuf_printf(wr, "Present ");
+    return log_presentRequest(assoc, reqb, apdu, errcode);
+}
 
-        if (*resp->presentStatus == Z_PresentStatus_failure)
-            wrbuf_printf(wr, "ERROR %d ", errcode);
-        else if (*resp->presentStatus == Z_PresentStatus_success)
-            wrbuf_printf(wr, "OK -  ");
-        else
-            wrbuf_printf(wr, "Partial " ODR_INT_PRINTF " - ",
-                         *resp->presentStatus);
+/* scan request while in the backend */
+struct scan_state {
+    Z_APDU *apdu;
+    bend_scan_rr *bsrr;
+    struct scan_entry *save_entries;
+    int step_size;
+};
 
-        wrbuf_printf(wr, " %s " ODR_INT_PRINTF "+" ODR_INT_PRINTF " ",
-                req->resultSetId, *req->resultSetStartPoint,
-                *req->numberOfRecordsRequested);
-        yaz_log(log_request, "%s", wrbuf_cstr(wr) );
-        wrbuf_destroy(wr);
-    }
-    if (!resp->records)
-        return 0;
-    resp->numberOfRecordsReturned = num;
-    resp->nextResultSetPosition = next;
+static Z_APDU *response_scanRequest(association *assoc, request *reqb,
+                                    struct scan_state *ss);
 
-    return apdu;
+static void scan_resume(association *assoc, request *reqb)
+{
+    deferred_response(assoc, reqb,
+                      response_scanRequest(
+                          assoc, reqb,
+                          (struct scan_state *) reqb->deferred_data));
 }
 
 /*
@@ -2996,11 +4062,10 @@ static Z_APDU *process_scanRequest(association *assoc, request *reqb)
     Odr_int *numberOfEntriesReturned = odr_intdup(assoc->encode, 0);
     Z_ListEntries *ents = (Z_ListEntries *)
         odr_malloc(assoc->encode, sizeof(*ents));
-    Z_DiagRecs *diagrecs_p = NULL;
     bend_scan_rr *bsrr = (bend_scan_rr *)
         odr_malloc(assoc->encode, sizeof(*bsrr));
-    struct scan_entry *save_entries;
-    int step_size = 0;
+    struct scan_state *ss = (struct scan_state *)
+        odr_malloc(assoc->encode, sizeof(*ss));
 
     yaz_log(log_requestdetail, "Got ScanRequest");
 
@@ -3008,9 +4073,12 @@ static Z_APDU *process_scanRequest(association *assoc, request *reqb)
     apdu->u.scanResponse = res;
     res->referenceId = req->referenceId;
 
+    ss->apdu = apdu;
+    ss->bsrr = bsrr;
     /* if step is absent, set it to 0 */
+    ss->step_size = 0;
     if (req->stepSize)
-        step_size = odr_int_to_int(*req->stepSize);
+        ss->step_size = odr_int_to_int(*req->stepSize);
 
     res->stepSize = 0;
     res->scanStatus = scanStatus;
@@ -3040,7 +4108,7 @@ static Z_APDU *process_scanRequest(association *assoc, request *reqb)
     bsrr->referenceId = req->referenceId;
     bsrr->stream = assoc->encode;
     bsrr->print = assoc->print;
-    bsrr->step_size = &step_size;
+    bsrr->step_size = &ss->step_size;
     bsrr->setname = yaz_oi_get_string_oid(&req->otherInfo,
                                           yaz_oid_userinfo_scan_set, 1, 0);
     bsrr->entries = 0;
@@ -3066,7 +4134,7 @@ static Z_APDU *process_scanRequest(association *assoc, request *reqb)
             bsrr->entries[i].display_term = 0;
         }
     }
-    save_entries = bsrr->entries;  /* save it so we can compare later */
+    ss->save_entries = bsrr->entries;  /* save it so we can compare later */
 
     bsrr->attributeset = req->attributeSet;
     log_scan_term_level(log_requestdetail, req->termListAndStartPoint,
@@ -3074,8 +4142,24 @@ static Z_APDU *process_scanRequest(association *assoc, request *reqb)
     bsrr->term_position = req->preferredPositionInResponse ?
         odr_int_to_int(*req->preferredPositionInResponse) : 1;
 
-    ((int (*)(void *, bend_scan_rr *))
-     (*assoc->init->bend_scan))(assoc->backend, bsrr);
+    reqb->deferred_data = ss;
+    if (backend_call(assoc, reqb, bsrr, 0, call_bend_scan, scan_resume))
+        return 0;
+    return response_scanRequest(assoc, reqb, ss);
+}
+
+static Z_APDU *response_scanRequest(association *assoc, request *reqb,
+                                    struct scan_state *ss)
+{
+    Z_ScanRequest *req = reqb->apdu_request->u.scanRequest;
+    Z_APDU *apdu = ss->apdu;
+    Z_ScanResponse *res = apdu->u.scanResponse;
+    Odr_int *scanStatus = res->scanStatus;
+    Z_ListEntries *ents = res->entries;
+    Z_DiagRecs *diagrecs_p = NULL;
+    bend_scan_rr *bsrr = ss->bsrr;
+    struct scan_entry *save_entries = ss->save_entries;
+    int step_size = ss->step_size;
 
     if (bsrr->errcode)
         diagrecs_p = zget_DiagRecs(assoc->encode,
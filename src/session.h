@@ -38,7 +38,11 @@
 #include <yaz/proto.h>
 #include <yaz/backend.h>
 #include <yaz/retrieval.h>
+#include <yaz/mutex.h>
+#include <yaz/timing.h>
 #include "eventl.h"
+#include "filecache.h"
+#include "querycache.h"
 
 struct gfs_server {
     statserv_options_block cb;
@@ -50,7 +54,15 @@ struct gfs_server {
     void *server_node_ptr;
     char *directory;
     char *docpath;
+    file_cache_t file_cache;
+    query_cache_t query_cache;   /* query translations; 0 = no cache */
     char *stylesheet;
+    int http_compress_level;     /* zlib level; 0 = no compression */
+    int http_compress_threshold; /* smallest HTTP body compressed */
+    size_t mem_soft;             /* records held back above; 0 = no limit */
+    size_t mem_hard;             /* session closed above; 0 = no limit */
+    char *metrics_path;          /* HTTP path of metrics; 0 = none */
+    int metrics_log;             /* seconds between metrics logs; 0 = none */
     yaz_retrieval_t retrieval;
     struct gfs_server *next;
 };
@@ -63,7 +75,8 @@ struct gfs_listen {
 
 typedef enum {
     REQUEST_IDLE,    /* the request is just sitting in the queue */
-    REQUEST_PENDING  /* operation pending (b'end processing or network I/O*/
+    REQUEST_PENDING, /* operation pending (b'end processing or network I/O*/
+    REQUEST_DEFERRED /* waiting for bend_complete_search/bend_complete_fetch */
     /* this list will have more elements when acc/res control is added */
 } request_state;
 
@@ -78,8 +91,29 @@ typedef struct request
     int size_response;     /* size of buffer */
     int len_response;      /* length of encoded data */
     char *response;        /* encoded data waiting for transmission */
+    char *response_ext;    /* data sent after response (not copied) */
+    int len_response_ext;  /* length of response_ext */
+    NMEM response_mem;     /* memory for response_ext */
+    int metrics_op;        /* enum gfs_metrics_op; -1 when not counted */
+    double metrics_start;  /* arrival of request */
+    int len_request;       /* size of encoded request */
+    double span_decode;    /* time decoding request (when spans enabled) */
+    double span_backend;   /* start of backend call that was deferred */
+    double metrics_backend; /* same for metrics */
+    int metrics_bend;      /* enum gfs_metrics_bend of deferred call */
+    const char *span_backend_phase;
+    int response_fd;       /* file sent after response (-1 for none) */
+    size_t response_fd_len;  /* bytes of file to send */
+    size_t response_fd_sent; /* bytes of file sent so far */
 
     void *clientData;
+    void *deferred_rr;     /* bend_search_rr/bend_fetch_rr in the backend */
+    int deferred_done;     /* set by bend_complete_search/fetch */
+    int deferred_busy;     /* handler still running in a worker */
+    void (*deferred_cont)(struct association *assoc, struct request *req);
+    void *deferred_data;   /* state for deferred_cont */
+    ODR encode;            /* own streams when run concurrently (or 0) */
+    ODR decode;
     struct request *next;
     struct request_q *q;
 } request;
@@ -118,6 +152,13 @@ typedef struct association
     void *backend;                /* backend handle */
     request_q incoming;           /* Q of incoming PDUs */
     request_q outgoing;           /* Q of outgoing data buffers (enc. PDUs) */
+    request_q deferred;           /* Q of requests in backend (bend_complete) */
+    YAZ_MUTEX deferred_mutex;     /* protects deferred (created on demand) */
+    YAZ_COND deferred_cond;       /* signalled by bend_complete_search/fetch */
+    IOCHAN wake_chan;             /* wakes event loop on completion */
+    int wake_fd[2];               /* pipe for wake_chan */
+    int destroy_deferred;         /* freed when deferred requests are done */
+    int concurrent_max;           /* operations run at a time (1=serial) */
     association_state state;
 
     /* session parameters */
@@ -133,6 +174,12 @@ typedef struct association
     statserv_options_block *last_control;
 
     struct gfs_server *server;
+
+    nmem_account_t mem_account;   /* memory charged to the session */
+    size_t mem_soft;              /* limits from gfs_server (0 = none) */
+    size_t mem_hard;
+    int mem_limited;              /* requests cut short by a limit */
+    yaz_spans_t spans;            /* phase timing; 0 when disabled */
 } association;
 
 association *create_association(IOCHAN channel, COMSTACK link,
@@ -25,10 +25,18 @@
 #include <iconv.h>
 #endif
 
+#if YAZ_POSIX_THREADS
+#include <pthread.h>
+#endif
+
 #include <yaz/xmalloc.h>
 #include <yaz/errno.h>
+#include <yaz/mutex.h>
 #include "iconv-p.h"
 
+/* max number of idle converters kept by yaz_iconv_pool_put */
+#define ICONV_POOL_MAX 32
+
 struct yaz_iconv_struct {
     int my_errno;
     int init_flag;
@@ -45,8 +53,14 @@ struct yaz_iconv_struct {
 #endif
     struct yaz_iconv_encoder_s encoder;
     struct yaz_iconv_decoder_s decoder;
+    char *pool_key;         /* "tocode/fromcode" if from pool; else 0 */
+    yaz_iconv_t pool_next;  /* next idle converter in pool */
 };
 
+static yaz_iconv_t iconv_pool_list = 0;
+static int iconv_pool_size = 0;
+static YAZ_MUTEX iconv_pool_mutex = 0;
+
 
 int yaz_iconv_isbuiltin(yaz_iconv_t cd)
 {
@@ -112,6 +126,8 @@ yaz_iconv_t yaz_iconv_open(const char *tocode, const char *fromcode)
     cd->decoder.destroy_handle = 0;
 
     cd->my_errno = YAZ_ICONV_UNKNOWN;
+    cd->pool_key = 0;
+    cd->pool_next = 0;
 
     /* a useful hack: if fromcode has leading @,
        the library not use YAZ's own conversions .. */
@@ -295,10 +311,115 @@ int yaz_iconv_close(yaz_iconv_t cd)
         (*cd->encoder.destroy_handle)(&cd->encoder);
     if (cd->decoder.destroy_handle)
         (*cd->decoder.destroy_handle)(&cd->decoder);
+    xfree(cd->pool_key);
     xfree(cd);
     return 0;
 }
 
+static void iconv_pool_init(void)
+{
+    yaz_mutex_create(&iconv_pool_mutex);
+}
+
+static void iconv_pool_lock(void)
+{
+#if YAZ_POSIX_THREADS
+    static pthread_once_t once_control = PTHREAD_ONCE_INIT;
+    pthread_once(&once_control, iconv_pool_init);
+#else
+    if (!iconv_pool_mutex)
+        iconv_pool_init();
+#endif
+    yaz_mutex_enter(iconv_pool_mutex);
+}
+
+static void iconv_pool_unlock(void)
+{
+    yaz_mutex_leave(iconv_pool_mutex);
+}
+
+yaz_iconv_t yaz_iconv_pool_get(const char *tocode, const char *fromcode)
+{
+    size_t to_len = strlen(tocode);
+    char *key = (char *) xmalloc(to_len + strlen(fromcode) + 2);
+    yaz_iconv_t cd, *cdp;
+
+    memcpy(key, tocode, to_len);
+    key[to_len] = '/';
+    strcpy(key + to_len + 1, fromcode);
+
+    iconv_pool_lock();
+    for (cdp = &iconv_pool_list; (cd = *cdp); cdp = &cd->pool_next)
+        if (!strcmp(cd->pool_key, key))
+        {
+            *cdp = cd->pool_next;
+            iconv_pool_size--;
+            break;
+        }
+    iconv_pool_unlock();
+    if (cd)
+        xfree(key);
+    else
+    {
+        cd = yaz_iconv_open(tocode, fromcode);
+        if (cd)
+            cd->pool_key = key;
+        else
+            xfree(key);
+    }
+    if (cd)
+        cd->pool_next = 0;
+    return cd;
+}
+
+void yaz_iconv_pool_put(yaz_iconv_t cd)
+{
+    if (!cd)
+        return;
+    if (!cd->pool_key)
+    {
+        yaz_iconv_close(cd);
+        return;
+    }
+    /* reset shift state so the converter is as if just opened */
+#if HAVE_ICONV_H
+    if (cd->iconv_cd != (iconv_t) (-1))
+        iconv(cd->iconv_cd, 0, 0, 0, 0);
+#endif
+    cd->init_flag = 1;
+    cd->unget_x = 0;
+    cd->my_errno = YAZ_ICONV_UNKNOWN;
+
+    iconv_pool_lock();
+    if (iconv_pool_size < ICONV_POOL_MAX)
+    {
+        cd->pool_next = iconv_pool_list;
+        iconv_pool_list = cd;
+        iconv_pool_size++;
+        cd = 0;
+    }
+    iconv_pool_unlock();
+    if (cd)
+        yaz_iconv_close(cd);
+}
+
+void yaz_iconv_pool_cleanup(void)
+{
+    yaz_iconv_t cd;
+
+    iconv_pool_lock();
+    cd = iconv_pool_list;
+    iconv_pool_list = 0;
+    iconv_pool_size = 0;
+    iconv_pool_unlock();
+    while (cd)
+    {
+        yaz_iconv_t cd_next = cd->pool_next;
+        yaz_iconv_close(cd);
+        cd = cd_next;
+    }
+}
+
 void yaz_iconv_set_errno(yaz_iconv_t cd, int no)
 {
     cd->my_errno = no;
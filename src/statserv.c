@@ -227,7 +227,15 @@ static struct gfs_server * gfs_server_new(const char *id)
     n->server_node_ptr = 0;
     n->directory = 0;
     n->docpath = 0;
+    n->file_cache = 0;
+    n->query_cache = 0;
     n->stylesheet = 0;
+    n->http_compress_level = 0;
+    n->http_compress_threshold = 1024;
+    n->mem_soft = 0;
+    n->mem_hard = 0;
+    n->metrics_path = 0;
+    n->metrics_log = 0;
     n->id = nmem_strdup_null(gfs_nmem, id);
     n->retrieval = yaz_retrieval_create();
     return n;
@@ -328,13 +336,35 @@ int control_association(association *assoc, const char *host, int force_open)
     yaz_log(YLOG_DEBUG, "server select: config=%s",
             assoc->last_control->configname);
 
+    assoc->mem_soft = assoc->server ? assoc->server->mem_soft : 0;
+    assoc->mem_hard = assoc->server ? assoc->server->mem_hard : 0;
     assoc->maximumRecordSize = assoc->last_control->maxrecordsize;
     assoc->preferredMessageSize = assoc->last_control->maxrecordsize;
     cs_set_max_recv_bytes(assoc->client_link, assoc->maximumRecordSize);
+    z_HTTP_set_max_content(assoc->decode, assoc->maximumRecordSize);
     return 1;
 }
 
 #if YAZ_HAVE_XML2
+/* parses byte count with optional K, M or G suffix; 0 on error */
+static size_t parse_mem_size(const char *s)
+{
+    char *end;
+    double v = strtod(s, &end);
+
+    if (end == s || v < 0)
+        return 0;
+    switch (*end)
+    {
+    case 'k': case 'K': v *= 1024.0; end++; break;
+    case 'm': case 'M': v *= 1024.0 * 1024.0; end++; break;
+    case 'g': case 'G': v *= 1024.0 * 1024.0 * 1024.0; end++; break;
+    }
+    if (*end)
+        return 0;
+    return (size_t) v;
+}
+
 static void xml_config_read(void)
 {
     struct gfs_server **gfsp = &gfs_server_list;
@@ -451,12 +481,117 @@ static void xml_config_read(void)
                 {
                     gfs->docpath =
                         nmem_dup_xml_content(gfs_nmem, ptr->children);
+                    if (!gfs->file_cache)
+                        gfs->file_cache = file_cache_create();
+                }
+                else if (!strcmp((const char *) ptr->name, "querycache"))
+                {
+                    query_cache_destroy(gfs->query_cache);
+                    gfs->query_cache = query_cache_create(atoi(
+                        nmem_dup_xml_content(gfs_nmem, ptr->children)));
                 }
                 else if (!strcmp((const char *) ptr->name, "maximumrecordsize"))
                 {
                     gfs->cb.maxrecordsize = atoi(
                         nmem_dup_xml_content(gfs_nmem, ptr->children));
                 }
+                else if (!strcmp((const char *) ptr->name,
+                                 "httpcompression"))
+                {
+                    struct _xmlAttr *attr = ptr->properties;
+
+                    gfs->http_compress_level = -1; /* zlib default */
+                    for ( ; attr; attr = attr->next)
+                        if (!xmlStrcmp(attr->name, BAD_CAST "level")
+                            && attr->children
+                            && attr->children->type == XML_TEXT_NODE)
+                            gfs->http_compress_level = atoi(
+                                nmem_dup_xml_content(gfs_nmem,
+                                                     attr->children));
+                        else if (!xmlStrcmp(attr->name, BAD_CAST "threshold")
+                                 && attr->children
+                                 && attr->children->type == XML_TEXT_NODE)
+                            gfs->http_compress_threshold = atoi(
+                                nmem_dup_xml_content(gfs_nmem,
+                                                     attr->children));
+                        else
+                            yaz_log(YLOG_WARN, "Unknown attribute '%s' for "
+                                    "httpcompression", attr->name);
+                    if (gfs->http_compress_level < -1
+                        || gfs->http_compress_level > 9)
+                    {
+                        yaz_log(YLOG_FATAL, "Bad httpcompression level %d "
+                                "in config %s", gfs->http_compress_level,
+                                control_block.xml_config);
+                        exit(1);
+                    }
+#if !HAVE_ZLIB
+                    yaz_log(YLOG_WARN, "httpcompression ignored: "
+                            "YAZ built without zlib");
+#endif
+                }
+                else if (!strcmp((const char *) ptr->name, "memorylimit"))
+                {
+                    struct _xmlAttr *attr = ptr->properties;
+
+                    for ( ; attr; attr = attr->next)
+                    {
+                        size_t *vp = 0;
+                        const char *v;
+
+                        if (!xmlStrcmp(attr->name, BAD_CAST "soft"))
+                            vp = &gfs->mem_soft;
+                        else if (!xmlStrcmp(attr->name, BAD_CAST "hard"))
+                            vp = &gfs->mem_hard;
+                        else
+                        {
+                            yaz_log(YLOG_WARN, "Unknown attribute '%s' for "
+                                    "memorylimit", attr->name);
+                            continue;
+                        }
+                        if (!attr->children
+                            || attr->children->type != XML_TEXT_NODE)
+                            continue;
+                        v = nmem_dup_xml_content(gfs_nmem, attr->children);
+                        if (!(*vp = parse_mem_size(v)))
+                        {
+                            yaz_log(YLOG_FATAL, "Bad memorylimit %s '%s' "
+                                    "in config %s", attr->name, v,
+                                    control_block.xml_config);
+                            exit(1);
+                        }
+                    }
+                    if (gfs->mem_hard && (!gfs->mem_soft
+                                          || gfs->mem_soft > gfs->mem_hard))
+                        gfs->mem_soft = gfs->mem_hard;
+                }
+                else if (!strcmp((const char *) ptr->name, "metrics"))
+                {
+                    struct _xmlAttr *attr = ptr->properties;
+
+                    for ( ; attr; attr = attr->next)
+                        if (!xmlStrcmp(attr->name, BAD_CAST "path")
+                            && attr->children
+                            && attr->children->type == XML_TEXT_NODE)
+                            gfs->metrics_path = nmem_dup_xml_content(
+                                gfs_nmem, attr->children);
+                        else if (!xmlStrcmp(attr->name, BAD_CAST "loginterval")
+                                 && attr->children
+                                 && attr->children->type == XML_TEXT_NODE)
+                            gfs->metrics_log = atoi(
+                                nmem_dup_xml_content(gfs_nmem,
+                                                     attr->children));
+                        else
+                            yaz_log(YLOG_WARN, "Unknown attribute '%s' for "
+                                    "metrics", attr->name);
+                    if (gfs->metrics_path && *gfs->metrics_path != '/')
+                    {
+                        yaz_log(YLOG_FATAL, "metrics path '%s' must start "
+                                "with / in config %s", gfs->metrics_path,
+                                control_block.xml_config);
+                        exit(1);
+                    }
+                }
                 else if (!strcmp((const char *) ptr->name, "stylesheet"))
                 {
                     char *s = nmem_dup_xml_content(gfs_nmem, ptr->children);
@@ -537,6 +672,23 @@ static void xml_config_open(void)
 
 static void xml_config_close(void)
 {
+    struct gfs_server *gfs;
+
+    for (gfs = gfs_server_list; gfs; gfs = gfs->next)
+    {
+        if (gfs->query_cache)
+        {
+            long hits, misses;
+            int entries;
+
+            query_cache_stat(gfs->query_cache, &hits, &misses, &entries);
+            yaz_log(YLOG_LOG, "querycache %s: %ld hits %ld misses "
+                    "%d entries", gfs->id ? gfs->id : "-",
+                    hits, misses, entries);
+        }
+        query_cache_destroy(gfs->query_cache);
+        file_cache_destroy(gfs->file_cache);
+    }
 #if YAZ_HAVE_XML2
     if (xml_config_doc)
     {
@@ -53,6 +53,9 @@
 #if HAVE_SYS_SOCKET_H
 #include <sys/socket.h>
 #endif
+#if HAVE_SYS_UIO_H
+#include <sys/uio.h>
+#endif
 #if HAVE_SYS_WAIT_H
 #include <sys/wait.h>
 #endif
@@ -69,12 +72,19 @@
 #define ENABLE_SSL 1
 #endif
 
+#if YAZ_POSIX_THREADS
+#include <pthread.h>
+#endif
+
 #include <yaz/comstack.h>
 #include <yaz/tcpip.h>
 #include <yaz/errno.h>
+#include <yaz/mutex.h>
+#include <yaz/log.h>
 
 static void tcpip_close(COMSTACK h);
 static int tcpip_put(COMSTACK h, char *buf, int size);
+static int tcpip_putv(COMSTACK h, const cs_iovec *iov, int iovcnt);
 static int tcpip_get(COMSTACK h, char **buf, int *bufsize);
 static int tcpip_put_connect(COMSTACK h, char *buf, int size);
 static int tcpip_get_connect(COMSTACK h, char **buf, int *bufsize);
@@ -90,6 +100,7 @@ static int tcpip_set_blocking(COMSTACK p, int blocking);
 #if ENABLE_SSL
 static int ssl_get(COMSTACK h, char **buf, int *bufsize);
 static int ssl_put(COMSTACK h, char *buf, int size);
+static int ssl_putv(COMSTACK h, const cs_iovec *iov, int iovcnt);
 #endif
 
 static COMSTACK tcpip_accept(COMSTACK h);
@@ -109,6 +120,7 @@ static void *tcpip_straddr(COMSTACK h, const char *str);
 #if HAVE_GNUTLS_H
 struct tcpip_cred_ptr {
     gnutls_certificate_credentials_t xcred;
+    gnutls_datum_t ticket_key; /* server side session tickets */
     int ref;
 };
 
@@ -122,6 +134,7 @@ typedef struct tcpip_state
 
     int written;  /* -1 if we aren't writing */
     int towrite;  /* to verify against user input */
+    int putv_no;  /* current buffer for cs_putv_loop */
     int (*complete)(const char *buf, int len); /* length/complete. */
 #if HAVE_GETADDRINFO
     struct addrinfo *ai;
@@ -129,6 +142,7 @@ typedef struct tcpip_state
     struct sockaddr_in addr;  /* returned by cs_straddr */
 #endif
     char buf[128]; /* returned by cs_addrstr */
+    char *session_key; /* host:port for TLS session cache (client) */
 #if HAVE_GNUTLS_H
     struct tcpip_cred_ptr *cred_ptr;
     gnutls_session_t session;
@@ -196,6 +210,7 @@ COMSTACK tcpip_type(int s, int flags, int protocol, void *vp)
     p->f_rcvconnect = tcpip_rcvconnect;
     p->f_get = tcpip_get;
     p->f_put = tcpip_put;
+    p->f_putv = tcpip_putv;
     p->f_close = tcpip_close;
     p->f_more = tcpip_more;
     p->f_bind = tcpip_bind;
@@ -224,9 +239,11 @@ COMSTACK tcpip_type(int s, int flags, int protocol, void *vp)
 #if HAVE_GETADDRINFO
     sp->ai = 0;
 #endif
+    sp->session_key = 0;
     sp->altbuf = 0;
     sp->altsize = sp->altlen = 0;
     sp->towrite = sp->written = -1;
+    sp->putv_no = 0;
     if (protocol == PROTO_WAIS)
         sp->complete = completeWAIS;
     else
@@ -269,11 +286,300 @@ static void tcpip_create_cred(COMSTACK cs)
     tcpip_state *sp = (tcpip_state *) cs->cprivate;
     sp->cred_ptr = (struct tcpip_cred_ptr *) xmalloc(sizeof(*sp->cred_ptr));
     sp->cred_ptr->ref = 1;
+    sp->cred_ptr->ticket_key.data = 0;
+    sp->cred_ptr->ticket_key.size = 0;
     gnutls_certificate_allocate_credentials(&sp->cred_ptr->xcred);
 }
 
 #endif
 
+/* Process-wide cache of client TLS sessions, keyed by host:port, so that
+   reconnects to the same server can resume instead of doing a full
+   handshake. Entries hold the serialized session; most recent first. */
+#define TLS_SESSION_CACHE_MAX 64
+
+struct tls_session_entry {
+    char *key;
+    unsigned char *data;
+    size_t len;
+    struct tls_session_entry *next;
+};
+
+static struct tls_session_entry *tls_session_list = 0;
+static int tls_session_hits = 0;
+static int tls_session_misses = 0;
+static YAZ_MUTEX tls_session_mutex = 0;
+
+static void tls_session_cache_init(void)
+{
+    yaz_mutex_create(&tls_session_mutex);
+}
+
+static void tls_session_lock(void)
+{
+#if YAZ_POSIX_THREADS
+    static pthread_once_t once_control = PTHREAD_ONCE_INIT;
+    pthread_once(&once_control, tls_session_cache_init);
+#else
+    if (!tls_session_mutex)
+        tls_session_cache_init();
+#endif
+    yaz_mutex_enter(tls_session_mutex);
+}
+
+static void tls_session_unlock(void)
+{
+    yaz_mutex_leave(tls_session_mutex);
+}
+
+#if ENABLE_SSL
+/* returns copy of cached session for key (xfree it) or NULL if none */
+static unsigned char *tls_session_get(const char *key, size_t *len)
+{
+    struct tls_session_entry **ep;
+    unsigned char *data = 0;
+
+    tls_session_lock();
+    for (ep = &tls_session_list; *ep; ep = &(*ep)->next)
+        if (!strcmp((*ep)->key, key))
+        {
+            struct tls_session_entry *e = *ep;
+
+            *ep = e->next; /* move to front */
+            e->next = tls_session_list;
+            tls_session_list = e;
+
+            data = (unsigned char *) xmalloc(e->len);
+            memcpy(data, e->data, e->len);
+            *len = e->len;
+            break;
+        }
+    tls_session_unlock();
+    return data;
+}
+
+static void tls_session_put(const char *key, const unsigned char *data,
+                            size_t len)
+{
+    struct tls_session_entry **ep, *e = 0;
+    int no = 0;
+
+    tls_session_lock();
+    for (ep = &tls_session_list; *ep; ep = &(*ep)->next)
+        if (!strcmp((*ep)->key, key))
+        {
+            e = *ep;
+            *ep = e->next;
+            xfree(e->data);
+            break;
+        }
+    if (!e)
+    {
+        e = (struct tls_session_entry *) xmalloc(sizeof(*e));
+        e->key = xstrdup(key);
+    }
+    e->data = (unsigned char *) xmalloc(len);
+    memcpy(e->data, data, len);
+    e->len = len;
+    e->next = tls_session_list;
+    tls_session_list = e;
+
+    for (ep = &tls_session_list; *ep; ep = &(*ep)->next)
+        if (++no > TLS_SESSION_CACHE_MAX)
+        {   /* drop least recently used */
+            e = *ep;
+            *ep = 0;
+            xfree(e->key);
+            xfree(e->data);
+            xfree(e);
+            break;
+        }
+    tls_session_unlock();
+}
+
+static void tls_session_count(COMSTACK h, int resumed)
+{
+    tls_session_lock();
+    if (resumed)
+        tls_session_hits++;
+    else
+        tls_session_misses++;
+    tls_session_unlock();
+    yaz_log(YLOG_DEBUG, "TLS session %s %s",
+            ((tcpip_state *) h->cprivate)->session_key,
+            resumed ? "resumed" : "full handshake");
+}
+#endif
+
+void cs_get_ssl_session_stats(int *hits, int *misses)
+{
+    tls_session_lock();
+    *hits = tls_session_hits;
+    *misses = tls_session_misses;
+    tls_session_unlock();
+}
+
+void cs_clear_ssl_session_cache(void)
+{
+    tls_session_lock();
+    while (tls_session_list)
+    {
+        struct tls_session_entry *e = tls_session_list;
+        tls_session_list = e->next;
+        xfree(e->key);
+        xfree(e->data);
+        xfree(e);
+    }
+    tls_session_hits = tls_session_misses = 0;
+    tls_session_unlock();
+}
+
+#if HAVE_GNUTLS_H
+static void tls_session_save(tcpip_state *sp)
+{
+    gnutls_datum_t d;
+
+    if (gnutls_session_get_data2(sp->session, &d) == GNUTLS_E_SUCCESS)
+    {
+        tls_session_put(sp->session_key, d.data, d.size);
+        gnutls_free(d.data);
+    }
+}
+
+#if GNUTLS_VERSION_NUMBER >= 0x030600
+/* TLS 1.3 tickets arrive after the handshake */
+static int tls_session_ticket_hook(gnutls_session_t session,
+                                   unsigned htype, unsigned when,
+                                   unsigned incoming,
+                                   const gnutls_datum_t *msg)
+{
+    tcpip_state *sp = (tcpip_state *) gnutls_session_get_ptr(session);
+
+    if (sp && incoming
+        && gnutls_protocol_get_version(session) == GNUTLS_TLS1_3)
+        tls_session_save(sp);
+    return 0;
+}
+#endif
+
+static void tls_session_resume(COMSTACK h)
+{
+    tcpip_state *sp = (tcpip_state *) h->cprivate;
+    unsigned char *data;
+    size_t len;
+
+    if (!sp->session_key)
+        return;
+#if GNUTLS_VERSION_NUMBER >= 0x030600
+    gnutls_session_set_ptr(sp->session, sp);
+    gnutls_handshake_set_hook_function(sp->session,
+                                       GNUTLS_HANDSHAKE_NEW_SESSION_TICKET,
+                                       GNUTLS_HOOK_POST,
+                                       tls_session_ticket_hook);
+#endif
+    data = tls_session_get(sp->session_key, &len);
+    if (data)
+    {
+        gnutls_session_set_data(sp->session, data, len);
+        xfree(data);
+    }
+}
+
+static void tls_session_established(COMSTACK h)
+{
+    tcpip_state *sp = (tcpip_state *) h->cprivate;
+
+    if (!sp->session_key)
+        return;
+    tls_session_count(h, gnutls_session_is_resumed(sp->session));
+#if GNUTLS_VERSION_NUMBER >= 0x030600
+    if (gnutls_protocol_get_version(sp->session) == GNUTLS_TLS1_3)
+        return; /* saved by tls_session_ticket_hook */
+#endif
+    tls_session_save(sp);
+}
+#elif HAVE_OPENSSL_SSL_H
+static int tls_session_new_cb(SSL *ssl, SSL_SESSION *sess)
+{
+    tcpip_state *sp = (tcpip_state *) SSL_get_app_data(ssl);
+    int len = i2d_SSL_SESSION(sess, 0);
+
+    if (sp && sp->session_key && len > 0)
+    {
+        unsigned char *data = (unsigned char *) xmalloc(len);
+        unsigned char *cp = data;
+
+        i2d_SSL_SESSION(sess, &cp);
+        tls_session_put(sp->session_key, data, len);
+        xfree(data);
+    }
+    return 0; /* we did not keep a reference to sess */
+}
+
+static void tls_session_resume(COMSTACK h)
+{
+    tcpip_state *sp = (tcpip_state *) h->cprivate;
+    unsigned char *data;
+    size_t len;
+
+    if (!sp->session_key || !sp->ctx_alloc)
+        return;
+    SSL_set_app_data(sp->ssl, sp);
+    data = tls_session_get(sp->session_key, &len);
+    if (data)
+    {
+        const unsigned char *cp = data;
+        SSL_SESSION *sess = d2i_SSL_SESSION(0, &cp, (long) len);
+        if (sess)
+        {
+            SSL_set_session(sp->ssl, sess);
+            SSL_SESSION_free(sess);
+        }
+        xfree(data);
+    }
+}
+
+static void tls_session_established(COMSTACK h)
+{
+    tcpip_state *sp = (tcpip_state *) h->cprivate;
+
+    if (sp->session_key && sp->ctx_alloc)
+        tls_session_count(h, SSL_session_reused(sp->ssl));
+}
+#endif
+
+static void tcpip_set_session_key(COMSTACK h, const char *str,
+                                  const char *port)
+{
+    tcpip_state *sp = (tcpip_state *) h->cprivate;
+    char host[512], *p;
+
+    if (h->type != ssl_type)
+        return;
+    strncpy(host, str, sizeof(host) - 1);
+    host[sizeof(host) - 1] = 0;
+    if ((p = strchr(host, '/')))
+        *p = 0;
+    xfree(sp->session_key);
+    sp->session_key = (char *) xmalloc(strlen(host) + strlen(port) + 2);
+    if (strrchr(host, ':'))
+        strcpy(sp->session_key, host);
+    else
+        sprintf(sp->session_key, "%s:%s", host, port);
+}
+
+static const char *default_port(COMSTACK h)
+{
+    if (h->protocol == PROTO_HTTP)
+        return h->type == ssl_type ? "443" : "80";
+    return "210";
+}
+
+void yaz_tcpip_set_session_host(COMSTACK h, const char *host)
+{
+    tcpip_set_session_key(h, host, default_port(h));
+}
+
 COMSTACK ssl_type(int s, int flags, int protocol, void *vp)
 {
 #if !ENABLE_SSL
@@ -287,6 +593,7 @@ COMSTACK ssl_type(int s, int flags, int protocol, void *vp)
         return 0;
     p->f_get = ssl_get;
     p->f_put = ssl_put;
+    p->f_putv = ssl_putv;
     p->type = ssl_type;
     sp = (tcpip_state *) p->cprivate;
 
@@ -431,21 +738,15 @@ int tcpip_strtoaddr_ex(const char *str, struct sockaddr_in *add,
 void *tcpip_straddr(COMSTACK h, const char *str)
 {
     tcpip_state *sp = (tcpip_state *)h->cprivate;
-    const char *port = "210";
+    const char *port = default_port(h);
     struct addrinfo *ai = 0;
-    if (h->protocol == PROTO_HTTP)
-    {
-        if (h->type == ssl_type)
-            port = "443";
-        else
-            port = "80";
-    }
     if (!tcpip_init())
         return 0;
 
     if (sp->ai)
         freeaddrinfo(sp->ai);
     sp->ai = tcpip_getaddrinfo(str, port);
+    tcpip_set_session_key(h, str, port);
     if (sp->ai && h->state == CS_ST_UNBND)
     {
         int s = -1;
@@ -470,6 +771,7 @@ void *tcpip_straddr(COMSTACK h, const char *str)
 {
     tcpip_state *sp = (tcpip_state *)h->cprivate;
     int port = 210;
+    char port_str[20];
     if (h->protocol == PROTO_HTTP)
     {
         if (h->type == ssl_type)
@@ -482,6 +784,8 @@ void *tcpip_straddr(COMSTACK h, const char *str)
         return 0;
     if (!tcpip_strtoaddr_ex(str, &sp->addr, port))
         return 0;
+    sprintf(port_str, "%d", port);
+    tcpip_set_session_key(h, str, port_str);
     if (h->state == CS_ST_UNBND)
     {
         int s;
@@ -590,6 +894,7 @@ int tcpip_rcvconnect(COMSTACK h)
         gnutls_transport_set_ptr(sp->session,
                                  (gnutls_transport_ptr_t)
                                  (size_t) h->iofile);
+        tls_session_resume(h);
     }
     if (sp->session)
     {
@@ -600,6 +905,7 @@ int tcpip_rcvconnect(COMSTACK h)
                 return 1;
             return -1;
         }
+        tls_session_established(h);
     }
 #elif HAVE_OPENSSL_SSL_H
     if (h->type == ssl_type && !sp->ctx)
@@ -613,6 +919,9 @@ int tcpip_rcvconnect(COMSTACK h)
             h->cerrno = CSERRORSSL;
             return -1;
         }
+        SSL_CTX_set_session_cache_mode(sp->ctx, SSL_SESS_CACHE_CLIENT
+                                       | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+        SSL_CTX_sess_set_new_cb(sp->ctx, tls_session_new_cb);
     }
     if (sp->ctx)
     {
@@ -622,6 +931,7 @@ int tcpip_rcvconnect(COMSTACK h)
         {
             sp->ssl = SSL_new(sp->ctx);
             SSL_set_fd(sp->ssl, h->iofile);
+            tls_session_resume(h);
         }
         res = SSL_connect(sp->ssl);
         if (res <= 0)
@@ -630,6 +940,7 @@ int tcpip_rcvconnect(COMSTACK h)
                 return 1;
             return -1;
         }
+        tls_session_established(h);
     }
 #endif
     h->event = CS_DATA;
@@ -672,6 +983,8 @@ static int tcpip_bind(COMSTACK h, void *address, int mode)
             h->cerrno = CSERRORSSL;
             return -1;
         }
+        /* let clients resume sessions, also in forked children */
+        gnutls_session_ticket_key_generate(&sp->cred_ptr->ticket_key);
     }
 #elif HAVE_OPENSSL_SSL_H
     if (h->type == ssl_type && !sp->ctx)
@@ -711,6 +1024,9 @@ static int tcpip_bind(COMSTACK h, void *address, int mode)
                 ERR_print_errors_fp(stderr);
                 exit(5);
             }
+            /* let clients resume sessions */
+            SSL_CTX_set_session_id_context(sp->ctx,
+                                           (const unsigned char *) "yaz", 3);
         }
         TRC(fprintf(stderr, "ssl_bind\n"));
     }
@@ -887,6 +1203,8 @@ COMSTACK tcpip_accept(COMSTACK h)
         state->altbuf = 0;
         state->altsize = state->altlen = 0;
         state->towrite = state->written = -1;
+        state->putv_no = 0;
+        state->session_key = 0;
         state->complete = st->complete;
 #if HAVE_GETADDRINFO
         state->ai = 0;
@@ -925,6 +1243,9 @@ COMSTACK tcpip_accept(COMSTACK h)
                 xfree(state);
                 return 0;
             }
+            if (st->cred_ptr->ticket_key.data)
+                gnutls_session_ticket_enable_server(
+                    state->session, &st->cred_ptr->ticket_key);
             /* cast to intermediate size_t to avoid GCC warning. */
             gnutls_transport_set_ptr(state->session,
                                      (gnutls_transport_ptr_t)
@@ -1175,6 +1496,12 @@ int ssl_get(COMSTACK h, char **buf, int *bufsize)
         }
         else if (res < 0)
         {
+            /* TLS 1.3 session tickets are processed here and may
+               yield GNUTLS_E_AGAIN even for a blocking socket */
+            if ((res == GNUTLS_E_AGAIN || res == GNUTLS_E_INTERRUPTED)
+                && ((h->flags & CS_FLAGS_BLOCKING)
+                    || gnutls_record_check_pending(sp->session) > 0))
+                continue;
             if (ssl_check_error(h, sp, res))
                 break;
             return -1;
@@ -1217,6 +1544,25 @@ int ssl_get(COMSTACK h, char **buf, int *bufsize)
 }
 #endif
 
+/* whether failed send would block */
+static int tcpip_put_would_block(void)
+{
+#ifdef WIN32
+    return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+    return yaz_errno() == EWOULDBLOCK
+#ifdef EAGAIN
+#if EAGAIN != EWOULDBLOCK
+        || yaz_errno() == EAGAIN
+#endif
+#endif
+#ifdef __sun__
+        || yaz_errno() == ENOENT /* Sun's sometimes set errno to this value! */
+#endif
+        || yaz_errno() == EINPROGRESS;
+#endif
+}
+
 /*
  * Returns 1, 0 or -1
  * In nonblocking mode, you must call again with same buffer while
@@ -1252,22 +1598,93 @@ int tcpip_put(COMSTACK h, char *buf, int size)
 #endif
                  )) < 0)
         {
-            if (
+            if (tcpip_put_would_block())
+            {
+                TRC(fprintf(stderr, "  Flow control stop\n"));
+                h->io_pending = CS_WANT_WRITE;
+                return 1;
+            }
+            h->cerrno = CSYSERR;
+            return -1;
+        }
+        state->written += res;
+        TRC(fprintf(stderr, "  Wrote %d, written=%d, nbytes=%d\n",
+                    res, state->written, size));
+    }
+    state->towrite = state->written = -1;
+    TRC(fprintf(stderr, "  Ok\n"));
+    return 0;
+}
+
+/* max number of buffers passed to sendmsg at a time */
+#define TCPIP_IOV_MAX 16
+
+/*
+ * Returns 1, 0 or -1
+ * In nonblocking mode, you must call again with same buffers while
+ * return value is 1.
+ */
+static int tcpip_putv(COMSTACK h, const cs_iovec *iov, int iovcnt)
+{
+    struct tcpip_state *state = (struct tcpip_state *)h->cprivate;
 #ifdef WIN32
-                WSAGetLastError() == WSAEWOULDBLOCK
+    return cs_putv_loop(h, iov, iovcnt, &state->putv_no);
 #else
-                yaz_errno() == EWOULDBLOCK
-#ifdef EAGAIN
-#if EAGAIN != EWOULDBLOCK
-             || yaz_errno() == EAGAIN
-#endif
-#endif
-#ifdef __sun__
-                || yaz_errno() == ENOENT /* Sun's sometimes set errno to this value! */
-#endif
-                || yaz_errno() == EINPROGRESS
+    int i, size = 0;
+
+    if (h->f_put == tcpip_put_connect)
+    {   /* send CONNECT to proxy first */
+        int r = tcpip_put(h, state->connect_request_buf,
+                          state->connect_request_len);
+        if (r)
+            return r;
+        h->f_put = tcpip_put;
+    }
+    TRC(fprintf(stderr, "tcpip_putv: iovcnt=%d\n", iovcnt));
+    for (i = 0; i < iovcnt; i++)
+        size += iov[i].len;
+    h->io_pending = 0;
+    h->event = CS_DATA;
+    if (state->towrite < 0)
+    {
+        state->towrite = size;
+        state->written = 0;
+    }
+    else if (state->towrite != size)
+    {
+        h->cerrno = CSWRONGBUF;
+        return -1;
+    }
+    while (state->towrite > state->written)
+    {
+        struct iovec v[TCPIP_IOV_MAX];
+        struct msghdr msg;
+        int res, n = 0, skip = state->written;
+
+        for (i = 0; i < iovcnt && n < TCPIP_IOV_MAX; i++)
+        {
+            if (skip >= iov[i].len)
+                skip -= iov[i].len;
+            else
+            {
+                v[n].iov_base = iov[i].buf + skip;
+                v[n].iov_len = iov[i].len - skip;
+                skip = 0;
+                n++;
+            }
+        }
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = v;
+        msg.msg_iovlen = n;
+        if ((res = sendmsg(h->iofile, &msg,
+#ifdef MSG_NOSIGNAL
+                           MSG_NOSIGNAL
+#else
+                           0
 #endif
-                )
+                 )) < 0)
+        {
+            if (tcpip_put_would_block())
             {
                 TRC(fprintf(stderr, "  Flow control stop\n"));
                 h->io_pending = CS_WANT_WRITE;
@@ -1283,6 +1700,7 @@ int tcpip_put(COMSTACK h, char *buf, int size)
     state->towrite = state->written = -1;
     TRC(fprintf(stderr, "  Ok\n"));
     return 0;
+#endif
 }
 
 
@@ -1339,6 +1757,13 @@ int ssl_put(COMSTACK h, char *buf, int size)
     TRC(fprintf(stderr, "  Ok\n"));
     return 0;
 }
+
+static int ssl_putv(COMSTACK h, const cs_iovec *iov, int iovcnt)
+{
+    struct tcpip_state *state = (struct tcpip_state *)h->cprivate;
+
+    return cs_putv_loop(h, iov, iovcnt, &state->putv_no);
+}
 #endif
 
 void tcpip_close(COMSTACK h)
@@ -1379,6 +1804,8 @@ void tcpip_close(COMSTACK h)
             TRC(fprintf(stderr, "Removed credentials %p pid=%d\n",
                         sp->cred_ptr->xcred, getpid()));
             gnutls_certificate_free_credentials(sp->cred_ptr->xcred);
+            if (sp->cred_ptr->ticket_key.data)
+                gnutls_free(sp->cred_ptr->ticket_key.data);
             xfree(sp->cred_ptr);
         }
         sp->cred_ptr = 0;
@@ -1397,6 +1824,7 @@ void tcpip_close(COMSTACK h)
     if (sp->ai)
         freeaddrinfo(sp->ai);
 #endif
+    xfree(sp->session_key);
     xfree(sp->connect_request_buf);
     xfree(sp->connect_response_buf);
     xfree(sp);
@@ -25,7 +25,10 @@
 #endif
 #include <time.h>
 
+#include <string.h>
 #include <yaz/xmalloc.h>
+#include <yaz/mutex.h>
+#include <yaz/log.h>
 #include <yaz/timing.h>
 
 struct yaz_timing {
@@ -151,6 +154,140 @@ void yaz_timing_destroy(yaz_timing_t *tp)
     }
 }
 
+struct yaz_spans_entry {
+    const char *op;
+    const char *phase;
+    double real_sec;
+    int count;
+};
+
+struct yaz_spans {
+    char *name;
+    YAZ_MUTEX mutex;
+    int num;
+    int max;
+    struct yaz_spans_entry *entries;
+};
+
+yaz_spans_t yaz_spans_create(const char *name)
+{
+    yaz_spans_t s = (yaz_spans_t) xmalloc(sizeof(*s));
+    s->name = xstrdup(name);
+    s->mutex = 0;
+    yaz_mutex_create(&s->mutex);
+    s->num = 0;
+    s->max = 0;
+    s->entries = 0;
+    return s;
+}
+
+void yaz_spans_destroy(yaz_spans_t *sp)
+{
+    if (*sp)
+    {
+        yaz_mutex_destroy(&(*sp)->mutex);
+        xfree((*sp)->entries);
+        xfree((*sp)->name);
+        xfree(*sp);
+        *sp = 0;
+    }
+}
+
+static double real_now(void)
+{
+#if HAVE_SYS_TIME_H
+    struct timeval tv;
+    gettimeofday(&tv, 0);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+#else
+#ifdef WIN32
+    LONGLONG t;
+    get_date_as_largeinteger(&t);
+    return t / 10000000.0;
+#else
+    return (double) time(0);
+#endif
+#endif
+}
+
+double yaz_spans_start(yaz_spans_t s)
+{
+    return s ? real_now() : 0.0;
+}
+
+void yaz_spans_stop(yaz_spans_t s, const char *op, const char *phase,
+                    double start)
+{
+    if (s)
+        yaz_spans_add(s, op, phase, real_now() - start);
+}
+
+void yaz_spans_add(yaz_spans_t s, const char *op, const char *phase,
+                   double real_sec)
+{
+    struct yaz_spans_entry *e = 0;
+    int i;
+
+    if (!s)
+        return;
+    yaz_mutex_enter(s->mutex);
+    for (i = 0; i < s->num; i++)
+    {
+        e = s->entries + i;
+        if (!strcmp(e->op, op) && !strcmp(e->phase, phase))
+            break;
+    }
+    if (i == s->num)
+    {
+        if (s->num == s->max)
+        {
+            s->max = s->max ? 2 * s->max : 16;
+            s->entries = (struct yaz_spans_entry *)
+                xrealloc(s->entries, s->max * sizeof(*s->entries));
+        }
+        e = s->entries + s->num++;
+        e->op = op;
+        e->phase = phase;
+        e->real_sec = 0.0;
+        e->count = 0;
+    }
+    e->real_sec += real_sec > 0.0 ? real_sec : 0.0;
+    e->count++;
+    yaz_mutex_leave(s->mutex);
+}
+
+void yaz_spans_write(yaz_spans_t s, WRBUF w)
+{
+    int i;
+
+    if (!s)
+        return;
+    yaz_mutex_enter(s->mutex);
+    for (i = 0; i < s->num; i++)
+    {
+        struct yaz_spans_entry *e = s->entries + i;
+        wrbuf_printf(w, "%s;%s;%s %.0f\n", s->name, e->op, e->phase,
+                     e->real_sec * 1000000.0);
+    }
+    yaz_mutex_leave(s->mutex);
+}
+
+void yaz_spans_log(yaz_spans_t s, int level)
+{
+    int i;
+
+    if (!s)
+        return;
+    yaz_mutex_enter(s->mutex);
+    for (i = 0; i < s->num; i++)
+    {
+        struct yaz_spans_entry *e = s->entries + i;
+        yaz_log(level, "%s;%s;%s %.0f count=%d", s->name, e->op, e->phase,
+                e->real_sec * 1000000.0, e->count);
+    }
+    yaz_mutex_leave(s->mutex);
+}
+
 /*
  * Local variables:
  * c-basic-offset: 4
@@ -57,6 +57,7 @@
 
 static void unix_close(COMSTACK h);
 static int unix_put(COMSTACK h, char *buf, int size);
+static int unix_putv(COMSTACK h, const cs_iovec *iov, int iovcnt);
 static int unix_get(COMSTACK h, char **buf, int *bufsize);
 static int unix_connect(COMSTACK h, void *address);
 static int unix_more(COMSTACK h);
@@ -90,6 +91,7 @@ typedef struct unix_state
 
     int written;  /* -1 if we aren't writing */
     int towrite;  /* to verify against user input */
+    int putv_no;  /* current buffer for cs_putv_loop */
     int (*complete)(const char *buf, int len); /* length/complete. */
     struct sockaddr_un addr;  /* returned by cs_straddr */
     int uid;
@@ -148,6 +150,7 @@ COMSTACK unix_type(int s, int flags, int protocol, void *vp)
     p->f_rcvconnect = unix_rcvconnect;
     p->f_get = unix_get;
     p->f_put = unix_put;
+    p->f_putv = unix_putv;
     p->f_close = unix_close;
     p->f_more = unix_more;
     p->f_bind = unix_bind;
@@ -165,6 +168,7 @@ COMSTACK unix_type(int s, int flags, int protocol, void *vp)
     state->altbuf = 0;
     state->altsize = state->altlen = 0;
     state->towrite = state->written = -1;
+    state->putv_no = 0;
     if (protocol == PROTO_WAIS)
         state->complete = completeWAIS;
     else
@@ -531,6 +535,7 @@ static COMSTACK unix_accept(COMSTACK h)
         state->altbuf = 0;
         state->altsize = state->altlen = 0;
         state->towrite = state->written = -1;
+        state->putv_no = 0;
         state->complete = st->complete;
         memcpy(&state->addr, &st->addr, sizeof(state->addr));
         cnew->state = CS_ST_ACCEPT;
@@ -703,6 +708,13 @@ static int unix_put(COMSTACK h, char *buf, int size)
     return 0;
 }
 
+static int unix_putv(COMSTACK h, const cs_iovec *iov, int iovcnt)
+{
+    struct unix_state *state = (struct unix_state *)h->cprivate;
+
+    return cs_putv_loop(h, iov, iovcnt, &state->putv_no);
+}
+
 static void unix_close(COMSTACK h)
 {
     unix_state *sp = (struct unix_state *)h->cprivate;
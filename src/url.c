@@ -117,6 +117,9 @@ Z_HTTP_Response *yaz_url_exec(yaz_url_t p, const char *uri,
                                          &gdu->u.HTTP_Request->headers,
                                          http_user, http_pass);
 
+        if (!z_HTTP_header_lookup(headers, "Accept-Encoding"))
+            z_HTTP_header_add_accept_encoding(p->odr_out,
+                                              &gdu->u.HTTP_Request->headers);
         res = 0;
         last_header_entry = &gdu->u.HTTP_Request->headers;
         while (*last_header_entry)
@@ -122,38 +122,88 @@ void wrbuf_xmlputs(WRBUF b, const char *cp)
     wrbuf_xmlputs_n(b, cp, strlen(cp));
 }
 
+/*
+ * Characters to be escaped and ASCII CTRL are rare in text, so the
+ * scan tests a machine word at a time and copies clean runs with one
+ * wrbuf_write. '&' and '\'' differ by one bit, so do '<' and '>'.
+ */
+typedef unsigned long xml_word_t;
+
+#define XML_ONES (~(xml_word_t) 0 / 255)
+#define XML_HIGH (XML_ONES * 0x80)
+#define XML_HAS_LESS(x, n) (((x) - XML_ONES * (n)) & ~(x) & XML_HIGH)
+#define XML_HAS_ZERO(x) XML_HAS_LESS(x, 1)
+#define XML_SPECIAL(x) (XML_HAS_LESS(x, 0x20) \
+                        | XML_HAS_ZERO((x) ^ (XML_ONES * '"'))      \
+                        | XML_HAS_ZERO(((x) | XML_ONES) ^ (XML_ONES * '\'')) \
+                        | XML_HAS_ZERO(((x) | (XML_ONES * 2)) ^ (XML_ONES * '>')))
+
+static size_t xml_clean_run(const char *cp, size_t size)
+{
+    size_t i = 0;
+
+    while (i + sizeof(xml_word_t) <= size)
+    {
+        xml_word_t w;
+        memcpy(&w, cp + i, sizeof(w));
+        if (XML_SPECIAL(w))
+            break;
+        i += sizeof(w);
+    }
+    for (; i < size; i++)
+    {
+        unsigned char ch = cp[i];
+        if (ch < 32 || ch == '<' || ch == '>' || ch == '&' || ch == '"'
+            || ch == '\'')
+            break;
+    }
+    return i;
+}
+
 void wrbuf_xmlputs_n(WRBUF b, const char *cp, size_t size)
 {
-    for (; size; size--)
+    while (size)
     {
+        size_t run = xml_clean_run(cp, size);
+
+        if (run)
+        {
+            wrbuf_write(b, cp, run);
+            cp += run;
+            size -= run;
+            if (!size)
+                break;
+        }
         /* only TAB,CR,LF of ASCII CTRL are allowed in XML 1.0! */
         if (*cp >= 0 && *cp <= 31)
             if (*cp != 9 && *cp != 10 && *cp != 13)
             {
                 cp++;  /* we silently ignore (delete) these.. */
+                size--;
                 continue;
             }
         switch(*cp)
         {
         case '<':
-            wrbuf_puts(b, "&lt;");
+            wrbuf_write(b, "&lt;", 4);
             break;
         case '>':
-            wrbuf_puts(b, "&gt;");
+            wrbuf_write(b, "&gt;", 4);
             break;
         case '&':
-            wrbuf_puts(b, "&amp;");
+            wrbuf_write(b, "&amp;", 5);
             break;
         case '"':
-            wrbuf_puts(b, "&quot;");
+            wrbuf_write(b, "&quot;", 6);
             break;
         case '\'':
-            wrbuf_puts(b, "&apos;");
+            wrbuf_write(b, "&apos;", 6);
             break;
         default:
             wrbuf_putc(b, *cp);
         }
         cp++;
+        size--;
     }
 }
 
@@ -31,6 +31,7 @@ set filename($m) z-core
 set init($m,h) {
 typedef struct Z_External Z_External;
 YAZ_EXPORT int z_External(ODR o, Z_External **p, int opt, const char *name);
+YAZ_EXPORT Z_External *yaz_clone_z_External(const Z_External *p, NMEM nmem);
 }
 
 set body($m,h) "
@@ -39,6 +40,7 @@ extern \"C\" \{
 #endif
 
 int z_ANY_type_0 (ODR o, void **p, int opt);
+void *yaz_clone_z_ANY_type_0(const void *p, NMEM nmem);
 
 #ifdef __cplusplus
 \}
@@ -52,6 +54,11 @@ int z_ANY_type_0 (ODR o, void **p, int opt)
     return 0;
 }
 
+void *yaz_clone_z_ANY_type_0(const void *p, NMEM nmem)
+{
+    return 0;
+}
+
 }
 
 # Type Name overrides
@@ -210,11 +217,17 @@ int z_SUTRS (ODR o, Odr_oct **p, int opt, const char *name)
     return odr_implicit_tag(o, odr_octetstring, p, ODR_UNIVERSAL,
         ODR_GENERALSTRING, opt, name);
 }
+
+Odr_oct *yaz_clone_z_SUTRS(const Odr_oct *p, NMEM nmem)
+{
+    return odr_clone_octetstring(p, nmem);
+}
 }
 
 set init($m,h) {
 typedef Odr_oct Z_SUTRS;
 YAZ_EXPORT int z_SUTRS (ODR o, Odr_oct **p, int opt, const char *name);
+YAZ_EXPORT Odr_oct *yaz_clone_z_SUTRS(const Odr_oct *p, NMEM nmem);
 }
 # ----
 set m RecordSyntax-opac
@@ -33,6 +33,7 @@ YAZ_SHPTR_TYPE(WRBUF)
 
 static int log_api0 = 0;
 static int log_details0 = 0;
+static int log_spans0 = 0;
 
 static void resultset_destroy(ZOOM_resultset r);
 static zoom_ret do_write_ex(ZOOM_connection c, char *buf_out, int len_out);
@@ -45,6 +46,7 @@ static void initlog(void)
     {
         log_api0 = yaz_log_module_level("zoom");
         log_details0 = yaz_log_module_level("zoomdetails");
+        log_spans0 = yaz_log_module_level("spans");
         log_level_initialized = 1;
     }
 }
@@ -156,6 +158,29 @@ void ZOOM_connection_show_tasks(ZOOM_connection c)
         ZOOM_connection_show_task(task);
 }
 
+/* name of current task for spans */
+const char *ZOOM_connection_span_op(ZOOM_connection c)
+{
+    if (!c->tasks)
+        return "none";
+    switch (c->tasks->which)
+    {
+    case ZOOM_TASK_SEARCH:
+        return "search";
+    case ZOOM_TASK_RETRIEVE:
+        return "retrieve";
+    case ZOOM_TASK_CONNECT:
+        return "connect";
+    case ZOOM_TASK_SCAN:
+        return "scan";
+    case ZOOM_TASK_PACKAGE:
+        return "package";
+    case ZOOM_TASK_SORT:
+        return "sort";
+    }
+    return "other";
+}
+
 ZOOM_task ZOOM_connection_add_task(ZOOM_connection c, int which)
 {
     ZOOM_task *taskp = &c->tasks;
@@ -192,6 +217,15 @@ void ZOOM_connection_remove_task(ZOOM_connection c)
 
     if (task)
     {
+        if (c->sru_pipelined)
+        {
+            /* responses still in flight belong to this task; they
+               can not be matched to the next task */
+            yaz_log(c->log_details, "%p ZOOM_connection_remove_task "
+                    "close with %d pipelined", c, c->sru_pipelined);
+            ZOOM_connection_close(c);
+        }
+        c->sru_gaps = 0;
         c->tasks = task->next;
         switch (task->which)
         {
@@ -252,6 +286,8 @@ ZOOM_API(ZOOM_connection)
 
     c->log_api = log_api0;
     c->log_details = log_details0;
+    c->spans = log_spans0 ? yaz_spans_create("zoom") : 0;
+    c->span_start = 0.0;
 
     yaz_log(c->log_api, "%p ZOOM_connection_create", c);
 
@@ -303,6 +339,9 @@ ZOOM_API(ZOOM_connection)
 
     c->sru_version = 0;
     c->no_redirects = 0;
+    c->sru_pipelined = 0;
+    c->sru_pipeline_ok = 1;
+    c->sru_gaps = 0;
     c->saveAPDU_wrbuf = 0;
     return c;
 }
@@ -395,6 +434,7 @@ ZOOM_API(void)
         return;
     }
     yaz_log(c->log_details, "%p ZOOM_connection_connect connect", c);
+    c->sru_pipeline_ok = 1;
     xfree(c->proxy);
     c->proxy = 0;
     val = ZOOM_options_get(c->options, "proxy");
@@ -587,6 +627,11 @@ ZOOM_API(void)
     yaz_log(c->log_api, "%p ZOOM_connection_destroy", c);
     if (c->cs)
         cs_close(c->cs);
+    if (c->spans)
+    {
+        yaz_spans_log(c->spans, log_spans0);
+        yaz_spans_destroy(&c->spans);
+    }
 
 #if ZOOM_RESULT_LISTS
     /* Remove the connection's usage of resultsets */
@@ -908,6 +953,7 @@ int ZOOM_test_reconnect(ZOOM_connection c)
 
     if (!c->reconnect_ok)
         return 0;
+    ZOOM_connection_srw_rewind(c);
     ZOOM_connection_close(c);
     c->reconnect_ok = 0;
     c->tasks->running = 0;
@@ -1099,10 +1145,14 @@ static zoom_ret do_connect_host(ZOOM_connection c, const char *logical_url)
     }
     if (c->cs)
     {
-        int ret = cs_connect(c->cs, add);
+        int ret;
+
+        c->span_start = yaz_spans_start(c->spans);
+        ret = cs_connect(c->cs, add);
         if (ret == 0)
         {
             ZOOM_Event event = ZOOM_Event_create(ZOOM_EVENT_CONNECT);
+            yaz_spans_stop(c->spans, "connect", "connect", c->span_start);
             ZOOM_connection_put_event(c, event);
             get_cert(c);
             if (c->proto == PROTO_Z3950)
@@ -1520,6 +1570,8 @@ static zoom_ret send_HTTP_redirect(ZOOM_connection c, const char *uri,
     gdu->u.HTTP_Request->method = odr_strdup(c->odr_out, "GET");
     z_HTTP_header_add(c->odr_out, &gdu->u.HTTP_Request->headers, "Accept",
                       "text/xml");
+    z_HTTP_header_add_accept_encoding(c->odr_out,
+                                      &gdu->u.HTTP_Request->headers);
 
     for (h = cookie_hres->headers; h; h = h->next)
     {
@@ -1554,17 +1606,34 @@ static zoom_ret send_HTTP_redirect(ZOOM_connection c, const char *uri,
     return ZOOM_send_GDU(c, gdu);
 }
 
-zoom_ret ZOOM_send_GDU(ZOOM_connection c, Z_GDU *gdu)
+/* encodes GDU, appending it to what is already encoded in odr_out */
+int ZOOM_encode_GDU(ZOOM_connection c, Z_GDU *gdu)
 {
-    ZOOM_Event event;
-
+    double start = yaz_spans_start(c->spans);
     int r = z_GDU(c->odr_out, &gdu, 0, 0);
+
+    yaz_spans_stop(c->spans, ZOOM_connection_span_op(c), "encode", start);
     if (!r)
-        return zoom_complete;
+        return 0;
     if (c->odr_print)
         z_GDU(c->odr_print, &gdu, 0, 0);
     if (c->odr_save)
         z_GDU(c->odr_save, &gdu, 0, 0);
+    return r;
+}
+
+zoom_ret ZOOM_send_GDU(ZOOM_connection c, Z_GDU *gdu)
+{
+    if (!ZOOM_encode_GDU(c, gdu))
+        return zoom_complete;
+    return ZOOM_send_encoded(c);
+}
+
+/* sends everything encoded in odr_out (one or more GDUs) */
+zoom_ret ZOOM_send_encoded(ZOOM_connection c)
+{
+    ZOOM_Event event;
+
     c->buf_out = odr_getbuf(c->odr_out, &c->len_out, 0);
     odr_reset(c->odr_out);
 
@@ -1658,6 +1727,7 @@ static void handle_http(ZOOM_connection c, Z_HTTP_Response *hres)
         }
         if (must_close)
         {
+            ZOOM_connection_srw_rewind(c);
             ZOOM_connection_close(c);
             if (c->tasks)
             {
@@ -1697,13 +1767,19 @@ static int do_read(ZOOM_connection c)
     {
         Z_GDU *gdu;
         ZOOM_Event event;
+        const char *op = ZOOM_connection_span_op(c); /* task may end when handled */
+        double start = yaz_spans_start(c->spans);
+        int ok;
 
+        yaz_spans_stop(c->spans, op, "wait", c->span_start);
         odr_reset(c->odr_in);
         odr_setbuf(c->odr_in, c->buf_in, r, 0);
         event = ZOOM_Event_create(ZOOM_EVENT_RECV_APDU);
         ZOOM_connection_put_event(c, event);
 
-        if (!z_GDU(c->odr_in, &gdu, 0, 0))
+        ok = z_GDU(c->odr_in, &gdu, 0, 0);
+        yaz_spans_stop(c->spans, op, "decode", start);
+        if (!ok)
         {
             int x;
             int err = odr_geterrorx(c->odr_in, &x);
@@ -1728,6 +1804,7 @@ static int do_read(ZOOM_connection c)
                 z_GDU(c->odr_print, &gdu, 0, 0);
             if (c->odr_save)
                 z_GDU(c->odr_save, &gdu, 0, 0);
+            start = yaz_spans_start(c->spans);
             if (gdu->which == Z_GDU_Z3950)
                 ZOOM_handle_Z3950_apdu(c, gdu->u.z3950);
             else if (gdu->which == Z_GDU_HTTP_Response)
@@ -1739,7 +1816,11 @@ static int do_read(ZOOM_connection c)
                 ZOOM_connection_close(c);
 #endif
             }
+            yaz_spans_stop(c->spans, op, "handle", start);
         }
+        /* with pipelining the next response is waited for from here,
+           not from the last write */
+        c->span_start = yaz_spans_start(c->spans);
     }
     return 1;
 }
@@ -1748,12 +1829,15 @@ static zoom_ret do_write_ex(ZOOM_connection c, char *buf_out, int len_out)
 {
     int r;
     ZOOM_Event event;
+    double start = yaz_spans_start(c->spans);
 
     event = ZOOM_Event_create(ZOOM_EVENT_SEND_DATA);
     ZOOM_connection_put_event(c, event);
 
     yaz_log(c->log_details, "%p do_write_ex len=%d", c, len_out);
-    if ((r = cs_put(c->cs, buf_out, len_out)) < 0)
+    r = cs_put(c->cs, buf_out, len_out);
+    yaz_spans_stop(c->spans, ZOOM_connection_span_op(c), "send", start);
+    if (r < 0)
     {
         yaz_log(c->log_details, "%p do_write_ex write failed", c);
         if (ZOOM_test_reconnect(c))
@@ -1783,6 +1867,7 @@ static zoom_ret do_write_ex(ZOOM_connection c, char *buf_out, int len_out)
         ZOOM_connection_set_mask(c, ZOOM_SELECT_READ|ZOOM_SELECT_EXCEPT);
         yaz_log(c->log_details, "%p do_write_ex write complete mask=%d",
                 c, c->mask);
+        c->span_start = yaz_spans_start(c->spans);
     }
     return zoom_pending;
 }
@@ -2011,6 +2096,7 @@ static void ZOOM_connection_do_io(ZOOM_connection c, int mask)
         }
         else if (ret == 0)
         {
+            yaz_spans_stop(c->spans, "connect", "connect", c->span_start);
             event = ZOOM_Event_create(ZOOM_EVENT_CONNECT);
             ZOOM_connection_put_event(c, event);
             get_cert(c);
@@ -2044,7 +2130,12 @@ static void ZOOM_connection_do_io(ZOOM_connection c, int mask)
             return;
         }
         if (mask & ZOOM_SELECT_READ)
+        {
             do_read(c);
+            /* pipelined responses may already be buffered in comstack */
+            while (c->cs && c->sru_pipelined && cs_more(c->cs))
+                do_read(c);
+        }
         if (c->cs && (mask & ZOOM_SELECT_WRITE))
             ZOOM_send_buf(c);
     }
@@ -2151,6 +2242,7 @@ ZOOM_API(void) ZOOM_connection_close(ZOOM_connection c)
     if (c->cs)
         cs_close(c->cs);
     c->cs = 0;
+    c->sru_pipelined = 0;
     ZOOM_connection_set_mask(c, 0);
     c->state = STATE_IDLE;
 }
@@ -35,6 +35,7 @@
 #include <yaz/zoom.h>
 #include <yaz/srw.h>
 #include <yaz/mutex.h>
+#include <yaz/timing.h>
 
 #define SHPTR 1
 #define ZOOM_RESULT_LISTS 0
@@ -56,6 +57,9 @@ typedef struct ZOOM_task_p *ZOOM_task;
 #define STATE_CONNECTING 1
 #define STATE_ESTABLISHED 2
 
+/* upper limit for option maxPipelined */
+#define ZOOM_MAX_PIPELINED 32
+
 #if ZOOM_RESULT_LISTS
 typedef struct ZOOM_resultsets_p *ZOOM_resultsets;
 #endif
@@ -111,9 +115,20 @@ struct ZOOM_connection_p {
     zoom_sru_mode sru_mode;
     int no_redirects; /* 0 for no redirects. >0 for number of redirects */
 
+    int sru_pipelined; /* number of pipelined SRU requests in flight */
+    int sru_pipeline_ok; /* 0 if server broke a pipeline; 1 otherwise */
+    int sru_pipeline_start[ZOOM_MAX_PIPELINED]; /* start of each in flight */
+    int sru_pipeline_count[ZOOM_MAX_PIPELINED]; /* count of each in flight */
+    int sru_gaps;      /* ranges that short pipelined pages did not fill */
+    int sru_gap_start[ZOOM_MAX_PIPELINED];
+    int sru_gap_count[ZOOM_MAX_PIPELINED];
+
     int log_details;
     int log_api;
     WRBUF saveAPDU_wrbuf;
+    yaz_spans_t spans;  /* time of phases; 0 when disabled */
+    double span_start;  /* start of connect or of wait for response:
+                           last write or last response read */
 };
 
 #if ZOOM_RESULT_LISTS
@@ -254,6 +269,7 @@ zoom_ret ZOOM_connection_Z3950_send_init(ZOOM_connection c);
 
 ZOOM_task ZOOM_connection_add_task(ZOOM_connection c, int which);
 void ZOOM_connection_remove_task(ZOOM_connection c);
+const char *ZOOM_connection_span_op(ZOOM_connection c);
 int ZOOM_test_reconnect(ZOOM_connection c);
 
 ZOOM_record ZOOM_record_cache_lookup(ZOOM_resultset r, int pos,
@@ -274,6 +290,7 @@ int ZOOM_uri_to_code(const char *uri);
 
 zoom_ret ZOOM_connection_srw_send_search(ZOOM_connection c);
 zoom_ret ZOOM_connection_srw_send_scan(ZOOM_connection c);
+void ZOOM_connection_srw_rewind(ZOOM_connection c);
 
 int ZOOM_handle_sru(ZOOM_connection c, Z_HTTP_Response *hres,
                     zoom_ret *cret, char **addinfo);
@@ -285,6 +302,8 @@ ZOOM_Event ZOOM_connection_get_event(ZOOM_connection c);
 void ZOOM_connection_remove_events(ZOOM_connection c);
 void ZOOM_Event_destroy(ZOOM_Event event);
 zoom_ret ZOOM_send_GDU(ZOOM_connection c, Z_GDU *gdu);
+int ZOOM_encode_GDU(ZOOM_connection c, Z_GDU *gdu);
+zoom_ret ZOOM_send_encoded(ZOOM_connection c);
 
 /*
  * Local variables:
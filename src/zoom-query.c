@@ -19,7 +19,7 @@
 #include <yaz/xmalloc.h>
 #include <yaz/log.h>
 #include <yaz/pquery.h>
-#include <yaz/cql.h>
+#include <yaz/rpn2cql.h>
 #include <yaz/ccl.h>
 #include <yaz/sortspec.h>
 
@@ -41,6 +41,8 @@ struct ZOOM_query_p {
     char *query_string;
     WRBUF full_query;
     WRBUF sru11_sort_spec;
+    ODR odr_rpn;
+    Z_RPNQuery *rpn_query; /* RPN built from CQL; 0: parse query_string */
 };
 
 static int generate(ZOOM_query s)
@@ -73,6 +75,10 @@ static int generate(ZOOM_query s)
         switch (s->query_type)
         {
         case Z_Query_type_1: /* RPN */
+            s->z_query = (Z_Query *) odr_malloc(s->odr_query,
+                                                sizeof(*s->z_query));
+            s->z_query->which = Z_Query_type_1;
+            s->z_query->u.type_1 = s->rpn_query;
             if (s->sort_spec &&
                 (s->sort_strategy == SORT_STRATEGY_TYPE7 ||
                  s->sort_strategy == SORT_STRATEGY_EMBED))
@@ -80,12 +86,11 @@ static int generate(ZOOM_query s)
                 int r = yaz_sort_spec_to_type7(s->sort_spec, s->full_query);
                 if (r)
                     return r;
+                s->z_query->u.type_1 = 0;
             }
-            s->z_query = (Z_Query *) odr_malloc(s->odr_query,
-                                                sizeof(*s->z_query));
-            s->z_query->which = Z_Query_type_1;
-            s->z_query->u.type_1 =
-                p_query_rpn(s->odr_query, wrbuf_cstr(s->full_query));
+            if (!s->z_query->u.type_1)
+                s->z_query->u.type_1 =
+                    p_query_rpn(s->odr_query, wrbuf_cstr(s->full_query));
             if (!s->z_query->u.type_1)
             {
                 s->z_query = 0;
@@ -136,30 +141,31 @@ Z_SortKeySpecList *ZOOM_query_get_sortspec(ZOOM_query s)
     return s->sort_strategy == SORT_STRATEGY_Z3950 ? s->sort_spec : 0;
 }
 
-static void cql2pqf_wrbuf_puts(const char *buf, void *client_data)
+const char *ZOOM_query_get_query_string(ZOOM_query s)
 {
-    WRBUF wrbuf = (WRBUF) client_data;
-    wrbuf_puts(wrbuf, buf);
+    return wrbuf_cstr(s->full_query);
 }
 
-const char *ZOOM_query_get_query_string(ZOOM_query s)
+static void cql2pqf_wrbuf_puts(const char *buf, void *client_data)
 {
-    return wrbuf_cstr(s->full_query);
+    WRBUF wrbuf = (WRBUF) client_data;
+    wrbuf_puts(wrbuf, buf);
 }
 
 /*
- * Returns an xmalloc()d string containing RPN that corresponds to the
- * CQL passed in.  On error, sets the Connection object's error state
- * and returns a null pointer.
+ * Returns RPN query, allocated from odr, that corresponds to the
+ * CQL passed in, and writes the PQF for it to pqf.  On error, sets the
+ * Connection object's error state and returns a null pointer.
  * ### We could cache CQL parser and/or transformer in Connection.
  */
-static char *cql2pqf(ZOOM_connection c, const char *cql)
+static Z_RPNQuery *cql2rpn(ZOOM_connection c, const char *cql, ODR odr,
+                           WRBUF pqf)
 {
     CQL_parser parser;
     int error;
     const char *cqlfile;
     cql_transform_t trans;
-    char *result = 0;
+    Z_RPNQuery *result = 0;
 
     parser = cql_parser_create();
     if ((error = cql_parser_string(parser, cql)) != 0) {
@@ -182,9 +188,8 @@ static char *cql2pqf(ZOOM_connection c, const char *cql)
     }
     else
     {
-        WRBUF wrbuf_result = wrbuf_alloc();
-        error = cql_transform(trans, cql_parser_result(parser),
-                              cql2pqf_wrbuf_puts, wrbuf_result);
+        error = cql_transform_rpn(trans, cql_parser_result(parser), odr,
+                                  &result);
         if (error != 0) {
             char buf[512];
             const char *addinfo;
@@ -195,10 +200,15 @@ static char *cql2pqf(ZOOM_connection c, const char *cql)
         }
         else
         {
-            result = xstrdup(wrbuf_cstr(wrbuf_result));
+            /* transforming resolves prefixes in the tree with memory
+               that is gone afterwards, so PQF needs a parse of its own */
+            cql_parser_destroy(parser);
+            parser = cql_parser_create();
+            cql_parser_string(parser, cql);
+            cql_transform(trans, cql_parser_result(parser),
+                          cql2pqf_wrbuf_puts, pqf);
         }
         cql_transform_close(trans);
-        wrbuf_destroy(wrbuf_result);
     }
     cql_parser_destroy(parser);
     return result;
@@ -219,6 +229,8 @@ ZOOM_API(ZOOM_query)
     s->full_query = wrbuf_alloc();
     s->sort_strategy = SORT_STRATEGY_Z3950;
     s->sru11_sort_spec = wrbuf_alloc();
+    s->odr_rpn = odr_createmem(ODR_ENCODE);
+    s->rpn_query = 0;
     return s;
 }
 
@@ -236,6 +248,7 @@ ZOOM_API(void)
         xfree(s->query_string);
         wrbuf_destroy(s->full_query);
         wrbuf_destroy(s->sru11_sort_spec);
+        odr_destroy(s->odr_rpn);
         xfree(s);
     }
 }
@@ -253,6 +266,8 @@ ZOOM_API(int)
     xfree(s->query_string);
     s->query_string = xstrdup(str);
     s->query_type = Z_Query_type_1;
+    s->rpn_query = 0;
+    odr_reset(s->odr_rpn);
     return generate(s);
 }
 
@@ -262,6 +277,8 @@ ZOOM_API(int)
     xfree(s->query_string);
     s->query_string = xstrdup(str);
     s->query_type = Z_Query_type_104;
+    s->rpn_query = 0;
+    odr_reset(s->odr_rpn);
     return generate(s);
 }
 
@@ -275,22 +292,34 @@ ZOOM_API(int)
 ZOOM_API(int)
     ZOOM_query_cql2rpn(ZOOM_query s, const char *str, ZOOM_connection conn)
 {
-    char *rpn;
-    int ret;
+    Z_RPNQuery *rpn;
+    WRBUF w = wrbuf_alloc();
+    ODR odr = odr_createmem(ODR_ENCODE);
     ZOOM_connection freeme = 0;
 
     if (conn == 0)
         conn = freeme = ZOOM_connection_create(0);
 
-    rpn = cql2pqf(conn, str);
+    rpn = cql2rpn(conn, str, odr, w);
     if (freeme != 0)
         ZOOM_connection_destroy(freeme);
     if (rpn == 0)
+    {
+        wrbuf_destroy(w);
+        odr_destroy(odr);
         return -1;
+    }
+    odr_destroy(s->odr_rpn);
+    s->odr_rpn = odr;
 
-    ret = ZOOM_query_prefix(s, rpn);
-    xfree(rpn);
-    return ret;
+    /* PQF is still the query string, e.g. for SRU, but the
+       Z39.50 query is the RPN structure built from CQL */
+    xfree(s->query_string);
+    s->query_string = xstrdup(wrbuf_cstr(w));
+    wrbuf_destroy(w);
+    s->query_type = Z_Query_type_1;
+    s->rpn_query = rpn;
+    return generate(s);
 }
 
 /*
@@ -18,11 +18,26 @@
 #include <yaz/diagbib1.h>
 #include <yaz/record_render.h>
 #include <yaz/shptr.h>
+#include <yaz/copy_types.h>
+#include <yaz/log.h>
 
 #if SHPTR
 YAZ_SHPTR_TYPE(WRBUF)
 #endif
 
+/* max number of rendered outputs kept for a record */
+#define RECORD_RENDER_MAX 8
+
+static int log_spans = 0;
+static int log_spans_initialized = 0;
+
+struct ZOOM_record_render {
+    char *type_spec;
+    char *buf;           /* 0 if record could not be rendered */
+    int len;
+    struct ZOOM_record_render *next;
+};
+
 struct ZOOM_record_p {
     ODR odr;
 #if SHPTR
@@ -38,6 +53,11 @@ struct ZOOM_record_p {
     const char *diag_message;
     const char *diag_details;
     const char *diag_set;
+
+    yaz_marc_t marc;     /* parsed ISO2709 record of npr; 0 if none */
+    NMEM render_nmem;    /* memory for render; 0 if nothing rendered */
+    struct ZOOM_record_render *render;
+    int num_render;
 };
 
 struct ZOOM_record_cache_p {
@@ -59,6 +79,17 @@ static int strcmp_null(const char *v1, const char *v2)
     return strcmp(v1, v2);
 }
 
+static void record_render_reset(ZOOM_record rec)
+{
+    if (rec->marc)
+        yaz_marc_destroy(rec->marc);
+    rec->marc = 0;
+    nmem_destroy(rec->render_nmem);
+    rec->render_nmem = 0;
+    rec->render = 0;
+    rec->num_render = 0;
+}
+
 static size_t record_hash(int pos)
 {
     if (pos < 0)
@@ -89,6 +120,10 @@ void ZOOM_record_cache_add(ZOOM_resultset r, Z_NamePlusRecord *npr,
     {
         rc = (ZOOM_record_cache) odr_malloc(r->odr, sizeof(*rc));
         rc->rec.odr = 0;
+        rc->rec.marc = 0;
+        rc->rec.render_nmem = 0;
+        rc->rec.render = 0;
+        rc->rec.num_render = 0;
 #if SHPTR
         YAZ_SHPTR_INC(r->record_wrbuf);
         rc->rec.record_wrbuf = r->record_wrbuf;
@@ -105,6 +140,7 @@ void ZOOM_record_cache_add(ZOOM_resultset r, Z_NamePlusRecord *npr,
         rc->next = r->record_hash[record_hash(pos)];
         r->record_hash[record_hash(pos)] = rc;
     }
+    record_render_reset(&rc->rec); /* record may have changed */
     rc->rec.npr = npr;
     rc->rec.schema = odr_strdup_null(r->odr, schema);
     rc->rec.diag_set = 0;
@@ -151,32 +187,30 @@ ZOOM_record ZOOM_record_cache_lookup(ZOOM_resultset r, int pos,
 ZOOM_API(ZOOM_record)
     ZOOM_record_clone(ZOOM_record srec)
 {
-    char *buf;
-    int size;
-    ODR odr_enc;
     ZOOM_record nrec;
+    NMEM nmem;
 
-    odr_enc = odr_createmem(ODR_ENCODE);
-    if (!z_NamePlusRecord(odr_enc, &srec->npr, 0, 0))
+    if (!srec->npr)
         return 0;
-    buf = odr_getbuf(odr_enc, &size, 0);
-
     nrec = (ZOOM_record) xmalloc(sizeof(*nrec));
     nrec->odr = odr_createmem(ODR_DECODE);
+    nmem = odr_getmem(nrec->odr);
 #if SHPTR
     nrec->record_wrbuf = 0;
 #else
     nrec->wrbuf = 0;
 #endif
-    odr_setbuf(nrec->odr, buf, size, 0);
-    z_NamePlusRecord(nrec->odr, &nrec->npr, 0, 0);
+    nrec->npr = yaz_clone_z_NamePlusRecord(srec->npr, nmem);
 
     nrec->schema = odr_strdup_null(nrec->odr, srec->schema);
     nrec->diag_uri = odr_strdup_null(nrec->odr, srec->diag_uri);
     nrec->diag_message = odr_strdup_null(nrec->odr, srec->diag_message);
     nrec->diag_details = odr_strdup_null(nrec->odr, srec->diag_details);
     nrec->diag_set = odr_strdup_null(nrec->odr, srec->diag_set);
-    odr_destroy(odr_enc);
+    nrec->marc = 0;
+    nrec->render_nmem = 0;
+    nrec->render = 0;
+    nrec->num_render = 0;
     return nrec;
 }
 
@@ -192,6 +226,7 @@ static void ZOOM_record_release(ZOOM_record rec)
     if (rec->wrbuf)
         wrbuf_destroy(rec->wrbuf);
 #endif
+    record_render_reset(rec);
 
     if (rec->odr)
         odr_destroy(rec->odr);
@@ -217,13 +252,24 @@ ZOOM_API(const char *)
     ZOOM_record_get(ZOOM_record rec, const char *type_spec, int *len)
 {
     WRBUF wrbuf;
+    struct ZOOM_record_render *rr;
+    const char *ret;
+    int len0;
+    yaz_timing_t t = 0;
 
-    if (len)
-        *len = 0; /* default return */
+    if (!len)
+        len = &len0;
+    *len = 0; /* default return */
 
     if (!rec || !rec->npr)
         return 0;
 
+    for (rr = rec->render; rr; rr = rr->next)
+        if (!strcmp(rr->type_spec, type_spec))
+        {
+            *len = rr->len;
+            return rr->buf;
+        }
 #if SHPTR
     if (!rec->record_wrbuf)
     {
@@ -236,7 +282,53 @@ ZOOM_API(const char *)
         rec->wrbuf = wrbuf_alloc();
     wrbuf = rec->wrbuf;
 #endif
-    return yaz_record_render(rec->npr, rec->schema, wrbuf, type_spec, len);
+    if (!log_spans_initialized)
+    {
+        log_spans = yaz_log_module_level("spans");
+        log_spans_initialized = 1;
+    }
+    if (log_spans)
+        t = yaz_timing_create();
+    ret = yaz_record_render2(rec->npr, rec->schema, wrbuf, type_spec, len,
+                             &rec->marc);
+    if (t)
+    {   /* records do not know their connection: log in folded form now */
+        yaz_timing_stop(t);
+        if (ret && ret == wrbuf_buf(wrbuf)) /* not just a lookup */
+            yaz_log(log_spans, "zoom;render;%.*s %.0f",
+                    (int) strcspn(type_spec, "; "), type_spec,
+                    yaz_timing_get_real(t) * 1000000.0);
+        yaz_timing_destroy(&t);
+    }
+    /* keep what was rendered in (shared) wrbuf. Other results refer
+       to the record itself */
+    if (!ret || ret == wrbuf_buf(wrbuf))
+    {
+        if (rec->num_render == RECORD_RENDER_MAX)
+        {
+            nmem_reset(rec->render_nmem);
+            rec->render = 0;
+            rec->num_render = 0;
+        }
+        if (!rec->render_nmem)
+            rec->render_nmem = nmem_create();
+        rr = (struct ZOOM_record_render *)
+            nmem_malloc(rec->render_nmem, sizeof(*rr));
+        rr->type_spec = nmem_strdup(rec->render_nmem, type_spec);
+        rr->len = ret ? *len : 0;
+        rr->buf = 0;
+        if (ret)
+        {
+            rr->buf = (char *) nmem_malloc(rec->render_nmem, rr->len + 1);
+            memcpy(rr->buf, ret, rr->len);
+            rr->buf[rr->len] = '\0';
+        }
+        rr->next = rec->render;
+        rec->render = rr;
+        rec->num_render++;
+        ret = rr->buf;
+    }
+    return ret;
 }
 
 ZOOM_API(int)
@@ -31,7 +31,7 @@ static void set_SRU_error(ZOOM_connection c, Z_SRW_diagnostic *d)
 
 
 #if YAZ_HAVE_XML2
-static zoom_ret send_srw(ZOOM_connection c, Z_SRW_PDU *sr)
+static Z_GDU *get_srw_gdu(ZOOM_connection c, Z_SRW_PDU *sr)
 {
     Z_GDU *gdu;
     const char *database =  ZOOM_options_get(c->options, "databaseName");
@@ -39,6 +39,8 @@ static zoom_ret send_srw(ZOOM_connection c, Z_SRW_PDU *sr)
     gdu = z_get_HTTP_Request_uri(c->odr_out, c->host_port,
                                  database,
                                  c->proxy ? 1 : 0);
+    z_HTTP_header_add_accept_encoding(c->odr_out,
+                                      &gdu->u.HTTP_Request->headers);
 
     if (c->sru_mode == zoom_sru_get)
     {
@@ -56,7 +58,14 @@ static zoom_ret send_srw(ZOOM_connection c, Z_SRW_PDU *sr)
     {
         yaz_solr_encode_request(gdu->u.HTTP_Request, sr, c->odr_out, c->charset);
     }
-    return ZOOM_send_GDU(c, gdu);
+    return gdu;
+}
+#endif
+
+#if YAZ_HAVE_XML2
+static zoom_ret send_srw(ZOOM_connection c, Z_SRW_PDU *sr)
+{
+    return ZOOM_send_GDU(c, get_srw_gdu(c, sr));
 }
 #endif
 
@@ -123,6 +132,127 @@ zoom_ret ZOOM_connection_srw_send_scan(ZOOM_connection c)
 }
 #endif
 
+#if YAZ_HAVE_XML2
+static Z_SRW_PDU *get_search_pdu(ZOOM_connection c, ZOOM_resultset resultset,
+                                 Z_Query *z_query, int start, int count,
+                                 Z_FacetList *facet_list)
+{
+    const char *option_val = 0;
+    Z_SRW_PDU *sr = ZOOM_srw_get_pdu(c, Z_SRW_searchRetrieve_request);
+
+    if (z_query->which == Z_Query_type_104)
+    {
+        sr->u.request->query_type = Z_SRW_query_type_cql;
+        sr->u.request->query.cql = z_query->u.type_104->u.cql;
+    }
+    else
+    {
+        sr->u.request->query_type = Z_SRW_query_type_pqf;
+        sr->u.request->query.pqf =
+            odr_strdup(c->odr_out,
+                       ZOOM_query_get_query_string(resultset->query));
+    }
+
+    option_val = ZOOM_query_get_sru11(resultset->query);
+    if (option_val)
+    {
+        sr->u.request->sort_type = Z_SRW_sort_type_sort;
+        sr->u.request->sort.sortKeys = odr_strdup(c->odr_out, option_val);
+    }
+    sr->u.request->startRecord = odr_intdup(c->odr_out, start + 1);
+    sr->u.request->maximumRecords = odr_intdup(
+        c->odr_out, (resultset->step > 0 && resultset->step < count) ?
+        resultset->step : count);
+    sr->u.request->recordSchema = resultset->schema;
+    sr->u.request->facetList = facet_list;
+
+    option_val = ZOOM_resultset_option_get(resultset, "recordPacking");
+    if (option_val)
+        sr->u.request->recordPacking = odr_strdup(c->odr_out, option_val);
+
+    option_val = ZOOM_resultset_option_get(resultset, "extraArgs");
+    yaz_encode_sru_extra(sr, c->odr_out, option_val);
+    return sr;
+}
+#endif
+
+#if YAZ_HAVE_XML2
+static int get_max_pipelined(ZOOM_connection c)
+{
+    int max_pipelined = ZOOM_options_get_int(c->options, "maxPipelined", 1);
+    if (max_pipelined > ZOOM_MAX_PIPELINED)
+        max_pipelined = ZOOM_MAX_PIPELINED;
+    return max_pipelined;
+}
+#endif
+
+#if YAZ_HAVE_XML2
+/* nothing to send: wait for pipelined responses if any */
+static zoom_ret wait_pipelined(ZOOM_connection c)
+{
+    if (!c->sru_pipelined)
+        return zoom_complete;
+    ZOOM_connection_set_mask(c, ZOOM_SELECT_READ|ZOOM_SELECT_EXCEPT);
+    return zoom_pending;
+}
+#endif
+
+#if YAZ_HAVE_XML2
+/* sends as many chunks of the result set as the pipeline allows, gaps
+   left by short pages first. All requests are encoded into one buffer
+   and written in one go */
+static zoom_ret send_srw_pipelined(ZOOM_connection c,
+                                   ZOOM_resultset resultset,
+                                   Z_Query *z_query, int *start, int *count)
+{
+    int max_pipelined = get_max_pipelined(c);
+    int no = 0;
+
+    /* more responses buffered: top up when they've been handled */
+    if (c->sru_pipelined && cs_more(c->cs))
+        return wait_pipelined(c);
+    while (c->sru_pipelined + no < max_pipelined
+           && (c->sru_gaps > 0 || *count > 0))
+    {
+        int s, n;
+        Z_SRW_PDU *sr;
+
+        if (c->sru_gaps > 0)
+        {   /* a gap is never larger than a chunk */
+            s = c->sru_gap_start[0];
+            n = c->sru_gap_count[0];
+            c->sru_gaps--;
+            memmove(c->sru_gap_start, c->sru_gap_start + 1,
+                    c->sru_gaps * sizeof(*c->sru_gap_start));
+            memmove(c->sru_gap_count, c->sru_gap_count + 1,
+                    c->sru_gaps * sizeof(*c->sru_gap_count));
+        }
+        else
+        {
+            s = *start;
+            n = resultset->step < *count ? resultset->step : *count;
+            *start += n;
+            *count -= n;
+        }
+        sr = get_search_pdu(c, resultset, z_query, s, n, 0);
+        if (!ZOOM_encode_GDU(c, get_srw_gdu(c, sr)))
+        {
+            odr_reset(c->odr_out);
+            return zoom_complete;
+        }
+        c->sru_pipeline_start[c->sru_pipelined + no] = s;
+        c->sru_pipeline_count[c->sru_pipelined + no] = n;
+        no++;
+    }
+    if (no == 0)
+        return wait_pipelined(c);
+    c->sru_pipelined += no;
+    yaz_log(c->log_details, "%p send_srw_pipelined sent=%d in flight=%d",
+            c, no, c->sru_pipelined);
+    return ZOOM_send_encoded(c);
+}
+#endif
+
 #if YAZ_HAVE_XML2
 zoom_ret ZOOM_connection_srw_send_search(ZOOM_connection c)
 {
@@ -131,9 +261,9 @@ zoom_ret ZOOM_connection_srw_send_search(ZOOM_connection c)
     int *start, *count;
     ZOOM_resultset resultset = 0;
     Z_SRW_PDU *sr = 0;
-    const char *option_val = 0;
     Z_Query *z_query;
     Z_FacetList *facet_list = 0;
+    int size_known = 0;
     if (c->error)                  /* don't continue on error */
         return zoom_complete;
     assert(c->tasks);
@@ -149,6 +279,7 @@ zoom_ret ZOOM_connection_srw_send_search(ZOOM_connection c)
         facets = ZOOM_options_get(resultset->options, "facets");
         if (facets)
             facet_list = yaz_pqf_parse_facet_list(c->odr_out, facets);
+        size_known = c->tasks->u.search.recv_search_fired;
         break;
     case ZOOM_TASK_RETRIEVE:
         resultset = c->tasks->u.retrieve.resultset;
@@ -157,8 +288,8 @@ zoom_ret ZOOM_connection_srw_send_search(ZOOM_connection c)
         count = &c->tasks->u.retrieve.count;
 
         if (*start >= resultset->size)
-            return zoom_complete;
-        if (*start + *count > resultset->size)
+            *count = 0;
+        else if (*start + *count > resultset->size)
             *count = resultset->size - *start;
 
         for (i = 0; i < *count; i++)
@@ -178,55 +309,32 @@ zoom_ret ZOOM_connection_srw_send_search(ZOOM_connection c)
         *start += i;
         *count -= i;
 
-        if (*count == 0)
-            return zoom_complete;
+        if (*count == 0 && !c->sru_gaps)
+            return wait_pipelined(c);
+        size_known = 1;
         break;
     default:
         return zoom_complete;
     }
     assert(resultset->query);
 
-    sr = ZOOM_srw_get_pdu(c, Z_SRW_searchRetrieve_request);
     z_query = ZOOM_query_get_Z_Query(resultset->query);
 
-    if (z_query->which == Z_Query_type_104
-        && z_query->u.type_104->which == Z_External_CQL)
-    {
-        sr->u.request->query_type = Z_SRW_query_type_cql;
-        sr->u.request->query.cql = z_query->u.type_104->u.cql;
-    }
-    else if (z_query->which == Z_Query_type_1 && z_query->u.type_1)
-    {
-        sr->u.request->query_type = Z_SRW_query_type_pqf;
-        sr->u.request->query.pqf =
-            odr_strdup(c->odr_out,
-                       ZOOM_query_get_query_string(resultset->query));
-    }
-    else
+    if (!(z_query->which == Z_Query_type_104
+          && z_query->u.type_104->which == Z_External_CQL)
+        && !(z_query->which == Z_Query_type_1 && z_query->u.type_1))
     {
         ZOOM_set_error(c, ZOOM_ERROR_UNSUPPORTED_QUERY, 0);
         return zoom_complete;
     }
-
-    option_val = ZOOM_query_get_sru11(resultset->query);
-    if (option_val)
-    {
-        sr->u.request->sort_type = Z_SRW_sort_type_sort;
-        sr->u.request->sort.sortKeys = odr_strdup(c->odr_out, option_val);
-    }
-    sr->u.request->startRecord = odr_intdup(c->odr_out, *start + 1);
-    sr->u.request->maximumRecords = odr_intdup(
-        c->odr_out, (resultset->step > 0 && resultset->step < *count) ?
-        resultset->step : *count);
-    sr->u.request->recordSchema = resultset->schema;
-    sr->u.request->facetList = facet_list;
-
-    option_val = ZOOM_resultset_option_get(resultset, "recordPacking");
-    if (option_val)
-        sr->u.request->recordPacking = odr_strdup(c->odr_out, option_val);
-
-    option_val = ZOOM_resultset_option_get(resultset, "extraArgs");
-    yaz_encode_sru_extra(sr, c->odr_out, option_val);
+    /* pipeline only when hit count is known and more than one
+       chunk remains */
+    if (c->sru_pipelined || c->sru_gaps ||
+        (size_known && c->sru_pipeline_ok && resultset->step > 0
+         && *count > resultset->step && get_max_pipelined(c) > 1))
+        return send_srw_pipelined(c, resultset, z_query, start, count);
+
+    sr = get_search_pdu(c, resultset, z_query, *start, *count, facet_list);
     return send_srw(c, sr);
 }
 #else
@@ -246,6 +354,8 @@ static zoom_ret handle_srw_response(ZOOM_connection c,
     ZOOM_Event event;
     int *start, *count;
     const char *syntax, *elementSetName;
+    int pipelined = c->sru_pipelined;
+    int base, requested = 0;
 
     if (!c->tasks)
         return zoom_complete;
@@ -280,6 +390,18 @@ static zoom_ret handle_srw_response(ZOOM_connection c,
         return zoom_complete;
     }
 
+    base = *start;
+    if (pipelined)
+    {
+        /* responses come in the order the requests were sent */
+        base = c->sru_pipeline_start[0];
+        requested = c->sru_pipeline_count[0];
+        c->sru_pipelined--;
+        memmove(c->sru_pipeline_start, c->sru_pipeline_start + 1,
+                c->sru_pipelined * sizeof(*c->sru_pipeline_start));
+        memmove(c->sru_pipeline_count, c->sru_pipeline_count + 1,
+                c->sru_pipelined * sizeof(*c->sru_pipeline_count));
+    }
     resultset->size = 0;
 
     if (res->resultSetId)
@@ -301,7 +423,7 @@ static zoom_ret handle_srw_response(ZOOM_connection c,
         }
         for (i = 0; i<res->num_records; i++)
         {
-            int pos = *start + i;
+            int pos = base + i;
             Z_SRW_record *sru_rec;
             Z_SRW_diagnostic *diag = 0;
             int num_diag;
@@ -346,8 +468,25 @@ static zoom_ret handle_srw_response(ZOOM_connection c,
             ZOOM_record_cache_add(resultset, npr, pos, syntax, elementSetName,
                                   sru_rec->recordSchema, diag);
         }
-        *count -= i;
-        *start += i;
+        if (!pipelined)
+        {   /* pipelined requests moved start and count when sent */
+            *count -= i;
+            *start += i;
+        }
+        else if (i > 0 && i < requested && base + i < resultset->size
+                 && c->sru_gaps < ZOOM_MAX_PIPELINED)
+        {   /* short page: ask for the rest again. Not if none came, as
+               the server would probably not return them anyway */
+            int n = requested - i;
+            if (base + i + n > resultset->size)
+                n = resultset->size - base - i;
+            c->sru_gap_start[c->sru_gaps] = base + i;
+            c->sru_gap_count[c->sru_gaps] = n;
+            c->sru_gaps++;
+            yaz_log(c->log_details, "%p handle_srw_response short page "
+                    "%d of %d; re-request %d+%d", c, i, requested,
+                    base + i, n);
+        }
         if (*count + *start > resultset->size)
             *count = resultset->size - *start;
         yaz_log(YLOG_DEBUG, "SRU result set size " ODR_INT_PRINTF " start %d count %d", resultset->size, *start, *count);
@@ -357,7 +496,7 @@ static zoom_ret handle_srw_response(ZOOM_connection c,
         nmem_transfer(odr_getmem(resultset->odr), nmem);
         nmem_destroy(nmem);
 
-        if (*count > 0)
+        if (*count > 0 || c->sru_pipelined || c->sru_gaps)
             return ZOOM_connection_srw_send_search(c);
     }
     return zoom_complete;
@@ -387,6 +526,42 @@ static void handle_srw_scan_response(ZOOM_connection c,
 }
 #endif
 
+/* called when the connection is lost or the server closes it. Pipelined
+   requests not answered are to be sent again - one at a time */
+void ZOOM_connection_srw_rewind(ZOOM_connection c)
+{
+    int *start = 0, *count = 0;
+
+    if (!c->sru_pipelined && !c->sru_gaps)
+        return;
+    if (c->tasks && c->tasks->which == ZOOM_TASK_SEARCH)
+    {
+        start = &c->tasks->u.search.start;
+        count = &c->tasks->u.search.count;
+    }
+    else if (c->tasks && c->tasks->which == ZOOM_TASK_RETRIEVE)
+    {
+        start = &c->tasks->u.retrieve.start;
+        count = &c->tasks->u.retrieve.count;
+    }
+    if (start)
+    {   /* from first gap or unanswered request on */
+        int first = c->sru_pipelined ? c->sru_pipeline_start[0] : *start;
+        int i;
+
+        for (i = 0; i < c->sru_gaps; i++)
+            if (c->sru_gap_start[i] < first)
+                first = c->sru_gap_start[i];
+        *count += *start - first;
+        *start = first;
+    }
+    c->sru_gaps = 0;
+    yaz_log(c->log_details, "%p ZOOM_connection_srw_rewind in flight=%d",
+            c, c->sru_pipelined);
+    c->sru_pipelined = 0;
+    c->sru_pipeline_ok = 0;
+}
+
 int ZOOM_handle_sru(ZOOM_connection c, Z_HTTP_Response *hres,
                     zoom_ret *cret, char **addinfo)
 {
@@ -505,6 +505,9 @@ static void otherInfo_attach(ZOOM_connection c, Z_APDU *a, ODR out)
 
 static int encode_APDU(ZOOM_connection c, Z_APDU *a, ODR out)
 {
+    double start = yaz_spans_start(c->spans);
+    int r;
+
     assert(a);
     if (c->cookie_out)
     {
@@ -521,7 +524,9 @@ static int encode_APDU(ZOOM_connection c, Z_APDU *a, ODR out)
                               1, c->client_IP);
     }
     otherInfo_attach(c, a, out);
-    if (!z_APDU(out, &a, 0, 0))
+    r = z_APDU(out, &a, 0, 0);
+    yaz_spans_stop(c->spans, ZOOM_connection_span_op(c), "encode", start);
+    if (!r)
     {
         FILE *outf = fopen("/tmp/apdu.txt", "a");
         if (a && outf)
@@ -697,7 +702,7 @@ zoom_ret ZOOM_connection_Z3950_send_search(ZOOM_connection c)
         const char *cp = ZOOM_options_get(r->options, "rpnCharset");
         if (cp)
         {
-            yaz_iconv_t cd = yaz_iconv_open(cp, "UTF-8");
+            yaz_iconv_t cd = yaz_iconv_pool_get(cp, "UTF-8");
             if (cd)
             {
                 int r;
@@ -707,7 +712,7 @@ zoom_ret ZOOM_connection_Z3950_send_search(ZOOM_connection c)
                 r = yaz_query_charset_convert_rpnquery_check(
                     search_req->query->u.type_1,
                     c->odr_out, cd);
-                yaz_iconv_close(cd);
+                yaz_iconv_pool_put(cd);
                 if (r)
                 {  /* query could not be char converted */
                     ZOOM_set_error(c, ZOOM_ERROR_INVALID_QUERY, 0);
@@ -838,14 +843,14 @@ zoom_ret ZOOM_connection_Z3950_send_scan(ZOOM_connection c)
         const char *cp = ZOOM_options_get(scan->options, "rpnCharset");
         if (cp)
         {
-            yaz_iconv_t cd = yaz_iconv_open(cp, "UTF-8");
+            yaz_iconv_t cd = yaz_iconv_pool_get(cp, "UTF-8");
             if (cd)
             {
                 rpn = yaz_copy_z_RPNQuery(rpn, c->odr_out);
 
                 yaz_query_charset_convert_rpnquery(
                     rpn, c->odr_out, cd);
-                yaz_iconv_close(cd);
+                yaz_iconv_pool_put(cd);
             }
         }
         req->attributeSet = rpn->attributeSetId;
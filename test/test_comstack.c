@@ -10,9 +10,29 @@
 #include <string.h>
 #include <stdio.h>
 
+#if HAVE_SYS_TYPES_H
+#include <sys/types.h>
+#endif
+#if HAVE_SYS_SOCKET_H
+#include <sys/socket.h>
+#endif
+#if HAVE_NETINET_IN_H
+#include <netinet/in.h>
+#endif
+#if HAVE_SYS_WAIT_H
+#include <sys/wait.h>
+#endif
+#if HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
 #include <yaz/test.h>
 #include <yaz/comstack.h>
 #include <yaz/tcpip.h>
+#include <yaz/unix.h>
+#include <yaz/xmalloc.h>
+#include <yaz/log.h>
+#include <yaz/timing.h>
 
 static void tst_http_request(void)
 {
@@ -190,6 +210,170 @@ static void tst_http_response(void)
     }
 }
 
+#if HAVE_SYS_SOCKET_H && !defined(WIN32)
+static void tst_putv_type(CS_TYPE type)
+{
+    int fd[2];
+    COMSTACK cs_w, cs_r;
+    char body[5000];
+    char *buf = 0;
+    int size = 0, r;
+    cs_iovec iov[3];
+    const char *head = "POST / HTTP/1.1\r\nContent-Length: ";
+    char head2[40];
+
+    YAZ_CHECK_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fd), 0);
+    cs_w = cs_createbysocket(fd[0], type, 1, PROTO_HTTP);
+    YAZ_CHECK(cs_w);
+    cs_r = cs_createbysocket(fd[1], type, 1, PROTO_HTTP);
+    YAZ_CHECK(cs_r);
+    if (!cs_w || !cs_r)
+        return;
+
+    memset(body, 'x', sizeof(body));
+    sprintf(head2, "%d\r\n\r\n", (int) sizeof(body));
+    iov[0].buf = (char *) head;
+    iov[0].len = strlen(head);
+    iov[1].buf = head2;
+    iov[1].len = strlen(head2);
+    iov[2].buf = body;
+    iov[2].len = sizeof(body);
+    YAZ_CHECK_EQ(cs_putv(cs_w, iov, 3), 0);
+
+    r = cs_get(cs_r, &buf, &size);
+    YAZ_CHECK_EQ(r, iov[0].len + iov[1].len + iov[2].len);
+    if (r > 0)
+    {
+        YAZ_CHECK(!memcmp(buf, head, iov[0].len));
+        YAZ_CHECK(!memcmp(buf + iov[0].len, head2, iov[1].len));
+        YAZ_CHECK(!memcmp(buf + iov[0].len + iov[1].len, body, sizeof(body)));
+    }
+    /* cs_put still works after cs_putv */
+    YAZ_CHECK_EQ(cs_put(cs_w, buf, r), 0);
+    YAZ_CHECK_EQ(cs_get(cs_r, &buf, &size), r);
+    xfree(buf);
+    cs_close(cs_w);
+    cs_close(cs_r);
+}
+
+static void tst_putv(void)
+{
+    tst_putv_type(tcpip_type);
+    tst_putv_type(unix_type);
+}
+#endif
+
+#if HAVE_SYS_WAIT_H && HAVE_UNISTD_H && !defined(WIN32)
+static void ssl_serve(COMSTACK l, int num)
+{
+    int i;
+    for (i = 0; i < num; i++)
+    {
+        COMSTACK cs;
+        char *buf = 0;
+        int size = 0;
+        const char *res = "HTTP/1.0 200 OK\r\nContent-Length: 0\r\n\r\n";
+
+        if (cs_listen(l, 0, 0))
+            break;
+        cs = cs_accept(l);
+        if (!cs)
+            break;
+        if (cs_get(cs, &buf, &size) > 0)
+            cs_put(cs, (char *) res, strlen(res));
+        xfree(buf);
+        cs_close(cs);
+    }
+}
+
+static int ssl_request(const char *host, const char *proxy)
+{
+    const char *req = "GET / HTTP/1.0\r\n\r\n";
+    char *buf = 0, uri[200];
+    int size = 0, r = -1;
+    void *ip;
+    COMSTACK cs;
+
+    sprintf(uri, "https://%.150s", host);
+    cs = cs_create_host_proxy(uri, 1, &ip, proxy);
+    if (!cs)
+        return -1;
+    if (cs_connect(cs, ip) == 0
+        && cs_put(cs, (char *) req, strlen(req)) == 0)
+        r = cs_get(cs, &buf, &size);
+    xfree(buf);
+    cs_close(cs);
+    return r;
+}
+
+/* loopback TLS against ztest's self-signed certificate: the first
+   connect does a full handshake; later ones resume the cached session.
+   Then the server acts as proxy for two targets that must not share
+   sessions */
+static void tst_ssl_session_cache(void)
+{
+    COMSTACK l = cs_create(ssl_type, 1, PROTO_HTTP);
+    const char *srcdir = getenv("srcdir");
+    char cert[1024], addr[64];
+    struct sockaddr_storage sa;
+    socklen_t sa_len = sizeof(sa);
+    int i, port, hits, misses, num = 4, num_proxy = 3;
+    void *ip;
+    pid_t pid;
+
+    if (!l)
+        return; /* no SSL support */
+    sprintf(cert, "%.900s/../ztest/ztest.pem", srcdir ? srcdir : ".");
+    YAZ_CHECK(cs_set_ssl_certificate_file(l, cert));
+    ip = cs_straddr(l, "127.0.0.1:0");
+    YAZ_CHECK(ip);
+    if (!ip || cs_bind(l, ip, CS_SERVER))
+    {
+        cs_close(l);
+        return;
+    }
+    YAZ_CHECK_EQ(getsockname(cs_fileno(l), (struct sockaddr *) &sa,
+                             &sa_len), 0);
+    if (sa.ss_family == AF_INET)
+        port = ntohs(((struct sockaddr_in *) &sa)->sin_port);
+    else
+        port = ntohs(((struct sockaddr_in6 *) &sa)->sin6_port);
+    sprintf(addr, "127.0.0.1:%d", port);
+
+    pid = fork();
+    YAZ_CHECK(pid != -1);
+    if (pid == 0)
+    {
+        ssl_serve(l, num + num_proxy);
+        _exit(0);
+    }
+    cs_close(l);
+    cs_clear_ssl_session_cache();
+    for (i = 0; i < num; i++)
+    {
+        yaz_timing_t t = yaz_timing_create();
+        int r = ssl_request(addr, 0);
+
+        yaz_timing_stop(t);
+        YAZ_CHECK(r > 0);
+        yaz_log(YLOG_LOG, "TLS request %d: %.6f s", i,
+                yaz_timing_get_real(t));
+        yaz_timing_destroy(&t);
+    }
+    cs_get_ssl_session_stats(&hits, &misses);
+    YAZ_CHECK_EQ(misses, 1);
+    YAZ_CHECK_EQ(hits, num - 1);
+
+    YAZ_CHECK(ssl_request("a.example:9999", addr) > 0);
+    YAZ_CHECK(ssl_request("b.example:9999", addr) > 0);
+    YAZ_CHECK(ssl_request("a.example:9999", addr) > 0);
+    cs_get_ssl_session_stats(&hits, &misses);
+    YAZ_CHECK_EQ(misses, 3);
+    YAZ_CHECK_EQ(hits, num);
+    waitpid(pid, 0, 0);
+}
+#endif
+
 /** \brief COMSTACK synopsis from manual, doc/comstack.xml */
 static int comstack_example(const char *server_address_str)
 {
@@ -257,6 +441,12 @@ int main (int argc, char **argv)
        comstack_example(argv[1]);
     tst_http_request();
     tst_http_response();
+#if HAVE_SYS_SOCKET_H && !defined(WIN32)
+    tst_putv();
+#endif
+#if HAVE_SYS_WAIT_H && HAVE_UNISTD_H && !defined(WIN32)
+    tst_ssl_session_cache();
+#endif
     YAZ_CHECK_TERM;
 }
 
@@ -0,0 +1,159 @@
+/* This file is part of the YAZ toolkit.
+ * Copyright (C) 1995-2013 Index Data
+ * See the file LICENSE for details.
+ */
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <yaz/test.h>
+#include <yaz/log.h>
+#include <yaz/cql.h>
+#include <yaz/wrbuf.h>
+
+struct str_stream {
+    const char *str;
+    int off;
+};
+
+static int getbyte_str(void *vp)
+{
+    struct str_stream *ss = (struct str_stream *) vp;
+    if (ss->str[ss->off] == 0)
+        return 0;
+    return ss->str[ss->off++];
+}
+
+static void ungetbyte_str(int b, void *vp)
+{
+    struct str_stream *ss = (struct str_stream *) vp;
+    if (b)
+        ss->off--;
+}
+
+/* checks that cql_parser_string and cql_parser_stream agree;
+   expect_ok tells whether query should parse */
+static int compare(const char *cql, int expect_ok)
+{
+    int ret = 0;
+    CQL_parser cp = cql_parser_create();
+    struct str_stream ss;
+    WRBUF w_str = wrbuf_alloc();
+    WRBUF w_stream = wrbuf_alloc();
+    int r_str, r_stream;
+
+    r_str = cql_parser_string(cp, cql);
+    if (r_str == 0)
+        cql_to_xml(cql_parser_result(cp), wrbuf_vp_puts, w_str);
+    ss.str = cql;
+    ss.off = 0;
+    r_stream = cql_parser_stream(cp, getbyte_str, ungetbyte_str, &ss);
+    if (r_stream == 0)
+        cql_to_xml(cql_parser_result(cp), wrbuf_vp_puts, w_stream);
+
+    if (r_str != r_stream)
+        yaz_log(YLOG_WARN, "%s: string %d stream %d", cql, r_str, r_stream);
+    else if (strcmp(wrbuf_cstr(w_str), wrbuf_cstr(w_stream)))
+    {
+        yaz_log(YLOG_WARN, "%s: string\n%s", cql, wrbuf_cstr(w_str));
+        yaz_log(YLOG_WARN, "%s: stream\n%s", cql, wrbuf_cstr(w_stream));
+    }
+    else if ((r_str == 0) != expect_ok)
+        yaz_log(YLOG_WARN, "%s: result %d", cql, r_str);
+    else
+        ret = 1;
+    wrbuf_destroy(w_stream);
+    wrbuf_destroy(w_str);
+    cql_parser_destroy(cp);
+    return ret;
+}
+
+static void tst_lexer(void)
+{
+    YAZ_CHECK(compare("a", 1));
+    YAZ_CHECK(compare("  a  ", 1));
+    YAZ_CHECK(compare("\ta\t", 1));
+    YAZ_CHECK(compare("", 0));
+    YAZ_CHECK(compare("a and b or c not d", 1));
+    YAZ_CHECK(compare("a AND b", 1));
+    YAZ_CHECK(compare("title=x", 1));
+    YAZ_CHECK(compare("title==x", 1));
+    YAZ_CHECK(compare("title<>x", 1));
+    YAZ_CHECK(compare("date>=1990 and date<=2000", 1));
+    YAZ_CHECK(compare("date>1990 and date<2000", 1));
+    YAZ_CHECK(compare("title all \"a b\"", 1));
+    YAZ_CHECK(compare("title any/rel.algorithm=cql a", 1));
+    YAZ_CHECK(compare("dc.title adj x", 1));
+    YAZ_CHECK(compare("a prox/unit=word/distance>1 b", 1));
+    YAZ_CHECK(compare("(a or b) and c", 1));
+    YAZ_CHECK(compare(">dc=\"http://purl.org/dc\" dc.title=x", 1));
+    YAZ_CHECK(compare("\"a \\\" b\"", 1));
+    YAZ_CHECK(compare("a\\ b", 1));
+    YAZ_CHECK(compare("a\\", 1));
+    YAZ_CHECK(compare("\"a\\", 1));
+    YAZ_CHECK(compare("\"unterminated", 1));
+    YAZ_CHECK(compare("\"\"", 1));
+    YAZ_CHECK(compare("a\nb", 1));
+    YAZ_CHECK(compare("a and\nb", 0));
+    YAZ_CHECK(compare("a sortby title/sort.descending", 1));
+    YAZ_CHECK(compare("a and", 0));
+    YAZ_CHECK(compare("(a", 0));
+    YAZ_CHECK(compare("a)", 0));
+}
+
+static void tst_sample(void)
+{
+    WRBUF w = wrbuf_alloc();
+    const char *srcdir = getenv("srcdir");
+    FILE *f;
+
+    if (srcdir)
+    {
+        wrbuf_puts(w, srcdir);
+        wrbuf_puts(w, "/");
+    }
+    wrbuf_puts(w, "cql2xcqlsample");
+    f = fopen(wrbuf_cstr(w), "r");
+    YAZ_CHECK(f);
+    if (f)
+    {
+        char line[256];
+        while (fgets(line, sizeof(line), f))
+        {
+            char *cp = strchr(line, '\n');
+            if (cp)
+                *cp = '\0';
+            if (*line != '#')
+            {
+                CQL_parser p = cql_parser_create();
+                int ok = cql_parser_string(p, line) == 0;
+                cql_parser_destroy(p);
+                YAZ_CHECK(compare(line, ok));
+            }
+        }
+        fclose(f);
+    }
+    wrbuf_destroy(w);
+}
+
+int main(int argc, char **argv)
+{
+    YAZ_CHECK_INIT(argc, argv);
+    YAZ_CHECK_LOG();
+    tst_lexer();
+    tst_sample();
+    YAZ_CHECK_TERM;
+}
+
+/*
+ * Local variables:
+ * c-basic-offset: 4
+ * c-file-style: "Stroustrup"
+ * indent-tabs-mode: nil
+ * End:
+ * vim: shiftwidth=4 tabstop=8 expandtab
+ */
@@ -0,0 +1,217 @@
+/* This file is part of the YAZ toolkit.
+ * Copyright (C) 1995-2013 Index Data
+ * See the file LICENSE for details.
+ */
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <yaz/test.h>
+#include <yaz/log.h>
+#include <yaz/rpn2cql.h>
+#include <yaz/pquery.h>
+#include <yaz/querytowrbuf.h>
+#include <yaz/wrbuf.h>
+#include "zoom-p.h"
+
+/* whether a and b have the same BER encoding */
+static int same_rpn(Z_RPNQuery *a, Z_RPNQuery *b)
+{
+    ODR odr_a = odr_createmem(ODR_ENCODE);
+    ODR odr_b = odr_createmem(ODR_ENCODE);
+    char *buf_a, *buf_b;
+    int len_a, len_b, ret;
+
+    z_RPNQuery(odr_a, &a, 0, 0);
+    buf_a = odr_getbuf(odr_a, &len_a, 0);
+    z_RPNQuery(odr_b, &b, 0, 0);
+    buf_b = odr_getbuf(odr_b, &len_b, 0);
+    ret = len_a == len_b && !memcmp(buf_a, buf_b, len_a);
+    odr_destroy(odr_b);
+    odr_destroy(odr_a);
+    return ret;
+}
+
+/* checks that cql_transform_rpn gives the same query as parsing
+   the PQF produced by cql_transform. CQL syntax errors are ignored.
+   Each transform gets its own tree as transforms resolve prefixes */
+static int compare(cql_transform_t ct, const char *cql)
+{
+    int ret = 0;
+    CQL_parser cp = cql_parser_create();
+    CQL_parser cp_rpn = cql_parser_create();
+    ODR odr = odr_createmem(ODR_ENCODE);
+    WRBUF pqf = wrbuf_alloc();
+
+    if (cql_parser_string(cp, cql) || cql_parser_string(cp_rpn, cql))
+        ret = 1;
+    else
+    {
+        Z_RPNQuery *q_pqf = 0, *q_rpn = 0;
+        int r_pqf = cql_transform(ct, cql_parser_result(cp),
+                                  wrbuf_vp_puts, pqf);
+        int r_rpn = cql_transform_rpn(ct, cql_parser_result(cp_rpn), odr,
+                                      &q_rpn);
+
+        if (r_pqf == 0)
+            q_pqf = p_query_rpn(odr, wrbuf_cstr(pqf));
+        if (r_pqf != r_rpn)
+            yaz_log(YLOG_WARN, "%s: error %d != %d", cql, r_pqf, r_rpn);
+        else if (r_pqf)
+        {
+            yaz_log(YLOG_LOG, "%s -> Error %d", cql, r_pqf);
+            ret = 1;
+        }
+        else if (q_pqf && q_rpn)
+        {
+            if (same_rpn(q_pqf, q_rpn))
+            {
+                yaz_log(YLOG_LOG, "%s -> %s", cql, wrbuf_cstr(pqf));
+                ret = 1;
+            }
+            else
+            {
+                WRBUF w = wrbuf_alloc();
+                yaz_rpnquery_to_wrbuf(w, q_rpn);
+                yaz_log(YLOG_WARN, "%s: expected %s", cql, wrbuf_cstr(pqf));
+                yaz_log(YLOG_WARN, "%s: got      %s", cql, wrbuf_cstr(w));
+                wrbuf_destroy(w);
+            }
+        }
+    }
+    wrbuf_destroy(pqf);
+    odr_destroy(odr);
+    cql_parser_destroy(cp_rpn);
+    cql_parser_destroy(cp);
+    return ret;
+}
+
+/* ZOOM_query_cql2rpn sends the RPN query built from CQL; its query
+   string, which SRU sends, is the PQF of cql_transform for that query */
+static void tst_zoom_query(const char *cqlfile)
+{
+    ZOOM_options opt = ZOOM_options_create();
+    ZOOM_connection c;
+    ZOOM_query q = ZOOM_query_create();
+    ODR odr = odr_createmem(ODR_DECODE);
+
+    ZOOM_options_set(opt, "cqlfile", cqlfile);
+    c = ZOOM_connection_create(opt);
+    YAZ_CHECK_EQ(ZOOM_query_cql2rpn(q, "dc.title = computer and a", c), 0);
+    YAZ_CHECK(!strcmp(ZOOM_query_get_query_string(q),
+                      "@and @attr 6=1 @attr 2=3 @attr 4=1 @attr 3=3 "
+                      "@attr 6=1 @attr 5=100 @attr 1=4 \"computer\" "
+                      "@attr 6=1 @attr 2=3 @attr 4=1 @attr 3=3 "
+                      "@attr 6=1 @attr 5=100 @attr 1=1016 \"a\" "));
+    YAZ_CHECK(same_rpn(p_query_rpn(odr, ZOOM_query_get_query_string(q)),
+                       ZOOM_query_get_Z_Query(q)->u.type_1));
+    YAZ_CHECK_EQ(ZOOM_query_cql2rpn(q, "a and", c), -1);
+    odr_destroy(odr);
+    ZOOM_query_destroy(q);
+    ZOOM_connection_destroy(c);
+    ZOOM_options_destroy(opt);
+}
+
+static void tst_sample(void)
+{
+    WRBUF w = wrbuf_alloc();
+    cql_transform_t ct;
+    const char *srcdir = getenv("srcdir");
+    FILE *f;
+
+    if (srcdir)
+    {
+        wrbuf_puts(w, srcdir);
+        wrbuf_puts(w, "/");
+    }
+    wrbuf_puts(w, "../etc/pqf.properties");
+    ct = cql_transform_open_fname(wrbuf_cstr(w));
+    YAZ_CHECK(ct);
+    tst_zoom_query(wrbuf_cstr(w));
+
+    wrbuf_rewind(w);
+    if (srcdir)
+    {
+        wrbuf_puts(w, srcdir);
+        wrbuf_puts(w, "/");
+    }
+    wrbuf_puts(w, "cql2pqfsample");
+    f = fopen(wrbuf_cstr(w), "r");
+    YAZ_CHECK(f);
+    if (ct && f)
+    {
+        char line[256];
+        while (fgets(line, sizeof(line), f))
+        {
+            char *cp = strchr(line, '\n');
+            if (cp)
+                *cp = '\0';
+            if (*line != '#')
+                YAZ_CHECK(compare(ct, line));
+        }
+    }
+    if (f)
+        fclose(f);
+
+    if (ct)
+    {
+        YAZ_CHECK(compare(ct, "a prox b"));
+        YAZ_CHECK(compare(ct, "a prox/unit=sentence/distance>2/ordered b"));
+        YAZ_CHECK(compare(ct, "a prox/unit=page b"));
+        YAZ_CHECK(compare(ct, "cql.resultSetId = foo or a"));
+        YAZ_CHECK(compare(ct, "dc.title any \"x y z\""));
+        YAZ_CHECK(compare(ct, "dc.title all \"x y z\" and c"));
+        YAZ_CHECK(compare(ct, "dc.title = x sortby dc.title"));
+        YAZ_CHECK(compare(ct, "a and/foo b"));
+        YAZ_CHECK(compare(ct, "foo.bar = x"));
+        cql_transform_close(ct);
+    }
+    wrbuf_destroy(w);
+}
+
+static void tst_attributes(void)
+{
+    cql_transform_t ct = cql_transform_create();
+
+    cql_transform_define_pattern(ct, "set",
+                                 "info:srw/cql-context-set/1/dc-v1.1");
+    cql_transform_define_pattern(ct, "set.dc",
+                                 "info:srw/cql-context-set/1/dc-v1.1");
+    cql_transform_define_pattern(ct, "index.dc.title", "exp-1 1=4 3=1");
+    cql_transform_define_pattern(ct, "index.dc.*", "1=*");
+    cql_transform_define_pattern(ct, "relation.=", "2=3 2=102");
+    cql_transform_define_pattern(ct, "relation.<", "bib-1 2=1");
+    cql_transform_define_pattern(ct, "structure.*", "4=1");
+    cql_transform_define_pattern(ct, "position.any", "3=3");
+    cql_transform_define_pattern(ct, "truncation.right", "5=1");
+    cql_transform_define_pattern(ct, "truncation.none", "5=100");
+
+    YAZ_CHECK(compare(ct, "a"));
+    YAZ_CHECK(compare(ct, "dc.title = a"));
+    YAZ_CHECK(compare(ct, "dc.creator = a*"));
+    YAZ_CHECK(compare(ct, "dc.creator < a and dc.title=b"));
+    YAZ_CHECK(compare(ct, "dc.creator > a"));
+    cql_transform_close(ct);
+}
+
+int main(int argc, char **argv)
+{
+    YAZ_CHECK_INIT(argc, argv);
+    YAZ_CHECK_LOG();
+    tst_sample();
+    tst_attributes();
+    YAZ_CHECK_TERM;
+}
+
+/*
+ * Local variables:
+ * c-basic-offset: 4
+ * c-file-style: "Stroustrup"
+ * indent-tabs-mode: nil
+ * End:
+ * vim: shiftwidth=4 tabstop=8 expandtab
+ */
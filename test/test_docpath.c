@@ -0,0 +1,142 @@
+/* This file is part of the YAZ toolkit.
+ * Copyright (C) 1995-2013 Index Data
+ * See the file LICENSE for details.
+ */
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#if HAVE_UNISTD_H && !defined(WIN32)
+#include <utime.h>
+#endif
+
+#include <yaz/test.h>
+#include "filecache.h"
+
+static void tst_parse_date(void)
+{
+    time_t t;
+
+    YAZ_CHECK(file_cache_parse_date("Sun, 06 Nov 1994 08:49:37 GMT",
+                                    &t) == 0);
+    YAZ_CHECK_EQ((long) t, 784111777L);
+    YAZ_CHECK(file_cache_parse_date("Sunday, 06-Nov-94 08:49:37 GMT",
+                                    &t) == 0);
+    YAZ_CHECK_EQ((long) t, 784111777L);
+    YAZ_CHECK(file_cache_parse_date("Sun Nov  6 08:49:37 1994", &t) == 0);
+    YAZ_CHECK_EQ((long) t, 784111777L);
+    YAZ_CHECK(file_cache_parse_date("Thu, 01 Jan 1970 00:00:00 GMT",
+                                    &t) == 0);
+    YAZ_CHECK_EQ((long) t, 0L);
+    YAZ_CHECK(file_cache_parse_date("Thu, 29 Feb 2024 23:59:59 GMT",
+                                    &t) == 0);
+    YAZ_CHECK_EQ((long) t, 1709251199L);
+
+    YAZ_CHECK(file_cache_parse_date("", &t) == -1);
+    YAZ_CHECK(file_cache_parse_date("Sun, 06 Nov 1994 08:49:37 CET",
+                                    &t) == -1);
+    YAZ_CHECK(file_cache_parse_date("Sun, 06 Foo 1994 08:49:37 GMT",
+                                    &t) == -1);
+    YAZ_CHECK(file_cache_parse_date("Sun, 06 Nov 1994", &t) == -1);
+}
+
+static void tst_not_modified(void)
+{
+    struct file_cache_info info;
+
+    info.etag = "\"a-b\"";
+    info.mtime = 784111777;
+
+    YAZ_CHECK(!file_cache_not_modified(&info, 0, 0));
+
+    YAZ_CHECK(file_cache_not_modified(&info, "\"a-b\"", 0));
+    YAZ_CHECK(file_cache_not_modified(&info, "W/\"a-b\"", 0));
+    YAZ_CHECK(file_cache_not_modified(&info, "\"x\", W/\"a-b\"", 0));
+    YAZ_CHECK(file_cache_not_modified(&info, "\"x\",\"a-b\" ", 0));
+    YAZ_CHECK(file_cache_not_modified(&info, "*", 0));
+    YAZ_CHECK(!file_cache_not_modified(&info, "\"a-b", 0));
+    YAZ_CHECK(!file_cache_not_modified(&info, "\"a\", \"b\"", 0));
+    YAZ_CHECK(!file_cache_not_modified(&info, "\"a-bc\"", 0));
+
+    YAZ_CHECK(file_cache_not_modified(&info, 0,
+                                      "Sun, 06 Nov 1994 08:49:37 GMT"));
+    YAZ_CHECK(file_cache_not_modified(&info, 0,
+                                      "Mon, 07 Nov 1994 08:49:37 GMT"));
+    YAZ_CHECK(!file_cache_not_modified(&info, 0,
+                                       "Sun, 06 Nov 1994 08:49:36 GMT"));
+    YAZ_CHECK(!file_cache_not_modified(&info, 0, "yesterday"));
+    /* If-Modified-Since is ignored when If-None-Match is present */
+    YAZ_CHECK(!file_cache_not_modified(&info, "\"x\"",
+                                       "Mon, 07 Nov 1994 08:49:37 GMT"));
+}
+
+static int write_file(const char *fname, const char *content)
+{
+    FILE *f = fopen(fname, "wb");
+    if (!f)
+        return -1;
+    fputs(content, f);
+    return fclose(f);
+}
+
+/* a file replaced by another of the same size and mtime is reloaded */
+static void tst_replaced(void)
+{
+#if HAVE_UNISTD_H && !defined(WIN32)
+    const char *fname = "test_docpath.tmp.txt";
+    const char *tmp = "test_docpath.new.txt";
+    file_cache_t fc = file_cache_create();
+    NMEM nmem = nmem_create();
+    struct file_cache_info info;
+    struct utimbuf ut;
+    char *etag;
+
+    ut.actime = ut.modtime = 784111777;
+    YAZ_CHECK(write_file(fname, "one") == 0);
+    YAZ_CHECK(utime(fname, &ut) == 0);
+    YAZ_CHECK_EQ(file_cache_lookup(fc, fname, -1, nmem, 1, &info), 0);
+    YAZ_CHECK(info.buf && !memcmp(info.buf, "one", 3));
+    YAZ_CHECK_EQ((long) info.mtime, 784111777L);
+    YAZ_CHECK(!strcmp(info.last_modified, "Sun, 06 Nov 1994 08:49:37 GMT"));
+    etag = info.etag;
+
+    YAZ_CHECK(write_file(tmp, "two") == 0);
+    YAZ_CHECK(utime(tmp, &ut) == 0);
+    YAZ_CHECK(rename(tmp, fname) == 0);
+    YAZ_CHECK_EQ(file_cache_lookup(fc, fname, -1, nmem, 1, &info), 0);
+    YAZ_CHECK(info.buf && !memcmp(info.buf, "two", 3));
+    YAZ_CHECK(strcmp(etag, info.etag));
+
+    YAZ_CHECK_EQ(file_cache_lookup(fc, "test_docpath.none.txt", -1,
+                                   nmem, 0, &info), -1);
+    unlink(fname);
+    nmem_destroy(nmem);
+    file_cache_destroy(fc);
+#endif
+}
+
+int main(int argc, char **argv)
+{
+    YAZ_CHECK_INIT(argc, argv);
+    YAZ_CHECK_LOG();
+    tst_parse_date();
+    tst_not_modified();
+    tst_replaced();
+    YAZ_CHECK_TERM;
+}
+
+/*
+ * Local variables:
+ * c-basic-offset: 4
+ * c-file-style: "Stroustrup"
+ * indent-tabs-mode: nil
+ * End:
+ * vim: shiftwidth=4 tabstop=8 expandtab
+ */
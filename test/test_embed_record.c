@@ -132,12 +132,56 @@ static int test_render(const char *type_spec, int is_marc, const char *input,
     return res;
 }
 
+/* yaz_record_render2 with one parsed record must give the same output
+   as yaz_record_render for each type */
+static void test3(void)
+{
+    const char *marc =
+        "00138nam  22000738a 4500001001300000003000400013100001700017245003"
+        "000034\036   11224466 \036DLC\03610\037aJack Collins\03610"
+        "\037aHow to program a computer\036\035";
+    const char *types[] = {
+        "xml", "raw", "render", "txml; charset=marc8,utf-8",
+        "raw; charset=marc8", "render; charset=latin1",
+        "xml", 0
+    };
+    ODR odr = odr_createmem(ODR_ENCODE);
+    WRBUF w1 = wrbuf_alloc();
+    WRBUF w2 = wrbuf_alloc();
+    yaz_marc_t mt = 0;
+    Z_NamePlusRecord *npr = odr_malloc(odr, sizeof(*npr));
+    int i;
+
+    npr->which = Z_NamePlusRecord_databaseRecord;
+    npr->u.databaseRecord = z_ext_record_usmarc(odr, marc, strlen(marc));
+    for (i = 0; types[i]; i++)
+    {
+        int len1, len2;
+        const char *r1 = yaz_record_render(npr, 0, w1, types[i], &len1);
+        const char *r2 = yaz_record_render2(npr, 0, w2, types[i], &len2,
+                                            &mt);
+        YAZ_CHECK(r1);
+        YAZ_CHECK(r2);
+        if (r1 && r2)
+        {
+            YAZ_CHECK_EQ(len1, len2);
+            YAZ_CHECK(len1 == len2 && !memcmp(r1, r2, len1));
+        }
+        YAZ_CHECK(mt);
+    }
+    yaz_marc_destroy(mt);
+    wrbuf_destroy(w1);
+    wrbuf_destroy(w2);
+    odr_destroy(odr);
+}
+
 int main(int argc, char **argv)
 {
     YAZ_CHECK_INIT(argc, argv);
     YAZ_CHECK_LOG();
     test1();
     test2();
+    test3();
 #if YAZ_HAVE_XML2
     YAZ_CHECK(test_render("xml", 0, "<my/>", "<my/>"));
 
@@ -0,0 +1,370 @@
+/* This file is part of the YAZ toolkit.
+ * Copyright (C) 1995-2013 Index Data
+ * See the file LICENSE for details.
+ */
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <yaz/zgdu.h>
+#include <yaz/wrbuf.h>
+#include <yaz/test.h>
+
+#if HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+static const char *mk_body(WRBUF w)
+{
+    int i;
+    for (i = 0; i < 200; i++)
+        wrbuf_printf(w, "<record><title>Title %d</title></record>\n", i);
+    return wrbuf_cstr(w);
+}
+
+static Z_HTTP_Response *mk_response(ODR o, const char *body)
+{
+    Z_GDU *gdu = z_get_HTTP_Response(o, 200);
+    Z_HTTP_Response *hres = gdu->u.HTTP_Response;
+
+    hres->content_buf = odr_strdup(o, body);
+    hres->content_len = strlen(body);
+    z_HTTP_header_add(o, &hres->headers, "Content-Type", "text/xml");
+    return hres;
+}
+
+/* encode response, decode it again and compare body with expect */
+static int round_trip(Z_HTTP_Response *hres, const char *expect)
+{
+    ODR enc = odr_createmem(ODR_ENCODE);
+    ODR dec = odr_createmem(ODR_DECODE);
+    Z_GDU *gdu = (Z_GDU *) odr_malloc(enc, sizeof(*gdu));
+    Z_GDU *gdu_r = 0;
+    char *buf;
+    int len, ret = 0;
+
+    gdu->which = Z_GDU_HTTP_Response;
+    gdu->u.HTTP_Response = hres;
+    if (z_GDU(enc, &gdu, 0, 0))
+    {
+        buf = odr_getbuf(enc, &len, 0);
+        odr_setbuf(dec, buf, len, 0);
+        if (z_GDU(dec, &gdu_r, 0, 0)
+            && gdu_r->which == Z_GDU_HTTP_Response)
+        {
+            Z_HTTP_Response *r = gdu_r->u.HTTP_Response;
+            ret = r->content_len == (int) strlen(expect)
+                && !memcmp(r->content_buf, expect, r->content_len)
+                && !z_HTTP_header_lookup(r->headers, "Content-Encoding");
+        }
+    }
+    odr_destroy(enc);
+    odr_destroy(dec);
+    return ret;
+}
+
+static const char *compressed_with(const char *accept)
+{
+    ODR o = odr_createmem(ODR_ENCODE);
+    WRBUF w = wrbuf_alloc();
+    const char *body = mk_body(w);
+    Z_HTTP_Response *hres = mk_response(o, body);
+    const char *coding = "none";
+
+    if (yaz_http_response_compress(o, hres, accept, -1))
+    {
+        const char *v = z_HTTP_header_lookup(hres->headers,
+                                             "Content-Encoding");
+        if (!strcmp(v, "gzip"))
+            coding = "gzip";
+        else if (!strcmp(v, "deflate"))
+            coding = "deflate";
+        else
+            coding = "other";
+        if (hres->content_len >= (int) strlen(body)
+            || !round_trip(hres, body))
+            coding = "bad";
+    }
+    wrbuf_destroy(w);
+    odr_destroy(o);
+    return coding;
+}
+
+#if HAVE_ZLIB
+static void tst_accept(void)
+{
+    YAZ_CHECK(!strcmp(compressed_with("gzip"), "gzip"));
+    YAZ_CHECK(!strcmp(compressed_with("deflate"), "deflate"));
+    YAZ_CHECK(!strcmp(compressed_with("gzip, deflate"), "gzip"));
+    YAZ_CHECK(!strcmp(compressed_with("GZIP"), "gzip"));
+    YAZ_CHECK(!strcmp(compressed_with("gzip;q=0, deflate"), "deflate"));
+    YAZ_CHECK(!strcmp(compressed_with("gzip; q=0.0,deflate;q=0.5"),
+                      "deflate"));
+    YAZ_CHECK(!strcmp(compressed_with("*"), "gzip"));
+    YAZ_CHECK(!strcmp(compressed_with("*;q=0"), "none"));
+    YAZ_CHECK(!strcmp(compressed_with("identity"), "none"));
+    YAZ_CHECK(!strcmp(compressed_with("xgzip"), "none"));
+    YAZ_CHECK(!strcmp(compressed_with(""), "none"));
+    YAZ_CHECK(!strcmp(compressed_with(0), "none"));
+}
+
+static void tst_small_body(void)
+{
+    ODR o = odr_createmem(ODR_ENCODE);
+    Z_HTTP_Response *hres = mk_response(o, "x");
+
+    /* gzip of one byte is larger than the byte itself */
+    YAZ_CHECK_EQ(yaz_http_response_compress(o, hres, "gzip", 6), 0);
+    YAZ_CHECK_EQ(hres->content_len, 1);
+    YAZ_CHECK(!z_HTTP_header_lookup(hres->headers, "Content-Encoding"));
+    odr_destroy(o);
+}
+
+static void tst_raw_deflate(void)
+{
+    ODR o = odr_createmem(ODR_ENCODE);
+    WRBUF w = wrbuf_alloc();
+    const char *body = mk_body(w);
+    Z_HTTP_Response *hres = mk_response(o, body);
+    z_stream zs;
+    char *buf = (char *) odr_malloc(o, hres->content_len + 100);
+
+    /* deflate without zlib wrapper as some servers send */
+    memset(&zs, 0, sizeof(zs));
+    YAZ_CHECK_EQ(deflateInit2(&zs, 6, Z_DEFLATED, -MAX_WBITS, 8,
+                              Z_DEFAULT_STRATEGY), Z_OK);
+    zs.next_in = (Bytef *) hres->content_buf;
+    zs.avail_in = hres->content_len;
+    zs.next_out = (Bytef *) buf;
+    zs.avail_out = hres->content_len + 100;
+    YAZ_CHECK_EQ(deflate(&zs, Z_FINISH), Z_STREAM_END);
+    hres->content_buf = buf;
+    hres->content_len = zs.total_out;
+    deflateEnd(&zs);
+    z_HTTP_header_add(o, &hres->headers, "Content-Encoding", "deflate");
+    YAZ_CHECK(round_trip(hres, body));
+
+    wrbuf_destroy(w);
+    odr_destroy(o);
+}
+
+static void tst_chunked_gzip(void)
+{
+    ODR o = odr_createmem(ODR_ENCODE);
+    ODR dec = odr_createmem(ODR_DECODE);
+    WRBUF w = wrbuf_alloc();
+    WRBUF msg = wrbuf_alloc();
+    const char *body = mk_body(w);
+    Z_HTTP_Response *hres = mk_response(o, body);
+    Z_GDU *gdu = 0;
+    int off, chunk = 100;
+
+    YAZ_CHECK(yaz_http_response_compress(o, hres, "gzip", 9));
+    wrbuf_puts(msg, "HTTP/1.1 200 OK\r\n"
+               "Content-Type: text/xml\r\n"
+               "Transfer-Encoding: chunked\r\n"
+               "Content-Encoding: gzip\r\n\r\n");
+    for (off = 0; off < hres->content_len; off += chunk)
+    {
+        int len = hres->content_len - off;
+        if (len > chunk)
+            len = chunk;
+        wrbuf_printf(msg, "%x\r\n", len);
+        wrbuf_write(msg, hres->content_buf + off, len);
+        wrbuf_puts(msg, "\r\n");
+    }
+    wrbuf_puts(msg, "0\r\n\r\n");
+
+    odr_setbuf(dec, wrbuf_buf(msg), wrbuf_len(msg), 0);
+    YAZ_CHECK(z_GDU(dec, &gdu, 0, 0));
+    if (gdu && gdu->which == Z_GDU_HTTP_Response)
+    {
+        Z_HTTP_Response *r = gdu->u.HTTP_Response;
+        YAZ_CHECK_EQ(r->content_len, (int) strlen(body));
+        YAZ_CHECK(r->content_buf && !strcmp(r->content_buf, body));
+        YAZ_CHECK(!z_HTTP_header_lookup(r->headers, "Content-Encoding"));
+    }
+
+    /* truncated gzip stream */
+    odr_reset(dec);
+    wrbuf_rewind(msg);
+    wrbuf_printf(msg, "HTTP/1.1 200 OK\r\n"
+                 "Content-Length: %d\r\n"
+                 "Content-Encoding: gzip\r\n\r\n", hres->content_len / 2);
+    wrbuf_write(msg, hres->content_buf, hres->content_len / 2);
+    odr_setbuf(dec, wrbuf_buf(msg), wrbuf_len(msg), 0);
+    YAZ_CHECK(!z_GDU(dec, &gdu, 0, 0));
+
+    wrbuf_destroy(msg);
+    wrbuf_destroy(w);
+    odr_destroy(dec);
+    odr_destroy(o);
+}
+
+/* decodes gzip coded request with body inflating to strlen(body) bytes */
+static int decode_gzip_request(int max_content, const char *body)
+{
+    ODR o = odr_createmem(ODR_ENCODE);
+    ODR dec = odr_createmem(ODR_DECODE);
+    Z_HTTP_Response *hres = mk_response(o, body);
+    WRBUF msg = wrbuf_alloc();
+    Z_GDU *gdu = 0;
+    int ret;
+
+    yaz_http_response_compress(o, hres, "gzip", 9);
+    wrbuf_printf(msg, "POST /sru HTTP/1.1\r\n"
+                 "Content-Length: %d\r\n"
+                 "Content-Encoding: gzip\r\n\r\n", hres->content_len);
+    wrbuf_write(msg, hres->content_buf, hres->content_len);
+    z_HTTP_set_max_content(dec, max_content);
+    odr_setbuf(dec, wrbuf_buf(msg), wrbuf_len(msg), 0);
+    ret = z_GDU(dec, &gdu, 0, 0)
+        && gdu->u.HTTP_Request->content_len == (int) strlen(body);
+    wrbuf_destroy(msg);
+    odr_destroy(dec);
+    odr_destroy(o);
+    return ret;
+}
+
+static void tst_max_content(void)
+{
+    WRBUF w = wrbuf_alloc();
+    const char *body;
+    int i;
+
+    /* compresses very well: 1 MB of the same byte */
+    for (i = 0; i < 1024 * 1024; i++)
+        wrbuf_putc(w, 'x');
+    body = wrbuf_cstr(w);
+    YAZ_CHECK(decode_gzip_request(0, body));
+    YAZ_CHECK(decode_gzip_request(1024 * 1024, body));
+    YAZ_CHECK(!decode_gzip_request(1024 * 1024 - 1, body));
+    YAZ_CHECK(!decode_gzip_request(10000, body));
+    wrbuf_destroy(w);
+}
+#endif
+
+static void tst_identity(void)
+{
+    ODR o = odr_createmem(ODR_ENCODE);
+    WRBUF w = wrbuf_alloc();
+    const char *body = mk_body(w);
+    Z_HTTP_Response *hres = mk_response(o, body);
+
+    /* no Content-Encoding: body as is */
+    YAZ_CHECK(round_trip(hres, body));
+    wrbuf_destroy(w);
+    odr_destroy(o);
+}
+
+static Z_HTTP_Request *decode_request(ODR dec, const char *msg)
+{
+    Z_GDU *gdu = 0;
+
+    odr_reset(dec);
+    odr_setbuf(dec, (char *) msg, strlen(msg), 0);
+    if (z_GDU(dec, &gdu, 0, 0) && gdu->which == Z_GDU_HTTP_Request)
+        return gdu->u.HTTP_Request;
+    return 0;
+}
+
+static void tst_request_headers(void)
+{
+    ODR dec = odr_createmem(ODR_DECODE);
+    Z_HTTP_Request *r;
+
+    r = decode_request(dec, "POST /db HTTP/1.1\r\n"
+                       "Host: localhost:9999\r\n"
+                       "content-type: text/xml\r\n"
+                       "X-Custom:   value\r\n"
+                       "TRANSFER-ENCODING: chunked\r\n"
+                       "\r\n"
+                       "4;ext=1\r\nabcd\r\n"
+                       "A\r\n0123456789\r\n"
+                       "0\r\n\r\n");
+    YAZ_CHECK(r);
+    if (r)
+    {
+        const char *v;
+
+        YAZ_CHECK(!strcmp(r->method, "POST"));
+        YAZ_CHECK(!strcmp(r->path, "/db"));
+        v = z_HTTP_header_lookup(r->headers, "Host");
+        YAZ_CHECK(v && !strcmp(v, "localhost:9999"));
+        v = z_HTTP_header_lookup(r->headers, "Content-Type");
+        YAZ_CHECK(v && !strcmp(v, "text/xml"));
+        v = z_HTTP_header_lookup(r->headers, "content-type");
+        YAZ_CHECK(v && !strcmp(v, "text/xml"));
+        v = z_HTTP_header_lookup(r->headers, "X-Custom");
+        YAZ_CHECK(v && !strcmp(v, "value"));
+        YAZ_CHECK(!z_HTTP_header_lookup(r->headers, "Connection"));
+        YAZ_CHECK_EQ(r->content_len, 14);
+        YAZ_CHECK(r->content_buf
+                  && !strcmp(r->content_buf, "abcd0123456789"));
+    }
+
+    r = decode_request(dec, "GET / HTTP/1.0\n"
+                       "Host: a\n"
+                       "\n");
+    YAZ_CHECK(r);
+    if (r)
+    {
+        const char *v = z_HTTP_header_lookup(r->headers, "Host");
+        YAZ_CHECK(v && !strcmp(v, "a"));
+        YAZ_CHECK_EQ(r->content_len, 0);
+        YAZ_CHECK(!r->content_buf);
+    }
+
+    /* chunk longer than the message */
+    YAZ_CHECK(!decode_request(dec, "POST / HTTP/1.1\r\n"
+                              "Transfer-Encoding: chunked\r\n"
+                              "\r\n"
+                              "ff\r\nabc\r\n0\r\n\r\n"));
+    /* chunk extension ends at CRLF, not at CR or LF alone */
+    r = decode_request(dec, "POST / HTTP/1.1\r\n"
+                       "Transfer-Encoding: chunked\r\n"
+                       "\r\n"
+                       "4;a=\"b\rc\n\"\r\nabcd\r\n0\r\n\r\n");
+    YAZ_CHECK(r && r->content_len == 4 && r->content_buf
+              && !strcmp(r->content_buf, "abcd"));
+    /* chunk extension without CRLF */
+    YAZ_CHECK(!decode_request(dec, "POST / HTTP/1.1\r\n"
+                              "Transfer-Encoding: chunked\r\n"
+                              "\r\n"
+                              "4;aaaa"));
+    /* header without colon */
+    YAZ_CHECK(!decode_request(dec, "GET / HTTP/1.1\r\n"
+                              "Host\r\n"
+                              "\r\n"));
+    odr_destroy(dec);
+}
+
+int main(int argc, char **argv)
+{
+    YAZ_CHECK_INIT(argc, argv);
+    YAZ_CHECK_LOG();
+    tst_identity();
+    tst_request_headers();
+#if HAVE_ZLIB
+    tst_accept();
+    tst_small_body();
+    tst_raw_deflate();
+    tst_chunked_gzip();
+    tst_max_content();
+#else
+    YAZ_CHECK(!strcmp(compressed_with("gzip"), "none"));
+#endif
+    YAZ_CHECK_TERM;
+}
+
+/*
+ * Local variables:
+ * c-basic-offset: 4
+ * c-file-style: "Stroustrup"
+ * indent-tabs-mode: nil
+ * End:
+ * vim: shiftwidth=4 tabstop=8 expandtab
+ */
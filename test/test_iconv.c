@@ -703,6 +703,52 @@ static void tst_danmarc_to_latin1(void)
 }
 
 
+static void tst_pool(void)
+{
+    char outbuf[20];
+    char *inbuf = "\xea";
+    char *outp = outbuf;
+    size_t inbytesleft = 1;
+    size_t outbytesleft = sizeof(outbuf);
+    yaz_iconv_t cd1, cd2;
+
+    cd1 = yaz_iconv_pool_get("ISO-8859-1", "MARC8");
+    YAZ_CHECK(cd1);
+    if (!cd1)
+        return;
+    /* leave converter in the middle of a combining sequence */
+    yaz_iconv(cd1, &inbuf, &inbytesleft, &outp, &outbytesleft);
+    yaz_iconv_pool_put(cd1);
+
+    cd2 = yaz_iconv_pool_get("UTF-8", "MARC8");
+    YAZ_CHECK(cd2 && cd2 != cd1);
+    yaz_iconv_pool_put(cd2);
+
+    cd2 = yaz_iconv_pool_get("ISO-8859-1", "MARC8");
+    YAZ_CHECK(cd2 == cd1);
+    YAZ_CHECK(tst_convert(cd2, "ax", "ax"));
+    YAZ_CHECK(tst_convert(cd2, "eneb\xb5r", "eneb\346r"));
+    yaz_iconv_pool_put(cd2);
+
+    /* system iconv */
+    cd1 = yaz_iconv_pool_get("UTF-8", "@ISO-8859-1");
+    if (cd1)
+    {
+        YAZ_CHECK(tst_convert(cd1, "\xe5", "\xc3\xa5"));
+        yaz_iconv_pool_put(cd1);
+        cd2 = yaz_iconv_pool_get("UTF-8", "@ISO-8859-1");
+        YAZ_CHECK(cd2 == cd1);
+        YAZ_CHECK(tst_convert(cd2, "\xd8", "\xc3\x98"));
+        yaz_iconv_pool_put(cd2);
+    }
+
+    YAZ_CHECK(yaz_iconv_pool_get("UTF-8", "no-such-charset") == 0);
+    yaz_iconv_pool_put(0);
+    /* converter not from pool is closed */
+    yaz_iconv_pool_put(yaz_iconv_open("UTF-8", "MARC8"));
+    yaz_iconv_pool_cleanup();
+}
+
 int main (int argc, char **argv)
 {
     YAZ_CHECK_INIT(argc, argv);
@@ -735,6 +781,8 @@ int main (int argc, char **argv)
     dconvert(1, "UCS4LE");
     dconvert(0, "CP865");
 
+    tst_pool();
+
     YAZ_CHECK_TERM;
 }
 /*
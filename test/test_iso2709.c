@@ -0,0 +1,162 @@
+/* This file is part of the YAZ toolkit.
+ * Copyright (C) 1995-2013 Index Data
+ * See the file LICENSE for details.
+ */
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <yaz/marcdisp.h>
+#include <yaz/wrbuf.h>
+#include <yaz/test.h>
+
+/* builds record in mt; data holds a control character that is not
+   a delimiter and a subfield that spans many machine words */
+static void mk_record(yaz_marc_t mt)
+{
+    int indicator_length, identifier_length, base_address;
+    int length_data_entry, length_starting, length_implementation;
+    char long_data[300];
+    int i;
+
+    for (i = 0; i < (int) sizeof(long_data) - 1; i++)
+        long_data[i] = 'a' + i % 26;
+    long_data[i] = '\0';
+
+    yaz_marc_reset(mt);
+    yaz_marc_set_leader(mt, "00000nam  2200000   4500",
+                        &indicator_length, &identifier_length,
+                        &base_address, &length_data_entry,
+                        &length_starting, &length_implementation);
+    yaz_marc_add_controlfield(mt, "001", "   11224466 ", 12);
+    yaz_marc_add_controlfield(mt, "008", "x\034y", 3);
+    yaz_marc_add_datafield(mt, "245", "10", 2);
+    yaz_marc_add_subfield(mt, "aThe title", 10);
+    yaz_marc_add_subfield(mt, "b", 1);
+    yaz_marc_add_subfield(mt, "c\033(B\034", 5);
+    yaz_marc_add_datafield(mt, "520", "  ", 2);
+    yaz_marc_add_subfield(mt, long_data, strlen(long_data));
+}
+
+static void tst_split(void)
+{
+    yaz_marc_t mt = yaz_marc_create();
+    WRBUF rec = wrbuf_alloc();
+    WRBUF buf = wrbuf_alloc();
+    int len;
+
+    mk_record(mt);
+    YAZ_CHECK_EQ(yaz_marc_write_iso2709(mt, rec), 0);
+    len = wrbuf_len(rec);
+
+    wrbuf_write(buf, wrbuf_buf(rec), len);
+    wrbuf_write(buf, wrbuf_buf(rec), len);
+    YAZ_CHECK_EQ(yaz_marc_iso2709_split(wrbuf_buf(buf), 2 * len), len);
+    YAZ_CHECK_EQ(yaz_marc_iso2709_split(wrbuf_buf(buf) + len, len), len);
+    YAZ_CHECK_EQ(yaz_marc_iso2709_split(wrbuf_buf(buf), len - 1), 0);
+    YAZ_CHECK_EQ(yaz_marc_iso2709_split(wrbuf_buf(buf), 4), 0);
+    YAZ_CHECK_EQ(yaz_marc_iso2709_split("0012x", 5), -1);
+    YAZ_CHECK_EQ(yaz_marc_iso2709_split("00010", 5), -1);
+
+    /* record length in leader too small: continue to next RS */
+    memcpy(wrbuf_buf(buf), "00030", 5);
+    YAZ_CHECK_EQ(yaz_marc_iso2709_split(wrbuf_buf(buf), 2 * len), len);
+
+    wrbuf_destroy(buf);
+    wrbuf_destroy(rec);
+    yaz_marc_destroy(mt);
+}
+
+static void tst_read(void)
+{
+    yaz_marc_t mt = yaz_marc_create();
+    WRBUF rec = wrbuf_alloc();
+    WRBUF copy = wrbuf_alloc();
+    WRBUF got = wrbuf_alloc();
+
+    mk_record(mt);
+    YAZ_CHECK_EQ(yaz_marc_write_iso2709(mt, rec), 0);
+
+    /* read and write again gives identical record */
+    YAZ_CHECK_EQ(yaz_marc_read_iso2709(mt, wrbuf_buf(rec), wrbuf_len(rec)),
+                 (int) wrbuf_len(rec));
+    YAZ_CHECK_EQ(yaz_marc_write_iso2709(mt, copy), 0);
+    YAZ_CHECK(!strcmp(wrbuf_cstr(rec), wrbuf_cstr(copy)));
+
+    /* bad digits in directory stops the scan with a comment */
+    wrbuf_buf(rec)[24 + 12 + 4] = 'x';
+    YAZ_CHECK_EQ(yaz_marc_read_iso2709(mt, wrbuf_buf(rec), wrbuf_len(rec)),
+                 (int) wrbuf_len(rec));
+    wrbuf_rewind(got);
+    yaz_marc_write_line(mt, got);
+    YAZ_CHECK(strstr(wrbuf_cstr(got), "Directory offset 36: Bad value"));
+    YAZ_CHECK(strstr(wrbuf_cstr(got), "001    11224466 "));
+    YAZ_CHECK(!strstr(wrbuf_cstr(got), "245"));
+
+    YAZ_CHECK_EQ(yaz_marc_read_iso2709(mt, "0002x", 5), -1);
+
+    wrbuf_destroy(got);
+    wrbuf_destroy(copy);
+    wrbuf_destroy(rec);
+    yaz_marc_destroy(mt);
+}
+
+/* output is the same whether input is copied or referenced */
+static void tst_reference_input(void)
+{
+    yaz_marc_t mt = yaz_marc_create();
+    WRBUF rec = wrbuf_alloc();
+    WRBUF copy = wrbuf_alloc();
+    WRBUF ref = wrbuf_alloc();
+    static const int modes[] = {
+        YAZ_MARC_LINE, YAZ_MARC_MARCXML, YAZ_MARC_ISO2709, YAZ_MARC_XCHANGE,
+        YAZ_MARC_TURBOMARC
+    };
+    size_t i;
+
+    mk_record(mt);
+    YAZ_CHECK_EQ(yaz_marc_write_iso2709(mt, rec), 0);
+    for (i = 0; i < sizeof(modes) / sizeof(*modes); i++)
+    {
+        yaz_marc_xml(mt, modes[i]);
+        wrbuf_rewind(copy);
+        wrbuf_rewind(ref);
+
+        yaz_marc_reference_input(mt, 0);
+        YAZ_CHECK(yaz_marc_decode_wrbuf(mt, wrbuf_buf(rec), wrbuf_len(rec),
+                                        copy) > 0);
+        yaz_marc_reference_input(mt, 1);
+        YAZ_CHECK(yaz_marc_decode_wrbuf(mt, wrbuf_buf(rec), wrbuf_len(rec),
+                                        ref) > 0);
+        YAZ_CHECK(wrbuf_len(ref) > 0);
+        YAZ_CHECK(wrbuf_len(copy) == wrbuf_len(ref)
+                  && !memcmp(wrbuf_buf(copy), wrbuf_buf(ref),
+                             wrbuf_len(ref)));
+    }
+    wrbuf_destroy(ref);
+    wrbuf_destroy(copy);
+    wrbuf_destroy(rec);
+    yaz_marc_destroy(mt);
+}
+
+int main(int argc, char **argv)
+{
+    YAZ_CHECK_INIT(argc, argv);
+    YAZ_CHECK_LOG();
+    tst_split();
+    tst_read();
+    tst_reference_input();
+    YAZ_CHECK_TERM;
+}
+
+/*
+ * Local variables:
+ * c-basic-offset: 4
+ * c-file-style: "Stroustrup"
+ * indent-tabs-mode: nil
+ * End:
+ * vim: shiftwidth=4 tabstop=8 expandtab
+ */
@@ -0,0 +1,105 @@
+/* This file is part of the YAZ toolkit.
+ * Copyright (C) 1995-2013 Index Data
+ * See the file LICENSE for details.
+ */
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <yaz/test.h>
+#include "metrics.h"
+
+/* returns 1 if line occurs as a whole line in text */
+static int has_line(const char *text, const char *line)
+{
+    size_t len = strlen(line);
+    const char *cp = text;
+
+    while ((cp = strstr(cp, line)))
+    {
+        if ((cp == text || cp[-1] == '\n') && cp[len] == '\n')
+            return 1;
+        cp++;
+    }
+    return 0;
+}
+
+static void tst_is_path(void)
+{
+    YAZ_CHECK(gfs_metrics_is_path("/metrics", "/metrics"));
+    YAZ_CHECK(gfs_metrics_is_path("/metrics", "/metrics?x=1"));
+    YAZ_CHECK(!gfs_metrics_is_path("/metrics", "/metricsx"));
+    YAZ_CHECK(!gfs_metrics_is_path("/metrics", "/metrics/x"));
+    YAZ_CHECK(!gfs_metrics_is_path("/metrics", "/metric"));
+    YAZ_CHECK(!gfs_metrics_is_path("/metrics", "/"));
+}
+
+static void tst_write(void)
+{
+    WRBUF w = wrbuf_alloc();
+    const char *t;
+
+    gfs_metrics_request(GFS_METRICS_SEARCH, 0.003, 100, 200);
+    gfs_metrics_request(GFS_METRICS_SEARCH, 20.0, 10, 20);
+    gfs_metrics_request(GFS_METRICS_OP_MAX, 1.0, 1000, 1000); /* ignored */
+    gfs_metrics_backend(GFS_METRICS_BEND_FETCH, 0.5);
+    gfs_metrics_association(1);
+    gfs_metrics_association(1);
+    gfs_metrics_association(-1);
+    gfs_metrics_write(w);
+    t = wrbuf_cstr(w);
+
+    YAZ_CHECK(has_line(t, "# TYPE yaz_gfs_request_duration_seconds "
+                       "histogram"));
+    YAZ_CHECK(has_line(t, "yaz_gfs_request_duration_seconds_bucket"
+                       "{type=\"search\",le=\"0.0025\"} 0"));
+    YAZ_CHECK(has_line(t, "yaz_gfs_request_duration_seconds_bucket"
+                       "{type=\"search\",le=\"0.005\"} 1"));
+    YAZ_CHECK(has_line(t, "yaz_gfs_request_duration_seconds_bucket"
+                       "{type=\"search\",le=\"10\"} 1"));
+    YAZ_CHECK(has_line(t, "yaz_gfs_request_duration_seconds_bucket"
+                       "{type=\"search\",le=\"+Inf\"} 2"));
+    YAZ_CHECK(has_line(t, "yaz_gfs_request_duration_seconds_sum"
+                       "{type=\"search\"} 20.003000"));
+    YAZ_CHECK(has_line(t, "yaz_gfs_request_duration_seconds_count"
+                       "{type=\"search\"} 2"));
+    /* types without requests are left out */
+    YAZ_CHECK(!strstr(t, "type=\"present\""));
+
+    YAZ_CHECK(has_line(t, "yaz_gfs_backend_duration_seconds_bucket"
+                       "{call=\"fetch\",le=\"0.25\"} 0"));
+    YAZ_CHECK(has_line(t, "yaz_gfs_backend_duration_seconds_bucket"
+                       "{call=\"fetch\",le=\"0.5\"} 1"));
+    YAZ_CHECK(has_line(t, "yaz_gfs_backend_duration_seconds_count"
+                       "{call=\"fetch\"} 1"));
+    YAZ_CHECK(!strstr(t, "call=\"search\""));
+
+    YAZ_CHECK(has_line(t, "# TYPE yaz_gfs_received_bytes_total counter"));
+    YAZ_CHECK(has_line(t, "yaz_gfs_received_bytes_total 110"));
+    YAZ_CHECK(has_line(t, "yaz_gfs_sent_bytes_total 220"));
+    YAZ_CHECK(has_line(t, "# TYPE yaz_gfs_associations gauge"));
+    YAZ_CHECK(has_line(t, "yaz_gfs_associations 1"));
+    YAZ_CHECK(has_line(t, "yaz_gfs_associations_total 2"));
+    wrbuf_destroy(w);
+}
+
+int main(int argc, char **argv)
+{
+    YAZ_CHECK_INIT(argc, argv);
+    YAZ_CHECK_LOG();
+    tst_is_path();
+    tst_write();
+    YAZ_CHECK_TERM;
+}
+
+/*
+ * Local variables:
+ * c-basic-offset: 4
+ * c-file-style: "Stroustrup"
+ * indent-tabs-mode: nil
+ * End:
+ * vim: shiftwidth=4 tabstop=8 expandtab
+ */
@@ -118,12 +118,53 @@ void tst_nmem_strsplit(void)
     nmem_destroy(nmem);
 }
 
+void tst_nmem_account(void)
+{
+    nmem_account_t a = nmem_account_create();
+    NMEM n1 = nmem_create();
+    NMEM n2 = nmem_create();
+    size_t sz;
+
+    YAZ_CHECK(nmem_account_current(a) == 0);
+    nmem_malloc(n1, 10);
+    nmem_set_account(n1, a);
+    YAZ_CHECK(nmem_get_account(n1) == a);
+    sz = nmem_account_current(a);
+    YAZ_CHECK(sz >= 10);
+
+    nmem_malloc(n1, 20000);
+    YAZ_CHECK(nmem_account_current(a) >= sz + 20000);
+    sz = nmem_account_current(a);
+
+    /* moving blocks out of the account */
+    nmem_transfer(n2, n1);
+    YAZ_CHECK(nmem_account_current(a) == 0);
+    YAZ_CHECK(nmem_account_peak(a) == sz);
+    nmem_set_account(n2, a);
+    YAZ_CHECK(nmem_account_current(a) == sz);
+    nmem_reset(n2);
+    YAZ_CHECK(nmem_account_current(a) == 0);
+
+    nmem_account_add(a, 100);
+    nmem_account_sub(a, 40);
+    YAZ_CHECK(nmem_account_current(a) == 60);
+    nmem_account_sub(a, 60);
+
+    /* account outlives its creator while handles are charged to it */
+    nmem_malloc(n1, 30);
+    nmem_account_destroy(a);
+    YAZ_CHECK(nmem_account_current(nmem_get_account(n1)) > 0);
+    nmem_destroy(n1);
+    nmem_destroy(n2);
+}
+
 int main (int argc, char **argv)
 {
     YAZ_CHECK_INIT(argc, argv);
     YAZ_CHECK_LOG();
     tst_nmem_malloc();
     tst_nmem_strsplit();
+    tst_nmem_account();
     YAZ_CHECK_TERM;
 }
 /*
@@ -7,6 +7,7 @@
 #endif
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <yaz/oid_util.h>
 #include "test_odrcodec.h"
 
@@ -314,6 +315,117 @@ static void tst_berint64(ODR encode, ODR decode)
 #endif
 }
 
+void tst_MySequence_clone(ODR encode)
+{
+    NMEM nmem = nmem_create();
+    Yc_MySequence *s = (Yc_MySequence *) odr_malloc(encode, sizeof(*s));
+    Yc_MySequence *t;
+    char *buf_s, *buf_t;
+    int len_s, len_t;
+
+    s->first = odr_intdup(encode, 12345);
+    s->second = (Odr_oct *) odr_malloc(encode, sizeof(*s->second));
+    s->second->buf = (unsigned char *) "hello";
+    s->second->len = 5;
+    s->second->size = 0;
+    s->third = odr_booldup(encode, 0);
+    s->fourth = odr_nullval();
+    s->fifth = odr_intdup(encode, YC_MySequence_enum2);
+    s->myoid = odr_getoidbystr(encode, MYOID);
+
+    YAZ_CHECK(yaz_clone_yc_MySequence(0, nmem) == 0);
+    t = yaz_clone_yc_MySequence(s, nmem);
+    YAZ_CHECK(t && t != s);
+    if (!t)
+    {
+        nmem_destroy(nmem);
+        return;
+    }
+    YAZ_CHECK(t->first && t->first != s->first && *t->first == 12345);
+    YAZ_CHECK(t->second && t->second != s->second
+              && t->second->buf != s->second->buf && t->second->len == 5
+              && memcmp(t->second->buf, "hello", 5) == 0);
+    YAZ_CHECK(t->third && t->third != s->third && *t->third == 0);
+    YAZ_CHECK(t->fourth);
+    YAZ_CHECK(t->fifth && *t->fifth == YC_MySequence_enum2);
+    YAZ_CHECK(t->myoid && t->myoid != s->myoid
+              && oid_oidcmp(t->myoid, s->myoid) == 0);
+
+    /* clone must encode to the same BER as the original */
+    YAZ_CHECK(yc_MySequence(encode, &s, 0, 0));
+    buf_s = odr_getbuf(encode, &len_s, 0);
+    buf_s = nmem_strdupn(nmem, buf_s, len_s);
+    odr_reset(encode);
+    YAZ_CHECK(yc_MySequence(encode, &t, 0, 0));
+    buf_t = odr_getbuf(encode, &len_t, 0);
+    YAZ_CHECK(len_s == len_t && memcmp(buf_s, buf_t, len_s) == 0);
+    odr_reset(encode);
+    nmem_destroy(nmem);
+}
+
+/* fills arm with a CHOICE of implicitly tagged INTEGERs: which i
+   has context tag tag0 + i */
+static void mk_choice(Odr_arm *arm, int num, int tag0)
+{
+    int i;
+
+    for (i = 0; i < num; i++)
+    {
+        arm[i].tagmode = ODR_IMPLICIT;
+        arm[i].zclass = ODR_CONTEXT;
+        arm[i].tag = tag0 + i;
+        arm[i].which = i;
+        arm[i].fun = (Odr_fun) odr_integer;
+        arm[i].name = 0;
+    }
+    arm[i].tagmode = arm[i].zclass = arm[i].tag = arm[i].which = -1;
+    arm[i].fun = 0;
+    arm[i].name = 0;
+}
+
+/* returns tag of CHOICE which (encoded with arm) and checks that it
+   decodes to the same; -1 on error */
+static int choice_tag(ODR encode, ODR decode, Odr_arm *arm, int which)
+{
+    Odr_int v = 42;
+    Odr_int *vp = &v;
+    Odr_int *dp = 0;
+    int w = which, len, tag = -1;
+    char *buf;
+
+    odr_reset(encode);
+    odr_reset(decode);
+    if (odr_choice(encode, arm, &vp, &w, 0))
+    {
+        buf = odr_getbuf(encode, &len, 0);
+        odr_setbuf(decode, buf, len, 0);
+        if (odr_choice(decode, arm, &dp, &w, 0) && w == which
+            && dp && *dp == 42)
+            tag = buf[0] & 0x1f;
+    }
+    return tag;
+}
+
+/* a table at an address where another one was (heap, stack) must not
+   use what was cached for the previous one */
+static void tst_choice_reuse(ODR encode, ODR decode)
+{
+    Odr_arm *arm = (Odr_arm *) xmalloc(11 * sizeof(*arm));
+
+    mk_choice(arm, 10, 0);
+    YAZ_CHECK_EQ(choice_tag(encode, decode, arm, 2), 2);
+    YAZ_CHECK_EQ(choice_tag(encode, decode, arm, 9), 9);
+
+    mk_choice(arm, 10, 20);
+    YAZ_CHECK_EQ(choice_tag(encode, decode, arm, 2), 22);
+    YAZ_CHECK_EQ(choice_tag(encode, decode, arm, 9), 29);
+
+    mk_choice(arm, 7, 0); /* shorter table */
+    YAZ_CHECK_EQ(choice_tag(encode, decode, arm, 6), 6);
+    YAZ_CHECK_EQ(choice_tag(encode, decode, arm, 9), -1);
+    xfree(arm);
+}
+
 static void tst(void)
 {
     ODR odr_encode = odr_createmem(ODR_ENCODE);
@@ -325,9 +437,11 @@ static void tst(void)
     tst_MySequence1(odr_encode, odr_decode);
     tst_MySequence2(odr_encode, odr_decode);
     tst_MySequence3(odr_encode, odr_decode);
+    tst_MySequence_clone(odr_encode);
 
     tst_berint32(odr_encode, odr_decode);
     tst_berint64(odr_encode, odr_decode);
+    tst_choice_reuse(odr_encode, odr_decode);
 
     odr_destroy(odr_encode);
     odr_destroy(odr_decode);
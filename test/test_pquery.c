@@ -13,6 +13,7 @@
 #include <yaz/wrbuf.h>
 #include <yaz/querytowrbuf.h>
 #include <yaz/pquery.h>
+#include <yaz/copy_types.h>
 #include <yaz/test.h>
 
 int expect_pqf(const char *pqf, const char *expect_pqf, int expect_error)
@@ -49,7 +50,16 @@ int expect_pqf(const char *pqf, const char *expect_pqf, int expect_error)
 
             if (!strcmp(wrbuf_cstr(wrbuf), expect_pqf))
             {
-                res = 1;
+                /* deep copy must survive the original */
+                NMEM nmem = nmem_create();
+                Z_RPNQuery *copy = yaz_clone_z_RPNQuery(rpn, nmem);
+
+                odr_reset(odr);
+                wrbuf_rewind(wrbuf);
+                yaz_rpnquery_to_wrbuf(wrbuf, copy);
+                if (!strcmp(wrbuf_cstr(wrbuf), expect_pqf))
+                    res = 1;
+                nmem_destroy(nmem);
             }
             wrbuf_destroy(wrbuf);
         }
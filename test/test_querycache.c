@@ -0,0 +1,174 @@
+/* This file is part of the YAZ toolkit.
+ * Copyright (C) 1995-2013 Index Data
+ * See the file LICENSE for details.
+ */
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <yaz/test.h>
+#include <yaz/pquery.h>
+#include "querycache.h"
+
+static const char *t1 = "transform 1";
+static const char *t2 = "transform 2";
+
+static void add_pqf(query_cache_t qc, const void *transform,
+                    const char *query, const char *pqf)
+{
+    ODR odr = odr_createmem(ODR_ENCODE);
+    struct query_cache_result res;
+
+    res.rpn = p_query_rpn(odr, pqf);
+    res.sortkeys = 0;
+    res.errcode = 0;
+    res.errstring = 0;
+    query_cache_add(qc, transform, query, &res);
+    odr_destroy(odr);
+}
+
+/* returns 1 if query is cached with RPN of pqf */
+static int lookup_pqf(query_cache_t qc, const void *transform,
+                      const char *query, const char *pqf)
+{
+    ODR odr = odr_createmem(ODR_ENCODE);
+    struct query_cache_result res;
+    int ret = 0;
+
+    if (query_cache_lookup(qc, transform, query, odr, &res) && res.rpn)
+    {
+        Z_RPNQuery *expect = p_query_rpn(odr, pqf);
+        char *buf1, *buf2;
+        int len1, len2;
+
+        z_RPNQuery(odr, &res.rpn, 0, 0);
+        buf1 = odr_getbuf(odr, &len1, 0);
+        buf1 = odr_strdupn(odr, buf1, len1);
+        odr_reset(odr);
+        z_RPNQuery(odr, &expect, 0, 0);
+        buf2 = odr_getbuf(odr, &len2, 0);
+        if (len1 == len2 && !memcmp(buf1, buf2, len1))
+            ret = 1;
+    }
+    odr_destroy(odr);
+    return ret;
+}
+
+static int cached(query_cache_t qc, const void *transform, const char *query)
+{
+    ODR odr = odr_createmem(ODR_ENCODE);
+    struct query_cache_result res;
+    int ret = query_cache_lookup(qc, transform, query, odr, &res);
+
+    odr_destroy(odr);
+    return ret;
+}
+
+static void tst_eviction(void)
+{
+    query_cache_t qc = query_cache_create(2);
+    long hits, misses;
+    int entries;
+
+    YAZ_CHECK(qc);
+    add_pqf(qc, t1, "a", "@attr 1=4 a");
+    add_pqf(qc, t1, "b", "@attr 1=4 b");
+    YAZ_CHECK(lookup_pqf(qc, t1, "a", "@attr 1=4 a")); /* a most recent */
+    add_pqf(qc, t1, "c", "@attr 1=4 c");  /* evicts b */
+    YAZ_CHECK(!cached(qc, t1, "b"));
+    YAZ_CHECK(lookup_pqf(qc, t1, "c", "@attr 1=4 c"));
+    YAZ_CHECK(lookup_pqf(qc, t1, "a", "@attr 1=4 a"));
+    add_pqf(qc, t1, "d", "@attr 1=4 d");  /* evicts c */
+    YAZ_CHECK(!cached(qc, t1, "c"));
+    YAZ_CHECK(cached(qc, t1, "a"));
+    YAZ_CHECK(cached(qc, t1, "d"));
+
+    query_cache_stat(qc, &hits, &misses, &entries);
+    YAZ_CHECK_EQ(hits, 5);
+    YAZ_CHECK_EQ(misses, 2);
+    YAZ_CHECK_EQ(entries, 2);
+    query_cache_destroy(qc);
+}
+
+static void tst_transform(void)
+{
+    query_cache_t qc = query_cache_create(10);
+    ODR odr = odr_createmem(ODR_ENCODE);
+    struct query_cache_result res;
+
+    add_pqf(qc, t1, "a", "@attr 1=4 a");
+    YAZ_CHECK(!cached(qc, t2, "a"));
+
+    res.rpn = 0;  /* failed translation for other transform */
+    res.sortkeys = 0;
+    res.errcode = 16;
+    res.errstring = "a";
+    query_cache_add(qc, t2, "a", &res);
+
+    YAZ_CHECK(lookup_pqf(qc, t1, "a", "@attr 1=4 a"));
+    memset(&res, 0, sizeof(res));
+    YAZ_CHECK(query_cache_lookup(qc, t2, "a", odr, &res));
+    YAZ_CHECK(res.rpn == 0);
+    YAZ_CHECK_EQ(res.errcode, 16);
+    YAZ_CHECK(res.errstring && !strcmp(res.errstring, "a"));
+    odr_destroy(odr);
+    query_cache_destroy(qc);
+}
+
+static void tst_encode_failure(void)
+{
+    query_cache_t qc = query_cache_create(10);
+    ODR odr = odr_createmem(ODR_ENCODE);
+    struct query_cache_result res;
+    long hits, misses;
+    int entries;
+
+    res.rpn = p_query_rpn(odr, "a");
+    res.rpn->RPNStructure->which = 99;  /* can not be encoded */
+    res.sortkeys = "title";
+    res.errcode = 0;
+    res.errstring = "x";
+    query_cache_add(qc, t1, "bad", &res);
+    YAZ_CHECK(!cached(qc, t1, "bad"));
+    query_cache_stat(qc, &hits, &misses, &entries);
+    YAZ_CHECK_EQ(entries, 0);
+
+    /* a cache is still usable */
+    add_pqf(qc, t1, "a", "a");
+    YAZ_CHECK(lookup_pqf(qc, t1, "a", "a"));
+    odr_destroy(odr);
+    query_cache_destroy(qc);
+}
+
+static void tst_disabled(void)
+{
+    query_cache_t qc = query_cache_create(0);
+
+    YAZ_CHECK(!qc);
+    add_pqf(qc, t1, "a", "a");
+    YAZ_CHECK(!cached(qc, t1, "a"));
+    query_cache_destroy(qc);
+}
+
+int main(int argc, char **argv)
+{
+    YAZ_CHECK_INIT(argc, argv);
+    YAZ_CHECK_LOG();
+    tst_eviction();
+    tst_transform();
+    tst_encode_failure();
+    tst_disabled();
+    YAZ_CHECK_TERM;
+}
+
+/*
+ * Local variables:
+ * c-basic-offset: 4
+ * c-file-style: "Stroustrup"
+ * indent-tabs-mode: nil
+ * End:
+ * vim: shiftwidth=4 tabstop=8 expandtab
+ */
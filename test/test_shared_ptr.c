@@ -18,6 +18,9 @@
 
 #include <yaz/shptr.h>
 #include <yaz/wrbuf.h>
+#include <yaz/thread_create.h>
+#include <yaz/timing.h>
+#include <yaz/log.h>
 #include <yaz/test.h>
 
 YAZ_SHPTR_TYPE(WRBUF)
@@ -41,10 +44,57 @@ static void test(void)
     YAZ_CHECK(!t);
 }
 
+#define BENCH_THREADS 4
+#define BENCH_ROUNDS 200000
+
+static WRBUF_shptr_t bench_ptr = 0;
+
+static void *bench_handler(void *arg)
+{
+    int i;
+    for (i = 0; i < BENCH_ROUNDS; i++)
+    {
+        /* copy is never the last reference, so never destroyed here */
+        WRBUF_shptr_t p = bench_ptr;
+        YAZ_SHPTR_INC(p);
+        YAZ_SHPTR_DEC(p, wrbuf_destroy);
+    }
+    return arg;
+}
+
+/* INC/DEC pairs from several threads on one shared pointer */
+static void bench_contention(void)
+{
+    yaz_thread_t t[BENCH_THREADS];
+    yaz_timing_t tm = yaz_timing_create();
+    int i;
+
+    YAZ_SHPTR_INIT(bench_ptr, wrbuf_alloc());
+    for (i = 0; i < BENCH_THREADS; i++)
+    {
+        t[i] = yaz_thread_create(bench_handler, 0);
+        YAZ_CHECK(t[i]);
+    }
+    for (i = 0; i < BENCH_THREADS; i++)
+        if (t[i])
+            yaz_thread_join(&t[i], 0);
+    yaz_timing_stop(tm);
+    YAZ_CHECK_EQ(bench_ptr->ref, 1);
+    yaz_log(YLOG_LOG, "shptr %s: %d threads x %d inc/dec in %.3f s",
+            YAZ_SHPTR_ATOMIC ? "atomic" : "mutex",
+            BENCH_THREADS, BENCH_ROUNDS, yaz_timing_get_real(tm));
+    yaz_timing_destroy(&tm);
+
+    YAZ_SHPTR_DEC(bench_ptr, wrbuf_destroy);
+    YAZ_CHECK(!bench_ptr);
+}
+
 int main (int argc, char **argv)
 {
     YAZ_CHECK_INIT(argc, argv);
+    YAZ_CHECK_LOG();
     test();
+    bench_contention();
     YAZ_CHECK_TERM;
 }
 
@@ -8,6 +8,7 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include <yaz/timing.h>
 #include <yaz/test.h>
@@ -53,12 +54,45 @@ static void tst(void)
     YAZ_CHECK(!t);
 }
 
+static void tst_spans(void)
+{
+    yaz_spans_t s = yaz_spans_create("prog");
+    WRBUF w = wrbuf_alloc();
+    double start;
+
+    YAZ_CHECK(s);
+    if (!s)
+        return;
+    start = yaz_spans_start(s);
+    YAZ_CHECK(start > 0.0);
+    yaz_spans_stop(s, "search", "decode", start);
+    yaz_spans_add(s, "search", "backend", 0.5);
+    yaz_spans_add(s, "search", "backend", 0.25);
+    yaz_spans_add(s, "present", "backend", 0.000002);
+
+    yaz_spans_write(s, w);
+    YAZ_CHECK(!strncmp(wrbuf_cstr(w), "prog;search;decode ", 19));
+    YAZ_CHECK(strstr(wrbuf_cstr(w), "\nprog;search;backend 750000\n"));
+    YAZ_CHECK(strstr(wrbuf_cstr(w), "\nprog;present;backend 2\n"));
+    yaz_spans_log(s, YLOG_LOG);
+
+    yaz_spans_destroy(&s);
+    YAZ_CHECK(!s);
+
+    /* disabled spans */
+    YAZ_CHECK(yaz_spans_start(s) == 0.0);
+    yaz_spans_stop(s, "search", "decode", 0.0);
+    yaz_spans_add(s, "search", "decode", 1.0);
+    wrbuf_destroy(w);
+}
+
 
 int main (int argc, char **argv)
 {
     YAZ_CHECK_INIT(argc, argv);
     YAZ_CHECK_LOG();
     tst();
+    tst_spans();
     YAZ_CHECK_TERM;
 }
 
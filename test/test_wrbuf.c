@@ -8,6 +8,7 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include <yaz/wrbuf.h>
 #include <yaz/test.h>
@@ -78,10 +79,64 @@ static void tstwrbuf(void)
     wrbuf_destroy(wr);
 }
 
+/* reference escaper: one character at a time */
+static void xmlputs_ref(WRBUF b, const char *cp, size_t size)
+{
+    for (; size; size--, cp++)
+    {
+        unsigned char ch = *cp;
+        if (ch < 32 && ch != 9 && ch != 10 && ch != 13)
+            continue;
+        if (ch == '<')
+            wrbuf_puts(b, "&lt;");
+        else if (ch == '>')
+            wrbuf_puts(b, "&gt;");
+        else if (ch == '&')
+            wrbuf_puts(b, "&amp;");
+        else if (ch == '"')
+            wrbuf_puts(b, "&quot;");
+        else if (ch == '\'')
+            wrbuf_puts(b, "&apos;");
+        else
+            wrbuf_putc(b, ch);
+    }
+}
+
+static void tst_xmlputs(void)
+{
+    WRBUF w1 = wrbuf_alloc();
+    WRBUF w2 = wrbuf_alloc();
+    char buf[40];
+    int ch, pos, errors = 0;
+
+    /* every byte value at every position of a clean string */
+    for (ch = 0; ch < 256; ch++)
+        for (pos = 0; pos < (int) sizeof(buf); pos++)
+        {
+            memset(buf, 'x', sizeof(buf));
+            buf[pos] = ch;
+            wrbuf_rewind(w1);
+            wrbuf_rewind(w2);
+            wrbuf_xmlputs_n(w1, buf, sizeof(buf));
+            xmlputs_ref(w2, buf, sizeof(buf));
+            if (strcmp(wrbuf_cstr(w1), wrbuf_cstr(w2)))
+                errors++;
+        }
+    YAZ_CHECK_EQ(errors, 0);
+
+    wrbuf_rewind(w1);
+    wrbuf_xmlputs(w1, "a<b>&\"c'\001\t d\344");
+    YAZ_CHECK(!strcmp(wrbuf_cstr(w1),
+                      "a&lt;b&gt;&amp;&quot;c&apos;\t d\344"));
+    wrbuf_destroy(w1);
+    wrbuf_destroy(w2);
+}
+
 int main (int argc, char **argv)
 {
     YAZ_CHECK_INIT(argc, argv);
     tstwrbuf();
+    tst_xmlputs();
     YAZ_CHECK_TERM;
 }
 
@@ -0,0 +1,183 @@
+/* This file is part of the YAZ toolkit.
+ * Copyright (C) 1995-2013 Index Data
+ * See the file LICENSE for details.
+ */
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#if HAVE_SYS_TYPES_H
+#include <sys/types.h>
+#endif
+#if HAVE_SYS_SOCKET_H
+#include <sys/socket.h>
+#endif
+#if HAVE_NETINET_IN_H
+#include <netinet/in.h>
+#endif
+#if HAVE_SYS_WAIT_H
+#include <sys/wait.h>
+#endif
+#if HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include <yaz/test.h>
+#include <yaz/comstack.h>
+#include <yaz/tcpip.h>
+#include <yaz/wrbuf.h>
+#include <yaz/xmalloc.h>
+#include <yaz/zoom.h>
+
+#if YAZ_HAVE_XML2 && HAVE_SYS_WAIT_H && HAVE_UNISTD_H && !defined(WIN32)
+/* returns value of SRU argument name in request line q; def if absent */
+static int sru_arg(const char *q, const char *name, int def)
+{
+    const char *eol = strchr(q, '\n');
+    size_t len = strlen(name);
+    const char *cp;
+
+    for (cp = q; (cp = strstr(cp, name)); cp++)
+    {
+        if (eol && cp > eol)
+            break;
+        if ((cp[-1] == '?' || cp[-1] == '&') && cp[len] == '=')
+            return atoi(cp + len + 1);
+    }
+    return def;
+}
+
+/* SRU server for one keep-alive connection on l. The result set has
+   hits records, but no response has more than page of them */
+static void sru_serve(COMSTACK l, int hits, int page)
+{
+    COMSTACK cs;
+    WRBUF req = wrbuf_alloc();
+    WRBUF body = wrbuf_alloc();
+    WRBUF res = wrbuf_alloc();
+    char *buf = 0;
+    int size = 0, r;
+
+    if (cs_listen(l, 0, 0) == 0 && (cs = cs_accept(l)))
+    {
+        while ((r = cs_get(cs, &buf, &size)) > 0)
+        {
+            int start, num, i;
+
+            wrbuf_rewind(req);
+            wrbuf_write(req, buf, r);
+            start = sru_arg(wrbuf_cstr(req), "startRecord", 1);
+            num = sru_arg(wrbuf_cstr(req), "maximumRecords", 0);
+            if (num > page)
+                num = page;
+            if (start - 1 + num > hits)
+                num = hits - start + 1;
+            wrbuf_rewind(body);
+            wrbuf_printf(body, "<?xml version=\"1.0\"?>\n"
+                         "<zs:searchRetrieveResponse xmlns:zs="
+                         "\"http://www.loc.gov/zing/srw/\">"
+                         "<zs:version>1.2</zs:version>"
+                         "<zs:numberOfRecords>%d</zs:numberOfRecords>"
+                         "<zs:records>", hits);
+            for (i = 0; i < num; i++)
+                wrbuf_printf(body, "<zs:record>"
+                             "<zs:recordSchema>test</zs:recordSchema>"
+                             "<zs:recordPacking>xml</zs:recordPacking>"
+                             "<zs:recordData><r>%d</r></zs:recordData>"
+                             "<zs:recordPosition>%d</zs:recordPosition>"
+                             "</zs:record>", start + i, start + i);
+            wrbuf_puts(body, "</zs:records></zs:searchRetrieveResponse>\n");
+            wrbuf_rewind(res);
+            wrbuf_printf(res, "HTTP/1.1 200 OK\r\n"
+                         "Content-Type: text/xml\r\n"
+                         "Content-Length: %d\r\n\r\n", (int) wrbuf_len(body));
+            wrbuf_write(res, wrbuf_buf(body), wrbuf_len(body));
+            if (cs_put(cs, wrbuf_buf(res), wrbuf_len(res)))
+                break;
+        }
+        cs_close(cs);
+    }
+    xfree(buf);
+    wrbuf_destroy(res);
+    wrbuf_destroy(body);
+    wrbuf_destroy(req);
+}
+
+/* pipelined SRU fetch against a server returning short pages: the
+   records missing from each page must be asked for again */
+static void tst_short_pages(void)
+{
+    COMSTACK l = cs_create(tcpip_type, 1, PROTO_HTTP);
+    struct sockaddr_storage sa;
+    socklen_t sa_len = sizeof(sa);
+    char host[80];
+    int i, port, cached = 0, hits = 20;
+    void *ip;
+    pid_t pid;
+    ZOOM_options o;
+    ZOOM_connection c;
+    ZOOM_resultset r;
+
+    YAZ_CHECK(l);
+    if (!l)
+        return;
+    ip = cs_straddr(l, "127.0.0.1:0");
+    YAZ_CHECK(ip && cs_bind(l, ip, CS_SERVER) == 0);
+    YAZ_CHECK(getsockname(cs_fileno(l), (struct sockaddr *) &sa,
+                          &sa_len) == 0);
+    port = ntohs(((struct sockaddr_in *) &sa)->sin_port);
+    sprintf(host, "http://127.0.0.1:%d/db", port);
+
+    pid = fork();
+    YAZ_CHECK(pid != -1);
+    if (pid == 0)
+    {
+        sru_serve(l, hits, 3);
+        _exit(0);
+    }
+    cs_close(l);
+
+    o = ZOOM_options_create();
+    ZOOM_options_set(o, "sru", "get");
+    ZOOM_options_set(o, "sru_version", "1.2");
+    ZOOM_options_set(o, "maxPipelined", "4");
+    ZOOM_options_set(o, "step", "5");
+    ZOOM_options_set_int(o, "count", hits);
+    c = ZOOM_connection_create(o);
+    ZOOM_connection_connect(c, host, 0);
+    r = ZOOM_connection_search_pqf(c, "x");
+    YAZ_CHECK_EQ(ZOOM_connection_error(c, 0, 0), 0);
+    YAZ_CHECK_EQ((int) ZOOM_resultset_size(r), hits);
+    for (i = 0; i < hits; i++)
+        if (ZOOM_resultset_record_immediate(r, i))
+            cached++;
+    YAZ_CHECK_EQ(cached, hits);
+    ZOOM_resultset_destroy(r);
+    ZOOM_connection_destroy(c);
+    ZOOM_options_destroy(o);
+    waitpid(pid, 0, 0);
+}
+#endif
+
+int main(int argc, char **argv)
+{
+    YAZ_CHECK_INIT(argc, argv);
+    YAZ_CHECK_LOG();
+#if YAZ_HAVE_XML2 && HAVE_SYS_WAIT_H && HAVE_UNISTD_H && !defined(WIN32)
+    tst_short_pages();
+#endif
+    YAZ_CHECK_TERM;
+}
+
+/*
+ * Local variables:
+ * c-basic-offset: 4
+ * c-file-style: "Stroustrup"
+ * indent-tabs-mode: nil
+ * End:
+ * vim: shiftwidth=4 tabstop=8 expandtab
+ */
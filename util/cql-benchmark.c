@@ -0,0 +1,159 @@
+/* This file is part of the YAZ toolkit.
+ * Copyright (C) 1995-2013 Index Data
+ * See the file LICENSE for details.
+ */
+/**
+ * \file cql-benchmark.c
+ * \brief CQL parser benchmark
+ *
+ * Parses the queries of a file, one per line (lines starting with #
+ * are skipped, as in test/cql2pqfsample), a number of times and reports
+ * the parse rate, once with cql_parser_string and once with
+ * cql_parser_stream reading the same strings through callbacks.
+ */
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <yaz/cql.h>
+#include <yaz/options.h>
+#include <yaz/timing.h>
+#include <yaz/xmalloc.h>
+
+struct str_stream {
+    const char *str;
+    int off;
+};
+
+static int getbyte_str(void *vp)
+{
+    struct str_stream *ss = (struct str_stream *) vp;
+    if (ss->str[ss->off] == 0)
+        return 0;
+    return ss->str[ss->off++];
+}
+
+static void ungetbyte_str(int b, void *vp)
+{
+    struct str_stream *ss = (struct str_stream *) vp;
+    if (b)
+        ss->off--;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage\n yaz-cql-benchmark [-n iterations] file\n");
+    exit(1);
+}
+
+static void bench(const char *name, char **queries, int num, long bytes,
+                  int iterations, int stream)
+{
+    CQL_parser cp = cql_parser_create();
+    yaz_timing_t t = yaz_timing_create();
+    long errors = 0;
+    double real;
+    int i, j;
+
+    for (i = 0; i < iterations; i++)
+        for (j = 0; j < num; j++)
+        {
+            int r;
+            if (stream)
+            {
+                struct str_stream ss;
+                ss.str = queries[j];
+                ss.off = 0;
+                r = cql_parser_stream(cp, getbyte_str, ungetbyte_str, &ss);
+            }
+            else
+                r = cql_parser_string(cp, queries[j]);
+            if (r)
+                errors++;
+        }
+    yaz_timing_stop(t);
+    real = yaz_timing_get_real(t);
+    if (real <= 0.0)
+        real = 1e-9;
+    printf("%-8s %8.3f s %10.0f queries/s %8.2f MB/s %ld errors\n",
+           name, real, (double) num * iterations / real,
+           (double) bytes * iterations / real / 1e6, errors / iterations);
+    yaz_timing_destroy(&t);
+    cql_parser_destroy(cp);
+}
+
+int main(int argc, char **argv)
+{
+    int ret;
+    char *arg;
+    int iterations = 1000;
+    const char *fname = 0;
+    char **queries = 0;
+    int num = 0, max = 0, i;
+    long bytes = 0;
+    char line[1024];
+    FILE *f;
+
+    while ((ret = options("n:", argv, argc, &arg)) != -2)
+    {
+        switch (ret)
+        {
+        case 'n':
+            iterations = atoi(arg);
+            break;
+        case 0:
+            fname = arg;
+            break;
+        default:
+            usage();
+        }
+    }
+    if (!fname || iterations < 1)
+        usage();
+    f = fopen(fname, "r");
+    if (!f)
+    {
+        fprintf(stderr, "%s: can not open\n", fname);
+        exit(1);
+    }
+    while (fgets(line, sizeof(line), f))
+    {
+        char *cp = strchr(line, '\n');
+        if (cp)
+            *cp = '\0';
+        if (*line == '#' || *line == '\0')
+            continue;
+        if (num == max)
+        {
+            max = max ? 2 * max : 64;
+            queries = (char **) xrealloc(queries, max * sizeof(*queries));
+        }
+        queries[num++] = xstrdup(line);
+        bytes += strlen(line);
+    }
+    fclose(f);
+    if (num == 0)
+    {
+        fprintf(stderr, "%s: no queries\n", fname);
+        exit(1);
+    }
+    printf("%d queries, %ld bytes, %d iterations\n", num, bytes, iterations);
+    bench("string", queries, num, bytes, iterations, 0);
+    bench("stream", queries, num, bytes, iterations, 1);
+    for (i = 0; i < num; i++)
+        xfree(queries[i]);
+    xfree(queries);
+    exit(0);
+}
+/*
+ * Local variables:
+ * c-basic-offset: 4
+ * c-file-style: "Stroustrup"
+ * indent-tabs-mode: nil
+ * End:
+ * vim: shiftwidth=4 tabstop=8 expandtab
+ */
@@ -0,0 +1,150 @@
+/* This file is part of the YAZ toolkit.
+ * Copyright (C) 1995-2013 Index Data
+ * See the file LICENSE for details.
+ */
+/**
+ * \file http-benchmark.c
+ * \brief HTTP Content-Encoding benchmark
+ *
+ * Fetches the same URL repeatedly over one keep-alive connection, once
+ * without and once with Accept-Encoding, and reports bytes on the wire
+ * and time per request including decoding. Point it to a local
+ * yaz-ztest with httpcompression enabled, e.g. with an SRU searchRetrieve
+ * for MARCXML records.
+ */
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <yaz/comstack.h>
+#include <yaz/zgdu.h>
+#include <yaz/options.h>
+#include <yaz/timing.h>
+#include <yaz/xmalloc.h>
+
+static void usage(void)
+{
+    fprintf(stderr, "usage\n yaz-http-benchmark [-n iterations] "
+            "[-e accept-encoding] url\n");
+    exit(1);
+}
+
+static int bench(const char *url, const char *accept_encoding,
+                 int iterations)
+{
+    ODR out = odr_createmem(ODR_ENCODE);
+    ODR in = odr_createmem(ODR_DECODE);
+    yaz_timing_t t;
+    void *add;
+    COMSTACK cs = cs_create_host(url, 1, &add);
+    Z_GDU *gdu;
+    char *req_buf, *netbuf = 0;
+    int req_len, netlen = 0;
+    long wire = 0, body = 0;
+    int i;
+
+    if (!cs || cs_connect(cs, add) < 0)
+    {
+        fprintf(stderr, "%s: can not connect\n", url);
+        if (cs)
+            cs_close(cs);
+        return 1;
+    }
+    gdu = z_get_HTTP_Request_uri(out, url, 0, 0);
+    gdu->u.HTTP_Request->method = "GET";
+    if (accept_encoding)
+        z_HTTP_header_add(out, &gdu->u.HTTP_Request->headers,
+                          "Accept-Encoding", accept_encoding);
+    if (!z_GDU(out, &gdu, 0, 0))
+    {
+        fprintf(stderr, "%s: encoding failed\n", url);
+        cs_close(cs);
+        return 1;
+    }
+    req_buf = odr_getbuf(out, &req_len, 0);
+
+    t = yaz_timing_create();
+    for (i = 0; i < iterations; i++)
+    {
+        int res;
+        Z_GDU *gdu_r;
+
+        if (cs_put(cs, req_buf, req_len) < 0
+            || (res = cs_get(cs, &netbuf, &netlen)) <= 0)
+        {
+            fprintf(stderr, "%s: request %d failed\n", url, i);
+            break;
+        }
+        odr_setbuf(in, netbuf, res, 0);
+        if (!z_GDU(in, &gdu_r, 0, 0) || gdu_r->which != Z_GDU_HTTP_Response
+            || gdu_r->u.HTTP_Response->code != 200)
+        {
+            fprintf(stderr, "%s: bad HTTP response\n", url);
+            break;
+        }
+        wire += res;
+        body += gdu_r->u.HTTP_Response->content_len;
+        odr_reset(in);
+    }
+    yaz_timing_stop(t);
+    if (i == iterations && iterations > 0)
+    {
+        double real = yaz_timing_get_real(t);
+        printf("%-16s %8ld wire bytes %8ld body bytes %8.3f s "
+               "%8.3f ms/request\n",
+               accept_encoding ? accept_encoding : "identity",
+               wire / iterations, body / iterations, real,
+               real * 1e3 / iterations);
+    }
+    yaz_timing_destroy(&t);
+    xfree(netbuf);
+    cs_close(cs);
+    odr_destroy(in);
+    odr_destroy(out);
+    return i == iterations ? 0 : 1;
+}
+
+int main(int argc, char **argv)
+{
+    int ret;
+    char *arg;
+    int iterations = 1000;
+    const char *accept_encoding = "gzip";
+    const char *url = 0;
+    int errors = 0;
+
+    while ((ret = options("n:e:", argv, argc, &arg)) != -2)
+    {
+        switch (ret)
+        {
+        case 'n':
+            iterations = atoi(arg);
+            break;
+        case 'e':
+            accept_encoding = arg;
+            break;
+        case 0:
+            url = arg;
+            break;
+        default:
+            usage();
+        }
+    }
+    if (!url || iterations < 1)
+        usage();
+    errors += bench(url, 0, iterations);
+    errors += bench(url, accept_encoding, iterations);
+    exit(errors ? 1 : 0);
+}
+/*
+ * Local variables:
+ * c-basic-offset: 4
+ * c-file-style: "Stroustrup"
+ * indent-tabs-mode: nil
+ * End:
+ * vim: shiftwidth=4 tabstop=8 expandtab
+ */
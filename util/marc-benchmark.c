@@ -0,0 +1,248 @@
+/* This file is part of the YAZ toolkit.
+ * Copyright (C) 1995-2013 Index Data
+ * See the file LICENSE for details.
+ */
+/**
+ * \file marc-benchmark.c
+ * \brief ISO2709 splitting, parsing and rendering benchmark
+ *
+ * Reads one or more ISO2709 files, replicates their records in memory
+ * until the given size is reached and reports the rate of splitting
+ * the buffer into records and of parsing the records with
+ * yaz_marc_read_iso2709. Use the test/marccol*.u8.marc files, e.g.
+ * yaz-marc-benchmark -s 1000 test/marccol?.u8.marc
+ *
+ * Option -r renders the first records (-c) with yaz_record_render, e.g.
+ * yaz-marc-benchmark -c 10000 -r "render; charset=marc8,iso-8859-1" ..
+ * Option -i compares yaz_iconv_open/yaz_iconv_close per record with
+ * yaz_iconv_pool_get/yaz_iconv_pool_put, e.g. -i marc8,iso-8859-1
+ */
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <yaz/marcdisp.h>
+#include <yaz/record_render.h>
+#include <yaz/proto.h>
+#include <yaz/yaz-iconv.h>
+#include <yaz/options.h>
+#include <yaz/timing.h>
+#include <yaz/xmalloc.h>
+
+static void usage(void)
+{
+    fprintf(stderr, "usage\n yaz-marc-benchmark [-s megabytes] "
+            "[-n iterations] [-c records] [-r type] [-i from,to] file..\n");
+    exit(1);
+}
+
+static int read_file(const char *fname, WRBUF w)
+{
+    char buf[4096];
+    size_t r;
+    FILE *inf = fopen(fname, "rb");
+
+    if (!inf)
+    {
+        fprintf(stderr, "%s: can not open\n", fname);
+        return -1;
+    }
+    while ((r = fread(buf, 1, sizeof(buf), inf)) > 0)
+        wrbuf_write(w, buf, r);
+    fclose(inf);
+    return 0;
+}
+
+static void report(const char *what, yaz_timing_t t, size_t bytes, long no)
+{
+    double real = yaz_timing_get_real(t);
+
+    if (real <= 0.0)
+        real = 1e-6;
+    printf("%-8s %10ld records %8.3f s %10.1f MB/s %12.0f records/s\n",
+           what, no, real, bytes / real / 1e6, no / real);
+}
+
+/* renders max_no records with type_spec */
+static void bench_render(const char *buf, size_t len, long max_no,
+                         const char *type_spec)
+{
+    ODR odr = odr_createmem(ODR_ENCODE);
+    WRBUF w = wrbuf_alloc();
+    yaz_timing_t t = yaz_timing_create();
+    size_t off, bytes = 0;
+    long no = 0, no_errors = 0;
+
+    for (off = 0; off < len && no < max_no; no++)
+    {
+        Z_NamePlusRecord npr;
+        int r = yaz_marc_iso2709_split(buf + off, len - off);
+        int out_len;
+
+        if (r <= 0)
+            break;
+        npr.databaseName = 0;
+        npr.which = Z_NamePlusRecord_databaseRecord;
+        npr.u.databaseRecord = z_ext_record_usmarc(odr, buf + off, r);
+        if (!yaz_record_render(&npr, 0, w, type_spec, &out_len))
+            no_errors++;
+        odr_reset(odr);
+        off += r;
+        bytes += r;
+    }
+    yaz_timing_stop(t);
+    report("render", t, bytes, no);
+    if (no_errors)
+        printf("%ld records could not be rendered\n", no_errors);
+    yaz_timing_destroy(&t);
+    wrbuf_destroy(w);
+    odr_destroy(odr);
+}
+
+/* opens and closes converter no times; with and without pool */
+static void bench_iconv(long no, const char *charsets)
+{
+    char from[40], to[40];
+    const char *cp = strchr(charsets, ',');
+    yaz_timing_t t;
+    long i;
+
+    if (!cp || cp - charsets >= (int) sizeof(from)
+        || strlen(cp + 1) >= sizeof(to))
+        usage();
+    memcpy(from, charsets, cp - charsets);
+    from[cp - charsets] = '\0';
+    strcpy(to, cp + 1);
+
+    t = yaz_timing_create();
+    for (i = 0; i < no; i++)
+    {
+        yaz_iconv_t cd = yaz_iconv_open(to, from);
+        if (!cd)
+        {
+            fprintf(stderr, "unsupported conversion %s\n", charsets);
+            exit(1);
+        }
+        yaz_iconv_close(cd);
+    }
+    yaz_timing_stop(t);
+    report("open", t, 0, no);
+
+    yaz_timing_start(t);
+    for (i = 0; i < no; i++)
+        yaz_iconv_pool_put(yaz_iconv_pool_get(to, from));
+    yaz_timing_stop(t);
+    report("pool", t, 0, no);
+    yaz_timing_destroy(&t);
+}
+
+int main(int argc, char **argv)
+{
+    int ret;
+    char *arg;
+    int iterations = 1;
+    size_t size = 100 * 1000000;
+    WRBUF src = wrbuf_alloc();
+    char *buf;
+    size_t len, off;
+    long no_split = 0, no_parse = 0, no_errors = 0;
+    yaz_marc_t mt = yaz_marc_create();
+    yaz_timing_t t;
+    int i;
+    long max_render = 10000;
+    const char *render_type = 0;
+    const char *iconv_charsets = 0;
+
+    while ((ret = options("s:n:c:r:i:", argv, argc, &arg)) != -2)
+    {
+        switch (ret)
+        {
+        case 's':
+            size = (size_t) atol(arg) * 1000000;
+            break;
+        case 'n':
+            iterations = atoi(arg);
+            break;
+        case 'c':
+            max_render = atol(arg);
+            break;
+        case 'r':
+            render_type = arg;
+            break;
+        case 'i':
+            iconv_charsets = arg;
+            break;
+        case 0:
+            if (read_file(arg, src))
+                exit(1);
+            break;
+        default:
+            usage();
+        }
+    }
+    if (wrbuf_len(src) == 0 || iterations < 1)
+        usage();
+
+    /* whole copies of the input only, so every record is complete */
+    len = (size / wrbuf_len(src) + 1) * wrbuf_len(src);
+    buf = (char *) xmalloc(len);
+    for (off = 0; off < len; off += wrbuf_len(src))
+        memcpy(buf + off, wrbuf_buf(src), wrbuf_len(src));
+
+    t = yaz_timing_create();
+    for (i = 0; i < iterations; i++)
+    {
+        for (off = 0; off < len; )
+        {
+            int r = yaz_marc_iso2709_split(buf + off, len - off);
+            if (r <= 0)
+                break;
+            off += r;
+            no_split++;
+        }
+    }
+    yaz_timing_stop(t);
+    report("split", t, len * iterations, no_split);
+
+    yaz_timing_start(t);
+    for (i = 0; i < iterations; i++)
+    {
+        for (off = 0; off < len; )
+        {
+            int r = yaz_marc_iso2709_split(buf + off, len - off);
+            if (r <= 0)
+                break;
+            if (yaz_marc_read_iso2709(mt, buf + off, r) <= 0)
+                no_errors++;
+            off += r;
+            no_parse++;
+        }
+    }
+    yaz_timing_stop(t);
+    report("parse", t, len * iterations, no_parse);
+    if (no_errors)
+        printf("%ld records could not be parsed\n", no_errors);
+
+    if (render_type)
+        bench_render(buf, len, max_render, render_type);
+    if (iconv_charsets)
+        bench_iconv(max_render, iconv_charsets);
+    yaz_timing_destroy(&t);
+    yaz_iconv_pool_cleanup();
+    yaz_marc_destroy(mt);
+    xfree(buf);
+    wrbuf_destroy(src);
+    exit(0);
+}
+/*
+ * Local variables:
+ * c-basic-offset: 4
+ * c-file-style: "Stroustrup"
+ * indent-tabs-mode: nil
+ * End:
+ * vim: shiftwidth=4 tabstop=8 expandtab
+ */
@@ -233,6 +233,8 @@ static void dump(const char *fname, const char *from, const char *to,
     yaz_marc_xml(mt, output_format);
     yaz_marc_write_using_libxml2(mt, write_using_libxml2);
     yaz_marc_debug(mt, verbose);
+    /* each record is written before its buffer is reused */
+    yaz_marc_reference_input(mt, 1);
 
     if (input_format == YAZ_MARC_MARCXML || input_format == YAZ_MARC_TURBOMARC || input_format == YAZ_MARC_XCHANGE)
     {
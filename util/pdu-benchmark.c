@@ -0,0 +1,253 @@
+/* This file is part of the YAZ toolkit.
+ * Copyright (C) 1995-2013 Index Data
+ * See the file LICENSE for details.
+ */
+/**
+ * \file pdu-benchmark.c
+ * \brief Z39.50 PDU encode/decode round trip benchmark
+ *
+ * Measures the BER codecs generated by yaz-asncomp. With -d only decoding is timed; the close PDU uses one of the last
+ * arms of the Z_APDU CHOICE and so shows the cost of arm dispatch.
+ */
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <yaz/proto.h>
+#include <yaz/pquery.h>
+#include <yaz/oid_db.h>
+#include <yaz/options.h>
+#include <yaz/timing.h>
+
+static void usage(void)
+{
+    fprintf(stderr, "usage\n yaz-pdu-benchmark [-n iterations] "
+            "[-r records] [-d] [-v]\n");
+    exit(1);
+}
+
+static Z_APDU *mk_init_request(ODR o)
+{
+    Z_APDU *apdu = zget_APDU(o, Z_APDU_initRequest);
+    Z_InitRequest *req = apdu->u.initRequest;
+
+    req->implementationId = "81";
+    req->implementationName = "YAZ PDU benchmark";
+    req->implementationVersion = "1.0";
+    return apdu;
+}
+
+static Z_APDU *mk_search_request(ODR o)
+{
+    Z_APDU *apdu = zget_APDU(o, Z_APDU_searchRequest);
+    Z_SearchRequest *req = apdu->u.searchRequest;
+    Z_Query *query = (Z_Query *) odr_malloc(o, sizeof(*query));
+
+    req->num_databaseNames = 1;
+    req->databaseNames = (char **) odr_malloc(o, sizeof(char *));
+    req->databaseNames[0] = "Default";
+    query->which = Z_Query_type_1;
+    query->u.type_1 = p_query_rpn(
+        o, "@and @and @attr 1=4 computer @attr 1=1003 knuth "
+        "@or @attr 1=31 1990 @attr 5=1 @attr 1=21 programming");
+    req->query = query;
+    return apdu;
+}
+
+static Z_APDU *mk_close(ODR o)
+{
+    Z_APDU *apdu = zget_APDU(o, Z_APDU_close);
+
+    *apdu->u.close->closeReason = Z_Close_finished;
+    return apdu;
+}
+
+static Z_APDU *mk_present_response(ODR o, int num)
+{
+    Z_APDU *apdu = zget_APDU(o, Z_APDU_presentResponse);
+    Z_PresentResponse *res = apdu->u.presentResponse;
+    Z_Records *records = (Z_Records *) odr_malloc(o, sizeof(*records));
+    Z_NamePlusRecordList *npl = (Z_NamePlusRecordList *)
+        odr_malloc(o, sizeof(*npl));
+    int i;
+
+    npl->num_records = num;
+    npl->records = (Z_NamePlusRecord **)
+        odr_malloc(o, sizeof(*npl->records) * num);
+    for (i = 0; i < num; i++)
+    {
+        Z_NamePlusRecord *npr = (Z_NamePlusRecord *)
+            odr_malloc(o, sizeof(*npr));
+        char buf[400];
+
+        memset(buf, 'a' + i % 26, sizeof(buf));
+        npr->databaseName = "Default";
+        npr->which = Z_NamePlusRecord_databaseRecord;
+        npr->u.databaseRecord =
+            z_ext_record_oid(o, yaz_oid_recsyn_usmarc, buf, sizeof(buf));
+        npl->records[i] = npr;
+    }
+    records->which = Z_Records_DBOSD;
+    records->u.databaseOrSurDiagnostics = npl;
+    res->records = records;
+    *res->numberOfRecordsReturned = num;
+    *res->nextResultSetPosition = num + 1;
+    return apdu;
+}
+
+/* encode once, then time decoding only */
+static int bench_decode(const char *label, Z_APDU *apdu, int iterations,
+                        int verbose)
+{
+    ODR enc = odr_createmem(ODR_ENCODE);
+    ODR dec = odr_createmem(ODR_DECODE);
+    yaz_timing_t t;
+    char *buf;
+    int i = 0, len = 0;
+
+    if (!z_APDU(enc, &apdu, 0, 0))
+        fprintf(stderr, "%s: encoding failed\n", label);
+    else
+    {
+        buf = odr_getbuf(enc, &len, 0);
+        t = yaz_timing_create();
+        for (i = 0; i < iterations; i++)
+        {
+            Z_APDU *apdu_r;
+
+            odr_setbuf(dec, buf, len, 0);
+            if (!z_APDU(dec, &apdu_r, 0, 0))
+            {
+                fprintf(stderr, "%s: decoding failed\n", label);
+                break;
+            }
+            odr_reset(dec);
+        }
+        yaz_timing_stop(t);
+        if (i == iterations)
+        {
+            double real = yaz_timing_get_real(t);
+            printf("%-16s %6d bytes %8d decodes     %8.3f s %8.2f us/op\n",
+                   label, len, iterations, real,
+                   iterations ? real * 1e6 / iterations : 0.0);
+        }
+        yaz_timing_destroy(&t);
+    }
+    if (verbose)
+    {
+        ODR pr = odr_createmem(ODR_PRINT);
+        z_APDU(pr, &apdu, 0, 0);
+        odr_destroy(pr);
+    }
+    odr_destroy(enc);
+    odr_destroy(dec);
+    return i == iterations ? 0 : 1;
+}
+
+static int bench(const char *label, Z_APDU *apdu, int iterations,
+                 int verbose)
+{
+    ODR enc = odr_createmem(ODR_ENCODE);
+    ODR dec = odr_createmem(ODR_DECODE);
+    yaz_timing_t t = yaz_timing_create();
+    int i, len = 0;
+
+    for (i = 0; i < iterations; i++)
+    {
+        Z_APDU *apdu_r;
+        char *buf;
+
+        if (!z_APDU(enc, &apdu, 0, 0))
+        {
+            fprintf(stderr, "%s: encoding failed\n", label);
+            break;
+        }
+        buf = odr_getbuf(enc, &len, 0);
+        odr_setbuf(dec, buf, len, 0);
+        if (!z_APDU(dec, &apdu_r, 0, 0))
+        {
+            fprintf(stderr, "%s: decoding failed\n", label);
+            break;
+        }
+        odr_reset(dec);
+        odr_reset(enc);
+    }
+    yaz_timing_stop(t);
+    if (i == iterations)
+    {
+        double real = yaz_timing_get_real(t);
+        printf("%-16s %6d bytes %8d round trips %8.3f s %8.2f us/op\n",
+               label, len, iterations, real,
+               iterations ? real * 1e6 / iterations : 0.0);
+    }
+    if (verbose)
+    {
+        ODR pr = odr_createmem(ODR_PRINT);
+        z_APDU(pr, &apdu, 0, 0);
+        odr_destroy(pr);
+    }
+    yaz_timing_destroy(&t);
+    odr_destroy(enc);
+    odr_destroy(dec);
+    return i == iterations ? 0 : 1;
+}
+
+int main(int argc, char **argv)
+{
+    int ret;
+    char *arg;
+    int iterations = 100000;
+    int num_records = 10;
+    int verbose = 0;
+    int decode_only = 0;
+    int errors = 0;
+    int (*fun)(const char *label, Z_APDU *apdu, int iterations,
+               int verbose) = bench;
+    ODR o;
+
+    while ((ret = options("n:r:dv", argv, argc, &arg)) != -2)
+    {
+        switch (ret)
+        {
+        case 'n':
+            iterations = atoi(arg);
+            break;
+        case 'r':
+            num_records = atoi(arg);
+            break;
+        case 'd':
+            decode_only = 1;
+            break;
+        case 'v':
+            verbose = 1;
+            break;
+        default:
+            usage();
+        }
+    }
+    if (iterations < 0 || num_records < 1)
+        usage();
+    o = odr_createmem(ODR_ENCODE);
+    if (decode_only)
+        fun = bench_decode;
+    errors += fun("initRequest", mk_init_request(o), iterations, verbose);
+    errors += fun("searchRequest", mk_search_request(o), iterations,
+                  verbose);
+    errors += fun("presentResponse", mk_present_response(o, num_records),
+                  iterations, verbose);
+    errors += fun("close", mk_close(o), iterations, verbose);
+    odr_destroy(o);
+    exit(errors ? 1 : 0);
+}
+/*
+ * Local variables:
+ * c-basic-offset: 4
+ * c-file-style: "Stroustrup"
+ * indent-tabs-mode: nil
+ * End:
+ * vim: shiftwidth=4 tabstop=8 expandtab
+ */
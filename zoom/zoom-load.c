@@ -0,0 +1,596 @@
+/* This file is part of the YAZ toolkit.
+ * Copyright (C) 1995-2013 Index Data
+ * See the file LICENSE for details.
+ */
+/** \file
+ * \brief ZOOM load generator with latency histograms
+ *
+ * Runs a mix of search, present and scan over a number of asynchronous
+ * ZOOM connections to one target (Z39.50, SRU or Solr) and reports
+ * latency percentiles per operation, as text or JSON.
+ *
+ * With a request rate (-r) the load is open-loop: requests are
+ * scheduled at fixed intervals whether or not the target keeps up,
+ * and latency is measured from the scheduled time, so that time spent
+ * waiting for a free connection is included. Without a rate each
+ * connection sends its next request as soon as the previous completes.
+ *
+ * Example, against yaz-ztest on port 9999:
+ *   zoom-load -c 20 -r 500 -d 30 -m search=6,present=3,scan=1 \
+ *     'localhost:9999/Default?hits=100000&record-size=2000'
+ */
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <yaz/xmalloc.h>
+#include <yaz/options.h>
+#include <yaz/gettimeofday.h>
+#include <yaz/poll.h>
+#include <yaz/zoom.h>
+
+/* HDR-style histogram: values below 128 are exact; above, each power
+   of two is split in 64 buckets, so the relative error is below 2% */
+#define HIST_SUB 64
+#define HIST_MAGNITUDES 40
+#define HIST_SIZE ((HIST_MAGNITUDES + 2) * HIST_SUB)
+
+struct histogram {
+    long counts[HIST_SIZE];
+    long total;
+    long errors;
+    double sum;
+    long max;
+};
+
+static int hist_index(long v)
+{
+    int b = 0;
+
+    while ((v >> b) >= 2 * HIST_SUB)
+        b++;
+    if (b > HIST_MAGNITUDES)
+        return HIST_SIZE - 1;
+    return b * HIST_SUB + (int) (v >> b);
+}
+
+/* highest value that maps to index i */
+static long hist_value(int i)
+{
+    int b = i / HIST_SUB - 1;
+    long sub;
+
+    if (b <= 0)
+        return i;
+    sub = i - b * HIST_SUB;
+    return ((sub + 1) << b) - 1;
+}
+
+static void hist_add(struct histogram *h, long usec)
+{
+    if (usec < 0)
+        usec = 0;
+    h->counts[hist_index(usec)]++;
+    h->total++;
+    h->sum += usec;
+    if (usec > h->max)
+        h->max = usec;
+}
+
+static long hist_percentile(const struct histogram *h, double p)
+{
+    long want = (long) (p * h->total / 100.0 + 0.5);
+    long seen = 0;
+    int i;
+
+    if (want < 1)
+        want = 1;
+    for (i = 0; i < HIST_SIZE; i++)
+    {
+        seen += h->counts[i];
+        if (seen >= want)
+            return hist_value(i) < h->max ? hist_value(i) : h->max;
+    }
+    return h->max;
+}
+
+enum op_type { OP_SEARCH, OP_PRESENT, OP_SCAN, OP_MAX };
+static const char *op_names[OP_MAX] = { "search", "present", "scan" };
+
+struct conn {
+    ZOOM_connection z;
+    ZOOM_resultset r;     /* result set of last search */
+    ZOOM_scanset s;
+    int busy;
+    enum op_type op;
+    double start;         /* scheduled (open-loop) or sent time */
+};
+
+struct load {
+    const char *zurl;
+    const char *query;
+    const char *query_type;
+    const char *scan_term;
+    int connections;
+    double rate;
+    double duration;
+    int present_count;
+    int weights[OP_MAX];
+    int json;
+    struct conn *conns;
+    struct histogram hist[OP_MAX];
+    double *backlog;      /* scheduled times not yet sent (ring) */
+    int backlog_size;
+    int backlog_head;
+    int backlog_num;
+    int backlog_max;
+    long dropped;
+};
+
+static double now(void)
+{
+    struct timeval tv;
+    yaz_gettimeofday(&tv);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage\n zoom-load [-c connections] [-r rate] "
+            "[-d seconds] [-m search=w,present=w,scan=w]\n"
+            "  [-q query] [-t pqf|cql] [-s scanterm] [-n present-count] "
+            "[-p z3950|sru|solr] [-o option=value] [-j] zurl\n");
+    exit(1);
+}
+
+static void parse_mix(struct load *l, const char *arg)
+{
+    int i;
+
+    for (i = 0; i < OP_MAX; i++)
+        l->weights[i] = 0;
+    while (*arg)
+    {
+        size_t len = strcspn(arg, "=");
+        for (i = 0; i < OP_MAX; i++)
+            if (len == strlen(op_names[i])
+                && !memcmp(arg, op_names[i], len))
+                break;
+        if (i == OP_MAX || arg[len] != '=')
+            usage();
+        arg += len + 1;
+        l->weights[i] = atoi(arg);
+        arg += strcspn(arg, ",");
+        if (*arg == ',')
+            arg++;
+    }
+}
+
+static enum op_type pick_op(struct load *l, struct conn *c)
+{
+    int i, sum = 0, v;
+
+    for (i = 0; i < OP_MAX; i++)
+        sum += l->weights[i];
+    v = rand() % sum;
+    for (i = 0; i < OP_MAX; i++)
+        if ((v -= l->weights[i]) < 0)
+            break;
+    /* present needs a result set with hits */
+    if (i == OP_PRESENT && (!c->r || ZOOM_resultset_size(c->r) == 0))
+        i = OP_SEARCH;
+    return (enum op_type) i;
+}
+
+static void complete_op(struct load *l, struct conn *c, double t);
+
+static void send_op(struct load *l, struct conn *c, double start)
+{
+    c->op = pick_op(l, c);
+    c->start = start;
+    c->busy = 1;
+    switch (c->op)
+    {
+    case OP_SEARCH:
+    {
+        ZOOM_query q = ZOOM_query_create();
+        if (!strcmp(l->query_type, "cql"))
+            ZOOM_query_cql(q, l->query);
+        else
+            ZOOM_query_prefix(q, l->query);
+        ZOOM_resultset_destroy(c->r);
+        c->r = ZOOM_connection_search(c->z, q);
+        ZOOM_query_destroy(q);
+        break;
+    }
+    case OP_PRESENT:
+    {
+        size_t hits = ZOOM_resultset_size(c->r);
+        size_t count = l->present_count;
+        size_t pos = 0;
+
+        if (count > hits)
+            count = hits;
+        if (hits > count) /* vary position to avoid record cache hits */
+            pos = rand() % (hits - count + 1);
+        ZOOM_resultset_records(c->r, 0, pos, count);
+        break;
+    }
+    case OP_SCAN:
+        c->s = ZOOM_connection_scan(c->z, l->scan_term);
+        break;
+    default:
+        break;
+    }
+    /* records all in cache: nothing was sent */
+    if (ZOOM_connection_is_idle(c->z)
+        && ZOOM_connection_peek_event(c->z) == ZOOM_EVENT_NONE)
+        complete_op(l, c, now());
+}
+
+static void complete_op(struct load *l, struct conn *c, double t)
+{
+    struct histogram *h = l->hist + c->op;
+    const char *msg, *addinfo;
+
+    if (ZOOM_connection_error(c->z, &msg, &addinfo))
+    {
+        h->errors++;
+        if (l->hist[c->op].errors == 1)
+            fprintf(stderr, "%s: %s %s\n", op_names[c->op], msg,
+                    addinfo ? addinfo : "");
+    }
+    else
+        hist_add(h, (long) ((t - c->start) * 1e6));
+    ZOOM_scanset_destroy(c->s);
+    c->s = 0;
+    c->busy = 0;
+}
+
+/* waits for socket activity, at most until deadline */
+static void wait_io(struct load *l, double deadline)
+{
+    struct yaz_poll_fd *fds = (struct yaz_poll_fd *)
+        xmalloc(sizeof(*fds) * l->connections);
+    int i, nfds = 0;
+    double wait = deadline - now();
+
+    if (wait < 0)
+        wait = 0;
+    for (i = 0; i < l->connections; i++)
+    {
+        int fd = ZOOM_connection_get_socket(l->conns[i].z);
+        int mask = ZOOM_connection_get_mask(l->conns[i].z);
+
+        if (fd != -1 && mask)
+        {
+            fds[nfds].fd = fd;
+            fds[nfds].input_mask = yaz_poll_none;
+            if (mask & ZOOM_SELECT_READ)
+                yaz_poll_add(fds[nfds].input_mask, yaz_poll_read);
+            if (mask & ZOOM_SELECT_WRITE)
+                yaz_poll_add(fds[nfds].input_mask, yaz_poll_write);
+            if (mask & ZOOM_SELECT_EXCEPT)
+                yaz_poll_add(fds[nfds].input_mask, yaz_poll_except);
+            fds[nfds].client_data = l->conns[i].z;
+            nfds++;
+        }
+    }
+    if (yaz_poll(fds, nfds, (int) wait,
+                 (int) ((wait - (int) wait) * 1e9)) > 0)
+    {
+        for (i = 0; i < nfds; i++)
+        {
+            int mask = 0;
+
+            if (fds[i].output_mask & yaz_poll_read)
+                mask |= ZOOM_SELECT_READ;
+            if (fds[i].output_mask & yaz_poll_write)
+                mask |= ZOOM_SELECT_WRITE;
+            if (fds[i].output_mask & yaz_poll_except)
+                mask |= ZOOM_SELECT_EXCEPT;
+            /* timeouts are ours, not the connection's */
+            if (mask)
+                ZOOM_connection_fire_event_socket(
+                    (ZOOM_connection) fds[i].client_data, mask);
+        }
+    }
+    xfree(fds);
+}
+
+/* processes pending events; returns number of busy connections */
+static int process_events(struct load *l, ZOOM_connection *zs)
+{
+    int i, busy = 0;
+
+    while ((i = ZOOM_event_nonblock(l->connections, zs)))
+    {
+        struct conn *c = l->conns + i - 1;
+        if (c->busy && ZOOM_connection_last_event(c->z) == ZOOM_EVENT_END)
+            complete_op(l, c, now());
+    }
+    for (i = 0; i < l->connections; i++)
+        busy += l->conns[i].busy;
+    return busy;
+}
+
+static struct conn *idle_conn(struct load *l)
+{
+    int i;
+    for (i = 0; i < l->connections; i++)
+        if (!l->conns[i].busy)
+            return l->conns + i;
+    return 0;
+}
+
+static void run(struct load *l, ZOOM_connection *zs, double *elapsed)
+{
+    double t0 = now(), t;
+    double next = t0;
+    double end = t0 + l->duration;
+    long scheduled = 0;
+
+    for (;;)
+    {
+        struct conn *c;
+        int sent = 0;
+
+        process_events(l, zs);
+        t = now();
+        if (l->rate > 0)
+        {
+            while (next <= t && next < end)
+            {
+                if (l->backlog_num == l->backlog_size)
+                    l->dropped++;
+                else
+                {
+                    l->backlog[(l->backlog_head + l->backlog_num)
+                               % l->backlog_size] = next;
+                    l->backlog_num++;
+                    if (l->backlog_num > l->backlog_max)
+                        l->backlog_max = l->backlog_num;
+                }
+                scheduled++;
+                next = t0 + scheduled / l->rate;
+            }
+            while (l->backlog_num && (c = idle_conn(l)))
+            {
+                send_op(l, c, l->backlog[l->backlog_head]);
+                l->backlog_head = (l->backlog_head + 1) % l->backlog_size;
+                l->backlog_num--;
+                sent = 1;
+            }
+        }
+        else if (t < end)
+        {
+            while ((c = idle_conn(l)))
+            {
+                send_op(l, c, t);
+                sent = 1;
+            }
+        }
+        if (t >= end)
+            break;
+        if (sent)
+            continue; /* let ZOOM start the new tasks before waiting */
+        wait_io(l, l->rate > 0 && next < end ? next : end);
+    }
+    /* drain requests in progress, but not forever */
+    end = now() + 30.0;
+    while (process_events(l, zs) && now() < end)
+        wait_io(l, end);
+    *elapsed = now() - t0;
+}
+
+static void report_text(struct load *l, double elapsed)
+{
+    int i;
+    long total = 0;
+
+    printf("%-8s %8s %6s %9s %9s %9s %9s %9s %9s\n", "op", "count",
+           "errors", "mean ms", "p50 ms", "p90 ms", "p99 ms", "p99.9 ms",
+           "max ms");
+    for (i = 0; i < OP_MAX; i++)
+    {
+        struct histogram *h = l->hist + i;
+        if (!h->total && !h->errors)
+            continue;
+        total += h->total;
+        printf("%-8s %8ld %6ld %9.3f %9.3f %9.3f %9.3f %9.3f %9.3f\n",
+               op_names[i], h->total, h->errors,
+               h->total ? h->sum / h->total / 1e3 : 0.0,
+               hist_percentile(h, 50) / 1e3, hist_percentile(h, 90) / 1e3,
+               hist_percentile(h, 99) / 1e3, hist_percentile(h, 99.9) / 1e3,
+               h->max / 1e3);
+    }
+    printf("%ld requests in %.3f s: %.1f requests/s", total, elapsed,
+           elapsed > 0 ? total / elapsed : 0.0);
+    if (l->rate > 0)
+        printf(", max backlog %d, dropped %ld", l->backlog_max, l->dropped);
+    printf("\n");
+}
+
+static void report_json(struct load *l, double elapsed)
+{
+    int i;
+    long total = 0;
+    const char *sep = "";
+
+    for (i = 0; i < OP_MAX; i++)
+        total += l->hist[i].total;
+    printf("{\"zurl\":\"");
+    for (i = 0; l->zurl[i]; i++)
+    {
+        if (l->zurl[i] == '"' || l->zurl[i] == '\\')
+            putchar('\\');
+        putchar(l->zurl[i]);
+    }
+    printf("\",\"connections\":%d,\"rate\":%g,\"duration\":%.3f,"
+           "\"requests\":%ld,\"throughput\":%.3f,\"max_backlog\":%d,"
+           "\"dropped\":%ld,\"operations\":{",
+           l->connections, l->rate, elapsed, total,
+           elapsed > 0 ? total / elapsed : 0.0, l->backlog_max, l->dropped);
+    for (i = 0; i < OP_MAX; i++)
+    {
+        struct histogram *h = l->hist + i;
+        if (!h->total && !h->errors)
+            continue;
+        printf("%s\"%s\":{\"count\":%ld,\"errors\":%ld,\"mean_us\":%.1f,"
+               "\"p50_us\":%ld,\"p90_us\":%ld,\"p99_us\":%ld,"
+               "\"p999_us\":%ld,\"max_us\":%ld}",
+               sep, op_names[i], h->total, h->errors,
+               h->total ? h->sum / h->total : 0.0,
+               hist_percentile(h, 50), hist_percentile(h, 90),
+               hist_percentile(h, 99), hist_percentile(h, 99.9), h->max);
+        sep = ",";
+    }
+    printf("}}\n");
+}
+
+int main(int argc, char **argv)
+{
+    struct load l;
+    ZOOM_options o = ZOOM_options_create();
+    ZOOM_connection *zs;
+    char *arg;
+    int ret, i;
+    double elapsed;
+
+    memset(&l, 0, sizeof(l));
+    l.connections = 10;
+    l.duration = 10.0;
+    l.query = "@attr 1=4 computer";
+    l.query_type = "pqf";
+    l.scan_term = "@attr 1=4 a";
+    l.present_count = 10;
+    l.weights[OP_SEARCH] = 1;
+
+    ZOOM_options_set(o, "async", "1");
+    while ((ret = options("c:r:d:m:q:t:s:n:p:o:j", argv, argc, &arg)) != -2)
+    {
+        switch (ret)
+        {
+        case 'c':
+            l.connections = atoi(arg);
+            break;
+        case 'r':
+            l.rate = atof(arg);
+            break;
+        case 'd':
+            l.duration = atof(arg);
+            break;
+        case 'm':
+            parse_mix(&l, arg);
+            break;
+        case 'q':
+            l.query = arg;
+            break;
+        case 't':
+            l.query_type = arg;
+            break;
+        case 's':
+            l.scan_term = arg;
+            break;
+        case 'n':
+            l.present_count = atoi(arg);
+            break;
+        case 'p':
+            if (!strcmp(arg, "sru"))
+                ZOOM_options_set(o, "sru", "get");
+            else if (!strcmp(arg, "solr"))
+                ZOOM_options_set(o, "sru", "solr");
+            else if (strcmp(arg, "z3950"))
+                usage();
+            break;
+        case 'o':
+        {
+            char name[128];
+            const char *cp = strchr(arg, '=');
+            if (!cp || cp - arg >= (int) sizeof(name))
+                usage();
+            memcpy(name, arg, cp - arg);
+            name[cp - arg] = '\0';
+            ZOOM_options_set(o, name, cp + 1);
+            break;
+        }
+        case 'j':
+            l.json = 1;
+            break;
+        case 0:
+            l.zurl = arg;
+            break;
+        default:
+            usage();
+        }
+    }
+    if (!l.zurl || l.connections < 1 || l.duration <= 0
+        || l.weights[OP_SEARCH] + l.weights[OP_PRESENT]
+        + l.weights[OP_SCAN] <= 0)
+        usage();
+    srand(1); /* same mix every run */
+
+    l.backlog_size = 100000;
+    l.backlog = (double *) xmalloc(sizeof(*l.backlog) * l.backlog_size);
+    l.conns = (struct conn *) xmalloc(sizeof(*l.conns) * l.connections);
+    zs = (ZOOM_connection *) xmalloc(sizeof(*zs) * l.connections);
+    for (i = 0; i < l.connections; i++)
+    {
+        struct conn *c = l.conns + i;
+        c->z = zs[i] = ZOOM_connection_create(o);
+        c->r = 0;
+        c->s = 0;
+        c->busy = 1;
+        c->op = OP_SEARCH;
+        ZOOM_connection_connect(c->z, l.zurl, 0);
+    }
+    /* connect and init before the clock starts */
+    while ((i = ZOOM_event(l.connections, zs)))
+    {
+        struct conn *c = l.conns + i - 1;
+        if (ZOOM_connection_last_event(c->z) == ZOOM_EVENT_END)
+        {
+            const char *msg, *addinfo;
+            if (ZOOM_connection_error(c->z, &msg, &addinfo))
+            {
+                fprintf(stderr, "%s: %s %s\n", l.zurl, msg,
+                        addinfo ? addinfo : "");
+                exit(1);
+            }
+            c->busy = 0;
+        }
+    }
+    for (i = 0; i < l.connections; i++)
+        l.conns[i].busy = 0;
+
+    run(&l, zs, &elapsed);
+    if (l.json)
+        report_json(&l, elapsed);
+    else
+        report_text(&l, elapsed);
+
+    for (i = 0; i < l.connections; i++)
+    {
+        ZOOM_scanset_destroy(l.conns[i].s);
+        ZOOM_resultset_destroy(l.conns[i].r);
+        ZOOM_connection_destroy(l.conns[i].z);
+    }
+    xfree(zs);
+    xfree(l.conns);
+    xfree(l.backlog);
+    ZOOM_options_destroy(o);
+    exit(0);
+}
+/*
+ * Local variables:
+ * c-basic-offset: 4
+ * c-file-style: "Stroustrup"
+ * indent-tabs-mode: nil
+ * End:
+ * vim: shiftwidth=4 tabstop=8 expandtab
+ */
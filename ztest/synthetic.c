@@ -0,0 +1,286 @@
+/* This file is part of the YAZ toolkit.
+ * Copyright (C) 1995-2013 Index Data
+ * See the file LICENSE for details.
+ */
+/** \file
+ * \brief Generates synthetic records of a given size for load testing
+ *
+ * A record consists of a control number, author, title, subjects and
+ * as many summary fields as needed to reach the requested size of the
+ * ISO2709 rendering. The content depends on record number and seed
+ * only, so the same database options produce the same records in
+ * every run. MARCXML and MARC-in-JSON renderings hold the same fields.
+ */
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+
+#include <yaz/wrbuf.h>
+#include <yaz/json.h>
+#include <yaz/marcdisp.h>
+
+#include "ztest.h"
+
+#define SYNTH_MAX_FIELDS 200
+#define SYNTH_MAX_SIZE 99000 /* ISO2709 record length has 5 digits */
+#define SYNTH_SUMMARY_LEN 900
+
+static const char *words[] = {
+    "adventure", "algebra", "ancient", "archive", "autumn", "balance",
+    "bridge", "canyon", "carbon", "castle", "century", "chemistry",
+    "climate", "coast", "comet", "compass", "culture", "delta", "desert",
+    "dialogue", "economy", "empire", "energy", "engine", "evening",
+    "festival", "forest", "fortune", "galaxy", "garden", "geometry",
+    "glacier", "harbor", "harvest", "history", "horizon", "island",
+    "journey", "justice", "kingdom", "language", "library", "lighthouse",
+    "machine", "meadow", "memory", "mineral", "mountain", "music",
+    "network", "ocean", "orbit", "painting", "planet", "poetry", "prairie",
+    "quantum", "railway", "reason", "river", "science", "season", "signal",
+    "silver", "society", "spring", "statistics", "summer", "theory",
+    "thunder", "travel", "valley", "village", "voyage", "weather", "winter"
+};
+#define NO_WORDS (sizeof(words) / sizeof(*words))
+
+struct synth_field {
+    char tag[4];
+    int data_off;   /* offset of text in WRBUF */
+    int data_len;
+};
+
+struct synth_record {
+    WRBUF text;
+    int num_fields;
+    struct synth_field fields[SYNTH_MAX_FIELDS];
+    unsigned state;
+};
+
+static unsigned synth_rand(struct synth_record *r)
+{
+    r->state = r->state * 1103515245 + 12345;
+    return (r->state >> 16) & 0x7fff;
+}
+
+static void synth_words(struct synth_record *r, int min, int max)
+{
+    int i, n = min + synth_rand(r) % (max - min + 1);
+    for (i = 0; i < n; i++)
+    {
+        if (i)
+            wrbuf_putc(r->text, ' ');
+        wrbuf_puts(r->text, words[synth_rand(r) % NO_WORDS]);
+    }
+}
+
+static void synth_add(struct synth_record *r, const char *tag)
+{
+    struct synth_field *f = r->fields + r->num_fields;
+
+    strcpy(f->tag, tag);
+    f->data_off = wrbuf_len(r->text);
+}
+
+static void synth_end(struct synth_record *r)
+{
+    struct synth_field *f = r->fields + r->num_fields++;
+
+    f->data_len = wrbuf_len(r->text) - f->data_off;
+    wrbuf_putc(r->text, '\0'); /* fields are C strings */
+}
+
+/* fixed ISO2709 overhead per data field: directory, indicators, $a, FS */
+#define SYNTH_FIELD_OVERHEAD (12 + 2 + 2 + 1)
+
+static void synth_make(struct synth_record *r, int num, unsigned seed,
+                       int size)
+{
+    int estimate;
+
+    r->state = seed ^ ((unsigned) num * 2654435761U);
+    r->num_fields = 0;
+
+    synth_add(r, "001");
+    wrbuf_printf(r->text, "synth%09d", num);
+    synth_end(r);
+
+    synth_add(r, "100");
+    synth_words(r, 1, 2);
+    synth_end(r);
+
+    synth_add(r, "245");
+    synth_words(r, 3, 8);
+    synth_end(r);
+
+    synth_add(r, "650");
+    wrbuf_puts(r->text, words[synth_rand(r) % 12]);
+    synth_end(r);
+
+    synth_add(r, "650");
+    wrbuf_puts(r->text, words[synth_rand(r) % NO_WORDS]);
+    synth_end(r);
+
+    if (size > SYNTH_MAX_SIZE)
+        size = SYNTH_MAX_SIZE;
+    /* leader, directory FS, record RS */
+    estimate = 24 + 1 + 1 + 12 + 1 + wrbuf_len(r->text) - r->num_fields
+        + (r->num_fields - 1) * SYNTH_FIELD_OVERHEAD;
+    while (r->num_fields < SYNTH_MAX_FIELDS
+           && estimate + SYNTH_FIELD_OVERHEAD < size)
+    {
+        int want = size - estimate - SYNTH_FIELD_OVERHEAD;
+        int len;
+
+        if (want > SYNTH_SUMMARY_LEN)
+            want = SYNTH_SUMMARY_LEN;
+        synth_add(r, "520");
+        while ((len = wrbuf_len(r->text) - r->fields[r->num_fields].data_off)
+               < want)
+        {
+            if (len)
+                wrbuf_putc(r->text, ' ');
+            wrbuf_puts(r->text, words[synth_rand(r) % NO_WORDS]);
+        }
+        if (len > want)
+            wrbuf_cut_right(r->text, len - want);
+        synth_end(r);
+        estimate += want + SYNTH_FIELD_OVERHEAD;
+    }
+}
+
+static const char *synth_data(struct synth_record *r, int i)
+{
+    return wrbuf_buf(r->text) + r->fields[i].data_off;
+}
+
+static int synth_is_control(struct synth_record *r, int i)
+{
+    return !memcmp(r->fields[i].tag, "00", 2);
+}
+
+static void synth_iso2709(struct synth_record *r, WRBUF w)
+{
+    int i, pos = 0;
+    int base = 24 + 12 * r->num_fields + 1;
+    int rlen;
+    char buf[20];
+
+    for (i = 0; i < r->num_fields; i++)
+        pos += r->fields[i].data_len + (synth_is_control(r, i) ? 1 : 5);
+    rlen = base + pos + 1;
+    wrbuf_printf(w, "%05dnam  22%05d   4500", rlen, base);
+    pos = 0;
+    for (i = 0; i < r->num_fields; i++)
+    {
+        int flen = r->fields[i].data_len + (synth_is_control(r, i) ? 1 : 5);
+        sprintf(buf, "%s%04d%05d", r->fields[i].tag, flen, pos);
+        wrbuf_puts(w, buf);
+        pos += flen;
+    }
+    wrbuf_putc(w, ISO2709_FS);
+    for (i = 0; i < r->num_fields; i++)
+    {
+        if (!synth_is_control(r, i))
+        {
+            wrbuf_puts(w, "  ");
+            wrbuf_putc(w, ISO2709_IDFS);
+            wrbuf_putc(w, 'a');
+        }
+        wrbuf_write(w, synth_data(r, i), r->fields[i].data_len);
+        wrbuf_putc(w, ISO2709_FS);
+    }
+    wrbuf_putc(w, ISO2709_RS);
+}
+
+static void synth_marcxml(struct synth_record *r, WRBUF w)
+{
+    int i;
+
+    wrbuf_puts(w, "<record xmlns=\"http://www.loc.gov/MARC21/slim\">\n"
+               "  <leader>00000nam a2200000   4500</leader>\n");
+    for (i = 0; i < r->num_fields; i++)
+    {
+        if (synth_is_control(r, i))
+        {
+            wrbuf_printf(w, "  <controlfield tag=\"%s\">", r->fields[i].tag);
+            wrbuf_xmlputs_n(w, synth_data(r, i), r->fields[i].data_len);
+            wrbuf_puts(w, "</controlfield>\n");
+        }
+        else
+        {
+            wrbuf_printf(w, "  <datafield tag=\"%s\" ind1=\" \" ind2=\" \">\n"
+                         "    <subfield code=\"a\">", r->fields[i].tag);
+            wrbuf_xmlputs_n(w, synth_data(r, i), r->fields[i].data_len);
+            wrbuf_puts(w, "</subfield>\n  </datafield>\n");
+        }
+    }
+    wrbuf_puts(w, "</record>\n");
+}
+
+static void synth_json(struct synth_record *r, WRBUF w)
+{
+    int i;
+
+    wrbuf_puts(w, "{\"leader\":\"00000nam a2200000   4500\",\"fields\":[");
+    for (i = 0; i < r->num_fields; i++)
+    {
+        if (i)
+            wrbuf_putc(w, ',');
+        wrbuf_printf(w, "{\"%s\":", r->fields[i].tag);
+        if (synth_is_control(r, i))
+        {
+            wrbuf_putc(w, '"');
+            wrbuf_json_puts(w, synth_data(r, i));
+            wrbuf_putc(w, '"');
+        }
+        else
+        {
+            wrbuf_puts(w, "{\"ind1\":\" \",\"ind2\":\" \","
+                       "\"subfields\":[{\"a\":\"");
+            wrbuf_json_puts(w, synth_data(r, i));
+            wrbuf_puts(w, "\"}]}");
+        }
+        wrbuf_putc(w, '}');
+    }
+    wrbuf_puts(w, "]}\n");
+}
+
+char *synthetic_record(int num, unsigned seed, int size, int format,
+                       ODR odr, int *len)
+{
+    struct synth_record *r = (struct synth_record *) xmalloc(sizeof(*r));
+    WRBUF w = wrbuf_alloc();
+    char *buf;
+
+    r->text = wrbuf_alloc();
+    synth_make(r, num, seed, size);
+    switch (format)
+    {
+    case ZTEST_SYNTH_XML:
+        synth_marcxml(r, w);
+        break;
+    case ZTEST_SYNTH_JSON:
+        synth_json(r, w);
+        break;
+    default:
+        synth_iso2709(r, w);
+    }
+    *len = wrbuf_len(w);
+    buf = (char *) odr_malloc(odr, *len + 1);
+    memcpy(buf, wrbuf_buf(w), *len);
+    buf[*len] = '\0';
+    wrbuf_destroy(r->text);
+    wrbuf_destroy(w);
+    xfree(r);
+    return buf;
+}
+
+/*
+ * Local variables:
+ * c-basic-offset: 4
+ * c-file-style: "Stroustrup"
+ * indent-tabs-mode: nil
+ * End:
+ * vim: shiftwidth=4 tabstop=8 expandtab
+ */
@@ -33,6 +33,9 @@
 #include <yaz/diagbib1.h>
 #include <yaz/otherinfo.h>
 #include <yaz/facet.h>
+#include <yaz/thread_create.h>
+#include <yaz/mutex.h>
+#include <yaz/gettimeofday.h>
 
 #include "ztest.h"
 
@@ -51,11 +54,18 @@ struct result_set {
     struct delay search_delay;
     struct delay present_delay;
     struct delay fetch_delay;
+    int async;
+    unsigned seed;
+    Odr_int synth_hits;   /* hit count; -1 for query-derived */
+    int record_min;       /* synthetic record size range; 0 for none */
+    int record_max;
+    int facet_terms;      /* facet cardinality; 0 for dummy facets */
     struct result_set *next;
 };
 
 struct session_handle {
     struct result_set *result_sets;
+    YAZ_MUTEX mutex; /* handlers may run concurrently */
 };
 
 int ztest_search(void *handle, bend_search_rr *rr);
@@ -230,7 +240,130 @@ static void do_delay(const struct delay *delayp)
     }
 }
 
-static void addterms(ODR odr, Z_FacetField *facet_field, const char *facet_name)
+struct async_delay {
+    struct timeval expire;
+    bend_search_rr *search_rr;
+    bend_fetch_rr *fetch_rr;
+    struct async_delay *next;
+};
+
+/*
+ * Timer queue for async delays. One thread completes deferred requests
+ * when they expire, in order of expiry. The thread is started on first
+ * use, so that it is created in the process that serves the request.
+ */
+static YAZ_MUTEX timer_mutex = 0;
+static YAZ_COND timer_cond = 0;
+static int timer_running = 0;
+static struct async_delay *timer_list = 0;
+
+static int timer_before(const struct timeval *a, const struct timeval *b)
+{
+    if (a->tv_sec != b->tv_sec)
+        return a->tv_sec < b->tv_sec;
+    return a->tv_usec < b->tv_usec;
+}
+
+static void *timer_handler(void *p)
+{
+    yaz_mutex_enter(timer_mutex);
+    for (;;)
+    {
+        struct async_delay *ad = timer_list;
+        struct timeval now;
+
+        if (!ad)
+        {
+            yaz_cond_wait(timer_cond, timer_mutex, 0);
+            continue;
+        }
+        yaz_gettimeofday(&now);
+        if (timer_before(&now, &ad->expire))
+        {
+            yaz_cond_wait(timer_cond, timer_mutex, &ad->expire);
+            continue;
+        }
+        timer_list = ad->next;
+        yaz_mutex_leave(timer_mutex);
+        if (ad->search_rr)
+            bend_complete_search(ad->search_rr);
+        else
+            bend_complete_fetch(ad->fetch_rr);
+        xfree(ad);
+        yaz_mutex_enter(timer_mutex);
+    }
+    return 0;
+}
+
+/* queues ad. Returns 0 if no timer thread could be started */
+static int timer_add(struct async_delay *ad)
+{
+    struct async_delay **app;
+
+    yaz_mutex_enter(timer_mutex);
+    if (!timer_running)
+    {
+        yaz_thread_t t = yaz_thread_create(timer_handler, 0);
+        if (!t)
+        {
+            yaz_mutex_leave(timer_mutex);
+            return 0;
+        }
+        yaz_thread_detach(&t);
+        timer_running = 1;
+    }
+    for (app = &timer_list; *app; app = &(*app)->next)
+        if (timer_before(&ad->expire, &(*app)->expire))
+            break;
+    ad->next = *app;
+    *app = ad;
+    if (app == &timer_list)
+        yaz_cond_signal(timer_cond); /* new earliest expiry */
+    yaz_mutex_leave(timer_mutex);
+    return 1;
+}
+
+/* completes the request when the delay expires, without blocking.
+   Falls back to a blocking delay if the timer is unavailable */
+static void do_async_delay(const struct delay *delayp,
+                           bend_search_rr *search_rr, bend_fetch_rr *fetch_rr)
+{
+    double d = delayp->d1;
+
+    if (d > 0.0)
+    {
+        struct async_delay *ad = xmalloc(sizeof(*ad));
+
+        if (delayp->d2 > d)
+            d += (rand()) * (delayp->d2 - d) / RAND_MAX;
+        yaz_gettimeofday(&ad->expire);
+        ad->expire.tv_sec += (long) d;
+        ad->expire.tv_usec += (long) ((d - (long) d) * 1000000);
+        if (ad->expire.tv_usec >= 1000000)
+        {
+            ad->expire.tv_sec++;
+            ad->expire.tv_usec -= 1000000;
+        }
+        ad->search_rr = search_rr;
+        ad->fetch_rr = fetch_rr;
+        if (search_rr)
+            search_rr->pending = 1;
+        else
+            fetch_rr->pending = 1;
+        if (!timer_add(ad))
+        {
+            if (search_rr)
+                search_rr->pending = 0;
+            else
+                fetch_rr->pending = 0;
+            xfree(ad);
+            ztest_sleep(d);
+        }
+    }
+}
+
+static void addterms(ODR odr, Z_FacetField *facet_field, const char *facet_name,
+                     Odr_int hits)
 {
     int index;
     int freq = 100;
@@ -243,13 +376,18 @@ static void addterms(ODR odr, Z_FacetField *facet_field, const char *facet_name)
         sprintf(key, "%s%d", facet_name, index);
         yaz_log(YLOG_DEBUG, "facet add term %s %d %s", facet_name, index, key);
 
+        if (hits >= 0) /* synthetic: Zipf-like distribution */
+            freq = (int) (hits / (index + 1));
         facet_term = facet_term_create_cstr(odr, key, freq);
         freq = freq - 10 ;
         facet_field_term_set(odr, facet_field, facet_term, index);
     }
 }
 
-Z_OtherInformation *build_facet_response(ODR odr, Z_FacetList *facet_list) {
+/* facet_terms > 0 limits number of terms per facet and makes
+   frequencies follow hits */
+Z_OtherInformation *build_facet_response(ODR odr, Z_FacetList *facet_list,
+                                         int facet_terms, Odr_int hits) {
     int index, new_index = 0;
     Z_FacetList *new_list = facet_list_create(odr, facet_list->num);
 
@@ -262,9 +400,12 @@ Z_OtherInformation *build_facet_response(ODR odr, Z_FacetList *facet_list) {
         yaz_log(YLOG_LOG, "Attributes: %s %d ", attrvalues.useattr, attrvalues.limit);
         if (attrvalues.errstring)
             yaz_log(YLOG_LOG, "Error parsing attributes: %s", attrvalues.errstring);
+        if (facet_terms > 0 && attrvalues.limit > facet_terms)
+            attrvalues.limit = facet_terms;
         if (attrvalues.limit > 0 && attrvalues.useattr) {
             new_list->elements[new_index] = facet_field_create(odr, facet_list->elements[index]->attributes, attrvalues.limit);
-            addterms(odr, new_list->elements[new_index], attrvalues.useattr);
+            addterms(odr, new_list->elements[new_index], attrvalues.useattr,
+                     facet_terms > 0 ? hits : -1);
             new_index++;
         }
         else {
@@ -322,11 +463,13 @@ int ztest_search(void *handle, bend_search_rr *rr)
         return 0;
     }
 
+    yaz_mutex_enter(sh->mutex);
     new_set = get_set(sh, rr->setname);
     if (new_set)
     {
         if (!rr->replace_set)
         {
+            yaz_mutex_leave(sh->mutex);
             rr->errcode = YAZ_BIB1_RESULT_SET_EXISTS_AND_REPLACE_INDICATOR_OFF;
             return 0;
         }
@@ -344,6 +487,11 @@ int ztest_search(void *handle, bend_search_rr *rr)
     init_delay(&new_set->search_delay);
     init_delay(&new_set->present_delay);
     init_delay(&new_set->fetch_delay);
+    new_set->async = 1;
+    new_set->seed = 0;
+    new_set->synth_hits = -1;
+    new_set->record_min = new_set->record_max = 0;
+    new_set->facet_terms = 0;
 
     db_sep = strchr(db, '?');
     if (db_sep)
@@ -357,13 +505,30 @@ int ztest_search(void *handle, bend_search_rr *rr)
             const char *name = names[i];
             const char *value = values[i];
             if (!strcmp(name, "seed"))
-                srand(atoi(value));
+            {
+                new_set->seed = atoi(value);
+                srand(new_set->seed);
+            }
             else if (!strcmp(name, "search-delay"))
                 parse_delay(&new_set->search_delay, value);
             else if (!strcmp(name, "present-delay"))
                 parse_delay(&new_set->present_delay, value);
             else if (!strcmp(name, "fetch-delay"))
                 parse_delay(&new_set->fetch_delay, value);
+            else if (!strcmp(name, "async"))
+                new_set->async = atoi(value);
+            else if (!strcmp(name, "hits"))
+                new_set->synth_hits = odr_atoi(value);
+            else if (!strcmp(name, "record-size"))
+            {
+                if (sscanf(value, "%d:%d", &new_set->record_min,
+                           &new_set->record_max) != 2)
+                    new_set->record_max = new_set->record_min = atoi(value);
+                if (new_set->record_max < new_set->record_min)
+                    new_set->record_max = new_set->record_min;
+            }
+            else if (!strcmp(name, "facet-terms"))
+                new_set->facet_terms = atoi(value);
             else
             {
                 rr->errcode = YAZ_BIB1_SERVICE_UNSUPP_FOR_THIS_DATABASE;
@@ -395,21 +560,30 @@ int ztest_search(void *handle, bend_search_rr *rr)
             odr_strdup(rr->stream, wrbuf_cstr(response_xml));
         wrbuf_destroy(response_xml);
     }
-    rr->hits = get_hit_count(rr->query);
+    if (new_set->synth_hits >= 0)
+        rr->hits = new_set->synth_hits;
+    else
+        rr->hits = get_hit_count(rr->query);
 
     if (1)
     {
         Z_FacetList *facet_list = yaz_oi_get_facetlist(&rr->search_input);
         if (facet_list) {
             yaz_log(YLOG_LOG, "%d Facets in search request.", facet_list->num);
-            rr->search_info = build_facet_response(rr->stream, facet_list);
+            rr->search_info = build_facet_response(rr->stream, facet_list,
+                                                   new_set->facet_terms,
+                                                   rr->hits);
         }
         else
             yaz_log(YLOG_DEBUG, "No facets parsed search request.");
 
     }
-    do_delay(&new_set->search_delay);
     new_set->hits = rr->hits;
+    yaz_mutex_leave(sh->mutex);
+    if (new_set->async)
+        do_async_delay(&new_set->search_delay, rr, 0);
+    else
+        do_delay(&new_set->search_delay);
 
     return 0;
 }
@@ -793,33 +967,29 @@ int ztest_sort(void *handle, bend_sort_rr *rr)
 int ztest_present(void *handle, bend_present_rr *rr)
 {
     struct session_handle *sh = (struct session_handle*) handle;
-    struct result_set *set = get_set(sh, rr->setname);
+    struct result_set *set;
+    struct delay present_delay;
 
+    yaz_mutex_enter(sh->mutex);
+    set = get_set(sh, rr->setname);
+    if (set)
+        present_delay = set->present_delay;
+    yaz_mutex_leave(sh->mutex);
     if (!set)
     {
         rr->errcode = YAZ_BIB1_SPECIFIED_RESULT_SET_DOES_NOT_EXIST;
         rr->errstring = odr_strdup(rr->stream, rr->setname);
         return 0;
     }
-    do_delay(&set->present_delay);
+    do_delay(&present_delay);
     return 0;
 }
 
-/* retrieval of a single record (present, and piggy back search) */
-int ztest_fetch(void *handle, bend_fetch_rr *r)
+static int ztest_fetch_record(struct result_set *set, bend_fetch_rr *r)
 {
-    struct session_handle *sh = (struct session_handle*) handle;
     char *cp;
     const Odr_oid *oid = r->request_format;
-    struct result_set *set = get_set(sh, r->setname);
 
-    if (!set)
-    {
-        r->errcode = YAZ_BIB1_SPECIFIED_RESULT_SET_DOES_NOT_EXIST;
-        r->errstring = odr_strdup(r->stream, r->setname);
-        return 0;
-    }
-    do_delay(&set->fetch_delay);
     r->last_in_set = 0;
     r->basename = set->db;
     r->output_format = r->request_format;
@@ -829,6 +999,31 @@ int ztest_fetch(void *handle, bend_fetch_rr *r)
         r->errcode = YAZ_BIB1_PRESENT_REQUEST_OUT_OF_RANGE;
         return 0;
     }
+    if (set->record_min > 0)
+    {
+        int format = -1;
+        int size = set->record_min;
+
+        if (set->record_max > size) /* same size for same record */
+            size += ((unsigned) r->number * 2654435761U ^ set->seed)
+                % (set->record_max - set->record_min + 1);
+        if (!oid || yaz_oid_is_iso2709(oid))
+        {
+            format = ZTEST_SYNTH_MARC;
+            r->output_format = odr_oiddup(r->stream, yaz_oid_recsyn_usmarc);
+        }
+        else if (!oid_oidcmp(oid, yaz_oid_recsyn_xml))
+            format = ZTEST_SYNTH_XML;
+        else if (!oid_oidcmp(oid, yaz_oid_recsyn_json))
+            format = ZTEST_SYNTH_JSON;
+        if (format != -1)
+        {
+            r->record = synthetic_record(r->number, set->seed, size, format,
+                                         r->stream, &r->len);
+            r->errcode = 0;
+            return 0;
+        }
+    }
     if (!oid || yaz_oid_is_iso2709(oid))
     {
         cp = dummy_marc_record(r->number, r->stream);
@@ -935,14 +1130,48 @@ int ztest_fetch(void *handle, bend_fetch_rr *r)
     return 0;
 }
 
+/* retrieval of a single record (present, and piggy back search) */
+int ztest_fetch(void *handle, bend_fetch_rr *r)
+{
+    struct session_handle *sh = (struct session_handle*) handle;
+    struct result_set *set;
+    struct delay fetch_delay;
+    int async;
+    int ret;
+
+    yaz_mutex_enter(sh->mutex);
+    set = get_set(sh, r->setname);
+    if (!set)
+    {
+        yaz_mutex_leave(sh->mutex);
+        r->errcode = YAZ_BIB1_SPECIFIED_RESULT_SET_DOES_NOT_EXIST;
+        r->errstring = odr_strdup(r->stream, r->setname);
+        return 0;
+    }
+    fetch_delay = set->fetch_delay;
+    async = set->async;
+    if (!async)
+    {
+        yaz_mutex_leave(sh->mutex);
+        do_delay(&fetch_delay);
+        yaz_mutex_enter(sh->mutex);
+        set = get_set(sh, r->setname);
+    }
+    ret = ztest_fetch_record(set, r);
+    yaz_mutex_leave(sh->mutex);
+    if (async)
+        do_async_delay(&fetch_delay, 0, r);
+    return ret;
+}
+
 /*
  * silly dummy-scan what reads words from a file.
  */
 int ztest_scan(void *handle, bend_scan_rr *q)
 {
-    static FILE *f = 0;
-    static struct scan_entry list[200];
-    static char entries[200][80];
+    FILE *f;
+    struct scan_entry *list;
+    char (*entries)[80];
     int hits[200];
     char term[80], *p;
     int i, pos;
@@ -950,8 +1179,9 @@ int ztest_scan(void *handle, bend_scan_rr *q)
     int num_entries_req = q->num_entries;
 
     /* Throw Database unavailable if other than Default or Slow */
-    if (!yaz_matchstr(q->basenames[0], "Default"))
-        ;  /* Default is OK in our test */
+    if (!yaz_matchstr(q->basenames[0], "Default")
+        || strcmp_prefix(q->basenames[0], "Default?"))
+        ;  /* Default is OK in our test, also with search options */
     else if (check_slow(q->basenames[0], 0 /* no assoc for scan */))
         ;
     else
@@ -963,18 +1193,16 @@ int ztest_scan(void *handle, bend_scan_rr *q)
 
     q->errcode = 0;
     q->errstring = 0;
-    q->entries = list;
     q->status = BEND_SCAN_SUCCESS;
-    if (!f && !(f = fopen("dummy-words", "r")))
-    {
-        perror("dummy-words");
-        exit(1);
-    }
     if (q->num_entries > 200)
     {
         q->errcode = YAZ_BIB1_RESOURCES_EXHAUSTED_NO_RESULTS_AVAILABLE;
         return 0;
     }
+    /* in stream rather than static: scans may run concurrently */
+    list = (struct scan_entry *) odr_malloc(q->stream, 200 * sizeof(*list));
+    entries = (char (*)[80]) odr_malloc(q->stream, 200 * sizeof(*entries));
+    q->entries = list;
     if (q->term)
     {
         int len;
@@ -1006,7 +1234,11 @@ int ztest_scan(void *handle, bend_scan_rr *q)
         if (yaz_islower(*p))
             *p = yaz_toupper(*p);
 
-    fseek(f, 0, SEEK_SET);
+    if (!(f = fopen("dummy-words", "r")))
+    {
+        perror("dummy-words");
+        exit(1);
+    }
     q->num_entries = 0;
 
     for (i = 0, pos = 0; fscanf(f, " %79[^:]:%d", entries[pos], &hits[pos]) == 2;
@@ -1053,6 +1285,7 @@ int ztest_scan(void *handle, bend_scan_rr *q)
     }
     if (feof(f))
         q->status = BEND_SCAN_PARTIAL;
+    fclose(f);
     return 0;
 }
 
@@ -1083,6 +1316,8 @@ bend_initresult *bend_init(bend_initrequest *q)
     struct session_handle *sh = xmalloc(sizeof(*sh));
 
     sh->result_sets = 0;
+    sh->mutex = 0;
+    yaz_mutex_create(&sh->mutex);
 
     if (!log_level_set)
     {
@@ -1108,6 +1343,7 @@ bend_initresult *bend_init(bend_initrequest *q)
 
     q->query_charset = "ISO-8859-1";
     q->records_in_same_charset = 0;
+    q->concurrent_operations = 4;
 
     return r;
 }
@@ -1116,12 +1352,15 @@ void bend_close(void *handle)
 {
     struct session_handle *sh = (struct session_handle*) handle;
     remove_sets(sh);
+    yaz_mutex_destroy(&sh->mutex);
     xfree(sh);              /* release our session */
     return;
 }
 
 int main(int argc, char **argv)
 {
+    yaz_mutex_create(&timer_mutex);
+    yaz_cond_create(&timer_cond);
     return statserv_main(argc, argv, bend_init, bend_close);
 }
 /*
@@ -36,6 +36,12 @@ char *dummy_marc_record(int num, ODR odr);
 char *dummy_xml_record(int num, ODR odr);
 Z_OPACRecord *dummy_opac(int num, ODR odr, const char *marc_input);
 
+#define ZTEST_SYNTH_MARC 0
+#define ZTEST_SYNTH_XML 1
+#define ZTEST_SYNTH_JSON 2
+char *synthetic_record(int num, unsigned seed, int size, int format,
+                       ODR odr, int *len);
+
 /*
  * Local variables:
  * c-basic-offset: 4